@@ -22,7 +22,18 @@ along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
 DWORD ADDON_ABI FGH_Initialize() { return Initialize(); }
 DWORD ADDON_ABI FGH_InstallHook() { return InstallHook(); }
 void ADDON_ABI FGH_UninstallHook() { return UninstallHook(); }
-void ADDON_ABI FGH_Uninitialize() { return Uninitialize(); }
+DWORD ADDON_ABI FGH_Uninitialize() { return Uninitialize(); }
 void ADDON_ABI FGH_RecordFocusedWindow() { return RecordFocusedWindow(); }
 void ADDON_ABI FGH_RestoreFocusedWindow() { return RestoreFocusedWindow(); }
 DWORD ADDON_ABI FGH_IsTopLevelWindowFocused() { return IsTopLevelWindowFocused(); }
+DWORD ADDON_ABI FGH_GetStats(void* pBuffer, DWORD cbBuffer) { return GetStats(pBuffer, cbBuffer); }
+DWORD ADDON_ABI FGH_DumpFlightRecorder(const wchar_t* szPath) { return DumpFlightRecorder(szPath); }
+DWORD ADDON_ABI FGH_SetHotkeyRules(const unsigned char* pRules, DWORD cbRules) { return SetHotkeyRules(pRules, cbRules); }
+DWORD ADDON_ABI FGH_InstallHookForWindow(HWND hwndPlugin) { return InstallHookForWindow(hwndPlugin); }
+DWORD ADDON_ABI FGH_InitializeAsync() { return InitializeAsync(); }
+DWORD ADDON_ABI FGH_GetInitStatus(void* pBuffer, DWORD cbBuffer) { return GetInitStatus(pBuffer, cbBuffer); }
+DWORD ADDON_ABI FGH_SetStrokeCommands(const unsigned char* pCommands, DWORD cbCommands) { return SetStrokeCommands(pCommands, cbCommands); }
+DWORD ADDON_ABI FGH_SetShapeTemplates(const unsigned char* pTemplates, DWORD cbTemplates) { return SetShapeTemplates(pTemplates, cbTemplates); }
+DWORD ADDON_ABI FGH_SetMoveDecimation(DWORD dwMinDistance, DWORD msMaxInterval) { return SetMoveDecimation(dwMinDistance, msMaxInterval); }
+DWORD ADDON_ABI FGH_SetSharedConfig(const void* pConfig, DWORD cbConfig) { return SetSharedConfig(pConfig, cbConfig); }
+DWORD ADDON_ABI FGH_SetGestureScript(const char* szScript) { return SetGestureScript(szScript); }
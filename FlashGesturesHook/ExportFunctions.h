@@ -22,7 +22,30 @@ along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
 DWORD ADDON_ABI FGH_Initialize();
 DWORD ADDON_ABI FGH_InstallHook();
 void ADDON_ABI FGH_UninstallHook();
-void ADDON_ABI FGH_Uninitialize();
+/* Returns the time the shutdown took in ms, it gives up on hung plugin threads after a bounded time */
+DWORD ADDON_ABI FGH_Uninitialize();
 void ADDON_ABI FGH_RecordFocusedWindow();
 void ADDON_ABI FGH_RestoreFocusedWindow();
 DWORD ADDON_ABI FGH_IsTopLevelWindowFocused();
+/* Copies up to cbBuffer bytes of a HookStatsSnapshot into pBuffer, returns the full snapshot size */
+DWORD ADDON_ABI FGH_GetStats(void* pBuffer, DWORD cbBuffer);
+/* Writes the flight recorders of all hooked threads in this process to szPath */
+DWORD ADDON_ABI FGH_DumpFlightRecorder(const wchar_t* szPath);
+/* Replaces the keys forwarded to firefox with a rule blob (see HotkeyRules.h), NULL restores the defaults */
+DWORD ADDON_ABI FGH_SetHotkeyRules(const unsigned char* pRules, DWORD cbRules);
+/* Hooks only the thread owning hwndPlugin, cheaper than FGH_InstallHook when a plugin window is created */
+DWORD ADDON_ABI FGH_InstallHookForWindow(HWND hwndPlugin);
+/* Same as FGH_Initialize without waiting for the hook manage thread to start, poll FGH_GetInitStatus for progress */
+DWORD ADDON_ABI FGH_InitializeAsync();
+/* Copies up to cbBuffer bytes of a HookInitSnapshot into pBuffer, returns the full snapshot size */
+DWORD ADDON_ABI FGH_GetInitStatus(void* pBuffer, DWORD cbBuffer);
+/* Recognizes trace gestures in the dll and sends firefox one hotkey per stroke (see StrokeRecognizer.h), NULL forwards strokes again */
+DWORD ADDON_ABI FGH_SetStrokeCommands(const unsigned char* pCommands, DWORD cbCommands);
+/* Shapes such as circles or letters matched before stroke directions, blob format in ShapeRecognizer.h, NULL removes them */
+DWORD ADDON_ABI FGH_SetShapeTemplates(const unsigned char* pTemplates, DWORD cbTemplates);
+/* Forwards moves of a triggered gesture only every dwMinDistance pixels or msMaxInterval ms (see MoveDecimator.h), 0 px forwards all */
+DWORD ADDON_ABI FGH_SetMoveDecimation(DWORD dwMinDistance, DWORD msMaxInterval);
+/* Writes a SharedConfig (see SharedConfig.h) that every hooked process and thread picks up, unlike the setters above */
+DWORD ADDON_ABI FGH_SetSharedConfig(const void* pConfig, DWORD cbConfig);
+/* Gestures declared in the text format of GestureScript.h, run by the "script" handler; NULL removes them */
+DWORD ADDON_ABI FGH_SetGestureScript(const char* szScript);
@@ -18,10 +18,21 @@ along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 bool Initialize();
+bool InitializeAsync();
 bool InstallHook();
+bool InstallHookForWindow(HWND hwnd);
 void UninstallHook();
-void Uninitialize();
+DWORD Uninitialize();
 void RecordFocusedWindow();
 void RestoreFocusedWindow();
 bool IsTopLevelWindowFocused();
+DWORD GetInitStatus(void* pBuffer, DWORD cbBuffer);
+DWORD GetStats(void* pBuffer, DWORD cbBuffer);
+bool DumpFlightRecorder(const wchar_t* szPath);
+bool SetHotkeyRules(const unsigned char* pRules, DWORD cbRules);
+bool SetStrokeCommands(const unsigned char* pCommands, DWORD cbCommands);
+bool SetShapeTemplates(const unsigned char* pTemplates, DWORD cbTemplates);
+bool SetMoveDecimation(DWORD dwMinDistance, DWORD msMaxInterval);
+bool SetSharedConfig(const void* pConfig, DWORD cbConfig);
+bool SetGestureScript(const char* szScript);
 LRESULT CALLBACK GetMsgHook(int nCode, WPARAM wParam, LPARAM lParam);
@@ -0,0 +1,91 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "FlightRecorder.h"
+
+// The ring is left uninitialized, snapshots only copy records that have been written
+FlightRecorder::FlightRecorder(uint32_t idThread) : m_nWritten(0), m_idThread(idThread) {
+}
+
+void FlightRecorder::snapshot(std::vector<FlightRecord>& vRecords) const {
+	FlightRecord records[CAPACITY];
+	uint32_t nBefore = m_nWritten.load(std::memory_order_acquire);
+	uint32_t nAvailable = nBefore < CAPACITY ? nBefore : CAPACITY;
+	memcpy(records, m_records, nAvailable * sizeof(FlightRecord));
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint32_t nAfter = m_nWritten.load(std::memory_order_relaxed);
+
+	// While copying, the writer may have filled records nBefore to nAfter, the last one possibly
+	// uncommitted. Each of them overwrote the record CAPACITY before it, which may thus be torn.
+	int64_t nTorn = static_cast<int64_t>(nAfter - nBefore) + 1 + nAvailable - CAPACITY;
+	uint32_t nIntact = nTorn <= 0 ? nAvailable : nTorn >= nAvailable ? 0 : nAvailable - static_cast<uint32_t>(nTorn);
+	for (uint32_t i = nBefore - nIntact; i != nBefore; i++)
+		vRecords.push_back(records[i % CAPACITY]);
+}
+
+bool WriteFlightDump(FILE* pFile, const FlightDump& dump) {
+	FlightDumpHeader header = { FLIGHT_DUMP_MAGIC, FLIGHT_DUMP_VERSION, sizeof(FlightRecord),
+		static_cast<uint32_t>(dump.vHandlerNames.size()), static_cast<uint32_t>(dump.vRings.size()) };
+	if (fwrite(&header, sizeof(header), 1, pFile) != 1)
+		return false;
+	for (const std::string& strName : dump.vHandlerNames) {
+		char szName[FLIGHT_HANDLER_NAME] = { 0 };
+		strncpy(szName, strName.c_str(), FLIGHT_HANDLER_NAME - 1);
+		if (fwrite(szName, sizeof(szName), 1, pFile) != 1)
+			return false;
+	}
+	for (const FlightDumpRing& ring : dump.vRings) {
+		FlightDumpRingHeader ringHeader = { ring.idThread, static_cast<uint32_t>(ring.vRecords.size()) };
+		if (fwrite(&ringHeader, sizeof(ringHeader), 1, pFile) != 1)
+			return false;
+		if (ring.vRecords.size() &&
+			fwrite(&ring.vRecords[0], sizeof(FlightRecord), ring.vRecords.size(), pFile) != ring.vRecords.size())
+			return false;
+	}
+	return true;
+}
+
+bool ReadFlightDump(FILE* pFile, FlightDump& dump) {
+	FlightDumpHeader header;
+	if (fread(&header, sizeof(header), 1, pFile) != 1 || header.magic != FLIGHT_DUMP_MAGIC ||
+		header.version != FLIGHT_DUMP_VERSION || header.cbRecord != sizeof(FlightRecord) ||
+		header.nHandlers > FLIGHT_MAX_HANDLERS)
+		return false;
+	dump.vHandlerNames.clear();
+	for (uint32_t i = 0; i < header.nHandlers; i++) {
+		char szName[FLIGHT_HANDLER_NAME];
+		if (fread(szName, sizeof(szName), 1, pFile) != 1)
+			return false;
+		szName[FLIGHT_HANDLER_NAME - 1] = '\0';
+		dump.vHandlerNames.push_back(szName);
+	}
+	dump.vRings.clear();
+	for (uint32_t i = 0; i < header.nRings; i++) {
+		FlightDumpRingHeader ringHeader;
+		if (fread(&ringHeader, sizeof(ringHeader), 1, pFile) != 1 || ringHeader.nRecords > FlightRecorder::CAPACITY)
+			return false;
+		FlightDumpRing ring;
+		ring.idThread = ringHeader.idThread;
+		ring.vRecords.resize(ringHeader.nRecords);
+		if (ringHeader.nRecords &&
+			fread(&ring.vRecords[0], sizeof(FlightRecord), ringHeader.nRecords, pFile) != ringHeader.nRecords)
+			return false;
+		dump.vRings.push_back(ring);
+	}
+	return true;
+}
@@ -0,0 +1,123 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Flight recorder of hook decisions: every hooked thread keeps its most recent decisions in a
+// ring, cheap enough to stay on in release builds. FGH_DumpFlightRecorder writes all rings to
+// a file that bench/FlightDecode turns into per-gesture timelines.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+/* Flags in FlightRecord::decision */
+enum FlightDecision {
+	FD_Swallowed = 0x01,        // removed from the plugin's queue
+	FD_ForwardedTarget = 0x02,  // a gesture handler forwarded messages to firefox
+	FD_ForwardedOrigin = 0x04,  // a canceled gesture handler replayed its messages to the plugin
+	FD_ForwardedKey = 0x08,     // key press forwarded to firefox
+	FD_ForwardedZoom = 0x10,    // Ctrl+Wheel forwarded to firefox
+	FD_NoFirefox = 0x20,        // the source window is not hosted by firefox
+};
+
+/* FlightRecord::aResults entry of a handler that did not see the message */
+const uint8_t FLIGHT_NOT_RUN = 0xff;
+const int FLIGHT_MAX_HANDLERS = 4;
+
+/* One message that took the hook's slow path, 32 bytes */
+struct FlightRecord {
+	uint64_t timestampNs;
+	/* window handles only have 32 significant bits, even in 64-bit processes */
+	uint32_t hwnd;
+	uint32_t wParam;
+	uint32_t lParam;
+	/* time spent in the hook, saturated */
+	uint32_t latencyNs;
+	uint16_t message;
+	uint8_t decision;
+	uint8_t reserved;
+	/* MessageHandleResult of each handler in pipeline order, or FLIGHT_NOT_RUN */
+	uint8_t aResults[FLIGHT_MAX_HANDLERS];
+};
+
+/*
+ * Ring of the latest records of one thread. Only the owning thread writes, any thread may take
+ * a snapshot. The writer never waits: a snapshot drops the records that were overwritten while
+ * it was being copied instead.
+ */
+class FlightRecorder {
+public:
+	static const uint32_t CAPACITY = 256;
+
+	explicit FlightRecorder(uint32_t idThread = 0);
+
+	/* Slot for the next record, visible to snapshots after commit() */
+	FlightRecord& next() { return m_records[m_nWritten.load(std::memory_order_relaxed) % CAPACITY]; }
+	void commit() { m_nWritten.store(m_nWritten.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+	/* Appends the intact records to vRecords, oldest first */
+	void snapshot(std::vector<FlightRecord>& vRecords) const;
+	uint32_t getThreadId() const { return m_idThread; }
+private:
+	FlightRecord m_records[CAPACITY];
+	/* records ever committed, wraps around */
+	std::atomic<uint32_t> m_nWritten;
+	uint32_t m_idThread;
+
+	FlightRecorder(const FlightRecorder&);
+	FlightRecorder& operator=(const FlightRecorder&);
+};
+
+/*
+ * Dump file layout, little endian:
+ *   FlightDumpHeader
+ *   nHandlers handler names, FLIGHT_HANDLER_NAME bytes each, NUL padded
+ *   nRings times: FlightDumpRingHeader followed by nRecords FlightRecords
+ */
+const uint32_t FLIGHT_DUMP_MAGIC = 0x52464746; // "FGFR"
+const uint32_t FLIGHT_DUMP_VERSION = 1;
+const int FLIGHT_HANDLER_NAME = 16;
+
+struct FlightDumpHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t cbRecord;
+	uint32_t nHandlers;
+	uint32_t nRings;
+};
+
+struct FlightDumpRingHeader {
+	uint32_t idThread;
+	uint32_t nRecords;
+};
+
+struct FlightDumpRing {
+	uint32_t idThread;
+	std::vector<FlightRecord> vRecords;
+};
+
+struct FlightDump {
+	std::vector<std::string> vHandlerNames;
+	std::vector<FlightDumpRing> vRings;
+};
+
+bool WriteFlightDump(FILE* pFile, const FlightDump& dump);
+/* Returns false if the file is not a flight recorder dump or is truncated */
+bool ReadFlightDump(FILE* pFile, FlightDump& dump);
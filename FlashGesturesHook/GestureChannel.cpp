@@ -0,0 +1,135 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "GestureChannel.h"
+
+#include <string.h>
+#include <thread>
+
+static_assert(GestureChannel::CAPACITY == 1u << 10, "LAP_SHIFT must match the capacity");
+static_assert(sizeof(GestureChannelEvent) == 4 * sizeof(uint32_t), "events are copied in whole words");
+static_assert(sizeof(GestureChannel) == 3 * 64 + GestureChannel::CAPACITY * 32, "the layout is shared by 32 and 64-bit builds");
+
+bool GestureChannel::attachConsumer(uint32_t idConsumer) {
+	uint32_t idNone = 0;
+	return m_idConsumer.compare_exchange_strong(idNone, idConsumer, std::memory_order_acq_rel);
+}
+
+void GestureChannel::detachConsumer(uint32_t idConsumer) {
+	m_idConsumer.compare_exchange_strong(idConsumer, 0, std::memory_order_acq_rel);
+}
+
+GestureChannelPushResult GestureChannel::push(GestureChannelSystem& system, const GestureChannelEvent& event) {
+	uint32_t idConsumer = getConsumer();
+	if (idConsumer == 0)
+		return GCP_NoConsumer;
+	uint64_t writer = static_cast<uint64_t>(system.currentProcessId()) << 32;
+
+	// claim the slot at the tail
+	Slot* pSlot = NULL;
+	int nFullAttempts = 0;
+	uint32_t pos = m_tail.load(std::memory_order_relaxed);
+	for (;;) {
+		Slot& slot = m_aSlots[pos % CAPACITY];
+		uint64_t state = slot.state.load(std::memory_order_acquire);
+		uint32_t phase = static_cast<uint32_t>(state);
+		if (phase == StateOf(pos, PHASE_EMPTY)) {
+			if (slot.state.compare_exchange_strong(state, writer | StateOf(pos, PHASE_WRITING), std::memory_order_acquire)) {
+				pSlot = &slot;
+				break;
+			}
+		} else if (phase == StateOf(pos - CAPACITY, PHASE_FULL) || phase == StateOf(pos - CAPACITY, PHASE_WRITING)) {
+			// the consumer has not taken the previous lap's event yet
+			if (++nFullAttempts == PUSH_ATTEMPTS)
+				return GCP_Full;
+			std::this_thread::yield();
+		} else {
+			// claimed by another producer that has not advanced the tail yet
+			m_tail.compare_exchange_strong(pos, pos + 1, std::memory_order_relaxed);
+		}
+		pos = m_tail.load(std::memory_order_relaxed);
+	}
+	// a failed exchange overwrites its first argument, pos still names our slot
+	uint32_t tail = pos;
+	m_tail.compare_exchange_strong(tail, pos + 1, std::memory_order_relaxed);
+
+	uint32_t aWords[4];
+	memcpy(aWords, &event, sizeof(aWords));
+	for (int i = 0; i < 4; i++)
+		pSlot->aWords[i].store(aWords[i], std::memory_order_relaxed);
+	pSlot->state.store(writer | StateOf(pos, PHASE_FULL), std::memory_order_release);
+
+	// pairs with the fence in rearm: either the consumer sees the slot full or we see no wake-up pending
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_wakeupPending.load(std::memory_order_relaxed) == 0 && m_wakeupPending.exchange(1, std::memory_order_relaxed) == 0) {
+		GestureChannelWakeResult result = system.wakeConsumer(idConsumer);
+		if (result == GCW_ConsumerGone)
+			detachGoneConsumer(idConsumer);
+		else if (result == GCW_Failed)
+			// left pending, the wake-up would never be posted again
+			m_wakeupPending.store(0, std::memory_order_relaxed);
+	}
+	return GCP_Queued;
+}
+
+bool GestureChannel::checkConsumer(GestureChannelSystem& system) {
+	uint32_t idConsumer = getConsumer();
+	if (idConsumer == 0)
+		return false;
+	// a spare wake-up only makes the consumer look at the ring once more
+	if (system.wakeConsumer(idConsumer) != GCW_ConsumerGone)
+		return true;
+	detachGoneConsumer(idConsumer);
+	return false;
+}
+
+void GestureChannel::detachGoneConsumer(uint32_t idConsumer) {
+	// producers post directly from now on, the next consumer to attach delivers what is left
+	m_idConsumer.compare_exchange_strong(idConsumer, 0, std::memory_order_acq_rel);
+	m_wakeupPending.store(0, std::memory_order_relaxed);
+}
+
+void GestureChannel::rearm() {
+	m_wakeupPending.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+bool GestureChannel::pop(GestureChannelSystem& system, GestureChannelEvent& event) {
+	for (;;) {
+		uint32_t pos = m_head;
+		Slot& slot = m_aSlots[pos % CAPACITY];
+		uint64_t state = slot.state.load(std::memory_order_acquire);
+		uint32_t phase = static_cast<uint32_t>(state);
+		if (phase == StateOf(pos, PHASE_FULL)) {
+			uint32_t aWords[4];
+			for (int i = 0; i < 4; i++)
+				aWords[i] = slot.aWords[i].load(std::memory_order_relaxed);
+			memcpy(&event, aWords, sizeof(aWords));
+			slot.state.store(StateOf(pos + CAPACITY, PHASE_EMPTY), std::memory_order_release);
+			m_head = pos + 1;
+			return true;
+		}
+		// empty, or still being written by a live process, which wakes us up once it is done
+		if (phase != StateOf(pos, PHASE_WRITING) || system.isProcessAlive(static_cast<uint32_t>(state >> 32)))
+			return false;
+		// the writer died between claiming the slot and filling it
+		slot.state.store(StateOf(pos + CAPACITY, PHASE_EMPTY), std::memory_order_release);
+		m_head = pos + 1;
+		m_nSkipped++;
+	}
+}
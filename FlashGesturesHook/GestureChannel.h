@@ -0,0 +1,134 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Gesture messages from plugin processes to the browser process through shared memory. Hooks in
+// plugin processes used to post every forwarded message to the firefox window across processes;
+// they now write them into a ring that a consumer thread in the browser process drains, woken up
+// by one message per batch instead of one per event.
+
+#include "GestureCore.h"
+
+#include <atomic>
+
+/* A forwarded message, window handles only have 32 significant bits, even in 64-bit processes */
+struct GestureChannelEvent {
+	uint32_t hwnd;
+	uint32_t message;
+	uint32_t wParam;
+	uint32_t lParam;
+};
+
+/* What the ring needs from the system, implemented with process handles and thread messages in the hook dll */
+enum GestureChannelWakeResult {
+	GCW_Posted,
+	/* not delivered, to a full message queue say; the next push posts it again */
+	GCW_Failed,
+	/* the consumer exited without detaching */
+	GCW_ConsumerGone
+};
+
+class GestureChannelSystem {
+public:
+	/* Recorded in the slots the calling process writes */
+	virtual uint32_t currentProcessId() = 0;
+	/* false once the process has exited, the slot it was writing is then skipped */
+	virtual bool isProcessAlive(uint32_t idProcess) = 0;
+	/* Posts the consumer its wake-up */
+	virtual GestureChannelWakeResult wakeConsumer(uint32_t idConsumer) = 0;
+protected:
+	~GestureChannelSystem() {}
+};
+
+enum GestureChannelPushResult {
+	GCP_Queued,
+	/* nobody drains the ring, post the message directly */
+	GCP_NoConsumer,
+	/* the consumer fell behind by a whole ring, push again later: posting directly would overtake the queued events */
+	GCP_Full
+};
+
+/*
+ * A bounded multi-producer, single-consumer ring laid out to live in memory mapped by several
+ * processes, which may be 32 and 64-bit builds. Zeroed memory is an empty ring without a consumer.
+ *
+ * Each slot has a state word holding the lap of the position it is free or full for, its phase,
+ * and the process writing it. A producer claims the slot at the tail by moving it from empty to
+ * writing, then advances the tail, which the next producer also does for it if it got preempted.
+ * The consumer takes slots in order at the head once they are full; a slot still being written
+ * by a process that has exited is skipped, so a crashing plugin cannot wedge the ring.
+ *
+ * Producers only wake the consumer up when no wake-up is pending yet, a wake-up that could not be
+ * posted is pending no longer. The consumer rearms before it drains, so an event published while it
+ * drains is either seen or wakes it up again.
+ */
+class GestureChannel {
+public:
+	static const uint32_t CAPACITY = 1024;
+	/* A producer that finds the ring full retries this many time slices before giving up */
+	static const int PUSH_ATTEMPTS = 16;
+
+	/* Ids are thread ids, 0 stands for no consumer. Only one consumer can be attached. */
+	bool attachConsumer(uint32_t idConsumer);
+	void detachConsumer(uint32_t idConsumer);
+	uint32_t getConsumer() const { return m_idConsumer.load(std::memory_order_acquire); }
+
+	/* Any thread of any process */
+	GestureChannelPushResult push(GestureChannelSystem& system, const GestureChannelEvent& event);
+	/*
+	 * Any thread, for a ring that stays full: wakes the consumer up even if a wake-up is pending, which
+	 * it may have died with or lost. false if there is no consumer, one that has exited is detached.
+	 */
+	bool checkConsumer(GestureChannelSystem& system);
+
+	/* Consumer: call when woken up, before popping; pushes after it wake the consumer again */
+	void rearm();
+	/* Consumer: the next event, in push order of each producer thread. false if there is none yet. */
+	bool pop(GestureChannelSystem& system, GestureChannelEvent& event);
+	/* Slots skipped because their writer died, counted by the consumer */
+	uint32_t getSkippedCount() const { return m_nSkipped; }
+private:
+	static const int LAP_SHIFT = 10;
+	enum { PHASE_EMPTY = 0, PHASE_WRITING = 1, PHASE_FULL = 2 };
+
+	struct Slot {
+		/* lap << 2 | phase in the low word, the writing process in the high word */
+		std::atomic<uint64_t> state;
+		std::atomic<uint32_t> aWords[4];
+		uint32_t reserved[2];
+	};
+
+	/* The low word of a slot's state for position pos in the given phase */
+	static uint32_t StateOf(uint32_t pos, int phase) {
+		return ((pos >> LAP_SHIFT) << 2) | phase;
+	}
+	/* Detaches idConsumer if it is still attached, after it was found gone */
+	void detachGoneConsumer(uint32_t idConsumer);
+
+	// producers, consumer and the wake-up flag on separate cache lines
+	std::atomic<uint32_t> m_tail;
+	uint32_t m_aPadTail[15];
+	/* only the consumer touches it */
+	uint32_t m_head;
+	uint32_t m_nSkipped;
+	uint32_t m_aPadHead[14];
+	std::atomic<uint32_t> m_idConsumer;
+	std::atomic<uint32_t> m_wakeupPending;
+	uint32_t m_aPadWakeup[14];
+	Slot m_aSlots[CAPACITY];
+};
@@ -0,0 +1,143 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Platform-neutral message types used by the gesture engine.
+// Nothing in here may depend on Win32, so that the engine also builds in the portable benchmarks.
+
+#include <stdint.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define GESTURE_CORE_SSE2
+#endif
+
+/* Opaque window identifier, holds an HWND on Windows */
+typedef uintptr_t GestureWindow;
+
+/* Message ids and key state flags, values are identical to their WM_* and MK_* counterparts */
+enum GestureMessageId {
+	GMSG_NULL = 0x0000,
+	GMSG_KEYDOWN = 0x0100,
+	GMSG_KEYUP = 0x0101,
+	GMSG_SYSKEYDOWN = 0x0104,
+	GMSG_SYSKEYUP = 0x0105,
+	GMSG_MOUSEMOVE = 0x0200,
+	GMSG_LBUTTONDOWN = 0x0201,
+	GMSG_LBUTTONUP = 0x0202,
+	GMSG_LBUTTONDBLCLK = 0x0203,
+	GMSG_RBUTTONDOWN = 0x0204,
+	GMSG_RBUTTONUP = 0x0205,
+	GMSG_RBUTTONDBLCLK = 0x0206,
+	GMSG_MBUTTONDOWN = 0x0207,
+	GMSG_MBUTTONUP = 0x0208,
+	GMSG_MBUTTONDBLCLK = 0x0209,
+	GMSG_MOUSEWHEEL = 0x020A,
+	GMSG_XBUTTONDOWN = 0x020B,
+	GMSG_XBUTTONDBLCLK = 0x020D,
+};
+
+enum GestureKeyState {
+	GMK_LBUTTON = 0x0001,
+	GMK_RBUTTON = 0x0002,
+	GMK_SHIFT = 0x0004,
+	GMK_CONTROL = 0x0008,
+	GMK_MBUTTON = 0x0010,
+};
+
+/*
+ * Interest masks hold one bit per keyboard or mouse message, so that finding out whether anybody cares
+ * about a message is a single bit test: mouse messages 0x200-0x20f take bits 0-15, key messages
+ * 0x100-0x10f bits 16-31. Every other message has no bit and is never interesting.
+ */
+inline uint32_t MessageInterestBit(unsigned int message) {
+	unsigned int i = message - GMSG_KEYDOWN;
+	if (i & ~0x10fu)
+		return 0;
+	return 1u << ((i & 0xf) | (~i >> 4 & 0x10));
+}
+
+const uint32_t INTEREST_MOUSE = 0x0000ffff;
+const uint32_t INTEREST_KEYS = 0xffff0000;
+
+/* Modifier keys held for a hotkey */
+enum GestureHotkeyModifier {
+	GHM_Alt = 0x01,
+	GHM_Ctrl = 0x02,
+	GHM_Shift = 0x04,
+};
+
+struct GesturePoint {
+	int x;
+	int y;
+
+	/* Same as CPoint(LPARAM) */
+	static GesturePoint fromLParam(intptr_t lParam) {
+		GesturePoint pt = { static_cast<short>(lParam & 0xffff), static_cast<short>((lParam >> 16) & 0xffff) };
+		return pt;
+	}
+	/* Same as MAKELPARAM(x, y) */
+	intptr_t toLParam() const {
+		return static_cast<intptr_t>(static_cast<uint32_t>(x & 0xffff) | (static_cast<uint32_t>(y & 0xffff) << 16));
+	}
+};
+
+/* The subset of MSG fields the gesture engine looks at */
+struct GestureMessage {
+	GestureWindow hwnd;
+	unsigned int message;
+	uintptr_t wParam;
+	intptr_t lParam;
+
+	GesturePoint getPoint() const { return GesturePoint::fromLParam(lParam); }
+};
+
+/*
+ * Moves packed lParam points by offset, wrapping each coordinate to 16 bits exactly like
+ * MAKELPARAM does. x and y live in separate 16-bit lanes, so a wrapping 16-bit add
+ * translates four points per SSE2 instruction.
+ */
+inline void TranslatePackedPoints(uint32_t* aPoints, int nPoints, GesturePoint offset) {
+	const uint32_t dx = static_cast<uint32_t>(offset.x);
+	const uint32_t dy = static_cast<uint32_t>(offset.y);
+	int i = 0;
+#ifdef GESTURE_CORE_SSE2
+	const __m128i vOffset = _mm_set1_epi32(static_cast<int>((dx & 0xffff) | (dy << 16)));
+	for (; i + 4 <= nPoints; i += 4) {
+		__m128i vPoints = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aPoints + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(aPoints + i), _mm_add_epi16(vPoints, vOffset));
+	}
+#endif
+	for (; i < nPoints; i++) {
+		uint32_t pt = aPoints[i];
+		aPoints[i] = ((pt + dx) & 0xffff) | ((((pt >> 16) + dy) & 0xffff) << 16);
+	}
+}
+
+/* Delivers gesture messages to windows, implemented with user32 calls in the hook dll */
+class GestureForwarder {
+public:
+	virtual void sendMessage(GestureWindow hwnd, const GestureMessage& msg) = 0;
+	virtual void postMessage(GestureWindow hwnd, const GestureMessage& msg) = 0;
+	/* Offset to add to a point in hwndFrom's client coordinates to get hwndTo's client coordinates */
+	virtual GesturePoint getClientOffset(GestureWindow hwndFrom, GestureWindow hwndTo) = 0;
+	/* Has hwnd's thread type virtualKey with GestureHotkeyModifier modifiers held, without taking the focus */
+	virtual void postHotkey(GestureWindow hwnd, uint8_t virtualKey, uint8_t modifiers) = 0;
+protected:
+	~GestureForwarder() {}
+};
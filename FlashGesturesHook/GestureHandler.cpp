@@ -15,141 +15,60 @@ You should have received a copy of the GNU General Public License
 along with Fire-IE.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include "StdAfx.h"
+#include "stdafx.h"
 #include "GestureHandler.h"
-#include "ThreadLocal.h"
 
-// Automatically cleanup at program exit
-GestureHandlers::~GestureHandlers() {
-	if (m_vHandlers.size()) {
-		for (size_t i = 0; i < m_vHandlers.size(); i++)
-			delete m_vHandlers[i];
-		m_vHandlers.clear();
-		ATLTRACE(_T("Cleared gesture handlers.\n"));
+void GestureHandler::forwardAllOrigin(GestureForwarder& forwarder, GestureWindow hOrigin) {
+	_ASSERT(hOrigin != 0);
+	int size = m_messages.size();
+	for (int i = 0; i + 1 < size; i++) {
+		forwarder.sendMessage(hOrigin, m_messages[i]);
 	}
-}
-
-GestureHandler::GestureHandler() :
-m_state(GS_None), m_bEnabled(true) {}
-
-GestureHandler::~GestureHandler() {}
-
-void GestureHandler::setState(GestureState state) {
-	this->m_state = state;
-}
-
-GestureState GestureHandler::getState() const {
-	return m_state;
-}
-
-bool GestureHandler::shouldUsePost(HWND hTarget) {
-	return true;
-}
-
-void GestureHandler::forwardAllOrigin(HWND hOrigin) {
-	_ASSERT(hOrigin != NULL);
-	for (std::vector<MSG>::iterator iter = m_vMessages.begin();
-		 iter != m_vMessages.end() && (iter + 1) != m_vMessages.end(); ++iter) {
-		::SendMessage(hOrigin, iter->message, iter->wParam, iter->lParam);
-	}
-	size_t size;
-	if (size = m_vMessages.size()) {
-		MSG* msg = &m_vMessages[size - 1];
-		::PostMessage(hOrigin, msg->message, msg->wParam, msg->lParam);
+	if (size) {
+		forwarder.postMessage(hOrigin, m_messages.back());
 	}
-	m_vMessages.clear();
+	m_messages.clear();
 }
 
-void GestureHandler::forwardAllTarget(HWND hOrigin, HWND hTarget) {
-	_ASSERT(hOrigin != NULL && hTarget != NULL);
+int GestureHandler::forwardAllTarget(GestureForwarder& forwarder, GestureWindow hTarget, GesturePoint offset) {
+	_ASSERT(hTarget != 0);
 	bool bShouldUsePost = shouldUsePost(hTarget);
-	for (std::vector<MSG>::iterator iter = m_vMessages.begin();
-		 iter != m_vMessages.end(); ++iter) {
-		CPoint pt(iter->lParam);
-		ClientToScreen(hOrigin, &pt);
-		ScreenToClient(hTarget, &pt);
-		if (bShouldUsePost)
-			::PostMessage(hTarget, iter->message, iter->wParam, MAKELPARAM(pt.x, pt.y));
-		else
-			::SendMessage(hTarget, iter->message, iter->wParam, MAKELPARAM(pt.x, pt.y));
-	}
-	m_vMessages.clear();
-}
-
-void GestureHandler::reset() {
-	m_state = GS_None;
-	m_vMessages.clear();
-}
-
-bool GestureHandler::shouldKeepTrack(MessageHandleResult res) const {
-	return (m_state == GS_Initiated && res != MHR_Discarded) || res == MHR_Triggered || res == MHR_Canceled;
-}
-
-bool GestureHandler::shouldSwallow(MessageHandleResult res) const {
-	return m_state == GS_Initiated || res == MHR_Triggered || res == MHR_Canceled;
-}
 
-MessageHandleResult GestureHandler::handleMessage(MSG* msg) {
-	if (!m_bEnabled)
-		return MHR_NotHandled;
+	// translate the whole batch at once, the offset is the same for every buffered message
+	uint32_t aPoints[GestureMessageBuffer::CAPACITY];
+	int size = m_messages.size();
+	for (int i = 0; i < size; i++)
+		aPoints[i] = static_cast<uint32_t>(m_messages[i].lParam);
+	TranslatePackedPoints(aPoints, size, offset);
 
-	MessageHandleResult res = this->handleMessageInternal(msg);
-	if (shouldKeepTrack(res)) {
-		m_vMessages.push_back(*msg);
+	for (int i = 0; i < size; i++) {
+		GestureMessage msg = m_messages[i];
+		msg.lParam = static_cast<intptr_t>(aPoints[i]);
+		if (bShouldUsePost)
+			forwarder.postMessage(hTarget, msg);
+		else
+			forwarder.sendMessage(hTarget, msg);
 	}
-	return res;
-}
-
-void GestureHandler::forwardOrigin(MSG* pMsg) {
-	::SendMessage(pMsg->hwnd, pMsg->message, pMsg->wParam, pMsg->lParam);
-}
-
-void GestureHandler::forwardTarget(MSG* pMsg, HWND hTarget) {
-	CPoint pt(pMsg->lParam);
-	ClientToScreen(pMsg->hwnd, &pt);
-	ScreenToClient(hTarget, &pt);
-	if (shouldUsePost(hTarget))
-		::PostMessage(hTarget, pMsg->message, pMsg->wParam, MAKELPARAM(pt.x, pt.y));
-	else
-		::SendMessage(hTarget, pMsg->message, pMsg->wParam, MAKELPARAM(pt.x, pt.y));
+	m_messages.clear();
+	return size;
 }
 
-void GestureHandler::setEnabled(bool bEnabled) {
-	if (!bEnabled && m_bEnabled) {
-		reset();
+int GestureHandler::forwardDecimated(GestureForwarder& forwarder, const GestureMessage& msg, MessageHandleResult res,
+									  GestureWindow hTarget, GesturePoint offset, uint32_t time) {
+	GestureMessage aMessages[2];
+	int nMessages;
+	if (msg.message == GMSG_MOUSEMOVE && res != MHR_GestureEnd) {
+		nMessages = m_decimator.onMove(msg, time, aMessages);
+	} else {
+		// firefox must see the final position before the button goes up
+		nMessages = m_decimator.flush(aMessages[0]) ? 1 : 0;
+		aMessages[nMessages++] = msg;
 	}
-	if (bEnabled != m_bEnabled) {
-		ATLTRACE((bEnabled ? _T("Enabled ") : _T("Disabled ")) + this->getName() + _T(" gesture handler.\n"));
-	}
-	m_bEnabled = bEnabled;
-}
-
-bool GestureHandler::getEnabled() const {
-	return m_bEnabled;
+	for (int i = 0; i < nMessages; i++)
+		forwardTarget(forwarder, aMessages[i], hTarget, offset);
+	return nMessages;
 }
 
-void GestureHandler::setEnabledGestures(const CString aStrGestureNames[], int iCount) {
-	const std::vector<GestureHandler*>& vHandlers = getHandlers();
-
-	// initialize states to false
-	std::vector<bool> vStates;
-	vStates.reserve(vHandlers.size());
-	for (size_t iState = 0; iState < vHandlers.size(); iState++) {
-		vStates.push_back(false);
-	}
-
-	// enable those handlers specified in the array
-	for (int iName = 0; iName < iCount; iName++) {
-		CString strName = aStrGestureNames[iName];
-		for (size_t iHandler = 0; iHandler < vHandlers.size(); iHandler++) {
-			if (vHandlers[iHandler]->getName() == strName) {
-				vStates[iHandler] = true;
-				break;
-			}
-		}
-	}
-
-	for (size_t iState = 0; iState < vHandlers.size(); iState++) {
-		vHandlers[iState]->setEnabled(vStates[iState]);
-	}
+void GestureHandler::forwardOrigin(GestureForwarder& forwarder, const GestureMessage& msg) {
+	forwarder.sendMessage(msg.hwnd, msg);
 }
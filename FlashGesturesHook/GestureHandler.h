@@ -17,6 +17,15 @@ along with Fire-IE.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include "GestureCore.h"
+#include "GestureMessageBuffer.h"
+#include "GestureScript.h"
+#include "HookStats.h"
+#include "FlightRecorder.h"
+#include "MoveDecimator.h"
+#include "ShapeRecognizer.h"
+#include "StrokeRecognizer.h"
+
 enum MessageHandleResult {
 	MHR_NotHandled, MHR_Initiated, MHR_Swallowed, MHR_Discarded, MHR_Triggered, MHR_Canceled, MHR_GestureEnd
 };
@@ -25,41 +34,323 @@ enum GestureState {
 	GS_None, GS_Initiated, GS_Triggered
 };
 
-struct GestureHandlers;
-
-/* Abstract class that determines whether we should forward mouse gesture related messages */
+/* Common state of a gesture handler, decides whether mouse gesture related messages should be forwarded */
 class GestureHandler {
 private:
-	bool shouldKeepTrack(MessageHandleResult res) const;
-	static bool shouldUsePost(HWND hTarget);
-
-	friend struct GestureHandlers;
+	bool shouldKeepTrack(MessageHandleResult res) const {
+		return (m_state == GS_Initiated && res != MHR_Discarded) || res == MHR_Triggered || res == MHR_Canceled;
+	}
+	static bool shouldUsePost(GestureWindow hTarget) { return true; }
 protected:
 	GestureState m_state;
 	bool m_bEnabled;
 
 	/* keep track of swallowed messages */
-	std::vector<MSG> m_vMessages;
+	GestureMessageBuffer m_messages;
+	/* thins out the moves forwarded while triggered, inactive unless FGH_SetMoveDecimation enabled it */
+	MoveDecimator m_decimator;
 
-	GestureHandler();
-	void setState(GestureState);
+	GestureHandler() : m_state(GS_None), m_bEnabled(true) {}
+	int forwardDecimated(GestureForwarder& forwarder, const GestureMessage& msg, MessageHandleResult res,
+						 GestureWindow target, GesturePoint offset, uint32_t time);
+	void setState(GestureState state) { m_state = state; }
+	/* Returns false if msg should have been kept but the buffer is full */
+	bool trackMessage(const GestureMessage& msg, MessageHandleResult res) {
+		return !shouldKeepTrack(res) || m_messages.push(msg);
+	}
+public:
+	GestureState getState() const { return m_state; }
+	bool getEnabled() const { return m_bEnabled; }
+	/* Number of swallowed messages waiting to be forwarded */
+	int getTrackedCount() const { return m_messages.size(); }
+	void forwardAllOrigin(GestureForwarder& forwarder, GestureWindow origin);
+	/*
+	 * offset maps the origin window's client coordinates to the target's, see GestureForwarder::getClientOffset.
+	 * Returns the number of messages forwarded.
+	 */
+	int forwardAllTarget(GestureForwarder& forwarder, GestureWindow target, GesturePoint offset);
+	/* Called when the handler triggers, ptForwarded is where the last forwarded message put the pointer */
+	void beginDecimation(const MoveDecimation& decimation, GesturePoint ptForwarded, uint32_t time) {
+		m_decimator.begin(decimation, ptForwarded, time);
+	}
+	/* Forwards a message handled while triggered, res is what handleMessage returned for it */
+	int forwardTriggered(GestureForwarder& forwarder, const GestureMessage& msg, MessageHandleResult res,
+						 GestureWindow target, GesturePoint offset, uint32_t time) {
+		if (m_decimator.isActive())
+			return forwardDecimated(forwarder, msg, res, target, offset, time);
+		forwardTarget(forwarder, msg, target, offset);
+		return 1;
+	}
+	bool shouldSwallow(MessageHandleResult res) const {
+		return m_state == GS_Initiated || res == MHR_Triggered || res == MHR_Canceled;
+	}
+	void reset() {
+		m_state = GS_None;
+		m_messages.clear();
+		m_decimator.reset();
+	}
+
+	static void forwardOrigin(GestureForwarder& forwarder, const GestureMessage& msg);
+	/* Inline, as every move of a triggered gesture goes through it */
+	static void forwardTarget(GestureForwarder& forwarder, const GestureMessage& msg, GestureWindow target, GesturePoint offset) {
+		GestureMessage msgTarget = msg;
+		uint32_t pt = static_cast<uint32_t>(msg.lParam);
+		TranslatePackedPoints(&pt, 1, offset);
+		msgTarget.lParam = static_cast<intptr_t>(pt);
+		if (shouldUsePost(target))
+			forwarder.postMessage(target, msgTarget);
+		else
+			forwarder.sendMessage(target, msgTarget);
+	}
+};
 
-	virtual MessageHandleResult handleMessageInternal(MSG*) = 0;
-	virtual ~GestureHandler();
+/*
+ * Static dispatch for a concrete handler. Derived provides
+ *   static const char* getName();
+ *   static const HookCounterId STATS_COUNTER;  (counts the messages it forwards)
+ *   MessageHandleResult handleMessageInternal(const GestureMessage&);
+ *   uint32_t getIdleInterest() const;  (the messages it can leave GS_None on, see MessageInterestBit)
+ * and may hide shouldSwallow/forwardAllOrigin/forwardAllTarget/forwardTriggered, which the pipeline
+ * always calls on Derived.
+ */
+template <class Derived>
+class GestureHandlerT : public GestureHandler {
 public:
-	virtual CString getName() const = 0;
-	MessageHandleResult handleMessage(MSG*);
-	GestureState getState() const;
-	void setEnabled(bool);
-	bool getEnabled() const;
-	virtual void forwardAllOrigin(HWND origin);
-	virtual void forwardAllTarget(HWND origin, HWND target);
-	virtual bool shouldSwallow(MessageHandleResult res) const;
-	void reset();
-
-	static const std::vector<GestureHandler*>& getHandlers();
-	static void setEnabledGestures(const CString aStrGestureNames[], int iCount);
-
-	static void forwardOrigin(MSG* msg);
-	static void forwardTarget(MSG* msg, HWND target);
+	MessageHandleResult handleMessage(const GestureMessage& msg) {
+		if (!m_bEnabled)
+			return MHR_NotHandled;
+
+		MessageHandleResult res = static_cast<Derived*>(this)->handleMessageInternal(msg);
+		if (!trackMessage(msg, res)) {
+			// Left over from a cancel another handler's gesture outlived, let msg pass rather than lose it
+			ATLTRACE(_T("%S Gesture not started, no room left for message no. %x\n"), Derived::getName(), msg.message);
+			setState(GS_None);
+			return MHR_NotHandled;
+		}
+		if (m_state == GS_Initiated && m_messages.isFull()) {
+			// Only moves are ever dropped from the buffer, a gesture still undecided after this many buttons
+			// and wheel turns is given up, so that the caller replays them like for any other cancel
+			ATLTRACE(_T("%S Gesture Canceled, no room left after message no. %x\n"), Derived::getName(), msg.message);
+			setState(GS_None);
+			res = MHR_Canceled;
+		}
+		return res;
+	}
+	void setEnabled(bool bEnabled) {
+		if (!bEnabled && m_bEnabled) {
+			reset();
+		}
+		if (bEnabled != m_bEnabled) {
+			ATLTRACE(_T("%s %S gesture handler.\n"), bEnabled ? _T("Enabled") : _T("Disabled"), Derived::getName());
+		}
+		m_bEnabled = bEnabled;
+	}
+	/* Messages handleMessage could do anything with, the others are NotHandled without changing state */
+	uint32_t getInterest() const {
+		if (!m_bEnabled)
+			return 0;
+		if (m_state != GS_None)
+			return INTEREST_MOUSE;
+		return static_cast<const Derived*>(this)->getIdleInterest();
+	}
+};
+
+class TraceHandler : public GestureHandlerT<TraceHandler> {
+private:
+	GesturePoint m_ptStart;
+	/* NULL or disabled: strokes are forwarded to firefox move by move */
+	const StrokeCommands* m_pStrokeCommands;
+	/* decided when the gesture triggers, so that reconfiguring cannot switch modes mid-stroke */
+	bool m_bRecognizing;
+	StrokeRecognizer m_recognizer;
+	/* NULL or empty: only directions are recognized */
+	const ShapeLibrary* m_pShapeLibrary;
+	/* the set matched against, fixed when the gesture triggers like m_bRecognizing */
+	const ShapeTemplates* m_pShapes;
+	ShapeTrace m_shapeTrace;
+
+	void addStrokePoint(GesturePoint pt) {
+		m_recognizer.addPoint(pt);
+		if (m_pShapes)
+			m_shapeTrace.addPoint(pt);
+	}
+	bool findShapeCommand(StrokeCommand& command);
+
+	void recognizeTracked();
+	int recognizeTriggered(GestureForwarder& forwarder, const GestureMessage& msg, MessageHandleResult res,
+						   GestureWindow target);
+public:
+	static const char* getName() { return "trace"; }
+	static const HookCounterId STATS_COUNTER = HC_ForwardedTrace;
+	TraceHandler();
+	void setStrokeCommands(const StrokeCommands* pCommands) { m_pStrokeCommands = pCommands; }
+	void setShapeLibrary(const ShapeLibrary* pLibrary) { m_pShapeLibrary = pLibrary; }
+	uint32_t getIdleInterest() const { return MessageInterestBit(GMSG_RBUTTONDOWN); }
+	MessageHandleResult handleMessageInternal(const GestureMessage& msg);
+	int forwardAllTarget(GestureForwarder& forwarder, GestureWindow target, GesturePoint offset) {
+		if (!m_bRecognizing)
+			return GestureHandler::forwardAllTarget(forwarder, target, offset);
+		recognizeTracked();
+		return 0;
+	}
+	int forwardTriggered(GestureForwarder& forwarder, const GestureMessage& msg, MessageHandleResult res,
+						 GestureWindow target, GesturePoint offset, uint32_t time) {
+		if (!m_bRecognizing)
+			return GestureHandler::forwardTriggered(forwarder, msg, res, target, offset, time);
+		return recognizeTriggered(forwarder, msg, res, target);
+	}
+};
+
+class RockerHandler : public GestureHandlerT<RockerHandler> {
+private:
+	GesturePoint m_ptStart;
+	bool m_bLeft;
+public:
+	static const char* getName() { return "rocker"; }
+	static const HookCounterId STATS_COUNTER = HC_ForwardedRocker;
+	RockerHandler();
+	uint32_t getIdleInterest() const { return MessageInterestBit(GMSG_LBUTTONDOWN) | MessageInterestBit(GMSG_RBUTTONDOWN); }
+	MessageHandleResult handleMessageInternal(const GestureMessage& msg);
+	bool shouldSwallow(MessageHandleResult) const;
+	void forwardAllOrigin(GestureForwarder& forwarder, GestureWindow origin);
+};
+
+class WheelHandler : public GestureHandlerT<WheelHandler> {
+private:
+	GesturePoint m_ptStart;
+public:
+	static const char* getName() { return "wheel"; }
+	static const HookCounterId STATS_COUNTER = HC_ForwardedWheel;
+	WheelHandler();
+	uint32_t getIdleInterest() const { return MessageInterestBit(GMSG_RBUTTONDOWN); }
+	MessageHandleResult handleMessageInternal(const GestureMessage& msg);
+};
+
+/* Runs the gestures of a GestureScript, see GestureScript.h */
+class ScriptHandler : public GestureHandlerT<ScriptHandler> {
+private:
+	GesturePoint m_ptStart;
+	/* NULL or empty: the handler ignores every message */
+	const GestureScriptLibrary* m_pScriptLibrary;
+	/* the script the current gesture started with, reloading cannot change the states under it */
+	const GestureScript* m_pScript;
+	int m_iState;
+	/* the last state entered besides idle is passthrough, like RockerHandler::m_bLeft */
+	bool m_bPassthrough;
+public:
+	static const char* getName() { return "script"; }
+	static const HookCounterId STATS_COUNTER = HC_ForwardedScript;
+	ScriptHandler();
+	void setScriptLibrary(const GestureScriptLibrary* pLibrary) { m_pScriptLibrary = pLibrary; }
+	/* Follows the library's current script, a reload is only seen once the thread looks at a message again */
+	uint32_t getIdleInterest() const;
+	MessageHandleResult handleMessageInternal(const GestureMessage& msg);
+	bool shouldSwallow(MessageHandleResult) const;
+	void forwardAllOrigin(GestureForwarder& forwarder, GestureWindow origin);
+};
+
+/*
+ * A fixed sequence of handlers stored by value, in priority order.
+ * forEach visits every handler, any() stops at the first handler the functor returns true for.
+ * Both expand to straight-line code, so the dispatch can be inlined completely.
+ */
+template <class... Handlers>
+struct GesturePipeline;
+
+template <>
+struct GesturePipeline<> {
+	static const int SIZE = 0;
+
+	template <class Fn> void forEach(Fn&) {}
+	template <class Fn> void forEach(Fn&) const {}
+	template <class Fn> bool any(Fn&) { return false; }
+	template <class Fn> bool any(Fn&) const { return false; }
+};
+
+template <class Head, class... Tail>
+struct GesturePipeline<Head, Tail...> {
+	static const int SIZE = 1 + GesturePipeline<Tail...>::SIZE;
+
+	Head head;
+	GesturePipeline<Tail...> tail;
+
+	template <class Fn> void forEach(Fn& fn) {
+		fn(head);
+		tail.forEach(fn);
+	}
+	template <class Fn> void forEach(Fn& fn) const {
+		fn(head);
+		tail.forEach(fn);
+	}
+	template <class Fn> bool any(Fn& fn) {
+		return fn(head) || tail.any(fn);
+	}
+	template <class Fn> bool any(Fn& fn) const {
+		return fn(head) || tail.any(fn);
+	}
+};
+
+/* The per-thread set of gesture handlers */
+struct GestureHandlers {
+	typedef GesturePipeline<TraceHandler, RockerHandler, WheelHandler, ScriptHandler> Pipeline;
+	Pipeline m_pipeline;
+
+	/* Origin to target coordinate offset, looked up once per triggered gesture */
+	GestureWindow m_hwndOffsetOrigin;
+	GestureWindow m_hwndOffsetTarget;
+	GesturePoint m_ptOffset;
+
+	/* Where forwarded messages are counted, may be NULL */
+	HookThreadStats* m_pStats;
+	/* NULL forwards every move of a triggered gesture */
+	const MoveDecimation* m_pMoveDecimation;
+
+	/* What the last handleMouseMessage did, for the flight recorder */
+	uint8_t m_aLastResults[FLIGHT_MAX_HANDLERS];
+	uint8_t m_lastDecision;
+
+	/* Messages looked at whatever the handlers do */
+	uint32_t m_baseInterest;
+	/* m_baseInterest and the handlers' interest, recomputed whenever a handler may have changed state */
+	uint32_t m_interest;
+
+	GestureHandlers();
+	void setStats(HookThreadStats* pStats) { m_pStats = pStats; }
+	/* Lets the trace handler recognize strokes itself, see StrokeCommands */
+	void setStrokeCommands(const StrokeCommands* pCommands);
+	/* Lets the trace handler match strokes against shape templates, tried before StrokeCommands */
+	void setShapeLibrary(const ShapeLibrary* pLibrary);
+	/* Gestures declared in a script, run by the script handler */
+	void setScriptLibrary(const GestureScriptLibrary* pLibrary);
+	void setMoveDecimation(const MoveDecimation* pDecimation) { m_pMoveDecimation = pDecimation; }
+	void countForwarded(HookCounterId id, int nMessages) {
+		if (m_pStats)
+			m_pStats->count(id, static_cast<uint32_t>(nMessages));
+	}
+	GesturePoint getTargetOffset(GestureForwarder& forwarder, GestureWindow hwndOrigin, GestureWindow hwndTarget);
+	void invalidateTargetOffset() { m_hwndOffsetOrigin = m_hwndOffsetTarget = 0; }
+
+	void setEnabledGestures(const char* const aszGestureNames[], int iCount);
+	/* Bit i enables handler i, in the order of getHandlerNames */
+	void setEnabledMask(uint32_t mask);
+	/* Handler names in pipeline order, the order of FlightRecord::aResults */
+	void getHandlerNames(std::vector<std::string>& vNames) const;
+
+	/* Messages that always take the hook's slow path, for what it does besides the gestures */
+	void setBaseInterest(uint32_t interest) {
+		m_baseInterest = interest;
+		updateInterest();
+	}
+	/*
+	 * The messages worth running through handleMouseMessage or the hook's key forwarding, see
+	 * MessageInterestBit. A mouse message outside of it changes nothing and is never swallowed.
+	 */
+	uint32_t getInterest() const { return m_interest; }
+	void updateInterest();
+
+	/* true if no enabled handler is initiated or triggered */
+	bool allInactive() const;
+	/* Runs a mouse message through the handlers, returns true if it should be swallowed; time is MSG::time */
+	bool handleMouseMessage(GestureForwarder& forwarder, GestureWindow hwndTarget, const GestureMessage& msg,
+							uint32_t time = 0);
 };
@@ -15,54 +15,19 @@ You should have received a copy of the GNU General Public License
 along with Fire-IE.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include "StdAfx.h"
+#include "stdafx.h"
 #include "GestureHandler.h"
-#include "ThreadLocal.h"
-
-class TraceHandler : public GestureHandler {
-private:
-	CPoint m_ptStart;
-protected:
-	MessageHandleResult handleMessageInternal(MSG* msg);
-public:
-	CString getName() const { return _T("trace"); }
-	TraceHandler();
-};
-
-class RockerHandler : public GestureHandler {
-private:
-	CPoint m_ptStart;
-	bool m_bLeft;
-protected:
-	MessageHandleResult handleMessageInternal(MSG* msg);
-public:
-	CString getName() const { return _T("rocker"); }
-	RockerHandler();
-	bool shouldSwallow(MessageHandleResult) const;
-	void forwardAllOrigin(HWND origin);
-};
-
-class WheelHandler : public GestureHandler {
-private:
-	CPoint m_ptStart;
-protected:
-	MessageHandleResult handleMessageInternal(MSG* msg);
-public:
-	CString getName() const { return _T("wheel"); }
-	WheelHandler();
-};
 
 TraceHandler::TraceHandler() :
-m_ptStart(-1, -1) {
+m_ptStart(), m_pStrokeCommands(NULL), m_bRecognizing(false), m_pShapeLibrary(NULL), m_pShapes(NULL) {
 
 }
 
-MessageHandleResult TraceHandler::handleMessageInternal(MSG* pMsg) {
-	CPoint ptCurrent(pMsg->lParam);
-	CSize dist;
+MessageHandleResult TraceHandler::handleMessageInternal(const GestureMessage& msg) {
+	GesturePoint ptCurrent = msg.getPoint();
 	switch (getState()) {
 	case GS_None:
-		if (pMsg->message == WM_RBUTTONDOWN) {
+		if (msg.message == GMSG_RBUTTONDOWN) {
 			m_ptStart = ptCurrent;
 			setState(GS_Initiated);
 			ATLTRACE(_T("Trace Gesture Initiated\n"));
@@ -70,25 +35,30 @@ MessageHandleResult TraceHandler::handleMessageInternal(MSG* pMsg) {
 		}
 		break;
 	case GS_Initiated:
-		dist = ptCurrent - m_ptStart;
-		if (pMsg->message == WM_MOUSEMOVE && (pMsg->wParam & MK_RBUTTON)) {
-			if (abs(dist.cx) > 10 || abs(dist.cy) > 10) {
+		if (msg.message == GMSG_MOUSEMOVE && (msg.wParam & GMK_RBUTTON)) {
+			if (abs(ptCurrent.x - m_ptStart.x) > 10 || abs(ptCurrent.y - m_ptStart.y) > 10) {
 				setState(GS_Triggered);
+				m_pShapes = m_pShapeLibrary ? m_pShapeLibrary->get() : NULL;
+				m_bRecognizing = m_pShapes || (m_pStrokeCommands && m_pStrokeCommands->isEnabled());
+				if (m_bRecognizing)
+					m_recognizer.begin(m_ptStart);
+				if (m_pShapes)
+					m_shapeTrace.begin(m_ptStart);
 				ATLTRACE(_T("Trace Gesture Triggered\n"));
 				return MHR_Triggered;
 			} else
 				return MHR_Swallowed;
-		} else if (pMsg->message == WM_RBUTTONDOWN || pMsg->message == WM_RBUTTONDBLCLK) {
+		} else if (msg.message == GMSG_RBUTTONDOWN || msg.message == GMSG_RBUTTONDBLCLK) {
 			ATLTRACE(_T("Duplicate Trace Gesture Initiation\n"));
 			return MHR_Discarded;
 		} else {
-			ATLTRACE(_T("Trace Gesture Canceled due to message no. %x\n"), pMsg->message);
+			ATLTRACE(_T("Trace Gesture Canceled due to message no. %x\n"), msg.message);
 			setState(GS_None);
 			return MHR_Canceled;
 		}
 		break;
 	case GS_Triggered:
-		if (pMsg->message == WM_MOUSEMOVE && (pMsg->wParam & MK_RBUTTON)) {
+		if (msg.message == GMSG_MOUSEMOVE && (msg.wParam & GMK_RBUTTON)) {
 			return MHR_Swallowed;
 		} else {
 			ATLTRACE(_T("Trace Gesture Ended\n"));
@@ -100,53 +70,102 @@ MessageHandleResult TraceHandler::handleMessageInternal(MSG* pMsg) {
 	return MHR_NotHandled;
 }
 
+void TraceHandler::recognizeTracked() {
+	// the moves so far belong to the stroke, firefox does not need to see them
+	for (int i = 0; i < m_messages.size(); i++) {
+		if (m_messages[i].message == GMSG_MOUSEMOVE)
+			addStrokePoint(m_messages[i].getPoint());
+	}
+	m_messages.clear();
+}
+
+bool TraceHandler::findShapeCommand(StrokeCommand& command) {
+	ShapePath path;
+	if (!NormalizeShape(m_shapeTrace.points(), m_shapeTrace.size(), path))
+		return false;
+	ShapeMatch match;
+	if (!m_pShapes->match(path, match, m_pShapeLibrary->getKernel()))
+		return false;
+	ATLTRACE(_T("Trace Gesture matches shape %d at %d%%\n"), match.iTemplate, static_cast<int>(match.meanDistance * 100));
+	command = match.command;
+	return true;
+}
+
+int TraceHandler::recognizeTriggered(GestureForwarder& forwarder, const GestureMessage& msg, MessageHandleResult res,
+									 GestureWindow hTarget) {
+	if (res != MHR_GestureEnd) {
+		addStrokePoint(msg.getPoint());
+		return 0;
+	}
+
+	m_bRecognizing = false;
+	// a stroke ended by anything but releasing the button is abandoned
+	if (msg.message != GMSG_RBUTTONUP)
+		return 0;
+	m_recognizer.addPoint(msg.getPoint());
+	StrokeCommand command;
+	// a drawn shape is more specific than its directions
+	if (m_pShapes) {
+		m_shapeTrace.end(msg.getPoint());
+		if (findShapeCommand(command)) {
+			forwarder.postHotkey(hTarget, command.virtualKey, command.modifiers);
+			return 1;
+		}
+	}
+	if (!m_pStrokeCommands || !m_pStrokeCommands->isEnabled() || !m_pStrokeCommands->find(m_recognizer, command)) {
+		ATLTRACE(_T("Trace Gesture %S matches no command\n"), m_recognizer.getDirections());
+		return 0;
+	}
+	ATLTRACE(_T("Trace Gesture %S, hotkey %x\n"), m_recognizer.getDirections(), command.virtualKey);
+	forwarder.postHotkey(hTarget, command.virtualKey, command.modifiers);
+	return 1;
+}
+
 RockerHandler::RockerHandler() :
-m_ptStart(-1, -1), m_bLeft(false) {
+m_ptStart(), m_bLeft(false) {
 
 }
 
-MessageHandleResult RockerHandler::handleMessageInternal(MSG* pMsg) {
-	CPoint ptCurrent(pMsg->lParam);
-	CSize dist;
+MessageHandleResult RockerHandler::handleMessageInternal(const GestureMessage& msg) {
+	GesturePoint ptCurrent = msg.getPoint();
 	switch (getState()) {
 	case GS_None:
-		if (pMsg->message == WM_LBUTTONDOWN || pMsg->message == WM_RBUTTONDOWN) {
+		if (msg.message == GMSG_LBUTTONDOWN || msg.message == GMSG_RBUTTONDOWN) {
 			m_ptStart = ptCurrent;
-			m_bLeft = (pMsg->message == WM_LBUTTONDOWN);
+			m_bLeft = (msg.message == GMSG_LBUTTONDOWN);
 			setState(GS_Initiated);
 			ATLTRACE(CString(_T("Rocker Gesture Initiated: ")) + (m_bLeft ? _T(" Left\n") : _T(" Right\n")));
 			return MHR_Initiated;
 		}
 		break;
 	case GS_Initiated:
-		dist = ptCurrent - m_ptStart;
-		if (pMsg->message == WM_MOUSEMOVE && (pMsg->wParam & (m_bLeft ? MK_LBUTTON : MK_RBUTTON))) {
-			if (abs(dist.cx) > 10 || abs(dist.cy) > 10) {
+		if (msg.message == GMSG_MOUSEMOVE && (msg.wParam & (m_bLeft ? GMK_LBUTTON : GMK_RBUTTON))) {
+			if (abs(ptCurrent.x - m_ptStart.x) > 10 || abs(ptCurrent.y - m_ptStart.y) > 10) {
 				setState(GS_None);
 				ATLTRACE(_T("Rocker Gesture Canceled due to mouse moved too far away\n"));
 				return MHR_Canceled;
 			} else
 				return MHR_Swallowed;
-		} else if (pMsg->message == (m_bLeft ? WM_RBUTTONDOWN : WM_LBUTTONDOWN)
-				   && (pMsg->wParam & (m_bLeft ? MK_LBUTTON : MK_RBUTTON))) {
+		} else if (msg.message == (m_bLeft ? GMSG_RBUTTONDOWN : GMSG_LBUTTONDOWN)
+				   && (msg.wParam & (m_bLeft ? GMK_LBUTTON : GMK_RBUTTON))) {
 			ATLTRACE(_T("Rocker Gesture Triggered\n"));
 			setState(GS_Triggered);
 			return MHR_Triggered;
-		} else if (pMsg->message == WM_LBUTTONDOWN || pMsg->message == WM_RBUTTONDOWN
-				   || pMsg->message == WM_LBUTTONDBLCLK || pMsg->message == WM_RBUTTONDBLCLK) {
+		} else if (msg.message == GMSG_LBUTTONDOWN || msg.message == GMSG_RBUTTONDOWN
+				   || msg.message == GMSG_LBUTTONDBLCLK || msg.message == GMSG_RBUTTONDBLCLK) {
 			ATLTRACE(_T("Duplicate Rocker Gesture Initiation\n"));
 			return MHR_Discarded;
 		} else {
-			ATLTRACE(_T("Rocker Gesture Canceled due to message no. %x\n"), pMsg->message);
+			ATLTRACE(_T("Rocker Gesture Canceled due to message no. %x\n"), msg.message);
 			setState(GS_None);
 			return MHR_Canceled;
 		}
 		break;
 	case GS_Triggered:
-		if ((pMsg->wParam & (m_bLeft ? MK_LBUTTON : MK_RBUTTON)) == 0
-			|| (pMsg->message != (m_bLeft ? WM_RBUTTONDOWN : WM_LBUTTONDOWN)
-			&& pMsg->message != (m_bLeft ? WM_RBUTTONUP : WM_LBUTTONUP)
-			&& pMsg->message != WM_MOUSEMOVE)) {
+		if ((msg.wParam & (m_bLeft ? GMK_LBUTTON : GMK_RBUTTON)) == 0
+			|| (msg.message != (m_bLeft ? GMSG_RBUTTONDOWN : GMSG_LBUTTONDOWN)
+			&& msg.message != (m_bLeft ? GMSG_RBUTTONUP : GMSG_LBUTTONUP)
+			&& msg.message != GMSG_MOUSEMOVE)) {
 			ATLTRACE(_T("Rocker Gesture Ended\n"));
 			setState(GS_None);
 			return MHR_GestureEnd;
@@ -164,23 +183,22 @@ bool RockerHandler::shouldSwallow(MessageHandleResult res) const {
 	return GestureHandler::shouldSwallow(res);
 }
 
-void RockerHandler::forwardAllOrigin(HWND hOrigin) {
+void RockerHandler::forwardAllOrigin(GestureForwarder& forwarder, GestureWindow hOrigin) {
 	// also don't forward anything to origin if gesture is left->right
 	if (m_bLeft) return;
-	GestureHandler::forwardAllOrigin(hOrigin);
+	GestureHandler::forwardAllOrigin(forwarder, hOrigin);
 }
 
 WheelHandler::WheelHandler() :
-m_ptStart(-1, -1) {
+m_ptStart() {
 
 }
 
-MessageHandleResult WheelHandler::handleMessageInternal(MSG* pMsg) {
-	CPoint ptCurrent(pMsg->lParam);
-	CSize dist;
+MessageHandleResult WheelHandler::handleMessageInternal(const GestureMessage& msg) {
+	GesturePoint ptCurrent = msg.getPoint();
 	switch (getState()) {
 	case GS_None:
-		if (pMsg->message == WM_RBUTTONDOWN) {
+		if (msg.message == GMSG_RBUTTONDOWN) {
 			m_ptStart = ptCurrent;
 			setState(GS_Initiated);
 			ATLTRACE(_T("Wheel Gesture Initiated\n"));
@@ -188,29 +206,28 @@ MessageHandleResult WheelHandler::handleMessageInternal(MSG* pMsg) {
 		}
 		break;
 	case GS_Initiated:
-		dist = ptCurrent - m_ptStart;
-		if (pMsg->message == WM_MOUSEMOVE && (pMsg->wParam & MK_RBUTTON)) {
-			if (abs(dist.cx) > 10 || abs(dist.cy) > 10) {
+		if (msg.message == GMSG_MOUSEMOVE && (msg.wParam & GMK_RBUTTON)) {
+			if (abs(ptCurrent.x - m_ptStart.x) > 10 || abs(ptCurrent.y - m_ptStart.y) > 10) {
 				setState(GS_None);
 				ATLTRACE(_T("Wheel Gesture Canceled due to mouse moved too far away\n"));
 				return MHR_Canceled;
 			} else
 				return MHR_Swallowed;
-		} else if (pMsg->message == WM_MOUSEWHEEL && (pMsg->wParam & MK_RBUTTON)) {
+		} else if (msg.message == GMSG_MOUSEWHEEL && (msg.wParam & GMK_RBUTTON)) {
 			ATLTRACE(_T("Wheel Gesture Triggered\n"));
 			setState(GS_Triggered);
 			return MHR_Triggered;
-		} else if (pMsg->message == WM_RBUTTONDOWN || pMsg->message == WM_RBUTTONDBLCLK) {
+		} else if (msg.message == GMSG_RBUTTONDOWN || msg.message == GMSG_RBUTTONDBLCLK) {
 			ATLTRACE(_T("Duplicate Wheel Gesture Initiation\n"));
 			return MHR_Discarded;
 		} else {
-			ATLTRACE(_T("Wheel Gesture Canceled due to message no. %x\n"), pMsg->message);
+			ATLTRACE(_T("Wheel Gesture Canceled due to message no. %x\n"), msg.message);
 			setState(GS_None);
 			return MHR_Canceled;
 		}
 		break;
 	case GS_Triggered:
-		if ((pMsg->message == WM_MOUSEMOVE || pMsg->message == WM_MOUSEWHEEL) && (pMsg->wParam & MK_RBUTTON)) {
+		if ((msg.message == GMSG_MOUSEMOVE || msg.message == GMSG_MOUSEWHEEL) && (msg.wParam & GMK_RBUTTON)) {
 			return MHR_Swallowed;
 		} else {
 			ATLTRACE(_T("Wheel Gesture Ended\n"));
@@ -222,13 +239,308 @@ MessageHandleResult WheelHandler::handleMessageInternal(MSG* pMsg) {
 	return MHR_NotHandled;
 }
 
-const std::vector<GestureHandler*>& GestureHandler::getHandlers() {
-	auto& vHandlers = ThreadLocalStorage::GetInstance().gestureHandlers.m_vHandlers;
-	if (vHandlers.size() == 0) {
-		vHandlers.push_back(new TraceHandler());
-		vHandlers.push_back(new RockerHandler());
-		vHandlers.push_back(new WheelHandler());
-		ATLTRACE(_T("Created gesture handlers.\n"));
+ScriptHandler::ScriptHandler() :
+m_ptStart(), m_pScriptLibrary(NULL), m_pScript(NULL), m_iState(SCRIPT_IDLE_STATE), m_bPassthrough(false) {
+
+}
+
+MessageHandleResult ScriptHandler::handleMessageInternal(const GestureMessage& msg) {
+	if (getState() == GS_None) {
+		// between gestures, also after a reset by another handler
+		m_pScript = m_pScriptLibrary ? m_pScriptLibrary->get() : NULL;
+		m_iState = SCRIPT_IDLE_STATE;
+	}
+	if (!m_pScript)
+		return MHR_NotHandled;
+
+	GesturePoint ptCurrent = msg.getPoint();
+	unsigned int key = GestureScript::KeyOf(msg.wParam);
+	int threshold = m_pScript->getState(m_iState).threshold;
+	if (threshold && (abs(ptCurrent.x - m_ptStart.x) > threshold || abs(ptCurrent.y - m_ptStart.y) > threshold))
+		key |= SK_Far;
+	const ScriptTransition& transition = m_pScript->getTransition(m_iState, GestureScript::EventOf(msg.message), key);
+	MessageHandleResult res = static_cast<MessageHandleResult>(transition.result);
+	if (res == MHR_Initiated)
+		m_ptStart = ptCurrent;
+	if (transition.iNextState != m_iState) {
+		m_iState = transition.iNextState;
+		const ScriptState& state = m_pScript->getState(m_iState);
+		if (state.kind != GS_None)
+			m_bPassthrough = state.bPassthrough;
+		setState(static_cast<GestureState>(state.kind));
+		ATLTRACE(_T("Script Gesture %S after message no. %x\n"), m_pScript->getStateName(m_iState), msg.message);
+	}
+	return res;
+}
+
+uint32_t ScriptHandler::getIdleInterest() const {
+	const GestureScript* pScript = m_pScriptLibrary ? m_pScriptLibrary->get() : NULL;
+	return pScript ? pScript->getState(SCRIPT_IDLE_STATE).interest : 0;
+}
+
+bool ScriptHandler::shouldSwallow(MessageHandleResult res) const {
+	if (m_bPassthrough && res != MHR_Triggered) return false;
+	return GestureHandler::shouldSwallow(res);
+}
+
+void ScriptHandler::forwardAllOrigin(GestureForwarder& forwarder, GestureWindow hOrigin) {
+	if (m_bPassthrough) return;
+	GestureHandler::forwardAllOrigin(forwarder, hOrigin);
+}
+
+static_assert(GestureHandlers::Pipeline::SIZE <= FLIGHT_MAX_HANDLERS, "flight records have no room for all handlers");
+
+namespace {
+
+struct ResetHandler {
+	template <class Handler> void operator()(Handler& handler) const {
+		handler.reset();
+	}
+};
+
+struct IsHandlerActive {
+	template <class Handler> bool operator()(const Handler& handler) const {
+		return handler.getEnabled() && handler.getState() != GS_None;
+	}
+};
+
+struct IsHandlerStarted {
+	template <class Handler> bool operator()(const Handler& handler) const {
+		return handler.getState() != GS_None;
+	}
+};
+
+struct CollectInterest {
+	uint32_t interest;
+
+	template <class Handler> void operator()(const Handler& handler) {
+		interest |= handler.getInterest();
+	}
+};
+
+struct SetStrokeCommands {
+	const StrokeCommands* pCommands;
+
+	template <class Handler> void operator()(Handler&) const {}
+	void operator()(TraceHandler& handler) const {
+		handler.setStrokeCommands(pCommands);
+	}
+};
+
+struct SetShapeLibrary {
+	const ShapeLibrary* pLibrary;
+
+	template <class Handler> void operator()(Handler&) const {}
+	void operator()(TraceHandler& handler) const {
+		handler.setShapeLibrary(pLibrary);
+	}
+};
+
+struct SetScriptLibrary {
+	const GestureScriptLibrary* pLibrary;
+
+	template <class Handler> void operator()(Handler&) const {}
+	void operator()(ScriptHandler& handler) const {
+		handler.setScriptLibrary(pLibrary);
+	}
+};
+
+struct EnableHandlerByMask {
+	uint32_t mask;
+	int iHandler;
+
+	template <class Handler> void operator()(Handler& handler) {
+		handler.setEnabled(((mask >> iHandler++) & 1) != 0);
+	}
+};
+
+struct CollectHandlerName {
+	std::vector<std::string>& vNames;
+
+	template <class Handler> void operator()(const Handler&) const {
+		vNames.push_back(Handler::getName());
+	}
+};
+
+struct EnableHandlerByName {
+	const char* const* aszGestureNames;
+	int iCount;
+
+	template <class Handler> void operator()(Handler& handler) const {
+		bool bEnabled = false;
+		for (int iName = 0; iName < iCount; iName++) {
+			if (strcmp(Handler::getName(), aszGestureNames[iName]) == 0) {
+				bEnabled = true;
+				break;
+			}
+		}
+		handler.setEnabled(bEnabled);
+	}
+};
+
+// Forward the mouse message if any guesture handler is triggered.
+struct ForwardTriggered {
+	GestureHandlers& handlers;
+	GestureForwarder& forwarder;
+	GestureWindow hwndTarget;
+	const GestureMessage& msg;
+	uint32_t time;
+	int iHandler;
+	/* false while the gesture goes on, nobody's interest changes then */
+	bool bStateChanged;
+
+	template <class Handler> bool operator()(Handler& handler) {
+		if (handler.getState() != GS_Triggered) {
+			iHandler++;
+			return false;
+		}
+
+		MessageHandleResult res = handler.handleMessage(msg);
+		bStateChanged = handler.getState() != GS_Triggered || res == MHR_GestureEnd;
+		handlers.m_aLastResults[iHandler++] = static_cast<uint8_t>(res);
+		// Forward the mousemove message to let firefox track the guesture.
+		int nForwarded = handler.forwardTriggered(forwarder, msg, res, hwndTarget,
+												  handlers.getTargetOffset(forwarder, msg.hwnd, hwndTarget), time);
+		if (nForwarded) {
+			handlers.countForwarded(Handler::STATS_COUNTER, nForwarded);
+			handlers.m_lastDecision |= FD_ForwardedTarget;
+		}
+		if (res == MHR_GestureEnd) {
+			ResetHandler reset;
+			handlers.m_pipeline.forEach(reset);
+			handlers.invalidateTargetOffset();
+		}
+		return true;
+	}
+};
+
+// Check if we could trigger a mouse guesture, stops at the triggered handler.
+struct TryTrigger {
+	GestureHandlers& handlers;
+	GestureForwarder& forwarder;
+	GestureWindow hwndTarget;
+	const GestureMessage& msg;
+	uint32_t time;
+	bool bShouldSwallow;
+	int iHandler;
+
+	template <class Handler> bool operator()(Handler& handler) {
+		// idle handlers that cannot start on the message would not even look at it
+		if (!(handler.getInterest() & MessageInterestBit(msg.message))) {
+			handlers.m_aLastResults[iHandler++] = MHR_NotHandled;
+			return false;
+		}
+		MessageHandleResult res = handler.handleMessage(msg);
+		handlers.m_aLastResults[iHandler++] = static_cast<uint8_t>(res);
+		bShouldSwallow = bShouldSwallow || handler.shouldSwallow(res);
+		if (res == MHR_Triggered) {
+			// look the offset up again for every gesture, the windows may have moved since the last one
+			handlers.invalidateTargetOffset();
+			int nForwarded = handler.forwardAllTarget(forwarder, hwndTarget,
+													  handlers.getTargetOffset(forwarder, msg.hwnd, hwndTarget));
+			if (nForwarded) {
+				handlers.countForwarded(Handler::STATS_COUNTER, nForwarded);
+				handlers.m_lastDecision |= FD_ForwardedTarget;
+			}
+			if (handlers.m_pMoveDecimation)
+				handler.beginDecimation(*handlers.m_pMoveDecimation, msg.getPoint(), time);
+			return true;
+		} else if (res == MHR_Canceled) {
+			IsHandlerStarted isStarted;
+			bool bShouldForwardBack = !handlers.m_pipeline.any(isStarted);
+			if (bShouldForwardBack) {
+				// the rocker handler may keep its messages instead of forwarding them
+				int nTracked = handler.getTrackedCount();
+				handler.forwardAllOrigin(forwarder, msg.hwnd);
+				if (nTracked != handler.getTrackedCount()) {
+					handlers.countForwarded(Handler::STATS_COUNTER, nTracked - handler.getTrackedCount());
+					handlers.m_lastDecision |= FD_ForwardedOrigin;
+				}
+				ResetHandler reset;
+				handlers.m_pipeline.forEach(reset);
+			}
+		}
+		return false;
+	}
+};
+
+}
+
+GestureHandlers::GestureHandlers() :
+m_hwndOffsetOrigin(0), m_hwndOffsetTarget(0), m_ptOffset(), m_pStats(NULL), m_pMoveDecimation(NULL), m_lastDecision(0),
+m_baseInterest(0), m_interest(0) {
+	memset(m_aLastResults, FLIGHT_NOT_RUN, sizeof(m_aLastResults));
+	updateInterest();
+}
+
+GesturePoint GestureHandlers::getTargetOffset(GestureForwarder& forwarder, GestureWindow hwndOrigin, GestureWindow hwndTarget) {
+	if (hwndOrigin != m_hwndOffsetOrigin || hwndTarget != m_hwndOffsetTarget) {
+		m_ptOffset = forwarder.getClientOffset(hwndOrigin, hwndTarget);
+		m_hwndOffsetOrigin = hwndOrigin;
+		m_hwndOffsetTarget = hwndTarget;
+	}
+	return m_ptOffset;
+}
+
+void GestureHandlers::setEnabledGestures(const char* const aszGestureNames[], int iCount) {
+	EnableHandlerByName enable = { aszGestureNames, iCount };
+	m_pipeline.forEach(enable);
+	updateInterest();
+}
+
+void GestureHandlers::setStrokeCommands(const StrokeCommands* pCommands) {
+	SetStrokeCommands set = { pCommands };
+	m_pipeline.forEach(set);
+}
+
+void GestureHandlers::setShapeLibrary(const ShapeLibrary* pLibrary) {
+	SetShapeLibrary set = { pLibrary };
+	m_pipeline.forEach(set);
+}
+
+void GestureHandlers::setScriptLibrary(const GestureScriptLibrary* pLibrary) {
+	SetScriptLibrary set = { pLibrary };
+	m_pipeline.forEach(set);
+	updateInterest();
+}
+
+void GestureHandlers::setEnabledMask(uint32_t mask) {
+	EnableHandlerByMask enable = { mask, 0 };
+	m_pipeline.forEach(enable);
+	updateInterest();
+}
+
+void GestureHandlers::getHandlerNames(std::vector<std::string>& vNames) const {
+	CollectHandlerName collect = { vNames };
+	m_pipeline.forEach(collect);
+}
+
+void GestureHandlers::updateInterest() {
+	CollectInterest collect = { m_baseInterest };
+	m_pipeline.forEach(collect);
+	m_interest = collect.interest;
+}
+
+bool GestureHandlers::allInactive() const {
+	IsHandlerActive isActive;
+	return !m_pipeline.any(isActive);
+}
+
+bool GestureHandlers::handleMouseMessage(GestureForwarder& forwarder, GestureWindow hwndTarget, const GestureMessage& msg,
+										 uint32_t time) {
+	memset(m_aLastResults, FLIGHT_NOT_RUN, sizeof(m_aLastResults));
+	m_lastDecision = 0;
+
+	ForwardTriggered forwardTriggered = { *this, forwarder, hwndTarget, msg, time, 0, false };
+	if (m_pipeline.any(forwardTriggered)) {
+		// a triggered handler that stays triggered leaves everybody's interest as it was
+		if (forwardTriggered.bStateChanged)
+			updateInterest();
+		return true;
 	}
-	return vHandlers;
+	TryTrigger tryTrigger = { *this, forwarder, hwndTarget, msg, time, false, 0 };
+	m_pipeline.any(tryTrigger);
+	// handlers only change state while handling a message
+	updateInterest();
+	return tryTrigger.bShouldSwallow;
 }
@@ -0,0 +1,90 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "GestureCore.h"
+
+/*
+ * Fixed-capacity ring of the messages a gesture handler has swallowed, in arrival order.
+ * A mouse move that follows a mouse move with the same key state replaces it, since only the
+ * latest position matters when the messages are replayed. When the ring is full, the oldest
+ * mouse move is dropped, so button and wheel messages keep their exact order. They are never
+ * dropped: once the ring holds nothing else it is full, and the gesture has to give up.
+ */
+class GestureMessageBuffer {
+public:
+	static const int CAPACITY = 16;
+
+	GestureMessageBuffer() : m_iHead(0), m_nCount(0) {}
+
+	int size() const { return m_nCount; }
+	bool empty() const { return m_nCount == 0; }
+	void clear() {
+		m_iHead = 0;
+		m_nCount = 0;
+	}
+
+	const GestureMessage& operator[](int i) const { return m_messages[physical(i)]; }
+	const GestureMessage& back() const { return (*this)[m_nCount - 1]; }
+	/* true if there is no room left without dropping a button or wheel message */
+	bool isFull() const { return m_nCount == CAPACITY && findMove() < 0; }
+
+	/* Returns false, without storing msg, if the ring is full */
+	bool push(const GestureMessage& msg) {
+		if (msg.message == GMSG_MOUSEMOVE && m_nCount) {
+			GestureMessage& last = m_messages[physical(m_nCount - 1)];
+			if (last.message == GMSG_MOUSEMOVE && last.wParam == msg.wParam) {
+				last = msg;
+				return true;
+			}
+		}
+		if (m_nCount == CAPACITY && !evictMove())
+			return false;
+		m_messages[physical(m_nCount)] = msg;
+		m_nCount++;
+		return true;
+	}
+private:
+	GestureMessage m_messages[CAPACITY];
+	int m_iHead;
+	int m_nCount;
+
+	int physical(int i) const { return (m_iHead + i) % CAPACITY; }
+
+	/* Index of the oldest mouse move, -1 if there is none */
+	int findMove() const {
+		for (int i = 0; i < m_nCount; i++) {
+			if (m_messages[physical(i)].message == GMSG_MOUSEMOVE)
+				return i;
+		}
+		return -1;
+	}
+
+	/* Drops the oldest mouse move, returns false if there is none */
+	bool evictMove() {
+		int iVictim = findMove();
+		if (iVictim < 0)
+			return false;
+		// close the gap by moving the older messages up by one
+		for (int i = iVictim; i > 0; i--)
+			m_messages[physical(i)] = m_messages[physical(i - 1)];
+		m_iHead = physical(1);
+		m_nCount--;
+		return true;
+	}
+};
@@ -0,0 +1,386 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "GestureScript.h"
+#include "GestureHandler.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+
+using namespace std;
+
+namespace {
+
+struct EventName {
+	const char* szName;
+	int iEvent;
+};
+
+const EventName s_aEventNames[] = {
+	{ "move", SE_Move }, { "wheel", SE_Wheel },
+	{ "ldown", SE_LButtonDown }, { "lup", SE_LButtonUp }, { "ldblclk", SE_LButtonDblClk },
+	{ "rdown", SE_RButtonDown }, { "rup", SE_RButtonUp }, { "rdblclk", SE_RButtonDblClk },
+	{ "mdown", SE_MButtonDown }, { "mup", SE_MButtonUp }, { "mdblclk", SE_MButtonDblClk },
+};
+
+struct ResultName {
+	const char* szName;
+	MessageHandleResult result;
+	/* the state the rule is in */
+	GestureState kind;
+	bool bHasTarget;
+};
+
+const ResultName s_aResultNames[] = {
+	{ "initiate", MHR_Initiated, GS_None, true },
+	{ "trigger", MHR_Triggered, GS_Initiated, true },
+	{ "swallow", MHR_Swallowed, GS_Initiated, false },
+	{ "swallow", MHR_Swallowed, GS_Triggered, false },
+	{ "discard", MHR_Discarded, GS_Initiated, false },
+	{ "cancel", MHR_Canceled, GS_Initiated, false },
+	{ "end", MHR_GestureEnd, GS_Triggered, false },
+};
+
+/* Not known yet, the rules entering a state decide */
+const int KIND_UNKNOWN = -1;
+
+struct ParsedState {
+	string strName;
+	int line;
+	bool bPassthrough;
+	int kind;
+	int threshold;
+};
+
+struct ParsedRule {
+	int line;
+	int iState;
+	string strGesture;
+	uint32_t eventMask;
+	unsigned int heldMask;
+	unsigned int releasedMask;
+	int threshold;
+	MessageHandleResult result;
+	string strTarget;
+	int iTarget;
+	bool bUsed;
+};
+
+const char* GetKindName(int kind) {
+	return kind == GS_None ? "idle" : kind == GS_Initiated ? "initiated" : "triggered";
+}
+
+bool IsValidName(const string& str) {
+	if (str.empty())
+		return false;
+	for (char c : str) {
+		if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-')
+			return false;
+	}
+	return true;
+}
+
+void Tokenize(const string& strLine, vector<string>& vTokens) {
+	vTokens.clear();
+	size_t i = 0;
+	while (i < strLine.size()) {
+		while (i < strLine.size() && isspace(static_cast<unsigned char>(strLine[i])))
+			i++;
+		size_t iStart = i;
+		while (i < strLine.size() && !isspace(static_cast<unsigned char>(strLine[i])))
+			i++;
+		if (i > iStart)
+			vTokens.push_back(strLine.substr(iStart, i - iStart));
+	}
+}
+
+/* Parses "events conditions", returns an error message or NULL */
+const char* ParseCondition(const vector<string>& vTokens, ParsedRule& rule) {
+	for (const string& strToken : vTokens) {
+		if (strToken == "any") {
+			rule.eventMask = (1u << SE_Count) - 1;
+			continue;
+		}
+		bool bEvent = false;
+		for (const EventName& name : s_aEventNames) {
+			if (strToken == name.szName) {
+				rule.eventMask |= 1u << name.iEvent;
+				bEvent = true;
+			}
+		}
+		if (bEvent)
+			continue;
+		if (strToken.size() == 2 && (strToken[0] == '+' || strToken[0] == '-')) {
+			unsigned int button = strToken[1] == 'L' ? SK_LButton : strToken[1] == 'R' ? SK_RButton :
+								  strToken[1] == 'M' ? SK_MButton : 0;
+			if (!button)
+				return "unknown button";
+			(strToken[0] == '+' ? rule.heldMask : rule.releasedMask) |= button;
+			continue;
+		}
+		if (strToken.size() > 1 && strToken[0] == '>') {
+			char* pEnd = NULL;
+			long threshold = strtol(strToken.c_str() + 1, &pEnd, 10);
+			if (*pEnd || threshold < 1 || threshold > SCRIPT_MAX_THRESHOLD)
+				return "distance out of range";
+			rule.threshold = static_cast<int>(threshold);
+			continue;
+		}
+		return "unknown event or condition";
+	}
+	if (!rule.eventMask)
+		return "no event";
+	if (rule.heldMask & rule.releasedMask)
+		return "a button cannot be held and released at once";
+	return NULL;
+}
+
+bool Fail(string& strError, int line, const string& strMessage) {
+	char szLine[32];
+	snprintf(szLine, sizeof(szLine), "line %d: ", line);
+	strError = szLine + strMessage;
+	return false;
+}
+
+}
+
+bool GestureScript::compile(const char* szScript, string& strError) {
+	vector<ParsedState> vStates;
+	ParsedState idle = { "idle", 0, false, GS_None, 0 };
+	vStates.push_back(idle);
+	map<string, int> mapStates;
+	vector<ParsedRule> vRules;
+	map<string, int> mapGestureLines;
+	string strGesture;
+	int iCurrentState = -1;
+	bool bGestureStarts = true;
+
+	vector<string> vTokens;
+	int line = 0;
+	const char* p = szScript;
+	while (*p) {
+		const char* pEnd = p;
+		while (*pEnd && *pEnd != '\n')
+			pEnd++;
+		string strLine(p, pEnd);
+		p = *pEnd ? pEnd + 1 : pEnd;
+		line++;
+		size_t iComment = strLine.find('#');
+		if (iComment != string::npos)
+			strLine.erase(iComment);
+		Tokenize(strLine, vTokens);
+		if (vTokens.empty())
+			continue;
+
+		if (vTokens[0] == "gesture") {
+			if (!bGestureStarts)
+				return Fail(strError, mapGestureLines[strGesture], "gesture " + strGesture + " never starts");
+			if (vTokens.size() != 2 || !IsValidName(vTokens[1]))
+				return Fail(strError, line, "expected gesture NAME");
+			if (mapGestureLines.count(vTokens[1]))
+				return Fail(strError, line, "gesture " + vTokens[1] + " declared twice");
+			strGesture = vTokens[1];
+			mapGestureLines[strGesture] = line;
+			iCurrentState = -1;
+			bGestureStarts = false;
+			continue;
+		}
+		if (strGesture.empty())
+			return Fail(strError, line, "expected gesture NAME");
+
+		string& strLast = vTokens.back();
+		if (strLast[strLast.size() - 1] == ':') {
+			// state header
+			strLast.erase(strLast.size() - 1);
+			if (strLast.empty())
+				vTokens.pop_back();
+			bool bPassthrough = vTokens.size() == 2 && vTokens[1] == "passthrough";
+			if (vTokens.empty() || vTokens.size() > 2 || (vTokens.size() == 2 && !bPassthrough) || !IsValidName(vTokens[0]))
+				return Fail(strError, line, "expected NAME: or NAME passthrough:");
+			if (vTokens[0] == "idle") {
+				if (bPassthrough)
+					return Fail(strError, line, "idle cannot be passthrough");
+				iCurrentState = SCRIPT_IDLE_STATE;
+				continue;
+			}
+			string strName = strGesture + "." + vTokens[0];
+			if (mapStates.count(strName))
+				return Fail(strError, line, "state " + vTokens[0] + " declared twice");
+			if (static_cast<int>(vStates.size()) == SCRIPT_MAX_STATES)
+				return Fail(strError, line, "too many states");
+			ParsedState state = { strName, line, bPassthrough, KIND_UNKNOWN, 0 };
+			iCurrentState = static_cast<int>(vStates.size());
+			mapStates[strName] = iCurrentState;
+			vStates.push_back(state);
+			continue;
+		}
+
+		// rule
+		if (iCurrentState < 0)
+			return Fail(strError, line, "rule outside of a state");
+		size_t iColon = strLine.find(':');
+		if (iColon == string::npos || strLine.find(':', iColon + 1) != string::npos)
+			return Fail(strError, line, "expected events and conditions: result");
+		ParsedRule rule = { line, iCurrentState, strGesture, 0, 0, 0, 0, MHR_NotHandled, string(), -1, false };
+		Tokenize(strLine.substr(0, iColon), vTokens);
+		const char* szError = ParseCondition(vTokens, rule);
+		if (szError)
+			return Fail(strError, line, szError);
+		Tokenize(strLine.substr(iColon + 1), vTokens);
+		const ResultName* pResult = NULL;
+		for (const ResultName& result : s_aResultNames) {
+			if (!vTokens.empty() && vTokens[0] == result.szName) {
+				pResult = &result;
+				break;
+			}
+		}
+		if (!pResult)
+			return Fail(strError, line, "expected initiate, trigger, swallow, discard, cancel or end");
+		if (vTokens.size() != (pResult->bHasTarget ? 2u : 1u))
+			return Fail(strError, line, pResult->bHasTarget ? string(pResult->szName) + " needs a state" :
+															  string(pResult->szName) + " takes no state");
+		rule.result = pResult->result;
+		if (pResult->bHasTarget)
+			rule.strTarget = vTokens[1];
+		ParsedState& state = vStates[iCurrentState];
+		if (rule.threshold) {
+			if (state.threshold && state.threshold != rule.threshold)
+				return Fail(strError, line, "all distances of a state must be the same");
+			state.threshold = rule.threshold;
+		}
+		if (iCurrentState == SCRIPT_IDLE_STATE)
+			bGestureStarts = true;
+		vRules.push_back(rule);
+	}
+	if (!bGestureStarts)
+		return Fail(strError, mapGestureLines[strGesture], "gesture " + strGesture + " never starts");
+
+	// the rules entering a state tell whether it is initiated or triggered
+	for (ParsedRule& rule : vRules) {
+		if (rule.strTarget.empty())
+			continue;
+		map<string, int>::const_iterator it = mapStates.find(rule.strGesture + "." + rule.strTarget);
+		if (it == mapStates.end())
+			return Fail(strError, rule.line, "no state " + rule.strTarget + " in gesture " + rule.strGesture);
+		rule.iTarget = it->second;
+		ParsedState& target = vStates[rule.iTarget];
+		int kind = rule.result == MHR_Initiated ? GS_Initiated : GS_Triggered;
+		if (target.kind != KIND_UNKNOWN && target.kind != kind)
+			return Fail(strError, rule.line, "state " + rule.strTarget + " is entered both by initiate and trigger");
+		target.kind = kind;
+	}
+	for (const ParsedState& state : vStates) {
+		if (state.kind == KIND_UNKNOWN)
+			return Fail(strError, state.line, "state " + state.strName + " is never entered");
+	}
+	for (const ParsedRule& rule : vRules) {
+		bool bAllowed = false;
+		for (const ResultName& result : s_aResultNames)
+			bAllowed = bAllowed || (result.result == rule.result && result.kind == vStates[rule.iState].kind);
+		if (!bAllowed) {
+			const char* szResult = "";
+			for (const ResultName& result : s_aResultNames) {
+				if (result.result == rule.result)
+					szResult = result.szName;
+			}
+			return Fail(strError, rule.line, string(szResult) + " is not allowed in " + GetKindName(vStates[rule.iState].kind) +
+							  " state " + vStates[rule.iState].strName);
+		}
+	}
+
+	// every state gets a transition for each event and key, the first rule that matches decides
+	int nStates = static_cast<int>(vStates.size());
+	m_vStates.resize(nStates);
+	m_vStateNames.resize(nStates);
+	m_vTransitions.resize(static_cast<size_t>(nStates) * SE_Count * SK_Count);
+	for (int iState = 0; iState < nStates; iState++) {
+		const ParsedState& parsed = vStates[iState];
+		ScriptState& state = m_vStates[iState];
+		state.kind = static_cast<uint8_t>(parsed.kind);
+		state.bPassthrough = parsed.bPassthrough;
+		state.threshold = static_cast<int16_t>(parsed.threshold);
+		state.interest = 0;
+		m_vStateNames[iState] = parsed.strName;
+		for (int iEvent = 0; iEvent < SE_Count; iEvent++) {
+			// SE_Other stands for the mouse messages after the wheel
+			uint32_t eventInterest = iEvent == SE_Other ? INTEREST_MOUSE & ~(MessageInterestBit(GMSG_MOUSEWHEEL) * 2 - 1)
+														: MessageInterestBit(GMSG_MOUSEMOVE + iEvent);
+			for (unsigned int key = 0; key < SK_Count; key++) {
+				ScriptTransition transition = { MHR_NotHandled, static_cast<uint8_t>(iState) };
+				for (ParsedRule& rule : vRules) {
+					if (rule.iState != iState || !(rule.eventMask & (1u << iEvent)) || (key & rule.heldMask) != rule.heldMask ||
+						(key & rule.releasedMask) || (rule.threshold && !(key & SK_Far)))
+						continue;
+					// without a threshold the far bit is never set
+					if (parsed.threshold || !(key & SK_Far))
+						rule.bUsed = true;
+					transition.result = static_cast<uint8_t>(rule.result);
+					if (rule.iTarget >= 0)
+						transition.iNextState = static_cast<uint8_t>(rule.iTarget);
+					else if (rule.result == MHR_Canceled || rule.result == MHR_GestureEnd)
+						transition.iNextState = SCRIPT_IDLE_STATE;
+					break;
+				}
+				m_vTransitions[(iState * SE_Count + iEvent) * SK_Count + key] = transition;
+				if (transition.result != MHR_NotHandled || transition.iNextState != iState)
+					state.interest |= eventInterest;
+			}
+		}
+	}
+	for (const ParsedRule& rule : vRules) {
+		if (!rule.bUsed)
+			return Fail(strError, rule.line, "never applies, the rules before it match every message it would");
+	}
+	return true;
+}
+
+GestureScriptLibrary::GestureScriptLibrary() {
+	m_pCurrent.store(NULL, std::memory_order_relaxed);
+}
+
+GestureScriptLibrary::~GestureScriptLibrary() {
+	delete m_pCurrent.load(std::memory_order_relaxed);
+	for (const GestureScript* pScript : m_vRetired)
+		delete pScript;
+}
+
+void GestureScriptLibrary::replace(const GestureScript* pScript) {
+	const GestureScript* pOld = m_pCurrent.exchange(pScript, std::memory_order_acq_rel);
+	if (pOld)
+		m_vRetired.push_back(pOld);
+}
+
+bool GestureScriptLibrary::load(const char* szScript, string& strError) {
+	GestureScript* pScript = new GestureScript();
+	if (!pScript->compile(szScript, strError)) {
+		delete pScript;
+		return false;
+	}
+	// a script without gestures has nothing but the idle state
+	if (pScript->getStateCount() == 1) {
+		delete pScript;
+		pScript = NULL;
+	}
+	replace(pScript);
+	return true;
+}
+
+void GestureScriptLibrary::clear() {
+	replace(NULL);
+}
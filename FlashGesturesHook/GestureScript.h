@@ -0,0 +1,148 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "GestureCore.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/*
+ * Gestures declared in a small text format and compiled into transition tables, run by ScriptHandler.
+ * Every gesture is a set of states; the handler starts in the idle state shared by all gestures, and
+ * each message moves it along the first rule of the current state that matches:
+ *
+ *   # right button drag, forwarded to firefox once it left a 10 px box (same as TraceHandler)
+ *   gesture trace
+ *     idle:
+ *       rdown: initiate armed
+ *     armed:
+ *       move +R >10: trigger drawing
+ *       move +R: swallow
+ *       rdown rdblclk: discard
+ *       any: cancel
+ *     drawing:
+ *       move +R: swallow
+ *       any: end
+ *
+ * A rule is "events conditions: result [state]":
+ *   events      move wheel ldown lup ldblclk rdown rup rdblclk mdown mup mdblclk, or any
+ *   conditions  +L +R +M  the button is held (wParam), -L -R -M  it is not,
+ *               >N  the pointer is more than N px away from where the gesture was initiated
+ *   result      idle:        initiate STATE
+ *               initiated:   trigger STATE, swallow, discard, cancel
+ *               triggered:   swallow, end
+ * cancel and end return to idle, states are initiated or triggered by the rules entering them. A state
+ * header "NAME passthrough:" makes the gesture leave the plugin's messages alone except for the one
+ * that triggers it, like the left->right rocker. All >N conditions of a state share one N. '#' starts
+ * a comment. A rule that can never apply because earlier rules match everything it would is an error,
+ * so gestures cannot start on the same message.
+ */
+
+enum ScriptEvent {
+	SE_Move, SE_LButtonDown, SE_LButtonUp, SE_LButtonDblClk, SE_RButtonDown, SE_RButtonUp, SE_RButtonDblClk,
+	SE_MButtonDown, SE_MButtonUp, SE_MButtonDblClk, SE_Wheel, SE_Other, SE_Count
+};
+
+/* Conditions a transition depends on besides the event, packed into the low bits of a table index */
+enum ScriptKey {
+	SK_LButton = 0x01,
+	SK_RButton = 0x02,
+	SK_MButton = 0x04,
+	/* farther from the initiating position than the state's threshold */
+	SK_Far = 0x08,
+	SK_Count = 0x10
+};
+
+const int SCRIPT_MAX_STATES = 64;
+const int SCRIPT_MAX_THRESHOLD = 0x7fff;
+/* Index of the state all gestures start from */
+const uint8_t SCRIPT_IDLE_STATE = 0;
+
+struct ScriptTransition {
+	/* MessageHandleResult */
+	uint8_t result;
+	uint8_t iNextState;
+};
+
+struct ScriptState {
+	/* GestureState */
+	uint8_t kind;
+	bool bPassthrough;
+	/* 0 if no rule of the state looks at the distance */
+	int16_t threshold;
+	/* messages with a rule in this state, see MessageInterestBit */
+	uint32_t interest;
+};
+
+/* A compiled script, immutable once compiled */
+class GestureScript {
+public:
+	GestureScript() {}
+
+	/* Returns false and describes the first error in strError, with its line number */
+	bool compile(const char* szScript, std::string& strError);
+
+	int getStateCount() const { return static_cast<int>(m_vStates.size()); }
+	const ScriptState& getState(int iState) const { return m_vStates[iState]; }
+	/* "gesture.state", for tracing */
+	const char* getStateName(int iState) const { return m_vStateNames[iState].c_str(); }
+	const ScriptTransition& getTransition(int iState, int iEvent, unsigned int key) const {
+		return m_vTransitions[(iState * SE_Count + iEvent) * SK_Count + key];
+	}
+
+	static int EventOf(unsigned int message) {
+		unsigned int i = message - GMSG_MOUSEMOVE;
+		return i < SE_Other ? static_cast<int>(i) : SE_Other;
+	}
+	static unsigned int KeyOf(uintptr_t wParam) {
+		return static_cast<unsigned int>((wParam & (GMK_LBUTTON | GMK_RBUTTON)) | ((wParam & GMK_MBUTTON) ? SK_MButton : 0));
+	}
+private:
+	std::vector<ScriptState> m_vStates;
+	std::vector<std::string> m_vStateNames;
+	/* SE_Count * SK_Count transitions per state */
+	std::vector<ScriptTransition> m_vTransitions;
+
+	GestureScript(const GestureScript&);
+	GestureScript& operator=(const GestureScript&);
+};
+
+/* The script shared by all hook threads, a thread keeps the one its gesture started with until it ends */
+class GestureScriptLibrary {
+public:
+	GestureScriptLibrary();
+	~GestureScriptLibrary();
+
+	/* NULL while there is no script */
+	const GestureScript* get() const { return m_pCurrent.load(std::memory_order_acquire); }
+
+	/* Returns false and keeps the current script if szScript does not compile. Not thread safe against itself. */
+	bool load(const char* szScript, std::string& strError);
+	void clear();
+private:
+	std::atomic<const GestureScript*> m_pCurrent;
+	/* replaced scripts may still be running on other threads, they are freed with the library */
+	std::vector<const GestureScript*> m_vRetired;
+
+	void replace(const GestureScript* pScript);
+
+	GestureScriptLibrary(const GestureScriptLibrary&);
+	GestureScriptLibrary& operator=(const GestureScriptLibrary&);
+};
@@ -18,350 +18,321 @@ along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
 #include "stdafx.h"
 #include "ExportFunctionsInternal.h"
 #include "GestureHandler.h"
+#include "HotkeyRules.h"
 #include "ThreadLocal.h"
+#include "Win32SharedConfig.h"
+#include "Win32GestureChannel.h"
+#include "Win32GestureForwarder.h"
+#include "Win32InputCapture.h"
+#include "Win32KeyStateSource.h"
+#include "Win32WindowTree.h"
 
 using namespace std;
 
-extern bool g_bIsInProcessHook;
-extern DWORD g_idCurrentProcess;
+// Key combinations forwarded to firefox, can be replaced at runtime by FGH_SetHotkeyRules
+HotkeyRules g_hotkeyRules;
 
-template <class T, class R>
-int ArrayFind(const T* arrayBegin, int arrayLength, const R& toFind) {
-	for (int i = 0; i < arrayLength; i++) {
-		if ((*(arrayBegin + i)) == toFind)
-			return i;
+bool SetHotkeyRules(const unsigned char* pRules, DWORD cbRules) {
+	if (pRules == NULL) {
+		g_hotkeyRules.loadDefaults();
+		return true;
+	}
+	if (!g_hotkeyRules.load(pRules, cbRules)) {
+		ATLTRACE(_T("ERROR: malformed hotkey rules, %d bytes\n"), cbRules);
+		return false;
 	}
-	return -1;
+	return true;
 }
 
-bool IsInProcessWindow(HWND hwnd) {
-	if (!g_bIsInProcessHook) return false;
+// Stroke directions recognized by the trace handler, empty until FGH_SetStrokeCommands enables recognition
+StrokeCommands g_strokeCommands;
 
-	DWORD idProcess = 0;
-	GetWindowThreadProcessId(hwnd, &idProcess);
-	return idProcess == g_idCurrentProcess;
+bool SetStrokeCommands(const unsigned char* pCommands, DWORD cbCommands) {
+	if (pCommands == NULL) {
+		g_strokeCommands.clear();
+		return true;
+	}
+	if (!g_strokeCommands.load(pCommands, cbCommands)) {
+		ATLTRACE(_T("ERROR: malformed stroke commands, %d bytes\n"), cbCommands);
+		return false;
+	}
+	return true;
 }
 
-//
-// Returns the real parent window
-// Same as GetParent(), but doesn't return the owner
-//
-HWND GetRealParent(HWND hWnd) {
-	HWND hParent;
+// Shapes matched by the trace handler before stroke directions, empty until FGH_SetShapeTemplates
+ShapeLibrary g_shapeLibrary;
 
-	hParent = GetAncestor(hWnd, GA_PARENT);
-	if (!hParent || hParent == GetDesktopWindow())
-		return NULL;
-
-	return hParent;
+bool SetShapeTemplates(const unsigned char* pTemplates, DWORD cbTemplates) {
+	if (pTemplates == NULL) {
+		g_shapeLibrary.clear();
+		return true;
+	}
+	if (!g_shapeLibrary.load(pTemplates, cbTemplates)) {
+		ATLTRACE(_T("ERROR: malformed shape templates, %d bytes\n"), cbTemplates);
+		return false;
+	}
+	return true;
 }
 
-HWND GetParentWindowForAnyClassName(HWND hwnd, const CString targetClassNames[], int nTargetClassNames, int maxLevelsUp, CString& className) {
-	int levels = 0;
-	int index = -1;
-	HWND hwndParent = hwnd;
-	while (hwndParent && levels <= maxLevelsUp && index < 0) {
-		hwnd = hwndParent;
-		hwndParent = GetRealParent(hwnd);
-
-		int nCopied = GetClassName(hwnd, className.GetBuffer(MAX_PATH), MAX_PATH);
-		className.ReleaseBuffer(nCopied);
+// Gestures run by the script handler, none until FGH_SetGestureScript
+GestureScriptLibrary g_gestureScripts;
 
-		if (nCopied == 0)
-			return NULL;
-
-		index = ArrayFind(targetClassNames, nTargetClassNames, className);
-
-		levels++;
+bool SetGestureScript(const char* szScript) {
+	if (szScript == NULL) {
+		g_gestureScripts.clear();
+		return true;
 	}
-
-	return (index < 0) ? NULL : hwnd;
+	std::string strError;
+	if (!g_gestureScripts.load(szScript, strError)) {
+		ATLTRACE(_T("ERROR: gesture script does not compile, %S\n"), strError.c_str());
+		return false;
+	}
+	return true;
 }
 
-HWND VerifyAndGetTopMozillaWindowClassWindow(HWND hwndChild) {
-	static const CString inProcessWrapperClassName = _T("MozillaWindowClass");
-	static const CString targetWindowClassName = _T("MozillaWindowClass");
-	static const CString targetPluginWindowClassNames[] = {
-		inProcessWrapperClassName, _T("GeckoPluginWindow"), _T("GeckoFPSandboxChildWindow")
-	};
-	static const int nTargetPluginWindowClassNames = ARRAYSIZE(targetPluginWindowClassNames);
-	static const int nTargetPluginWindowClassNamesInProcess = 1;
-	static const CString lowIntegrityWindowClassNames[] = {
-		_T("GeckoFPSandboxChildWindow")
-	};
-	static const int nLowIntegrityWindowClassNames = ARRAYSIZE(lowIntegrityWindowClassNames);
-
-	CString intermediateClassName;
-	HWND hwndIntermediate = 
-		GetParentWindowForAnyClassName(hwndChild, targetPluginWindowClassNames,
-		IsInProcessWindow(hwndChild) ? nTargetPluginWindowClassNamesInProcess : nTargetPluginWindowClassNames,
-		10, intermediateClassName);
-	if (!hwndIntermediate)
-		return NULL;
-
-	HWND hwndTop = GetAncestor(hwndIntermediate, GA_ROOT);
-	if (hwndTop == hwndIntermediate)
-		return NULL;
-
-	// Bypass root window class checking, as we can't do it reliably in a low integrity process
-	if (0 <= ArrayFind(lowIntegrityWindowClassNames, nLowIntegrityWindowClassNames, intermediateClassName))
-		return hwndTop;
-
-	// Check root window class name
-	CString topClassName;
-	int nCopied = GetClassName(hwndTop, topClassName.GetBuffer(MAX_PATH), MAX_PATH);
-	topClassName.ReleaseBuffer(nCopied);
-	if (nCopied == 0 || topClassName != targetWindowClassName)
-		return NULL;
-
-	return hwndTop;
-}
+// How much triggered gestures thin out the moves they forward, nothing until FGH_SetMoveDecimation
+MoveDecimation g_moveDecimation;
 
-bool FilterFirefoxKey(int keyCode, bool bAltPressed, bool bCtrlPressed, bool bShiftPressed) {
-	if (bCtrlPressed && bAltPressed) {
-		// BUG FIX: Characters like @, #,  (and others that require AltGr on European keyboard layouts) cannot be entered in the plugin
-		// Suggested by Meyer Kuno (Helbling Technik): AltGr is represented in Windows massages as the combination of Alt+Ctrl, and that is used for text input, not for menu naviagation.
-		// 
-		switch (keyCode) {
-		case 'R': // Ctrl+Alt+R, Restart firefox
-			return true;
-		default:
-			return false;
-		}
-	} else if (bCtrlPressed) {
-		switch (keyCode) {
-		case VK_CONTROL: // Only Ctrl is pressed
-		case VK_MENU: // Might be in AltGr up sequence
-			return false;
-		case VK_SHIFT: // Ctrl-Shift switching IME, should not lose focus
-		case VK_SPACE:
-		case VK_PROCESSKEY:
-			ATLTRACE(_T("VK_SHIFT, VK_SPACE or VK_PROCESSKEY\n"));
-			return false;
-
-		// The following shortcut keys will be handle by the plugin only and won't be sent to Firefox
-		case 'C': // Ctrl+C, Copy
-		case 'V': // Ctrl+V, Paste
-		case 'X': // Ctrl+X, Cut
-		case 'A': // Ctrl+A, Select All
-		case 'Z': // Ctrl+Z, undo
-		case 'Y': // Ctrl+Y, redo 
-		case VK_HOME: // Ctrl+HOME, Scroll to Top
-		case VK_END:  // Ctrl+END, Scroll to end
-		case VK_LEFT: // Ctrl+L/R, Jump to prev/next word
-		case VK_RIGHT:
-		case VK_UP: // Ctrl+U/D, identical to Up/Down
-		case VK_DOWN:
-		case VK_RETURN: // Ctrl-Return, fast post on Baidu Tieba & potentially other places
-			return false;
-		default:
-			ATLTRACE(_T("Forwarded firefox key with keyCode = %d\n"), keyCode);
-			return true;
-		}
-	} else if (bAltPressed) {
-		return true;
-	} else {
-		switch (keyCode) {
-		case VK_F2: // Developer toolbar
-			return bShiftPressed;
-		case VK_F3: // find next, with shift: find prev
-			return true;
-		case VK_F4: // Shift-F4 opens Scratchpad which is very handy
-			return bShiftPressed;
-		case VK_F5: // Refresh or Performance tab in Developer Tools (Shift-F5)
-			return true;
-		case VK_F6: // Locate the address bar
-			return !bShiftPressed;
-		case VK_F7: // Style Editor
-			return bShiftPressed;
-		case VK_F8: // Shift-F8 opens WebIDE
-			return bShiftPressed;
-		case VK_F10: // Locate the menu bar
-			return !bShiftPressed;
-		case VK_F11: // full screen
-			return !bShiftPressed;
-		case VK_F12: // Firebug
-			return !bShiftPressed;
-		default:
-			return false;
-		}
+bool SetMoveDecimation(DWORD dwMinDistance, DWORD msMaxInterval) {
+	if (!g_moveDecimation.set(static_cast<int>(dwMinDistance), msMaxInterval)) {
+		ATLTRACE(_T("ERROR: move decimation out of range, %u px, %u ms\n"), dwMinDistance, msMaxInterval);
+		return false;
 	}
-
-	return false;
+	return true;
 }
 
-bool ForwardFirefoxKeyMessage(HWND hwndFirefox, MSG* pMsg) {
-	bool bAltPressed = HIBYTE(GetKeyState(VK_MENU)) != 0;
-	bool bCtrlPressed = HIBYTE(GetKeyState(VK_CONTROL)) != 0;
-	bool bShiftPressed = HIBYTE(GetKeyState(VK_SHIFT)) != 0;
-
-	static MSG s_pendingAltDown = { 0 };
+// Applies g_pSharedConfig to the settings above and to each hook thread's handlers
+SharedConfigSync g_sharedConfigSync(g_hotkeyRules, g_moveDecimation);
 
-	ATLTRACE(_T("ForwardFirefoxKeyMessage MSG: %x wParam: %x, lPara: %x\n"), pMsg->message, pMsg->wParam, pMsg->lParam);
-	if (bAltPressed && !bCtrlPressed && pMsg->wParam == VK_MENU) {
-		// Alt without Ctrl is pressed. We'll delay sending the Alt down message, in case Ctrl is pressed
-		// before Alt up.  AltGr is represented in Windows massages as the combination of Alt+Ctrl, and 
-		// that is used for text input, not for menu naviagation.
-		s_pendingAltDown = *pMsg;
-		ATLTRACE(_T("ForwardFirefoxKeyMessage : Alt pending...\n"));
+bool SetSharedConfig(const void* pConfig, DWORD cbConfig) {
+	SharedConfigBlock* pSharedConfig = OpenSharedConfigForWrite();
+	if (pSharedConfig == NULL) {
+		ATLTRACE(_T("ERROR: shared config is not mapped\n"));
 		return false;
-	} else if (bCtrlPressed) {
-		if (s_pendingAltDown.message != WM_NULL) {
-			// Clear the pending Alt down message as Ctrl is pressed.
-			s_pendingAltDown.message = WM_NULL;
-			ATLTRACE(_T("ForwardFirefoxKeyMessage : Cleared pending Alt.\n"));
-		}
 	}
-
-	// Send Alt key up message to Firefox, so that user could select the main window menu by press alt key.
-	if (pMsg->message == WM_SYSKEYUP && pMsg->wParam == VK_MENU) {
-		if (s_pendingAltDown.message != WM_NULL) {
-			// Send the pending Alt down message first.
-			::SetFocus(hwndFirefox);
-			::PostMessage(hwndFirefox, s_pendingAltDown.message, s_pendingAltDown.wParam, s_pendingAltDown.lParam);
-			s_pendingAltDown.message = WM_NULL;
-			bAltPressed = true;
-			ATLTRACE(_T("ForwardFirefoxKeyMessage : Sent pending Alt.\n"));
-		}
+	// an older extension leaves out the fields appended since, a newer one adds fields this build ignores
+	SharedConfig config;
+	if (pConfig == NULL || cbConfig < SHARED_CONFIG_MIN_SIZE) {
+		ATLTRACE(_T("ERROR: shared config of %d bytes, expected at least %d\n"), cbConfig, SHARED_CONFIG_MIN_SIZE);
+		return false;
 	}
-	// Might be in AltGr up sequence, skip
-	else if (pMsg->message == WM_SYSKEYUP && pMsg->wParam == VK_CONTROL) {
-		ATLTRACE(_T("ForwardFirefoxKeyMessage : Return from AltGr up sequence.\n"));
+	memset(&config, 0, sizeof(config));
+	memcpy(&config, pConfig, cbConfig < sizeof(config) ? cbConfig : sizeof(config));
+	config.cbSize = sizeof(config);
+	if (!IsValidSharedConfig(config)) {
+		ATLTRACE(_T("ERROR: malformed shared config\n"));
 		return false;
 	}
-
-	if (bCtrlPressed || bAltPressed || (pMsg->wParam >= VK_F1 && pMsg->wParam <= VK_F24)) {
-		int nKeyCode = static_cast<int>(pMsg->wParam);
-		if (FilterFirefoxKey(nKeyCode, bAltPressed, bCtrlPressed, bShiftPressed)) {
-			::SetFocus(hwndFirefox);
-			::PostMessage(hwndFirefox, pMsg->message, pMsg->wParam, pMsg->lParam);
-			return true;
-		}
+	if (!pSharedConfig->write(config)) {
+		ATLTRACE(_T("ERROR: shared config is locked by an unfinished write\n"));
+		return false;
 	}
-	return false;
+	return true;
 }
 
-bool ForwardFirefoxMouseMessage(HWND hwndFirefox, MSG* pMsg) {
-	const std::vector<GestureHandler*>& handlers = GestureHandler::getHandlers();
-
-	// Forward the mouse message if any guesture handler is triggered.
-	for (std::vector<GestureHandler*>::const_iterator iter = handlers.begin();
-		 iter != handlers.end(); ++iter) {
-		if ((*iter)->getState() == GS_Triggered) {
-			GestureHandler* triggeredHandler = *iter;
-			MessageHandleResult res = triggeredHandler->handleMessage(pMsg);
-			if (res == MHR_GestureEnd) {
-				for (std::vector<GestureHandler*>::const_iterator iter = handlers.begin();
-					 iter != handlers.end(); ++iter) {
-					(*iter)->reset();
-				}
-			}
-			// Forward the mousemove message to let firefox track the guesture.
-			GestureHandler::forwardTarget(pMsg, hwndFirefox);
-			return true;
-		}
-	}
+bool ForwardFirefoxKeyMessage(HWND hwndFirefox, MSG* pMsg) {
+	ThreadLocalStorage& tls = ThreadLocalStorage::GetInstance();
 
-	// Check if we could trigger a mouse guesture.
-	bool bShouldSwallow = false;
-	for (GestureHandler* handler: handlers) {
-		MessageHandleResult res = handler->handleMessage(pMsg);
-		bShouldSwallow = bShouldSwallow || handler->shouldSwallow(res);
-		if (res == MHR_Triggered) {
-			handler->forwardAllTarget(pMsg->hwnd, hwndFirefox);
-			break;
-		} else if (res == MHR_Canceled) {
-			bool bShouldForwardBack = true;
-			for (const GestureHandler* h : handlers) {
-				if (h->getState() != GS_None) {
-					bShouldForwardBack = false;
-					break;
-				}
-			}
-			if (bShouldForwardBack) {
-				handler->forwardAllOrigin(pMsg->hwnd);
-				for (GestureHandler* h : handlers) {
-					h->reset();
-				}
-			}
-		}
+	ATLTRACE(_T("ForwardFirefoxKeyMessage MSG: %x wParam: %x, lPara: %x\n"), pMsg->message, pMsg->wParam, pMsg->lParam);
+	KeyDecision decision = tls.modifiers.filterKey(ToGestureMessage(pMsg), g_hotkeyRules);
+	if (decision.bPostPendingAlt) {
+		const GestureMessage& altDown = decision.pendingAltDown;
+		::SetFocus(hwndFirefox);
+		::PostMessage(hwndFirefox, altDown.message, altDown.wParam, altDown.lParam);
+		tls.hookStats.count(HC_ForwardedKey);
+		ATLTRACE(_T("ForwardFirefoxKeyMessage : Sent pending Alt.\n"));
 	}
-	return bShouldSwallow;
+	if (decision.bForward) {
+		ATLTRACE(_T("Forwarded firefox key with keyCode = %d\n"), pMsg->wParam);
+		::SetFocus(hwndFirefox);
+		::PostMessage(hwndFirefox, pMsg->message, pMsg->wParam, pMsg->lParam);
+		tls.hookStats.count(HC_ForwardedKey);
+	}
+	return decision.bForward;
+}
+
+bool ForwardFirefoxMouseMessage(HWND hwndFirefox, MSG* pMsg) {
+	GestureHandlers& handlers = ThreadLocalStorage::GetInstance().gestureHandlers;
+	Win32ChannelForwarder forwarder(ToGestureWindow(hwndFirefox));
+	return handlers.handleMouseMessage(forwarder, ToGestureWindow(hwndFirefox), ToGestureMessage(pMsg), pMsg->time);
 }
 
 bool ForwardZoomMessage(HWND hwndFirefox, MSG* pMsg) {
-	bool bCtrlPressed = HIBYTE(GetKeyState(VK_CONTROL)) != 0;
+	bool bCtrlPressed = ThreadLocalStorage::GetInstance().modifiers.isCtrlDown();
 	bool bShouldForward = bCtrlPressed && pMsg->message == WM_MOUSEWHEEL;
 	if (bShouldForward) {
 		ATLTRACE(_T("Ctrl+Wheel forwarded.\n"));
-		GestureHandler::forwardTarget(pMsg, hwndFirefox);
+		GestureWindow hwndOrigin = ToGestureWindow(pMsg->hwnd), hwndTarget = ToGestureWindow(hwndFirefox);
+		Win32ChannelForwarder forwarder(hwndTarget);
+		GestureHandler::forwardTarget(forwarder, ToGestureMessage(pMsg), hwndTarget, forwarder.getClientOffset(hwndOrigin, hwndTarget));
+		ThreadLocalStorage::GetInstance().hookStats.count(HC_ForwardedZoom);
 	}
 	return bShouldForward;
 }
 
+void RecordFlight(FlightRecorder& recorder, const MSG* pMsg, UINT message, uint64_t nsStart, uint64_t nsLatency,
+				  uint8_t decision, const uint8_t* aResults) {
+	FlightRecord& record = recorder.next();
+	record.timestampNs = nsStart;
+	record.hwnd = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(pMsg->hwnd));
+	record.wParam = static_cast<uint32_t>(pMsg->wParam);
+	record.lParam = static_cast<uint32_t>(pMsg->lParam);
+	record.latencyNs = nsLatency > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(nsLatency);
+	record.message = static_cast<uint16_t>(message);
+	record.decision = decision;
+	record.reserved = 0;
+	if (aResults)
+		memcpy(record.aResults, aResults, sizeof(record.aResults));
+	else
+		memset(record.aResults, FLIGHT_NOT_RUN, sizeof(record.aResults));
+	recorder.commit();
+}
+
+static void TrackModifiers(ThreadLocalStorage& tls, const MSG* pMsg) {
+	if (WM_KEYFIRST <= pMsg->message && pMsg->message <= WM_KEYLAST)
+		tls.modifiers.onKeyMessage(g_keyStateSource, ToGestureMessage(pMsg), pMsg->time);
+	else
+		tls.modifiers.onMouseMessage(ToGestureMessage(pMsg));
+}
+
 LRESULT CALLBACK GetMsgHook(int nCode, WPARAM wParam, LPARAM lParam) {
-	bool& bReentranceGuard = ThreadLocalStorage::GetInstance().bGetMsgHookReentranceGuard;
+	// Hotkeys of recognized strokes come to the firefox window as commands, typed here in its own thread,
+	// which is always hooked and usually has no storage
+	if (nCode >= 0 && wParam == PM_REMOVE && lParam && IsHotkeyCommandMessage(reinterpret_cast<MSG *>(lParam)->message)) {
+		TypeHotkeyCommand(reinterpret_cast<MSG *>(lParam));
+		return CallNextHookEx(NULL, nCode, wParam, lParam);
+	}
+
+	// Threads get their storage when they first see a message for a firefox plugin window,
+	// until then they have nothing to track and nothing can reenter
+	ThreadLocalStorage* pTLS = ThreadLocalStorage::GetExisting();
 
-	if (nCode < 0 || bReentranceGuard) // Prevent reentrance problems caused by SendMessage
+	// While the shared config asks for it, the input trace gets the key and mouse messages such a thread
+	// removes, before anything is filtered out, so that a replay sees what the hook saw; typed keys are masked
+	if (pTLS && nCode >= 0 && wParam == PM_REMOVE && lParam) {
+		bool bCapture = (g_sharedConfigSync.getFlags() & SCF_CaptureInput) != 0;
+		if (bCapture || g_bInputCaptureOpen.load(std::memory_order_relaxed))
+			CaptureInput(*pTLS, reinterpret_cast<MSG *>(lParam), bCapture);
+	}
+
+	// A thread with storage only looks at the messages in its interest mask: keys, button presses and
+	// whatever its gesture handlers could react to in their current state. Paints, timers and the moves
+	// between gestures leave after a single bit test.
+	if (pTLS && nCode >= 0 && lParam) {
+		uint32_t interestBit = MessageInterestBit(reinterpret_cast<MSG *>(lParam)->message);
+		if (!(pTLS->gestureHandlers.getInterest() & interestBit)) {
+			if (interestBit && wParam == PM_REMOVE)
+				pTLS->hookStats.count(HC_FastExits);
+			return CallNextHookEx(NULL, nCode, wParam, lParam);
+		}
+	}
+
+	if (nCode < 0 || (pTLS && pTLS->bGetMsgHookReentranceGuard)) // Prevent reentrance problems caused by SendMessage
 	{
-		if (bReentranceGuard)
+		if (nCode >= 0)
 			ATLTRACE(_T("GetMsgHook WARNING: reentered.\n"));
 		return CallNextHookEx(NULL, nCode, wParam, lParam);
 	}
-	bReentranceGuard = true;
+	if (pTLS)
+		pTLS->bGetMsgHookReentranceGuard = true;
 
 	if (wParam == PM_REMOVE && lParam) {
 		MSG * pMsg = reinterpret_cast<MSG *>(lParam);
 		HWND hwnd = pMsg->hwnd;
 
 		// here we only handle keyboard messages and mouse button messages
-		if (!(WM_KEYFIRST <= pMsg->message && pMsg->message <= WM_KEYLAST) && !(WM_MOUSEFIRST <= pMsg->message && pMsg->message <= WM_MOUSELAST) || hwnd == NULL) {
+		if ((!(WM_KEYFIRST <= pMsg->message && pMsg->message <= WM_KEYLAST) && !(WM_MOUSEFIRST <= pMsg->message && pMsg->message <= WM_MOUSELAST)) || hwnd == NULL) {
 			goto Exit;
 		}
 
-		// for WM_MOUSEMOVE, if none of the gesture handlers are initiated or triggered, 
-		// just exit here to avoid comparing window class names (improves performance)
-		if (pMsg->message == WM_MOUSEMOVE) {
-			bool bAllInactive = true;
-			const vector<GestureHandler*>& handlers = GestureHandler::getHandlers();
-			for (GestureHandler* pHandler : handlers) {
-				if (pHandler->getEnabled() && pHandler->getState() != GS_None) {
-					bAllInactive = false;
-					break;
-				}
-			}
-			if (bAllInactive) goto Exit;
+		if (pTLS) {
+			pTLS->hookStats.count(HC_MessagesSeen);
+			// keep track of the modifier keys, whichever window the message is for
+			TrackModifiers(*pTLS, pMsg);
+			// a single load unless the extension changed the shared config
+			if (g_pSharedConfig)
+				g_sharedConfigSync.sync(*g_pSharedConfig, pTLS->gestureHandlers, pTLS->sharedConfigVersion);
 		}
 
-		// Get top MozillaWindowClass object from the window hierarchy
-		HWND hwndFirefox = VerifyAndGetTopMozillaWindowClassWindow(hwnd);
-		if (hwndFirefox == NULL) {
+		// without storage no gesture can be going on, moves are too frequent to compare window class names
+		if (pMsg->message == WM_MOUSEMOVE && pTLS == NULL)
 			goto Exit;
+
+		// only the slow path below is timed, the fast exits are just counted
+		uint64_t nsStart = HookTimestampNs();
+
+		// Get top MozillaWindowClass object from the window hierarchy
+		HWND hwndFirefox;
+		if (pTLS == NULL) {
+			// Without storage there is no root cache either, button and key messages are rare enough to walk the tree
+			hwndFirefox = ToHWND(VerifyAndGetTopMozillaWindowClassWindow(g_windowTree, ToGestureWindow(hwnd)));
+			if (hwndFirefox == NULL)
+				goto Exit;
+			pTLS = &ThreadLocalStorage::GetInstance();
+			pTLS->bGetMsgHookReentranceGuard = true;
+			pTLS->hookStats.count(HC_MessagesSeen);
+			pTLS->hookStats.count(HC_RootLookups);
+			pTLS->hookStats.count(HC_RootCacheMisses);
+			TrackModifiers(*pTLS, pMsg);
+			if (g_pSharedConfig)
+				g_sharedConfigSync.sync(*g_pSharedConfig, pTLS->gestureHandlers, pTLS->sharedConfigVersion);
+		} else {
+			pTLS->hookStats.count(HC_RootLookups);
+			FirefoxRootCache& rootCache = pTLS->firefoxRootCache;
+			size_t nHits = rootCache.getHits();
+			size_t nInvalidations = rootCache.getInvalidations();
+			hwndFirefox = ToHWND(rootCache.resolve(g_windowTree, ToGestureWindow(hwnd)));
+			pTLS->hookStats.count(rootCache.getHits() != nHits ? HC_RootCacheHits : HC_RootCacheMisses);
+			if (rootCache.getInvalidations() != nInvalidations)
+				pTLS->hookStats.count(HC_RootCacheInvalidations, static_cast<uint32_t>(rootCache.getInvalidations() - nInvalidations));
+			if (hwndFirefox == NULL) {
+				uint64_t nsLatency = HookTimestampNs() - nsStart;
+				pTLS->hookStats.recordLatency(nsLatency);
+				RecordFlight(pTLS->flightRecorder, pMsg, pMsg->message, nsStart, nsLatency, FD_NoFirefox, NULL);
+				goto Exit;
+			}
 		}
 
+		ThreadLocalStorage& tls = *pTLS;
+		UINT message = pMsg->message;
 		bool bShouldSwallow = false;
+		uint8_t decision = 0;
+		const uint8_t* aResults = NULL;
 
 		if (WM_KEYFIRST <= pMsg->message && pMsg->message <= WM_KEYLAST) {
 			// Forward the key press messages to firefox
 			if (pMsg->message == WM_KEYDOWN || pMsg->message == WM_SYSKEYDOWN || pMsg->message == WM_SYSKEYUP) {
 				bShouldSwallow = bShouldSwallow || ForwardFirefoxKeyMessage(hwndFirefox, pMsg);
+				if (bShouldSwallow)
+					decision |= FD_ForwardedKey;
 			}
 		}
 
 		// Check if we should enable mouse gestures
 		if (WM_MOUSEFIRST <= pMsg->message && pMsg->message <= WM_MOUSELAST) {
 			bShouldSwallow = bShouldSwallow || ForwardFirefoxMouseMessage(hwndFirefox, pMsg);
+			decision |= tls.gestureHandlers.m_lastDecision;
+			aResults = tls.gestureHandlers.m_aLastResults;
 		}
 
 		// Check if we should handle Ctrl+Wheel zooming
-		bShouldSwallow = bShouldSwallow || ForwardZoomMessage(hwndFirefox, pMsg);
+		if (!bShouldSwallow && ForwardZoomMessage(hwndFirefox, pMsg)) {
+			bShouldSwallow = true;
+			decision |= FD_ForwardedZoom;
+		}
 
 		if (bShouldSwallow) {
 			ATLTRACE(_T("GetMsgHook SWALLOWED.\n"));
+			tls.hookStats.count(HC_Swallowed);
+			decision |= FD_Swallowed;
 			pMsg->message = WM_NULL;
 		}
+		uint64_t nsLatency = HookTimestampNs() - nsStart;
+		tls.hookStats.recordLatency(nsLatency);
+		RecordFlight(tls.flightRecorder, pMsg, message, nsStart, nsLatency, decision, aResults);
 	}
 Exit:
-	bReentranceGuard = false;
+	if (pTLS)
+		pTLS->bGetMsgHookReentranceGuard = false;
 	return CallNextHookEx(NULL, nCode, wParam, lParam);
 }
@@ -0,0 +1,123 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "HookInitStatus.h"
+
+HookInitStatus::HookInitStatus() {
+	m_state.store(HIP_NotStarted, std::memory_order_relaxed);
+	m_nHookedThreads.store(0, std::memory_order_relaxed);
+	m_dwLastError.store(0, std::memory_order_relaxed);
+	m_nsBegin.store(0, std::memory_order_relaxed);
+	m_usThreadStarted.store(0, std::memory_order_relaxed);
+	m_usFirstHook.store(0, std::memory_order_relaxed);
+}
+
+uint32_t HookInitStatus::microsecondsSinceBegin(uint64_t nsNow) const {
+	uint64_t us = (nsNow - m_nsBegin.load(std::memory_order_relaxed)) / 1000;
+	// 0 means "not reached yet"
+	if (us == 0)
+		return 1;
+	return us > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(us);
+}
+
+bool HookInitStatus::begin(uint64_t nsNow) {
+	uint32_t state = m_state.load(std::memory_order_relaxed);
+	do {
+		if (state != HIP_NotStarted && state != HIP_Failed)
+			return false;
+	} while (!m_state.compare_exchange_weak(state, HIP_Starting, std::memory_order_acq_rel));
+	// nobody reads the timings before the thread has started, apart from pollers who see zeroes
+	m_nsBegin.store(nsNow, std::memory_order_relaxed);
+	m_nHookedThreads.store(0, std::memory_order_relaxed);
+	m_dwLastError.store(0, std::memory_order_relaxed);
+	m_usThreadStarted.store(0, std::memory_order_relaxed);
+	m_usFirstHook.store(0, std::memory_order_relaxed);
+	return true;
+}
+
+void HookInitStatus::fail(uint32_t dwLastError) {
+	m_dwLastError.store(dwLastError, std::memory_order_relaxed);
+	uint32_t state = m_state.load(std::memory_order_relaxed);
+	do {
+		if ((state & PHASE_MASK) != HIP_Starting)
+			return;
+	} while (!m_state.compare_exchange_weak(state, HIP_Failed, std::memory_order_acq_rel));
+}
+
+bool HookInitStatus::threadStarted(uint64_t nsNow, bool* pbInstall) {
+	*pbInstall = false;
+	uint32_t state = m_state.load(std::memory_order_relaxed);
+	do {
+		if ((state & PHASE_MASK) != HIP_Starting)
+			return false;
+	} while (!m_state.compare_exchange_weak(state, HIP_ThreadStarted, std::memory_order_acq_rel));
+	m_usThreadStarted.store(microsecondsSinceBegin(nsNow), std::memory_order_relaxed);
+	*pbInstall = (state & DEFERRED_INSTALL) != 0;
+	return true;
+}
+
+void HookInitStatus::installPassCompleted(uint32_t nHookedThreads, uint64_t nsNow) {
+	setHookedThreads(nHookedThreads);
+	if (nHookedThreads && m_usFirstHook.load(std::memory_order_relaxed) == 0)
+		m_usFirstHook.store(microsecondsSinceBegin(nsNow), std::memory_order_relaxed);
+	uint32_t state = HIP_ThreadStarted;
+	m_state.compare_exchange_strong(state, HIP_HooksInstalled, std::memory_order_acq_rel);
+}
+
+bool HookInitStatus::deferInstall() {
+	uint32_t state = m_state.load(std::memory_order_relaxed);
+	do {
+		if ((state & PHASE_MASK) != HIP_Starting)
+			return false;
+	} while (!m_state.compare_exchange_weak(state, state | DEFERRED_INSTALL, std::memory_order_acq_rel));
+	return true;
+}
+
+bool HookInitStatus::deferUninstall() {
+	uint32_t state = m_state.load(std::memory_order_relaxed);
+	do {
+		if ((state & PHASE_MASK) != HIP_Starting)
+			return false;
+	} while (!m_state.compare_exchange_weak(state, state & ~DEFERRED_INSTALL, std::memory_order_acq_rel));
+	return true;
+}
+
+HookInitPhase HookInitStatus::requestStop() {
+	uint32_t state = m_state.load(std::memory_order_relaxed);
+	do {
+		HookInitPhase phase = static_cast<HookInitPhase>(state & PHASE_MASK);
+		if (phase == HIP_NotStarted || phase == HIP_Failed || phase == HIP_Stopping)
+			return phase;
+	} while (!m_state.compare_exchange_weak(state, HIP_Stopping, std::memory_order_acq_rel));
+	return static_cast<HookInitPhase>(state & PHASE_MASK);
+}
+
+void HookInitStatus::stopped() {
+	m_nHookedThreads.store(0, std::memory_order_relaxed);
+	uint32_t state = HIP_Stopping;
+	m_state.compare_exchange_strong(state, HIP_NotStarted, std::memory_order_acq_rel);
+}
+
+void HookInitStatus::snapshot(HookInitSnapshot& snapshot) const {
+	snapshot.cbSize = sizeof(snapshot);
+	snapshot.phase = phase();
+	snapshot.nHookedThreads = m_nHookedThreads.load(std::memory_order_relaxed);
+	snapshot.dwLastError = m_dwLastError.load(std::memory_order_relaxed);
+	snapshot.usThreadStarted = m_usThreadStarted.load(std::memory_order_relaxed);
+	snapshot.usFirstHook = m_usFirstHook.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,108 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Startup of the hook manage thread as seen by the browser, which must never block on it.
+// FGH_InitializeAsync only starts the thread; the phase, the number of hooked threads and the
+// startup timings are published here and polled through FGH_GetInitStatus.
+// Install requests made before the thread can receive messages are deferred to its startup.
+
+#include <stdint.h>
+#include <atomic>
+
+/* Values are part of the FGH_GetInitStatus interface, append only */
+enum HookInitPhase {
+	HIP_NotStarted = 0,
+	/* the hook manage thread has been created but cannot receive messages yet */
+	HIP_Starting = 1,
+	/* the thread is running, no install pass has completed yet */
+	HIP_ThreadStarted = 2,
+	/* at least one install pass has completed */
+	HIP_HooksInstalled = 3,
+	/* Uninitialize has been called, the hook manage thread has not exited yet */
+	HIP_Stopping = 4,
+	/* the thread could not be created, see dwLastError */
+	HIP_Failed = 5,
+};
+
+/*
+ * As returned by FGH_GetInitStatus.
+ * The extension reads this through js-ctypes, so fields may only be appended.
+ */
+struct HookInitSnapshot {
+	uint32_t cbSize;
+	uint32_t phase;
+	/* threads hooked right now */
+	uint32_t nHookedThreads;
+	uint32_t dwLastError;
+	/* microseconds from FGH_InitializeAsync to the thread starting and to the first hook, 0 until then */
+	uint32_t usThreadStarted;
+	uint32_t usFirstHook;
+};
+
+class HookInitStatus {
+public:
+	HookInitStatus();
+
+	HookInitPhase phase() const { return static_cast<HookInitPhase>(m_state.load(std::memory_order_acquire) & PHASE_MASK); }
+
+	/* NotStarted or Failed to Starting, false if the thread is already running or has not stopped yet */
+	bool begin(uint64_t nsNow);
+	/* Starting to Failed */
+	void fail(uint32_t dwLastError);
+	/*
+	 * Called by the hook manage thread once it can receive messages, Starting to ThreadStarted.
+	 * Returns false if Uninitialize came first, the thread must then exit without hooking anything.
+	 * *pbInstall tells whether installs were deferred while starting.
+	 */
+	bool threadStarted(uint64_t nsNow, bool* pbInstall);
+	/* Records an install pass of the hook manage thread, ThreadStarted to HooksInstalled */
+	void installPassCompleted(uint32_t nHookedThreads, uint64_t nsNow);
+	void setHookedThreads(uint32_t nHookedThreads) { m_nHookedThreads.store(nHookedThreads, std::memory_order_relaxed); }
+
+	/*
+	 * While Starting, install requests cannot be posted yet and are remembered instead.
+	 * Returns false once the thread has started, the request must then be posted as usual.
+	 */
+	bool deferInstall();
+	/* Undoes deferred installs, false once the thread has started */
+	bool deferUninstall();
+
+	/* Moves to Stopping and returns the phase before */
+	HookInitPhase requestStop();
+	/* Stopping to NotStarted, Initialize may be called again */
+	void stopped();
+
+	void snapshot(HookInitSnapshot& snapshot) const;
+private:
+	static const uint32_t PHASE_MASK = 0xff;
+	static const uint32_t DEFERRED_INSTALL = 0x100;
+
+	/* The phase and the deferred requests change together, so no request slips past threadStarted */
+	std::atomic<uint32_t> m_state;
+	std::atomic<uint32_t> m_nHookedThreads;
+	std::atomic<uint32_t> m_dwLastError;
+	std::atomic<uint64_t> m_nsBegin;
+	std::atomic<uint32_t> m_usThreadStarted;
+	std::atomic<uint32_t> m_usFirstHook;
+
+	uint32_t microsecondsSinceBegin(uint64_t nsNow) const;
+
+	HookInitStatus(const HookInitStatus&);
+	HookInitStatus& operator=(const HookInitStatus&);
+};
@@ -0,0 +1,45 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "HookInstall.h"
+
+HookInstallBatch::HookInstallBatch() : m_bAll(false), m_nRequests(0) {}
+
+void HookInstallBatch::clear() {
+	m_bAll = false;
+	m_vWindows.clear();
+	m_nRequests = 0;
+}
+
+void HookInstallBatch::collectThreads(WindowTree& tree, uint32_t idMainThread, uint32_t idMainProcess,
+									  ThreadProcessMap& mapThreads) const {
+	mapThreads.insert(std::make_pair(idMainThread, idMainProcess));
+
+	std::vector<GestureWindow> vWindows;
+	if (m_bAll)
+		tree.getChildWindowsOfThread(idMainThread, vWindows);
+	// a targeted window need not descend from the main thread's windows, so it is looked up either way
+	vWindows.insert(vWindows.end(), m_vWindows.begin(), m_vWindows.end());
+
+	for (GestureWindow hwnd : vWindows) {
+		uint32_t idProcess = 0;
+		uint32_t idThread = tree.getWindowThread(hwnd, &idProcess);
+		if (idThread)
+			mapThreads.insert(std::make_pair(idThread, idProcess));
+	}
+}
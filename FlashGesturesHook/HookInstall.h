@@ -0,0 +1,51 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Install requests queued up in the hook manage thread are handled together in one pass.
+// Only a request for all windows enumerates the window hierarchy; hooking a single plugin window
+// just looks up the thread that owns it.
+
+#include "WindowTree.h"
+
+#include <unordered_map>
+#include <vector>
+
+/* Thread id to the id of its process */
+typedef std::unordered_map<uint32_t, uint32_t> ThreadProcessMap;
+
+class HookInstallBatch {
+public:
+	HookInstallBatch();
+
+	/* FGH_InstallHook: every thread owning a child window of the main thread's top level windows */
+	void requestAll() { m_bAll = true; m_nRequests++; }
+	/* FGH_InstallHookForWindow: the thread owning hwnd */
+	void requestWindow(GestureWindow hwnd) { m_vWindows.push_back(hwnd); m_nRequests++; }
+	bool empty() const { return m_nRequests == 0; }
+	/* Number of requests merged into this batch */
+	size_t size() const { return m_nRequests; }
+	void clear();
+
+	/* Adds the threads to hook to mapThreads, the main thread is always among them */
+	void collectThreads(WindowTree& tree, uint32_t idMainThread, uint32_t idMainProcess, ThreadProcessMap& mapThreads) const;
+private:
+	bool m_bAll;
+	std::vector<GestureWindow> m_vWindows;
+	size_t m_nRequests;
+};
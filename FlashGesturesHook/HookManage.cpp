@@ -18,6 +18,14 @@ along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
 #include "stdafx.h"
 
 #include "ExportFunctionsInternal.h"
+#include "HookInitStatus.h"
+#include "HookInstall.h"
+#include "HookRegistry.h"
+#include "ThreadLocal.h"
+#include "Win32GestureChannel.h"
+#include "Win32ThreadExitWaiter.h"
+#include "Win32WakeupChannel.h"
+#include "Win32WindowTree.h"
 #include <unordered_map>
 
 using namespace std;
@@ -29,9 +37,11 @@ DWORD g_idCurrentProcess = 0;
 uintptr_t g_hHookManageThread = 0;
 unsigned int g_idHookManagerThread = 0;
 
-unordered_map<DWORD, HHOOK> g_mapHookByThreadId;
-vector<HANDLE> g_vThreadsToWait;
-vector<DWORD> g_vThreadIdsToWait;
+// Only touched by the hook manage thread
+HookRegistry g_hookRegistry;
+
+// Polled by FGH_GetInitStatus, written by both the main thread and the hook manage thread
+HookInitStatus g_initStatus;
 
 #ifdef _DEBUG
 struct DetailedHookInformation {
@@ -43,10 +53,38 @@ unordered_map<DWORD, DetailedHookInformation> g_mapHookInfoByThreadId;
 #endif
 
 HMODULE g_hThisModule = NULL;
+// The hook manage thread's reference to the dll, taken before it is created and released as it exits
+static HMODULE s_hManageThreadModule = NULL;
 
 const UINT USERMESSAGE_INSTALL_HOOK = WM_USER + 20;
 const UINT USERMESSAGE_UNINSTALL_HOOK = WM_USER + 21;
 const UINT USERMESSAGE_EXIT_THREAD = WM_USER + 22;
+const UINT USERMESSAGE_THREAD_EXITED = WM_USER + 23;
+const UINT USERMESSAGE_INSTALL_HOOK_FOR_WINDOW = WM_USER + 24;
+
+// Uninitialize stops waiting for the hook manage thread after this, it is only slower if unhooking hangs
+const DWORD SHUTDOWN_DEADLINE_MS = WAKEUP_DEADLINE_MS + 1000;
+
+/* Hands thread exits over to the hook manage thread, wParam is the hook's slot */
+class HookManagerExitSink : public ThreadExitSink {
+public:
+	void threadExited(HookSlot slot) {
+		if (!PostThreadMessage((DWORD)g_idHookManagerThread, USERMESSAGE_THREAD_EXITED, slot, 0))
+			ATLTRACE(_T("ERROR: PostThreadMessage(USERMESSAGE_THREAD_EXITED) failed, last error = %d\n"), GetLastError());
+	}
+};
+HookManagerExitSink g_hookManagerExitSink;
+
+void UnhookEntry(const HookEntry& entry) {
+	g_threadExitWaiter.unwatch(entry.wait);
+	UnhookWindowsHookEx(reinterpret_cast<HHOOK>(entry.hook));
+#ifdef _DEBUG
+	const DetailedHookInformation& info = g_mapHookInfoByThreadId[entry.idThread];
+	ATLTRACE(_T("Unhooked: %s, PID=%d, TID=%d\n"),
+			 info.fileName, info.idProcess, info.idThread);
+	g_mapHookInfoByThreadId.erase(entry.idThread);
+#endif
+}
 
 bool InstallHookForThread(DWORD idThread, DWORD idProcess) {
 #ifdef _DEBUG
@@ -62,7 +100,9 @@ bool InstallHookForThread(DWORD idThread, DWORD idProcess) {
 		? SetWindowsHookEx(WH_GETMESSAGE, GetMsgHook, NULL, idThread)
 		: SetWindowsHookEx(WH_GETMESSAGE, GetMsgHook, g_hThisModule, idThread);
 	if (hhook != NULL) {
-		g_mapHookByThreadId[idThread] = hhook;
+		HookSlot slot = g_hookRegistry.insert(idThread, reinterpret_cast<uintptr_t>(hhook));
+		// threads we cannot wait for stay hooked until the next uninstall, as before
+		g_hookRegistry.get(slot)->wait = g_threadExitWaiter.watch(idThread, slot, g_hookManagerExitSink);
 #ifdef _DEBUG
 		ATLTRACE(_T("Hooked: %s, PID=%d, TID=%d\n"), fileName, idProcess, idThread);
 		DetailedHookInformation hookInfo = { idProcess, idThread, fileName };
@@ -75,72 +115,28 @@ bool InstallHookForThread(DWORD idThread, DWORD idProcess) {
 	return hhook != NULL;
 }
 
-BOOL CALLBACK GetChildWindowsCallback(HWND hwnd, LPARAM lParam) {
-	vector<HWND>& vWindows = *(reinterpret_cast<vector<HWND>*>(lParam));
-	vWindows.push_back(hwnd);
-	return TRUE;
-}
-
-BOOL CALLBACK GetTopLevelWindowsCallback(HWND hwnd, LPARAM lParam) {
-	EnumChildWindows(hwnd, GetChildWindowsCallback, lParam);
-	return TRUE;
-}
-
-vector<HWND> GetChildWindows() {
-	vector<HWND> vWindows;
-	EnumThreadWindows(g_idMainThread, GetTopLevelWindowsCallback, reinterpret_cast<LPARAM>(&vWindows));
-	return vWindows;
-}
-
-bool InstallAllHooks() {
-	vector<HWND> vHWNDChildWindows = GetChildWindows();
-	unordered_map<DWORD, DWORD> mapIdThreadsToHook = { make_pair(g_idMainThread, g_idCurrentProcess) };
-	for (HWND hwnd : vHWNDChildWindows) {
-		DWORD idProcess = 0;
-		DWORD idThread = GetWindowThreadProcessId(hwnd, &idProcess);
-		if (idThread)
-			mapIdThreadsToHook.insert(make_pair(idThread, idProcess));
-	}
+void InstallHooks(HookInstallBatch& batch) {
+	if (batch.empty())
+		return;
+	ATLTRACE(_T("Installing hooks for %d merged request(s)\n"), batch.size());
+	ThreadProcessMap mapIdThreadsToHook;
+	batch.collectThreads(g_windowTree, g_idMainThread, g_idCurrentProcess, mapIdThreadsToHook);
+	batch.clear();
 
 	for (auto pair : mapIdThreadsToHook) {
 		DWORD idThread = pair.first;
 		DWORD idProcess = pair.second;
-		if (g_mapHookByThreadId.find(idThread) == g_mapHookByThreadId.end())
+		if (g_hookRegistry.find(idThread) == INVALID_HOOK_SLOT)
 			InstallHookForThread(idThread, idProcess);
 	}
-
-	g_vThreadsToWait.clear();
-	g_vThreadIdsToWait.clear();
-	for (auto pair : g_mapHookByThreadId) {
-		DWORD idThread = pair.first;
-		HANDLE hThread = OpenThread(SYNCHRONIZE, FALSE, idThread);
-		if (hThread != NULL) {
-			g_vThreadsToWait.push_back(hThread);
-			g_vThreadIdsToWait.push_back(idThread);
-		}
-	}
-
-	return true;
+	g_initStatus.installPassCompleted(static_cast<uint32_t>(g_hookRegistry.size()), HookTimestampNs());
 }
 
 bool UninstallAllHooks() {
-	for (HANDLE hThread : g_vThreadsToWait)
-		CloseHandle(hThread);
-	for (auto pair : g_mapHookByThreadId) {
-		UnhookWindowsHookEx(pair.second);
-#ifdef _DEBUG
-		const DetailedHookInformation& info = g_mapHookInfoByThreadId[pair.first];
-		ATLTRACE(_T("Unhooked: %s, PID=%d, TID=%d\n"),
-				 info.fileName, info.idProcess, info.idThread);
-#endif
-	}
-
-	g_vThreadsToWait.clear();
-	g_vThreadIdsToWait.clear();
-	g_mapHookByThreadId.clear();
-#ifdef _DEBUG
-	g_mapHookInfoByThreadId.clear();
-#endif
+	for (const HookEntry& entry : g_hookRegistry)
+		UnhookEntry(entry);
+	g_hookRegistry.clear();
+	g_initStatus.setHookedThreads(0);
 
 	return true;
 }
@@ -148,84 +144,133 @@ bool UninstallAllHooks() {
 void WakeUpMessageLoops() {
 	// Send all child windows a message to wake their message loop up
 	unordered_map<DWORD, HWND> mapThreadToHWND;
-	for (HWND hwnd : GetChildWindows()) {
-		DWORD idThread = GetWindowThreadProcessId(hwnd, NULL);
+	vector<GestureWindow> vChildWindows;
+	g_windowTree.getChildWindowsOfThread(g_idMainThread, vChildWindows);
+	for (GestureWindow hwnd : vChildWindows) {
+		DWORD idThread = g_windowTree.getWindowThread(hwnd, NULL);
 		if (idThread && mapThreadToHWND.find(idThread) == mapThreadToHWND.end()) {
-			mapThreadToHWND.insert(make_pair(idThread, hwnd));
+			mapThreadToHWND.insert(make_pair(idThread, ToHWND(hwnd)));
 		}
 	}
+	vector<GestureWindow> vWindowsToWake;
 	for (auto pair : mapThreadToHWND) {
 		// Do not disturb the main thread, it should be waiting for us (the hook manage thread)
 		if (pair.first == g_idMainThread)
 			continue;
 
-		HWND hwnd = pair.second;
-		SendMessageTimeout(hwnd, WM_NULL, 0, 0,
-						   SMTO_BLOCK | SMTO_ABORTIFHUNG | SMTO_NOTIMEOUTIFNOTHUNG, 200, NULL);
+		vWindowsToWake.push_back(ToGestureWindow(pair.second));
 	}
+	// All threads are woken up at once, hung ones cannot hold us up for longer than WAKEUP_DEADLINE_MS in total
+	Win32WakeupChannel channel;
+	WakeupReport report = WakeUpWindows(channel, vWindowsToWake);
+	ATLTRACE(_T("Woke up %d of %d thread(s) in %d ms, %d hung, %d timed out, %d failed\n"), report.nCompleted,
+			 report.nWindows, report.msElapsed, report.nHung, report.nTimedOut, report.nFailed);
 }
 
 unsigned int __stdcall HookManageThread(void* vpStartEvent) {
+	// NULL when started by InitializeAsync, nobody waits for us then
 	HANDLE hStartEvent = reinterpret_cast<HANDLE>(vpStartEvent);
-	if (!SetEvent(hStartEvent)) {
+	// Keeps the dll loaded while this thread runs, even if Uninitialize gives up waiting for it
+	HMODULE hPinnedModule = s_hManageThreadModule;
+	// _beginthreadex may not have stored our id yet, but hooks installed below already report to it
+	g_idHookManagerThread = GetCurrentThreadId();
+	// Create the message queue, PostThreadMessage fails until then
+	MSG msgPeek;
+	PeekMessage(&msgPeek, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+	bool bDeferredInstall = false;
+	bool bRunning = g_initStatus.threadStarted(HookTimestampNs(), &bDeferredInstall);
+	if (hStartEvent && !SetEvent(hStartEvent)) {
 		ATLTRACE(_T("ERROR: cannot set start event, last error = %d\n"), GetLastError());
 		ATLASSERT(false);
-		return 1;
+		FreeLibraryAndExitThread(hPinnedModule, 1);
+	}
+	if (!bRunning) {
+		ATLTRACE(_T("HookManageThread: uninitialized before it started\n"));
+		FreeLibraryAndExitThread(hPinnedModule, 0);
 	}
-	// Pump a message-wait loop
+	// Plugin processes hand their gesture messages to this thread from now on
+	AttachGestureChannelConsumer();
+	if (bDeferredInstall) {
+		HookInstallBatch batch;
+		batch.requestAll();
+		InstallHooks(batch);
+	}
+	// Pump a message-wait loop, hooked threads' exits arrive as USERMESSAGE_THREAD_EXITED
 	while (true) {
-		DWORD nCount = (DWORD)g_vThreadsToWait.size();
-		if (nCount >= MAXIMUM_WAIT_OBJECTS)
-			nCount = MAXIMUM_WAIT_OBJECTS - 1;
-		DWORD ret = MsgWaitForMultipleObjects(nCount, nCount ? &g_vThreadsToWait[0] : NULL, FALSE, INFINITE, QS_ALLINPUT);
-		if (ret == WAIT_OBJECT_0 + nCount) {
+		DWORD ret = MsgWaitForMultipleObjects(0, NULL, FALSE, INFINITE, QS_ALLINPUT);
+		if (ret == WAIT_OBJECT_0) {
+			// Install requests that queued up are merged and handled once the queue is empty
+			HookInstallBatch batch;
 			MSG msg;
 			while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
 				switch (msg.message) {
 				case USERMESSAGE_INSTALL_HOOK:
-					InstallAllHooks();
+					batch.requestAll();
+					break;
+				case USERMESSAGE_INSTALL_HOOK_FOR_WINDOW:
+					batch.requestWindow(static_cast<GestureWindow>(msg.wParam));
+					break;
+				case USERMESSAGE_CHANNEL_WAKEUP:
+					DeliverGestureChannelEvents();
 					break;
 				case USERMESSAGE_UNINSTALL_HOOK:
+					// installs queued before the uninstall would be undone right away
+					batch.clear();
 					UninstallAllHooks();
 					break;
+				case USERMESSAGE_THREAD_EXITED:
+					// stale if the hook has been uninstalled since
+					if (HookEntry* pEntry = g_hookRegistry.get(static_cast<HookSlot>(msg.wParam))) {
+						UnhookEntry(*pEntry);
+						g_hookRegistry.remove(pEntry->slot);
+						g_initStatus.setHookedThreads(static_cast<uint32_t>(g_hookRegistry.size()));
+					}
+					break;
 				case USERMESSAGE_EXIT_THREAD:
 					// Have we cleaned up yet?
-					if (g_mapHookByThreadId.size())
+					if (g_hookRegistry.size())
 						UninstallAllHooks();
+					DetachGestureChannelConsumer();
 					// HACK: Wake child windows' message loop up so they'll have a chance to unload the dll
 					WakeUpMessageLoops();
 					// Never return again...
+					FreeLibraryAndExitThread(hPinnedModule, 0);
 					return 0;
 				default:
 					break;
 				}
 			}
-		} else if (ret >= WAIT_OBJECT_0 && ret < WAIT_OBJECT_0 + nCount) {
-			size_t nIndex = ret - WAIT_OBJECT_0;
-			HANDLE hThread = g_vThreadsToWait[nIndex];
-			DWORD idThread = g_vThreadIdsToWait[nIndex];
-			HHOOK hhook = g_mapHookByThreadId[idThread];
-			g_vThreadsToWait.erase(g_vThreadsToWait.begin() + nIndex);
-			g_vThreadIdsToWait.erase(g_vThreadIdsToWait.begin() + nIndex);
-			g_mapHookByThreadId.erase(idThread);
-
-			CloseHandle(hThread);
-			UnhookWindowsHookEx(hhook);
-#ifdef _DEBUG
-			const DetailedHookInformation& info = g_mapHookInfoByThreadId[idThread];
-			ATLTRACE(_T("Unhooked: %s, PID=%d, TID=%d\n"),
-					 info.fileName, info.idProcess, info.idThread);
-			g_mapHookInfoByThreadId.erase(idThread);
-#endif
+			InstallHooks(batch);
 		} else { // failed, timeout or whatever wierd reasons
 			ATLTRACE(_T("ERROR: failed MsgWaitForMultipleObjects, last error = %d\n"), ret == WAIT_FAILED ? GetLastError() : 0);
 		}
 	}
 }
 
-bool Initialize() {
-	if (g_idMainThread)
-		return true;
+/*
+ * Finishes an Uninitialize that gave up waiting for the hook manage thread, once the thread has exited.
+ * Until then the phase stays Stopping and no new thread is started, the old one may still be unhooking
+ * through g_hookRegistry.
+ */
+static void ReapHookManageThread() {
+	if (g_initStatus.phase() != HIP_Stopping || g_hHookManageThread == 0)
+		return;
+	HANDLE hHookManageThread = reinterpret_cast<HANDLE>(g_hHookManageThread);
+	if (WaitForSingleObject(hHookManageThread, 0) != WAIT_OBJECT_0)
+		return;
+	// GetInitStatus may race Uninitialize here, only one of them closes the handle
+	if (InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(&g_hHookManageThread), NULL,
+										  hHookManageThread) != hHookManageThread)
+		return;
+	CloseHandle(hHookManageThread);
+	g_idMainThread = 0;
+	g_initStatus.stopped();
+}
+
+static bool StartHookManageThread(bool bWaitForStart) {
+	ReapHookManageThread();
+	if (!g_initStatus.begin(HookTimestampNs()))
+		return g_initStatus.phase() != HIP_Stopping;
 
 	g_bIsInProcessHook = true;
 
@@ -236,47 +281,135 @@ bool Initialize() {
 		reinterpret_cast<LPCWSTR>(Initialize), &g_hThisModule))
 	{
 		ATLTRACE(_T("ERROR: failed to get module handle, last error = %d\n"), GetLastError());
+		g_initStatus.fail(GetLastError());
 		return false;
 	}
-	HANDLE hStartEvent = CreateEvent(0, FALSE, FALSE, 0);
-	if (hStartEvent == NULL) {
-		ATLTRACE(_T("ERROR: cannot create start event, last error = %d\n"), GetLastError());
-		FreeLibrary(g_hThisModule);
+	// Taken here rather than by the thread, so that it never runs without it
+	if (!GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, reinterpret_cast<LPCWSTR>(HookManageThread),
+		&s_hManageThreadModule))
+	{
+		ATLTRACE(_T("ERROR: failed to pin the module for HookManageThread, last error = %d\n"), GetLastError());
+		g_initStatus.fail(GetLastError());
 		return false;
 	}
+	HANDLE hStartEvent = NULL;
+	if (bWaitForStart) {
+		hStartEvent = CreateEvent(0, FALSE, FALSE, 0);
+		if (hStartEvent == NULL) {
+			ATLTRACE(_T("ERROR: cannot create start event, last error = %d\n"), GetLastError());
+			g_initStatus.fail(GetLastError());
+			FreeLibrary(s_hManageThreadModule);
+			FreeLibrary(g_hThisModule);
+			return false;
+		}
+	}
 	g_hHookManageThread = _beginthreadex(NULL, 0, HookManageThread,
 										 reinterpret_cast<void*>(hStartEvent), 0, &g_idHookManagerThread);
 	if (g_hHookManageThread == 0) {
 		ATLTRACE(_T("ERROR: cannot create HookManageThread, last error = %d\n"), _doserrno);
-		CloseHandle(hStartEvent);
+		g_initStatus.fail(_doserrno);
+		if (hStartEvent)
+			CloseHandle(hStartEvent);
+		FreeLibrary(s_hManageThreadModule);
 		FreeLibrary(g_hThisModule);
 		return false;
 	}
-	WaitForSingleObject(hStartEvent, INFINITE);
-	CloseHandle(hStartEvent);
+	if (hStartEvent) {
+		WaitForSingleObject(hStartEvent, INFINITE);
+		CloseHandle(hStartEvent);
+	}
 
 	return true;
 }
 
+bool Initialize() {
+	return StartHookManageThread(true);
+}
+
+bool InitializeAsync() {
+	return StartHookManageThread(false);
+}
+
 bool InstallHook() {
+	// the hook manage thread installs them as soon as it has started
+	if (g_initStatus.deferInstall())
+		return true;
 	if (PostThreadMessage((DWORD)g_idHookManagerThread, USERMESSAGE_INSTALL_HOOK, 0, 0))
 		return true;
 	ATLTRACE(_T("ERROR: PostThreadMessage(USERMESSAGE_INSTALL_HOOK) failed, last error = %d\n"), GetLastError());
 	return false;
 }
 
+bool InstallHookForWindow(HWND hwnd) {
+	// cannot be queued before the hook manage thread has started, so it becomes an install for all windows
+	if (g_initStatus.deferInstall())
+		return true;
+	if (PostThreadMessage((DWORD)g_idHookManagerThread, USERMESSAGE_INSTALL_HOOK_FOR_WINDOW, reinterpret_cast<WPARAM>(hwnd), 0))
+		return true;
+	ATLTRACE(_T("ERROR: PostThreadMessage(USERMESSAGE_INSTALL_HOOK_FOR_WINDOW) failed, last error = %d\n"), GetLastError());
+	return false;
+}
+
 void UninstallHook() {
+	if (g_initStatus.deferUninstall())
+		return;
 	if (!PostThreadMessage((DWORD)g_idHookManagerThread, USERMESSAGE_UNINSTALL_HOOK, 0, 0))
 		ATLTRACE(_T("ERROR: PostThreadMessage(USERMESSAGE_UNINSTALL_HOOK) failed, last error = %d\n"), GetLastError());
 }
 
-void Uninitialize() {
-	if (!PostThreadMessage((DWORD)g_idHookManagerThread, USERMESSAGE_EXIT_THREAD, 0, 0))
+DWORD Uninitialize() {
+	uint64_t nsStart = HookTimestampNs();
+	ReapHookManageThread();
+	HookInitPhase phase = g_initStatus.requestStop();
+	if (phase == HIP_NotStarted || phase == HIP_Failed || phase == HIP_Stopping)
+		return 0;
+	// A thread that has not started yet sees the stop request itself and exits
+	if (phase != HIP_Starting && !PostThreadMessage((DWORD)g_idHookManagerThread, USERMESSAGE_EXIT_THREAD, 0, 0))
 		ATLTRACE(_T("ERROR: PostThreadMessage(USERMESSAGE_EXIT_THREAD) failed, last error = %d\n"), GetLastError());
 	HANDLE hHookManageThread = reinterpret_cast<HANDLE>(g_hHookManageThread);
-	WaitForSingleObject(hHookManageThread, INFINITE);
-	CloseHandle(hHookManageThread);
+	if (WaitForSingleObject(hHookManageThread, SHUTDOWN_DEADLINE_MS) == WAIT_OBJECT_0) {
+		// Re-initialize? Probably
+		ReapHookManageThread();
+	} else {
+		ATLTRACE(_T("ERROR: HookManageThread did not exit within %d ms, leaving it behind, Stopping until it exits\n"),
+				 SHUTDOWN_DEADLINE_MS);
+	}
 
-	// Re-initialize? Probably
-	g_idMainThread = 0;
+	DWORD msElapsed = static_cast<DWORD>((HookTimestampNs() - nsStart) / 1000000);
+	ATLTRACE(_T("Uninitialized in %d ms\n"), msElapsed);
+	return msElapsed;
+}
+
+DWORD GetInitStatus(void* pBuffer, DWORD cbBuffer) {
+	ReapHookManageThread();
+	HookInitSnapshot snapshot;
+	g_initStatus.snapshot(snapshot);
+	if (pBuffer)
+		memcpy(pBuffer, &snapshot, min(static_cast<size_t>(cbBuffer), sizeof(snapshot)));
+	return sizeof(snapshot);
+}
+
+DWORD GetStats(void* pBuffer, DWORD cbBuffer) {
+	HookStatsSnapshot snapshot;
+	ThreadLocalStorage::SnapshotStats(snapshot);
+	if (pBuffer)
+		memcpy(pBuffer, &snapshot, min(static_cast<size_t>(cbBuffer), sizeof(snapshot)));
+	return sizeof(snapshot);
+}
+
+bool DumpFlightRecorder(const wchar_t* szPath) {
+	FlightDump dump;
+	GestureHandlers().getHandlerNames(dump.vHandlerNames);
+	ThreadLocalStorage::SnapshotFlightRecorders(dump.vRings);
+
+	FILE* pFile = NULL;
+	if (_wfopen_s(&pFile, szPath, L"wb") != 0 || pFile == NULL) {
+		ATLTRACE(_T("ERROR: cannot open flight recorder dump %s\n"), szPath);
+		return false;
+	}
+	bool bSucceeded = WriteFlightDump(pFile, dump);
+	fclose(pFile);
+	if (!bSucceeded)
+		ATLTRACE(_T("ERROR: failed to write flight recorder dump %s\n"), szPath);
+	return bSucceeded;
 }
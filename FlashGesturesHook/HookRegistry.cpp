@@ -0,0 +1,106 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "HookRegistry.h"
+
+static uint32_t SlotIndex(HookSlot slot) {
+	return slot & HOOK_SLOT_INDEX_MASK;
+}
+
+static uint32_t SlotGeneration(HookSlot slot) {
+	return slot >> HOOK_SLOT_INDEX_BITS;
+}
+
+static HookSlot MakeSlot(uint32_t index, uint32_t generation) {
+	return index | (generation << HOOK_SLOT_INDEX_BITS);
+}
+
+/* Generations wrap, a notification would have to be 4096 reuses late to be mistaken for current */
+static uint32_t NextGeneration(HookSlot slot) {
+	return (SlotGeneration(slot) + 1) & (0xffffffffu >> HOOK_SLOT_INDEX_BITS);
+}
+
+HookRegistry::HookRegistry() : m_iFirstFreeSlot(NO_FREE_SLOT) {}
+
+HookSlot HookRegistry::find(uint32_t idThread) const {
+	auto iter = m_mapSlotByThreadId.find(idThread);
+	return iter == m_mapSlotByThreadId.end() ? INVALID_HOOK_SLOT : iter->second;
+}
+
+HookSlot HookRegistry::insert(uint32_t idThread, uintptr_t hook) {
+	ATLASSERT(find(idThread) == INVALID_HOOK_SLOT);
+	uint32_t index = m_iFirstFreeSlot;
+	if (index != NO_FREE_SLOT) {
+		m_iFirstFreeSlot = m_vSlots[index].iEntryOrNextFree;
+	} else {
+		index = static_cast<uint32_t>(m_vSlots.size());
+		ATLASSERT(index < HOOK_SLOT_INDEX_MASK);
+		SlotInfo info = { 0, 0 };
+		m_vSlots.push_back(info);
+	}
+	SlotInfo& info = m_vSlots[index];
+	info.iEntryOrNextFree = static_cast<uint32_t>(m_vEntries.size());
+
+	HookEntry entry = { MakeSlot(index, info.generation), idThread, hook, 0 };
+	m_vEntries.push_back(entry);
+	m_mapSlotByThreadId[idThread] = entry.slot;
+	return entry.slot;
+}
+
+HookEntry* HookRegistry::get(HookSlot slot) {
+	uint32_t index = SlotIndex(slot);
+	if (slot == INVALID_HOOK_SLOT || index >= m_vSlots.size())
+		return NULL;
+	// a free slot holds the next free index instead, whatever entry that hits belongs to another slot
+	uint32_t iEntry = m_vSlots[index].iEntryOrNextFree;
+	if (iEntry >= m_vEntries.size() || m_vEntries[iEntry].slot != slot)
+		return NULL;
+	return &m_vEntries[iEntry];
+}
+
+bool HookRegistry::remove(HookSlot slot) {
+	HookEntry* pEntry = get(slot);
+	if (pEntry == NULL)
+		return false;
+	m_mapSlotByThreadId.erase(pEntry->idThread);
+
+	uint32_t index = SlotIndex(slot);
+	uint32_t iEntry = m_vSlots[index].iEntryOrNextFree;
+	if (iEntry + 1 != m_vEntries.size()) {
+		m_vEntries[iEntry] = m_vEntries.back();
+		m_vSlots[SlotIndex(m_vEntries[iEntry].slot)].iEntryOrNextFree = iEntry;
+	}
+	m_vEntries.pop_back();
+
+	m_vSlots[index].generation = NextGeneration(slot);
+	m_vSlots[index].iEntryOrNextFree = m_iFirstFreeSlot;
+	m_iFirstFreeSlot = index;
+	return true;
+}
+
+void HookRegistry::clear() {
+	// keep the generations, so that late notifications stay stale
+	for (const HookEntry& entry : m_vEntries) {
+		uint32_t index = SlotIndex(entry.slot);
+		m_vSlots[index].generation = NextGeneration(entry.slot);
+		m_vSlots[index].iEntryOrNextFree = m_iFirstFreeSlot;
+		m_iFirstFreeSlot = index;
+	}
+	m_vEntries.clear();
+	m_mapSlotByThreadId.clear();
+}
@@ -0,0 +1,96 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Bookkeeping of the installed hooks, owned by the hook manage thread.
+// Hooks live in a slot map: a slot names an entry for O(1) access and removal, and carries a
+// generation so that exit notifications for a hook that is already gone are recognized as stale.
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+/* Index in the low HOOK_SLOT_INDEX_BITS bits, generation above */
+typedef uint32_t HookSlot;
+const int HOOK_SLOT_INDEX_BITS = 20;
+const uint32_t HOOK_SLOT_INDEX_MASK = (1u << HOOK_SLOT_INDEX_BITS) - 1;
+const HookSlot INVALID_HOOK_SLOT = 0xffffffff;
+
+/* Receives the exits of watched threads, may be called on any thread */
+class ThreadExitSink {
+public:
+	virtual void threadExited(HookSlot slot) = 0;
+protected:
+	~ThreadExitSink() {}
+};
+
+/* Watches hooked threads for exit, implemented with thread pool waits in the hook dll */
+class ThreadExitWaiter {
+public:
+	/* Reports slot to sink once idThread has exited. Returns a wait to pass to unwatch, 0 on failure */
+	virtual uintptr_t watch(uint32_t idThread, HookSlot slot, ThreadExitSink& sink) = 0;
+	/* Cancels a wait. A notification that was already reported may still be on its way */
+	virtual void unwatch(uintptr_t wait) = 0;
+protected:
+	~ThreadExitWaiter() {}
+};
+
+struct HookEntry {
+	HookSlot slot;
+	uint32_t idThread;
+	/* HHOOK */
+	uintptr_t hook;
+	/* from ThreadExitWaiter::watch, 0 if the thread is not watched */
+	uintptr_t wait;
+};
+
+class HookRegistry {
+public:
+	HookRegistry();
+
+	/* INVALID_HOOK_SLOT if idThread is not hooked */
+	HookSlot find(uint32_t idThread) const;
+	/* idThread must not be hooked yet */
+	HookSlot insert(uint32_t idThread, uintptr_t hook);
+	/* NULL if slot has been removed since */
+	HookEntry* get(HookSlot slot);
+	/* false if slot has been removed already */
+	bool remove(HookSlot slot);
+	void clear();
+
+	size_t size() const { return m_vEntries.size(); }
+	/* Entries in no particular order, removing invalidates them */
+	HookEntry* begin() { return m_vEntries.empty() ? NULL : &m_vEntries[0]; }
+	HookEntry* end() { return begin() + m_vEntries.size(); }
+private:
+	/* m_vSlots[index] holds the current generation and the entry's position, or the next free index */
+	struct SlotInfo {
+		uint32_t generation;
+		uint32_t iEntryOrNextFree;
+	};
+	static const uint32_t NO_FREE_SLOT = 0xffffffff;
+
+	std::vector<SlotInfo> m_vSlots;
+	uint32_t m_iFirstFreeSlot;
+	/* dense, removal moves the last entry into the hole */
+	std::vector<HookEntry> m_vEntries;
+	std::unordered_map<uint32_t, HookSlot> m_mapSlotByThreadId;
+
+	HookRegistry(const HookRegistry&);
+	HookRegistry& operator=(const HookRegistry&);
+};
@@ -0,0 +1,72 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "HookStats.h"
+
+#include <cstddef>
+#ifndef _WIN32
+#include <chrono>
+#endif
+
+// Consumers built against the first published snapshot find the latency histogram here
+static_assert(offsetof(HookStatsSnapshot, aLatencyNs) == 2 * sizeof(uint32_t) + 9 * sizeof(uint64_t),
+			  "HookStatsSnapshot fields may only be appended");
+
+HookThreadStats::HookThreadStats() {
+	for (int i = 0; i < HC_Count; i++)
+		m_aCounters[i].store(0, std::memory_order_relaxed);
+	for (int i = 0; i < HOOK_LATENCY_BUCKETS; i++)
+		m_aLatencyNs[i].store(0, std::memory_order_relaxed);
+}
+
+void HookThreadStats::addTo(HookStatsSnapshot& snapshot) const {
+	for (int i = 0; i < HC_Count; i++)
+		snapshot.counter(static_cast<HookCounterId>(i)) += m_aCounters[i].load(std::memory_order_relaxed);
+	for (int i = 0; i < HOOK_LATENCY_BUCKETS; i++)
+		snapshot.aLatencyNs[i] += m_aLatencyNs[i].load(std::memory_order_relaxed);
+}
+
+void InitHookStatsSnapshot(HookStatsSnapshot& snapshot) {
+	memset(&snapshot, 0, sizeof(snapshot));
+	snapshot.cbSize = sizeof(snapshot);
+}
+
+#ifdef _WIN32
+
+static double GetNsPerPerformanceTick() {
+	LARGE_INTEGER liFrequency;
+	QueryPerformanceFrequency(&liFrequency);
+	return 1e9 / static_cast<double>(liFrequency.QuadPart);
+}
+
+static const double g_dNsPerPerformanceTick = GetNsPerPerformanceTick();
+
+uint64_t HookTimestampNs() {
+	LARGE_INTEGER liCounter;
+	QueryPerformanceCounter(&liCounter);
+	return static_cast<uint64_t>(static_cast<double>(liCounter.QuadPart) * g_dNsPerPerformanceTick);
+}
+
+#else
+
+uint64_t HookTimestampNs() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+#endif
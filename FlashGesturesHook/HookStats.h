@@ -0,0 +1,115 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Counters and latency histograms of the message hook.
+// Each hooked thread only ever writes its own HookThreadStats, so counting needs no locked
+// instructions; other threads merely read them when a snapshot is taken.
+
+#include <stdint.h>
+#include <atomic>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+enum HookCounterId {
+	// Before the interest masks every key and mouse message was seen, and the idle moves among them were
+	// counted as fast exits as well. Now each message is counted once, so seen + fast exits is all input,
+	// and fast exits also include the button messages no handler can react to in its current state.
+	HC_MessagesSeen,     // PM_REMOVE keyboard and mouse messages a plugin thread was interested in
+	HC_FastExits,        // those it was not interested in, mostly mouse moves between gestures
+	HC_RootLookups,      // firefox root window lookups
+	HC_Swallowed,        // messages removed from the plugin's queue
+	HC_ForwardedTrace,   // messages forwarded by the trace gesture handler
+	HC_ForwardedRocker,  // messages forwarded by the rocker gesture handler
+	HC_ForwardedWheel,   // messages forwarded by the wheel gesture handler
+	HC_ForwardedKey,     // key presses forwarded to firefox
+	HC_ForwardedZoom,    // Ctrl+Wheel messages forwarded to firefox
+	// Counters added after the snapshot layout was published, they follow aLatencyNs in HookStatsSnapshot
+	HC_ForwardedScript,  // messages forwarded by the script gesture handler
+	HC_RootCacheHits,    // root lookups answered by the thread's FirefoxRootCache
+	HC_RootCacheMisses,  // root lookups that walked the window tree
+	HC_RootCacheInvalidations, // root cache entries dropped because a window was reparented or destroyed
+	HC_Count
+};
+
+/* First counter that HookStatsSnapshot keeps in aAppendedCounters rather than aCounters */
+const int HC_FirstAppended = HC_ForwardedScript;
+
+const int HOOK_LATENCY_BUCKETS = 32;
+const int HOOK_CACHE_LINE = 64;
+
+/*
+ * Process-wide totals as returned by FGH_GetStats.
+ * The extension reads this through js-ctypes, so fields may only be appended: new counters go to
+ * the end of HookCounterId, which grows aAppendedCounters and nothing before it.
+ */
+struct HookStatsSnapshot {
+	uint32_t cbSize;
+	/* threads that currently hold hook statistics */
+	uint32_t nThreads;
+	uint64_t aCounters[HC_FirstAppended];
+	/* aLatencyNs[i] counts hook calls that took [2^i, 2^(i+1)) ns, the last bucket is open ended */
+	uint64_t aLatencyNs[HOOK_LATENCY_BUCKETS];
+	/* counters from HC_FirstAppended on */
+	uint64_t aAppendedCounters[HC_Count - HC_FirstAppended];
+
+	uint64_t& counter(HookCounterId id) { return id < HC_FirstAppended ? aCounters[id] : aAppendedCounters[id - HC_FirstAppended]; }
+	uint64_t counter(HookCounterId id) const { return id < HC_FirstAppended ? aCounters[id] : aAppendedCounters[id - HC_FirstAppended]; }
+};
+
+/* Statistics of a single thread, padded so that no other thread's data shares its cache lines */
+class HookThreadStats {
+public:
+	HookThreadStats();
+
+	void count(HookCounterId id, uint32_t n = 1) { bump(m_aCounters[id], n); }
+	void recordLatency(uint64_t ns) { bump(m_aLatencyNs[LatencyBucket(ns)], 1); }
+	/* Adds this thread's numbers to snapshot, may be called from any thread */
+	void addTo(HookStatsSnapshot& snapshot) const;
+
+	static int LatencyBucket(uint64_t ns) {
+		uint32_t v = ns > 0xffffffffu ? 0xffffffffu : static_cast<uint32_t>(ns) | 1;
+#ifdef _MSC_VER
+		unsigned long iBit;
+		_BitScanReverse(&iBit, v);
+		return static_cast<int>(iBit);
+#else
+		return 31 - __builtin_clz(v);
+#endif
+	}
+private:
+	char m_padFront[HOOK_CACHE_LINE];
+	std::atomic<uint32_t> m_aCounters[HC_Count];
+	std::atomic<uint32_t> m_aLatencyNs[HOOK_LATENCY_BUCKETS];
+	char m_padBack[HOOK_CACHE_LINE];
+
+	/* Single writer, so a plain load and store is enough */
+	static void bump(std::atomic<uint32_t>& counter, uint32_t n) {
+		counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	HookThreadStats(const HookThreadStats&);
+	HookThreadStats& operator=(const HookThreadStats&);
+};
+
+void InitHookStatsSnapshot(HookStatsSnapshot& snapshot);
+
+/* Monotonic timestamp for latency measurements */
+uint64_t HookTimestampNs();
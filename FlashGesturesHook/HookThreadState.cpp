@@ -0,0 +1,107 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "HookThreadState.h"
+
+#include <atomic>
+#include <new>
+
+namespace {
+
+struct HOOK_CACHE_ALIGN PoolSlot {
+	char bytes[HOOK_POOL_SLOT_SIZE];
+};
+
+PoolSlot s_aPoolSlots[HookThreadState::POOL_SLOTS];
+/* bit i is set while slot i is in use */
+std::atomic<uint32_t> s_slotsInUse(0);
+
+void* AllocateAligned(size_t cb) {
+#ifdef _MSC_VER
+	return _aligned_malloc(cb, __alignof(HookThreadState));
+#else
+	void* p = NULL;
+	return posix_memalign(&p, alignof(HookThreadState), cb) == 0 ? p : NULL;
+#endif
+}
+
+void FreeAligned(void* p) {
+#ifdef _MSC_VER
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+}
+
+HookThreadState::HookThreadState(uint32_t idThread) :
+bGetMsgHookReentranceGuard(false), sharedConfigVersion(0), flightRecorder(idThread), pInputTrace(NULL),
+inputTraceGeneration(0) {
+	gestureHandlers.setStats(&hookStats);
+	gestureHandlers.setBaseInterest(BaseInterest());
+}
+
+uint32_t HookThreadState::BaseInterest() {
+	const unsigned int aPresses[] = {
+		GMSG_LBUTTONDOWN, GMSG_LBUTTONDBLCLK, GMSG_RBUTTONDOWN, GMSG_RBUTTONDBLCLK,
+		GMSG_MBUTTONDOWN, GMSG_MBUTTONDBLCLK, GMSG_XBUTTONDOWN, GMSG_XBUTTONDBLCLK
+	};
+	uint32_t interest = INTEREST_KEYS | MessageInterestBit(GMSG_MOUSEWHEEL);
+	for (unsigned int message : aPresses)
+		interest |= MessageInterestBit(message);
+	return interest;
+}
+
+void* HookThreadState::operator new(size_t cb) {
+	if (cb <= sizeof(PoolSlot)) {
+		uint32_t inUse = s_slotsInUse.load(std::memory_order_relaxed);
+		for (;;) {
+			int iSlot = 0;
+			while (iSlot < POOL_SLOTS && (inUse & (1u << iSlot)))
+				iSlot++;
+			if (iSlot == POOL_SLOTS)
+				break;
+			if (s_slotsInUse.compare_exchange_weak(inUse, inUse | (1u << iSlot), std::memory_order_acquire))
+				return &s_aPoolSlots[iSlot];
+		}
+	}
+	void* p = AllocateAligned(cb);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void HookThreadState::operator delete(void* p) {
+	if (p == NULL)
+		return;
+	PoolSlot* pSlot = static_cast<PoolSlot*>(p);
+	if (s_aPoolSlots <= pSlot && pSlot < s_aPoolSlots + POOL_SLOTS) {
+		s_slotsInUse.fetch_and(~(1u << (pSlot - s_aPoolSlots)), std::memory_order_release);
+		return;
+	}
+	FreeAligned(p);
+}
+
+int HookThreadState::PoolSlotsInUse() {
+	uint32_t inUse = s_slotsInUse.load(std::memory_order_relaxed);
+	int n = 0;
+	for (; inUse; inUse &= inUse - 1)
+		n++;
+	return n;
+}
@@ -0,0 +1,74 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Everything a hooked thread keeps between hook calls, in one block.
+// Blocks are only created for threads that actually host a firefox plugin window, and come from
+// a small static pool of cache line aligned slots, so the common case never touches the heap.
+
+#include "GestureHandler.h"
+#include "HookStats.h"
+#include "FlightRecorder.h"
+#include "ModifierTracker.h"
+#include "WindowTree.h"
+
+#ifdef _MSC_VER
+#define HOOK_CACHE_ALIGN __declspec(align(64))
+#else
+#define HOOK_CACHE_ALIGN __attribute__((aligned(64)))
+#endif
+
+class InputTraceEncoder;
+
+struct HOOK_CACHE_ALIGN HookThreadState {
+	/* Slots in the static pool, further blocks are allocated from the heap */
+	static const int POOL_SLOTS = 4;
+
+	GestureHandlers gestureHandlers;
+	FirefoxRootCache firefoxRootCache;
+	ModifierTracker modifiers;
+	bool bGetMsgHookReentranceGuard;
+	/* the SharedConfigBlock version gestureHandlers was last configured from */
+	uint32_t sharedConfigVersion;
+	HookThreadStats hookStats;
+	FlightRecorder flightRecorder;
+	/* This thread's encoder in the input trace being captured, owned by Win32InputCapture.cpp; stale unless inputTraceGeneration is current */
+	InputTraceEncoder* pInputTrace;
+	uint32_t inputTraceGeneration;
+
+	explicit HookThreadState(uint32_t idThread);
+
+	static void* operator new(size_t cb);
+	static void operator delete(void* p);
+	/* Number of pool slots currently in use */
+	static int PoolSlotsInUse();
+
+	/*
+	 * What GetMsgHook looks at in every thread, see GestureHandlers::setBaseInterest: every key message for
+	 * the modifier tracking, the wheel for Ctrl+Wheel zoom, and button presses, which are rare and pick up
+	 * configuration changes before a gesture could start.
+	 */
+	static uint32_t BaseInterest();
+
+private:
+	HookThreadState(const HookThreadState&);
+	HookThreadState& operator=(const HookThreadState&);
+};
+
+/* Bytes of a pool slot, a type derived from HookThreadState must not add members or it never gets one */
+const size_t HOOK_POOL_SLOT_SIZE = sizeof(HookThreadState);
@@ -0,0 +1,94 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "HotkeyRules.h"
+
+namespace {
+
+// Alt alone and Ctrl alone forward keys to firefox, AltGr (Ctrl+Alt) and plain keys do not.
+// AltGr is used for text input on European keyboard layouts, not for menu navigation.
+const uint8_t DEFAULT_FORWARD = HKM_Alt | HKM_ShiftAlt | HKM_Ctrl | HKM_ShiftCtrl;
+// Ctrl shortcuts the plugin handles by itself, Alt still forwards them
+const uint8_t PLUGIN_CTRL_KEYS = HKM_Alt | HKM_ShiftAlt;
+
+const uint8_t s_abDefaultRules[] = {
+	HOTKEY_RULES_VERSION,
+	DEFAULT_FORWARD,
+
+	'R', DEFAULT_FORWARD | HKM_CtrlAlt | HKM_ShiftCtrlAlt, // Ctrl+Alt+R, Restart firefox
+
+	GVK_CONTROL, PLUGIN_CTRL_KEYS, // Only Ctrl is pressed
+	GVK_MENU, PLUGIN_CTRL_KEYS, // Might be in AltGr up sequence
+	GVK_SHIFT, PLUGIN_CTRL_KEYS, // Ctrl-Shift switching IME, should not lose focus
+	GVK_SPACE, PLUGIN_CTRL_KEYS,
+	GVK_PROCESSKEY, PLUGIN_CTRL_KEYS,
+	'C', PLUGIN_CTRL_KEYS, // Ctrl+C, Copy
+	'V', PLUGIN_CTRL_KEYS, // Ctrl+V, Paste
+	'X', PLUGIN_CTRL_KEYS, // Ctrl+X, Cut
+	'A', PLUGIN_CTRL_KEYS, // Ctrl+A, Select All
+	'Z', PLUGIN_CTRL_KEYS, // Ctrl+Z, undo
+	'Y', PLUGIN_CTRL_KEYS, // Ctrl+Y, redo
+	GVK_HOME, PLUGIN_CTRL_KEYS, // Ctrl+HOME, Scroll to Top
+	GVK_END, PLUGIN_CTRL_KEYS, // Ctrl+END, Scroll to end
+	GVK_LEFT, PLUGIN_CTRL_KEYS, // Ctrl+L/R, Jump to prev/next word
+	GVK_RIGHT, PLUGIN_CTRL_KEYS,
+	GVK_UP, PLUGIN_CTRL_KEYS, // Ctrl+U/D, identical to Up/Down
+	GVK_DOWN, PLUGIN_CTRL_KEYS,
+	GVK_RETURN, PLUGIN_CTRL_KEYS, // Ctrl-Return, fast post on Baidu Tieba & potentially other places
+
+	GVK_F1 + 1, DEFAULT_FORWARD | HKM_Shift, // F2: Developer toolbar
+	GVK_F1 + 2, DEFAULT_FORWARD | HKM_None | HKM_Shift, // F3: find next, with shift: find prev
+	GVK_F1 + 3, DEFAULT_FORWARD | HKM_Shift, // F4: Shift-F4 opens Scratchpad which is very handy
+	GVK_F1 + 4, DEFAULT_FORWARD | HKM_None | HKM_Shift, // F5: Refresh or Performance tab in Developer Tools (Shift-F5)
+	GVK_F1 + 5, DEFAULT_FORWARD | HKM_None, // F6: Locate the address bar
+	GVK_F1 + 6, DEFAULT_FORWARD | HKM_Shift, // F7: Style Editor
+	GVK_F1 + 7, DEFAULT_FORWARD | HKM_Shift, // F8: Shift-F8 opens WebIDE
+	GVK_F1 + 9, DEFAULT_FORWARD | HKM_None, // F10: Locate the menu bar
+	GVK_F1 + 10, DEFAULT_FORWARD | HKM_None, // F11: full screen
+	GVK_F1 + 11, DEFAULT_FORWARD | HKM_None, // F12: Firebug
+};
+
+}
+
+HotkeyRules::HotkeyRules() {
+	loadDefaults();
+}
+
+bool HotkeyRules::load(const uint8_t* pBlob, size_t cbBlob) {
+	if (pBlob == NULL || cbBlob < 2 || pBlob[0] != HOTKEY_RULES_VERSION || (cbBlob - 2) % 2 != 0)
+		return false;
+
+	uint8_t aRules[256];
+	memset(aRules, pBlob[1], sizeof(aRules));
+	for (size_t i = 2; i < cbBlob; i += 2)
+		aRules[pBlob[i]] = pBlob[i + 1];
+	for (int keyCode = 0; keyCode < 256; keyCode++)
+		m_aRules[keyCode].store(aRules[keyCode], std::memory_order_relaxed);
+	return true;
+}
+
+void HotkeyRules::loadDefaults() {
+	size_t cbBlob;
+	const uint8_t* pBlob = GetDefaultBlob(cbBlob);
+	load(pBlob, cbBlob);
+}
+
+const uint8_t* HotkeyRules::GetDefaultBlob(size_t& cbBlob) {
+	cbBlob = sizeof(s_abDefaultRules);
+	return s_abDefaultRules;
+}
@@ -0,0 +1,92 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Which key presses in a plugin window are forwarded to firefox, as a table with one bit per
+// virtual-key code and modifier combination.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+/* Virtual-key codes the default rules refer to, values are identical to their VK_* counterparts */
+enum GestureVirtualKey {
+	GVK_RETURN = 0x0D,
+	GVK_SHIFT = 0x10,
+	GVK_CONTROL = 0x11,
+	GVK_MENU = 0x12,
+	GVK_SPACE = 0x20,
+	GVK_END = 0x23,
+	GVK_HOME = 0x24,
+	GVK_LEFT = 0x25,
+	GVK_UP = 0x26,
+	GVK_RIGHT = 0x27,
+	GVK_DOWN = 0x28,
+	GVK_F1 = 0x70,
+	GVK_F24 = 0x87,
+	GVK_PROCESSKEY = 0xE5,
+};
+
+/*
+ * Modifier combinations, one bit each in a rule.
+ * Bit i stands for the combination with (i & 1) Alt, (i & 2) Ctrl and (i & 4) Shift.
+ */
+enum HotkeyModifiers {
+	HKM_None = 0x01,
+	HKM_Alt = 0x02,
+	HKM_Ctrl = 0x04,
+	HKM_CtrlAlt = 0x08,
+	HKM_Shift = 0x10,
+	HKM_ShiftAlt = 0x20,
+	HKM_ShiftCtrl = 0x40,
+	HKM_ShiftCtrlAlt = 0x80,
+};
+
+/*
+ * Rule blob, as passed to FGH_SetHotkeyRules:
+ *   byte 0      HOTKEY_RULES_VERSION
+ *   byte 1      HotkeyModifiers that forward any key without a rule of its own
+ *   then pairs  virtual-key code, HotkeyModifiers that forward this key
+ */
+const uint8_t HOTKEY_RULES_VERSION = 1;
+
+class HotkeyRules {
+public:
+	/* Starts with the default rules */
+	HotkeyRules();
+
+	bool shouldForward(int keyCode, bool bAltPressed, bool bCtrlPressed, bool bShiftPressed) const {
+		int iModifiers = (bAltPressed ? 1 : 0) | (bCtrlPressed ? 2 : 0) | (bShiftPressed ? 4 : 0);
+		return (m_aRules[keyCode & 0xff].load(std::memory_order_relaxed) >> iModifiers) & 1;
+	}
+
+	/*
+	 * Replaces all rules, returns false and keeps the current ones if the blob is malformed.
+	 * Lookups on other threads see each key's old or new rule, never a mix within one key.
+	 */
+	bool load(const uint8_t* pBlob, size_t cbBlob);
+	void loadDefaults();
+
+	/* The built-in rules as a blob */
+	static const uint8_t* GetDefaultBlob(size_t& cbBlob);
+private:
+	std::atomic<uint8_t> m_aRules[256];
+
+	HotkeyRules(const HotkeyRules&);
+	HotkeyRules& operator=(const HotkeyRules&);
+};
@@ -0,0 +1,288 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "InputTrace.h"
+
+// Deep enough for any plugin window, the root lookup gives up after 10 levels
+static const int MAX_DESCRIBED_ANCESTORS = 32;
+
+static void AppendVarint(std::vector<uint8_t>& vOut, uint32_t value) {
+	while (value >= 0x80) {
+		vOut.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	vOut.push_back(static_cast<uint8_t>(value));
+}
+
+static void AppendZigzag(std::vector<uint8_t>& vOut, int value) {
+	AppendVarint(vOut, (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31));
+}
+
+static void AppendBytes(std::vector<uint8_t>& vOut, const void* p, size_t cb) {
+	const uint8_t* pBytes = static_cast<const uint8_t*>(p);
+	vOut.insert(vOut.end(), pBytes, pBytes + cb);
+}
+
+static bool IsMouseMessage(unsigned int message) {
+	return (message & ~0xfu) == GMSG_MOUSEMOVE;
+}
+
+bool MaskCapturedMessage(GestureMessage& msg, const ModifierTracker& modifiers, const HotkeyRules& rules) {
+	if (IsMouseMessage(msg.message))
+		return true;
+	if (msg.message != GMSG_KEYDOWN && msg.message != GMSG_KEYUP && msg.message != GMSG_SYSKEYDOWN && msg.message != GMSG_SYSKEYUP)
+		return false;
+	// GVK_SHIFT, GVK_CONTROL, GVK_MENU and their left and right variants
+	bool bModifier = (GVK_SHIFT <= msg.wParam && msg.wParam <= GVK_MENU) || (0xA0 <= msg.wParam && msg.wParam <= 0xA5);
+	// the keys ModifierTracker::filterKey asks the rules about
+	bool bAlt = modifiers.isAltDown(), bCtrl = modifiers.isCtrlDown();
+	bool bHotkey = (bAlt || bCtrl || (GVK_F1 <= msg.wParam && msg.wParam <= GVK_F24)) &&
+		rules.shouldForward(static_cast<int>(msg.wParam), bAlt, bCtrl, modifiers.isShiftDown());
+	if (!bModifier && !bHotkey) {
+		// the scan code and the extended key bit tell the key as well
+		msg.wParam = 0;
+		msg.lParam &= 0xE000FFFF;
+	}
+	return true;
+}
+
+void AppendInputTraceHeader(std::vector<uint8_t>& vOut) {
+	InputTraceHeader header = { INPUT_TRACE_MAGIC, INPUT_TRACE_VERSION, sizeof(InputTraceChunkHeader), 0 };
+	AppendBytes(vOut, &header, sizeof(header));
+}
+
+InputTraceEncoder::InputTraceEncoder(uint32_t idThread) : m_idThread(idThread), m_nMessages(0), m_baseTime(0),
+m_lastTime(0) {
+	memset(&m_last, 0, sizeof(m_last));
+}
+
+void InputTraceEncoder::describeWindows(GestureWindow hwnd, WindowTree& tree, GestureForwarder& forwarder) {
+	// ancestors first, so that a reader always knows a window's parent
+	GestureWindow ahwndChain[MAX_DESCRIBED_ANCESTORS];
+	int nChain = 0;
+	for (; hwnd && nChain < MAX_DESCRIBED_ANCESTORS && !m_setKnownWindows.count(static_cast<uint32_t>(hwnd));
+		 hwnd = tree.getParent(hwnd))
+		ahwndChain[nChain++] = hwnd;
+
+	while (nChain) {
+		hwnd = ahwndChain[--nChain];
+		m_setKnownWindows.insert(static_cast<uint32_t>(hwnd));
+		char szClassName[MAX_WINDOW_CLASS_NAME];
+		int cchClassName = tree.getClassName(hwnd, szClassName, MAX_WINDOW_CLASS_NAME);
+		GesturePoint ptOrigin = forwarder.getClientOffset(hwnd, 0);
+		m_vPayload.push_back(ITT_Window);
+		AppendVarint(m_vPayload, static_cast<uint32_t>(hwnd));
+		AppendVarint(m_vPayload, static_cast<uint32_t>(tree.getParent(hwnd)));
+		AppendVarint(m_vPayload, tree.getWindowThread(hwnd, NULL));
+		m_vPayload.push_back(tree.isInProcess(hwnd) ? ITW_InProcess : 0);
+		AppendZigzag(m_vPayload, ptOrigin.x);
+		AppendZigzag(m_vPayload, ptOrigin.y);
+		AppendVarint(m_vPayload, static_cast<uint32_t>(cchClassName));
+		AppendBytes(m_vPayload, szClassName, cchClassName);
+	}
+}
+
+void InputTraceEncoder::append(const GestureMessage& msg, uint32_t time, WindowTree& tree, GestureForwarder& forwarder) {
+	uint32_t hwnd = static_cast<uint32_t>(msg.hwnd);
+	if (hwnd && !m_setKnownWindows.count(hwnd))
+		describeWindows(msg.hwnd, tree, forwarder);
+	if (m_nMessages++ == 0)
+		m_baseTime = m_lastTime = time;
+
+	size_t iTag = m_vPayload.size();
+	uint8_t tag = 0;
+	m_vPayload.push_back(0);
+	if (hwnd != static_cast<uint32_t>(m_last.hwnd)) {
+		tag |= ITM_Window;
+		AppendVarint(m_vPayload, hwnd);
+	}
+	if (msg.message != m_last.message) {
+		tag |= ITM_Message;
+		AppendVarint(m_vPayload, msg.message);
+	}
+	if (static_cast<uint32_t>(msg.wParam) != static_cast<uint32_t>(m_last.wParam)) {
+		tag |= ITM_WParam;
+		AppendVarint(m_vPayload, static_cast<uint32_t>(msg.wParam));
+	}
+	if (static_cast<uint32_t>(msg.lParam) != static_cast<uint32_t>(m_last.lParam)) {
+		if (IsMouseMessage(msg.message)) {
+			tag |= ITM_Point;
+			GesturePoint pt = msg.getPoint(), ptLast = m_last.getPoint();
+			AppendZigzag(m_vPayload, pt.x - ptLast.x);
+			AppendZigzag(m_vPayload, pt.y - ptLast.y);
+		} else {
+			tag |= ITM_LParam;
+			AppendVarint(m_vPayload, static_cast<uint32_t>(msg.lParam));
+		}
+	}
+	AppendVarint(m_vPayload, time - m_lastTime);
+	m_vPayload[iTag] = tag;
+
+	m_last = msg;
+	m_lastTime = time;
+}
+
+void InputTraceEncoder::takeChunk(std::vector<uint8_t>& vOut) {
+	if (m_vPayload.empty())
+		return;
+	InputTraceChunkHeader header = { m_idThread, static_cast<uint32_t>(m_vPayload.size()), m_nMessages, m_baseTime };
+	AppendBytes(vOut, &header, sizeof(header));
+	AppendBytes(vOut, &m_vPayload[0], m_vPayload.size());
+	m_vPayload.clear();
+	m_nMessages = 0;
+	memset(&m_last, 0, sizeof(m_last));
+}
+
+InputTraceReader::InputTraceReader(const void* pData, size_t cbData) : m_pData(static_cast<const uint8_t*>(pData)),
+m_cbData(cbData), m_offset(sizeof(InputTraceHeader)), m_chunkEnd(sizeof(InputTraceHeader)), m_bValid(false),
+m_bCorrupt(false), m_nChunks(0), m_nChunkMessages(0), m_idThread(0), m_lastTime(0) {
+	memset(&m_last, 0, sizeof(m_last));
+	InputTraceHeader header;
+	if (cbData < sizeof(header))
+		return;
+	memcpy(&header, pData, sizeof(header));
+	m_bValid = header.magic == INPUT_TRACE_MAGIC && header.version == INPUT_TRACE_VERSION &&
+		header.cbChunkHeader == sizeof(InputTraceChunkHeader);
+}
+
+bool InputTraceReader::fail() {
+	m_bCorrupt = true;
+	return false;
+}
+
+bool InputTraceReader::readVarint(uint32_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 35 && m_offset < m_chunkEnd; shift += 7) {
+		uint8_t b = m_pData[m_offset++];
+		value |= static_cast<uint32_t>(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+bool InputTraceReader::readZigzag(int& value) {
+	uint32_t zigzag;
+	if (!readVarint(zigzag))
+		return false;
+	value = static_cast<int>(zigzag >> 1) ^ -static_cast<int>(zigzag & 1);
+	return true;
+}
+
+bool InputTraceReader::readWindow() {
+	InputTraceWindow window;
+	uint32_t cchClassName;
+	int x, y;
+	if (!readVarint(window.hwnd) || !readVarint(window.hwndParent) || !readVarint(window.idThread) || m_offset >= m_chunkEnd)
+		return false;
+	window.flags = m_pData[m_offset++];
+	if (!readZigzag(x) || !readZigzag(y) || !readVarint(cchClassName) || cchClassName >= MAX_WINDOW_CLASS_NAME ||
+		cchClassName > m_chunkEnd - m_offset)
+		return false;
+	window.ptOrigin.x = x;
+	window.ptOrigin.y = y;
+	window.strClassName.assign(reinterpret_cast<const char*>(m_pData + m_offset), cchClassName);
+	m_offset += cchClassName;
+	m_mapWindows[window.hwnd] = window;
+	return true;
+}
+
+bool InputTraceReader::next(InputTraceMessage& message) {
+	if (!m_bValid || m_bCorrupt)
+		return false;
+	for (;;) {
+		if (m_offset == m_chunkEnd) {
+			// the chunk must hold as many messages as its header says
+			if (m_nChunks && m_nChunkMessages)
+				return fail();
+			if (m_offset == m_cbData)
+				return false;
+			InputTraceChunkHeader header;
+			if (m_cbData - m_offset < sizeof(header))
+				return fail();
+			memcpy(&header, m_pData + m_offset, sizeof(header));
+			m_offset += sizeof(header);
+			if (header.cbPayload > m_cbData - m_offset)
+				return fail();
+			m_chunkEnd = m_offset + header.cbPayload;
+			m_nChunks++;
+			m_nChunkMessages = header.nMessages;
+			m_idThread = header.idThread;
+			m_lastTime = header.baseTime;
+			memset(&m_last, 0, sizeof(m_last));
+			continue;
+		}
+
+		uint8_t tag = m_pData[m_offset++];
+		if (tag == ITT_Window) {
+			if (!readWindow())
+				return fail();
+			continue;
+		}
+		if (tag & ~(ITM_Window | ITM_Message | ITM_WParam | ITM_Point | ITM_LParam) || (tag & ITM_Point && tag & ITM_LParam) ||
+			m_nChunkMessages == 0)
+			return fail();
+
+		GestureMessage msg = m_last;
+		uint32_t value, delta;
+		if (tag & ITM_Window) {
+			if (!readVarint(value))
+				return fail();
+			msg.hwnd = value;
+		}
+		if (tag & ITM_Message) {
+			if (!readVarint(value))
+				return fail();
+			msg.message = value;
+		}
+		if (tag & ITM_WParam) {
+			if (!readVarint(value))
+				return fail();
+			msg.wParam = value;
+		}
+		if (tag & ITM_Point) {
+			int dx, dy;
+			if (!readZigzag(dx) || !readZigzag(dy))
+				return fail();
+			GesturePoint pt = m_last.getPoint();
+			pt.x = static_cast<short>(pt.x + dx);
+			pt.y = static_cast<short>(pt.y + dy);
+			msg.lParam = pt.toLParam();
+		}
+		if (tag & ITM_LParam) {
+			if (!readVarint(value))
+				return fail();
+			msg.lParam = static_cast<intptr_t>(value);
+		}
+		if (!readVarint(delta))
+			return fail();
+
+		m_last = msg;
+		m_lastTime += delta;
+		m_nChunkMessages--;
+		message.idThread = m_idThread;
+		message.msg = msg;
+		message.time = m_lastTime;
+		return true;
+	}
+}
+
+const InputTraceWindow* InputTraceReader::findWindow(uint32_t hwnd) const {
+	std::unordered_map<uint32_t, InputTraceWindow>::const_iterator it = m_mapWindows.find(hwnd);
+	return it == m_mapWindows.end() ? NULL : &it->second;
+}
@@ -0,0 +1,187 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Input traces: the key and mouse messages hooked threads removed from their queues, captured
+// while the shared config sets SCF_CaptureInput and replayed by the benchmarks. A moving mouse
+// costs about four bytes per message instead of the 28 of a MSG. Traces hold what the gesture
+// handlers and the hotkey forwarding act on, never what was typed, see MaskCapturedMessage.
+
+#include "GestureCore.h"
+#include "ModifierTracker.h"
+#include "WindowTree.h"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+ * File layout, little endian:
+ *   InputTraceHeader
+ *   chunks, each an InputTraceChunkHeader followed by cbPayload bytes of records
+ *
+ * A chunk holds messages of one thread, in the order it removed them. Delta coding restarts with
+ * every chunk. The window table spans the file: each thread describes a window, and its ancestors,
+ * in a window record before its first message for it, so the table is complete at every message
+ * when the file is read in order. Handles, wParam and lParam keep their low 32 bits, like in the other formats.
+ *
+ * A record starts with a tag byte. ITT_Window is followed by
+ *   varint hwnd, varint parent (0 for top level), varint thread, byte ITW_* flags,
+ *   zigzag x and y of the client origin on the screen, varint class name length, class name
+ * Any other tag is a message; its ITM_* bits say which fields differ from the previous message
+ * of the chunk and follow in this order:
+ *   ITM_Window: varint hwnd   ITM_Message: varint message   ITM_WParam: varint wParam
+ *   ITM_Point: zigzag deltas of the x and y packed into lParam   ITM_LParam: varint lParam
+ * followed by the varint time since the previous message, modulo 2^32 like GetMessageTime.
+ */
+const uint32_t INPUT_TRACE_MAGIC = 0x54494746; // "FGIT"
+const uint32_t INPUT_TRACE_VERSION = 1;
+
+struct InputTraceHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t cbChunkHeader;
+	uint32_t reserved;
+};
+
+struct InputTraceChunkHeader {
+	uint32_t idThread;
+	uint32_t cbPayload;
+	uint32_t nMessages;
+	/* time the first message's delta is relative to */
+	uint32_t baseTime;
+};
+
+enum InputTraceTag {
+	ITM_Window = 0x01,
+	ITM_Message = 0x02,
+	ITM_WParam = 0x04,
+	ITM_Point = 0x08,
+	ITM_LParam = 0x10,
+	ITT_Window = 0x80,
+};
+
+enum InputTraceWindowFlag {
+	/* in the process that installed the hooks, see WindowTree::isInProcess */
+	ITW_InProcess = 0x01,
+};
+
+struct InputTraceWindow {
+	uint32_t hwnd;
+	uint32_t hwndParent;
+	uint32_t idThread;
+	uint8_t flags;
+	GesturePoint ptOrigin;
+	std::string strClassName;
+};
+
+struct InputTraceMessage {
+	uint32_t idThread;
+	GestureMessage msg;
+	uint32_t time;
+};
+
+/* Appends the file header to vOut */
+void AppendInputTraceHeader(std::vector<uint8_t>& vOut);
+
+/*
+ * Prepares a message the hook removed for the trace, false if it is left out. Mouse messages are kept
+ * as they are. Key presses keep their key code only for Alt, Ctrl and Shift and for keys that would be
+ * forwarded to firefox as hotkeys with the modifiers held before them; any other key press keeps just
+ * its timing, repeat count and transition bits. Character messages are left out.
+ */
+bool MaskCapturedMessage(GestureMessage& msg, const ModifierTracker& modifiers, const HotkeyRules& rules);
+
+/*
+ * Encodes what one thread captures. Not thread safe: each thread has its own, and a new one per
+ * file, as the windows it has described are only known to the file it writes to.
+ */
+class InputTraceEncoder {
+public:
+	/* A chunk this large is due to be written */
+	static const size_t CHUNK_SIZE = 64 * 1024;
+
+	explicit InputTraceEncoder(uint32_t idThread);
+
+	/* Appends msg, preceded by window records for its window and ancestors the file does not know yet */
+	void append(const GestureMessage& msg, uint32_t time, WindowTree& tree, GestureForwarder& forwarder);
+	/* Bytes in the current chunk */
+	size_t getPendingSize() const { return m_vPayload.size(); }
+	/* Appends the current chunk, header included, to vOut and starts the next; nothing if it is empty */
+	void takeChunk(std::vector<uint8_t>& vOut);
+private:
+	uint32_t m_idThread;
+	std::vector<uint8_t> m_vPayload;
+	uint32_t m_nMessages;
+	uint32_t m_baseTime;
+	GestureMessage m_last;
+	uint32_t m_lastTime;
+	std::unordered_set<uint32_t> m_setKnownWindows;
+
+	void describeWindows(GestureWindow hwnd, WindowTree& tree, GestureForwarder& forwarder);
+
+	InputTraceEncoder(const InputTraceEncoder&);
+	InputTraceEncoder& operator=(const InputTraceEncoder&);
+};
+
+/*
+ * Streams the messages out of a trace in memory, typically a mapped file: nothing is copied, so the
+ * size of the trace only matters to the address space. Stops at the first record that does not decode.
+ */
+class InputTraceReader {
+public:
+	InputTraceReader(const void* pData, size_t cbData);
+
+	/* false if the header is not one of a trace this build reads */
+	bool isValid() const { return m_bValid; }
+	/* The next message, false at the end of the trace or at a corrupt or truncated record */
+	bool next(InputTraceMessage& message);
+	/* true once next stopped because of a corrupt or truncated record */
+	bool isCorrupt() const { return m_bCorrupt; }
+	/* Bytes consumed so far, everything before has been decoded */
+	size_t getOffset() const { return m_offset; }
+
+	/* The window table as far as the trace has been read, NULL if hwnd is not described yet */
+	const InputTraceWindow* findWindow(uint32_t hwnd) const;
+	size_t getWindowCount() const { return m_mapWindows.size(); }
+	size_t getChunkCount() const { return m_nChunks; }
+private:
+	const uint8_t* m_pData;
+	size_t m_cbData;
+	size_t m_offset;
+	/* end of the current chunk's payload, m_offset when between chunks */
+	size_t m_chunkEnd;
+	bool m_bValid;
+	bool m_bCorrupt;
+	size_t m_nChunks;
+	/* messages the current chunk has left */
+	uint32_t m_nChunkMessages;
+	uint32_t m_idThread;
+	GestureMessage m_last;
+	uint32_t m_lastTime;
+	std::unordered_map<uint32_t, InputTraceWindow> m_mapWindows;
+
+	bool readVarint(uint32_t& value);
+	bool readZigzag(int& value);
+	bool readWindow();
+	bool fail();
+
+	InputTraceReader(const InputTraceReader&);
+	InputTraceReader& operator=(const InputTraceReader&);
+};
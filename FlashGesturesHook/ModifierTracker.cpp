@@ -0,0 +1,119 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "ModifierTracker.h"
+
+namespace {
+
+const intptr_t KF_EXTENDED_BIT = 0x01000000;
+const int SCANCODE_RSHIFT = 0x36;
+
+}
+
+ModifierTracker::ModifierTracker() :
+m_keys(0), m_bSynced(false), m_timeLastKey(0), m_hwndLastKey(0), m_bAltPending(false), m_pendingAltDown() {}
+
+void ModifierTracker::resync(KeyStateSource& source) {
+	setPair(KEY_LALT, KEY_RALT, source.isKeyDown(GVK_MENU));
+	setPair(KEY_LCTRL, KEY_RCTRL, source.isKeyDown(GVK_CONTROL));
+	setPair(KEY_LSHIFT, KEY_RSHIFT, source.isKeyDown(GVK_SHIFT));
+	m_bSynced = true;
+}
+
+void ModifierTracker::onKeyMessage(KeyStateSource& source, const GestureMessage& msg, uint32_t time) {
+	// the state is stale if key messages went to another thread in between, e.g. after focus moved
+	if (!m_bSynced || msg.hwnd != m_hwndLastKey || time - m_timeLastKey > RESYNC_INTERVAL_MS)
+		resync(source);
+	m_timeLastKey = time;
+	m_hwndLastKey = msg.hwnd;
+
+	bool bDown;
+	switch (msg.message) {
+	case GMSG_KEYDOWN:
+	case GMSG_SYSKEYDOWN:
+		bDown = true;
+		break;
+	case GMSG_KEYUP:
+	case GMSG_SYSKEYUP:
+		bDown = false;
+		break;
+	default:
+		return;
+	}
+	bool bRight = (msg.lParam & KF_EXTENDED_BIT) != 0;
+	switch (msg.wParam) {
+	case GVK_MENU:
+		setKey(bRight ? KEY_RALT : KEY_LALT, bDown);
+		break;
+	case GVK_CONTROL:
+		setKey(bRight ? KEY_RCTRL : KEY_LCTRL, bDown);
+		break;
+	case GVK_SHIFT:
+		// both shift keys are non-extended, only the scan code tells them apart
+		setKey(((msg.lParam >> 16) & 0xff) == SCANCODE_RSHIFT ? KEY_RSHIFT : KEY_LSHIFT, bDown);
+		break;
+	}
+}
+
+void ModifierTracker::onMouseMessage(const GestureMessage& msg) {
+	setPair(KEY_LCTRL, KEY_RCTRL, (msg.wParam & GMK_CONTROL) != 0);
+	setPair(KEY_LSHIFT, KEY_RSHIFT, (msg.wParam & GMK_SHIFT) != 0);
+}
+
+KeyDecision ModifierTracker::filterKey(const GestureMessage& msg, const HotkeyRules& rules) {
+	KeyDecision decision = { false, GestureMessage(), false };
+	bool bAltPressed = isAltDown();
+	bool bCtrlPressed = isCtrlDown();
+	bool bShiftPressed = isShiftDown();
+
+	if (bAltPressed && !bCtrlPressed && msg.wParam == GVK_MENU) {
+		// Alt without Ctrl is pressed. We'll delay sending the Alt down message, in case Ctrl is pressed
+		// before Alt up.
+		m_pendingAltDown = msg;
+		m_bAltPending = true;
+		ATLTRACE(_T("ForwardFirefoxKeyMessage : Alt pending...\n"));
+		return decision;
+	} else if (bCtrlPressed) {
+		if (m_bAltPending) {
+			// Clear the pending Alt down message as Ctrl is pressed.
+			m_bAltPending = false;
+			ATLTRACE(_T("ForwardFirefoxKeyMessage : Cleared pending Alt.\n"));
+		}
+	}
+
+	// Send Alt key up message to Firefox, so that user could select the main window menu by press alt key.
+	if (msg.message == GMSG_SYSKEYUP && msg.wParam == GVK_MENU) {
+		if (m_bAltPending) {
+			// Send the pending Alt down message first.
+			decision.bPostPendingAlt = true;
+			decision.pendingAltDown = m_pendingAltDown;
+			m_bAltPending = false;
+			bAltPressed = true;
+		}
+	}
+	// Might be in AltGr up sequence, skip
+	else if (msg.message == GMSG_SYSKEYUP && msg.wParam == GVK_CONTROL) {
+		ATLTRACE(_T("ForwardFirefoxKeyMessage : Return from AltGr up sequence.\n"));
+		return decision;
+	}
+
+	if (bCtrlPressed || bAltPressed || (msg.wParam >= GVK_F1 && msg.wParam <= GVK_F24)) {
+		decision.bForward = rules.shouldForward(static_cast<int>(msg.wParam), bAltPressed, bCtrlPressed, bShiftPressed);
+	}
+	return decision;
+}
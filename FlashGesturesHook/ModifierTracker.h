@@ -0,0 +1,92 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Per-thread state of the Alt, Ctrl and Shift keys, kept up to date from the messages the hook
+// sees instead of asking GetKeyState for every key press.
+
+#include "GestureCore.h"
+#include "HotkeyRules.h"
+
+/* The system's view of the keyboard, implemented with GetKeyState in the hook dll */
+class KeyStateSource {
+public:
+	virtual bool isKeyDown(int keyCode) = 0;
+protected:
+	~KeyStateSource() {}
+};
+
+/* What to do with a key press in a plugin window */
+struct KeyDecision {
+	/* Post this delayed Alt down to firefox first */
+	bool bPostPendingAlt;
+	GestureMessage pendingAltDown;
+	/* Post the key message itself to firefox and swallow it */
+	bool bForward;
+};
+
+class ModifierTracker {
+public:
+	/* Key messages further apart than this resync with the system, key ups may have gone to other threads */
+	static const uint32_t RESYNC_INTERVAL_MS = 500;
+
+	ModifierTracker();
+
+	/* Call for every key message of the thread, before it is filtered; time is MSG::time */
+	void onKeyMessage(KeyStateSource& source, const GestureMessage& msg, uint32_t time);
+	/* Mouse messages report Ctrl and Shift in wParam, which corrects them for free */
+	void onMouseMessage(const GestureMessage& msg);
+	void resync(KeyStateSource& source);
+
+	bool isAltDown() const { return (m_keys & (KEY_LALT | KEY_RALT)) != 0; }
+	bool isCtrlDown() const { return (m_keys & (KEY_LCTRL | KEY_RCTRL)) != 0; }
+	bool isShiftDown() const { return (m_keys & (KEY_LSHIFT | KEY_RSHIFT)) != 0; }
+
+	/*
+	 * Decides whether a WM_KEYDOWN, WM_SYSKEYDOWN or WM_SYSKEYUP should reach firefox.
+	 * An Alt down without Ctrl is held back until the Alt up, as Ctrl may still follow: AltGr is
+	 * represented in Windows messages as Alt+Ctrl, and that is used for text input, not menus.
+	 */
+	KeyDecision filterKey(const GestureMessage& msg, const HotkeyRules& rules);
+private:
+	enum {
+		KEY_LALT = 0x01, KEY_RALT = 0x02, KEY_LCTRL = 0x04, KEY_RCTRL = 0x08, KEY_LSHIFT = 0x10, KEY_RSHIFT = 0x20
+	};
+
+	uint8_t m_keys;
+	bool m_bSynced;
+	uint32_t m_timeLastKey;
+	GestureWindow m_hwndLastKey;
+
+	bool m_bAltPending;
+	GestureMessage m_pendingAltDown;
+
+	void setKey(uint8_t key, bool bDown) {
+		if (bDown)
+			m_keys |= key;
+		else
+			m_keys &= ~key;
+	}
+	/* Sets the pair from the combined state, keeping the tracked side if it agrees */
+	void setPair(uint8_t left, uint8_t right, bool bDown) {
+		if (!bDown)
+			m_keys &= ~(left | right);
+		else if (!(m_keys & (left | right)))
+			m_keys |= left;
+	}
+};
@@ -0,0 +1,92 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "MoveDecimator.h"
+
+MoveDecimation::MoveDecimation() {
+	m_packed.store(0, std::memory_order_relaxed);
+}
+
+bool MoveDecimation::set(int minDistance, uint32_t msMaxInterval) {
+	if (minDistance < 0 || minDistance > MAX_DISTANCE || msMaxInterval > MAX_INTERVAL_MS)
+		return false;
+	m_packed.store(static_cast<uint32_t>(minDistance) | (msMaxInterval << 16), std::memory_order_relaxed);
+	return true;
+}
+
+MoveDecimationConfig MoveDecimation::get() const {
+	uint32_t packed = m_packed.load(std::memory_order_relaxed);
+	MoveDecimationConfig config = { static_cast<int>(packed & 0xffff), packed >> 16 };
+	return config;
+}
+
+MoveDecimator::MoveDecimator() :
+m_config(), m_bActive(false), m_bPending(false), m_pending(), m_ptForwarded(), m_timeForwarded(0) {}
+
+void MoveDecimator::begin(const MoveDecimation& decimation, GesturePoint ptForwarded, uint32_t time) {
+	m_config = decimation.get();
+	m_bActive = m_config.minDistance > 0;
+	m_bPending = false;
+	forwarded(ptForwarded, time);
+}
+
+static int64_t SquaredLength(int64_t dx, int64_t dy) {
+	return dx * dx + dy * dy;
+}
+
+int MoveDecimator::onMove(const GestureMessage& msg, uint32_t time, GestureMessage aMoves[2]) {
+	int nMoves = 0;
+	GesturePoint pt = msg.getPoint();
+	if (m_bPending) {
+		// the way to the held back move against the step after it
+		GesturePoint ptPending = m_pending.getPoint();
+		int64_t hx = ptPending.x - m_ptForwarded.x, hy = ptPending.y - m_ptForwarded.y;
+		int64_t sx = pt.x - ptPending.x, sy = pt.y - ptPending.y;
+		int64_t hh = SquaredLength(hx, hy), ss = SquaredLength(sx, sy);
+		// single pixel steps have no meaningful direction
+		if (hh >= 4 && ss >= 4) {
+			int64_t dot = hx * sx + hy * sy;
+			// cos(angle) < cos(45 degrees), without a square root
+			if (dot <= 0 || 2 * dot * dot < hh * ss) {
+				aMoves[nMoves++] = m_pending;
+				forwarded(ptPending, time);
+			}
+		}
+		m_bPending = false;
+	}
+
+	int64_t minDistance = m_config.minDistance;
+	if (SquaredLength(pt.x - m_ptForwarded.x, pt.y - m_ptForwarded.y) >= minDistance * minDistance ||
+		(m_config.msMaxInterval && time - m_timeForwarded >= m_config.msMaxInterval)) {
+		aMoves[nMoves++] = msg;
+		forwarded(pt, time);
+	} else {
+		m_pending = msg;
+		m_bPending = true;
+	}
+	return nMoves;
+}
+
+bool MoveDecimator::flush(GestureMessage& msg) {
+	if (!m_bPending)
+		return false;
+	msg = m_pending;
+	m_bPending = false;
+	m_ptForwarded = m_pending.getPoint();
+	return true;
+}
@@ -0,0 +1,88 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "GestureCore.h"
+
+#include <atomic>
+
+/* What FGH_SetMoveDecimation configured, a zero minDistance forwards every move */
+struct MoveDecimationConfig {
+	/* a move closer than this to the last forwarded position is held back */
+	int minDistance;
+	/* but never for longer than this, so firefox follows slow drags too; 0 holds moves back by distance only */
+	uint32_t msMaxInterval;
+};
+
+/* The configuration shared by all hook threads, read once per gesture */
+class MoveDecimation {
+public:
+	static const int MAX_DISTANCE = 0xffff;
+	static const uint32_t MAX_INTERVAL_MS = 0xffff;
+
+	MoveDecimation();
+
+	/* Returns false for values out of range */
+	bool set(int minDistance, uint32_t msMaxInterval);
+	void clear() { m_packed.store(0, std::memory_order_relaxed); }
+	MoveDecimationConfig get() const;
+private:
+	/* minDistance in the low 16 bits, msMaxInterval in the high ones, so both change at once */
+	std::atomic<uint32_t> m_packed;
+
+	MoveDecimation(const MoveDecimation&);
+	MoveDecimation& operator=(const MoveDecimation&);
+};
+
+/*
+ * Thins out the moves a triggered gesture forwards to firefox. High polling rate mice report
+ * up to 1000 moves a second, each of which would be a posted message. A move is held back
+ * while it is within minDistance of the last forwarded position and msMaxInterval has not passed.
+ * A held back move is still forwarded when the path turns by more than 45 degrees right after it,
+ * so corners survive, and before any other message, so firefox sees the final position
+ * before a button goes up.
+ */
+class MoveDecimator {
+public:
+	MoveDecimator();
+
+	/* ptForwarded is the last position firefox has been sent */
+	void begin(const MoveDecimation& decimation, GesturePoint ptForwarded, uint32_t time);
+	bool isActive() const { return m_bActive; }
+	void reset() {
+		m_bActive = false;
+		m_bPending = false;
+	}
+
+	/* Stores the moves to forward in aMoves and returns their number: the corner before msg if the path turns there, msg itself */
+	int onMove(const GestureMessage& msg, uint32_t time, GestureMessage aMoves[2]);
+	/* The held back move, if any, to be forwarded before a message that is not a move */
+	bool flush(GestureMessage& msg);
+private:
+	MoveDecimationConfig m_config;
+	bool m_bActive;
+	bool m_bPending;
+	GestureMessage m_pending;
+	GesturePoint m_ptForwarded;
+	uint32_t m_timeForwarded;
+
+	void forwarded(GesturePoint pt, uint32_t time) {
+		m_ptForwarded = pt;
+		m_timeForwarded = time;
+	}
+};
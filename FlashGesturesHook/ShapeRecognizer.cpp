@@ -0,0 +1,359 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "ShapeRecognizer.h"
+
+#include <math.h>
+
+#if defined(GESTURE_CORE_SSE2) && (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__))
+#include <immintrin.h>
+#define SHAPE_AVX
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SHAPE_TARGET_AVX
+#else
+#define SHAPE_TARGET_AVX __attribute__((target("avx")))
+#endif
+#endif
+
+ShapeTrace::ShapeTrace() : m_nPoints(0), m_nStride(1), m_nSeen(0) {}
+
+void ShapeTrace::begin(GesturePoint pt) {
+	m_aPoints[0] = pt;
+	m_nPoints = 1;
+	m_nStride = 1;
+	m_nSeen = 1;
+}
+
+void ShapeTrace::thinOut() {
+	for (int i = 1; 2 * i < m_nPoints; i++)
+		m_aPoints[i] = m_aPoints[2 * i];
+	m_nPoints = (m_nPoints + 1) / 2;
+	m_nStride *= 2;
+}
+
+void ShapeTrace::addPoint(GesturePoint pt) {
+	if (m_nSeen++ % m_nStride)
+		return;
+	if (m_nPoints == SHAPE_MAX_TRACE)
+		thinOut();
+	m_aPoints[m_nPoints++] = pt;
+}
+
+void ShapeTrace::end(GesturePoint pt) {
+	if (m_nPoints == SHAPE_MAX_TRACE)
+		thinOut();
+	m_aPoints[m_nPoints++] = pt;
+}
+
+bool NormalizeShape(const GesturePoint* aPoints, int nPoints, ShapePath& path) {
+	if (nPoints < 2)
+		return false;
+	float length = 0;
+	for (int i = 1; i < nPoints; i++)
+		length += hypotf(static_cast<float>(aPoints[i].x - aPoints[i - 1].x), static_cast<float>(aPoints[i].y - aPoints[i - 1].y));
+	if (length < 1)
+		return false;
+
+	// resample to equidistant points along the path
+	const float interval = length / (SHAPE_POINTS - 1);
+	float xPrev = static_cast<float>(aPoints[0].x), yPrev = static_cast<float>(aPoints[0].y);
+	path.aX[0] = xPrev;
+	path.aY[0] = yPrev;
+	int k = 1;
+	float traveled = 0;
+	for (int i = 1; i < nPoints && k < SHAPE_POINTS;) {
+		float x = static_cast<float>(aPoints[i].x), y = static_cast<float>(aPoints[i].y);
+		float d = hypotf(x - xPrev, y - yPrev);
+		if (d > 0 && traveled + d >= interval) {
+			float t = (interval - traveled) / d;
+			xPrev += t * (x - xPrev);
+			yPrev += t * (y - yPrev);
+			path.aX[k] = xPrev;
+			path.aY[k] = yPrev;
+			k++;
+			traveled = 0;
+		} else {
+			traveled += d;
+			xPrev = x;
+			yPrev = y;
+			i++;
+		}
+	}
+	// rounding may leave the last point short
+	for (; k < SHAPE_POINTS; k++) {
+		path.aX[k] = static_cast<float>(aPoints[nPoints - 1].x);
+		path.aY[k] = static_cast<float>(aPoints[nPoints - 1].y);
+	}
+
+	float xSum = 0, ySum = 0;
+	float xMin = path.aX[0], xMax = path.aX[0], yMin = path.aY[0], yMax = path.aY[0];
+	for (int i = 0; i < SHAPE_POINTS; i++) {
+		xSum += path.aX[i];
+		ySum += path.aY[i];
+		xMin = path.aX[i] < xMin ? path.aX[i] : xMin;
+		xMax = path.aX[i] > xMax ? path.aX[i] : xMax;
+		yMin = path.aY[i] < yMin ? path.aY[i] : yMin;
+		yMax = path.aY[i] > yMax ? path.aY[i] : yMax;
+	}
+	// the same scale for both axes, so a line stays a line
+	float halfSize = ((xMax - xMin) > (yMax - yMin) ? (xMax - xMin) : (yMax - yMin)) / 2;
+	if (halfSize < 0.5f)
+		return false;
+	float xCenter = xSum / SHAPE_POINTS, yCenter = ySum / SHAPE_POINTS, scale = 1 / halfSize;
+	for (int i = 0; i < SHAPE_POINTS; i++) {
+		path.aX[i] = (path.aX[i] - xCenter) * scale;
+		path.aY[i] = (path.aY[i] - yCenter) * scale;
+	}
+	return true;
+}
+
+ShapeKernel BestShapeKernel() {
+#ifdef SHAPE_AVX
+#ifdef _MSC_VER
+	int aRegisters[4];
+	__cpuid(aRegisters, 1);
+	// AVX, and the OS saves the ymm registers
+	const int AVX_AND_OSXSAVE = (1 << 28) | (1 << 27);
+	if ((aRegisters[2] & AVX_AND_OSXSAVE) == AVX_AND_OSXSAVE && (_xgetbv(0) & 6) == 6)
+		return SK_AVX;
+#else
+	if (__builtin_cpu_supports("avx"))
+		return SK_AVX;
+#endif
+#endif
+#ifdef GESTURE_CORE_SSE2
+	return SK_SSE2;
+#else
+	return SK_Scalar;
+#endif
+}
+
+const char* GetShapeKernelName(ShapeKernel kernel) {
+	switch (kernel) {
+	case SK_SSE2: return "sse2";
+	case SK_AVX: return "avx";
+	default: return "scalar";
+	}
+}
+
+namespace {
+
+void ScoreScalar(const ShapePath& path, const float* pX, const float* pY, int nStride, int nTemplates, float* aScores) {
+	for (int t = 0; t < nTemplates; t++) {
+		float sum = 0;
+		for (int i = 0; i < SHAPE_POINTS; i++) {
+			float dx = path.aX[i] - pX[i * nStride + t], dy = path.aY[i] - pY[i * nStride + t];
+			sum += sqrtf(dx * dx + dy * dy);
+		}
+		aScores[t] = sum * (1.0f / SHAPE_POINTS);
+	}
+}
+
+#ifdef GESTURE_CORE_SSE2
+void ScoreSSE2(const ShapePath& path, const float* pX, const float* pY, int nStride, int nTemplates, float* aScores) {
+	const __m128 vScale = _mm_set1_ps(1.0f / SHAPE_POINTS);
+	for (int t = 0; t < nTemplates; t += 4) {
+		__m128 vSum = _mm_setzero_ps();
+		for (int i = 0; i < SHAPE_POINTS; i++) {
+			__m128 vDx = _mm_sub_ps(_mm_set1_ps(path.aX[i]), _mm_loadu_ps(pX + i * nStride + t));
+			__m128 vDy = _mm_sub_ps(_mm_set1_ps(path.aY[i]), _mm_loadu_ps(pY + i * nStride + t));
+			vSum = _mm_add_ps(vSum, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vDx, vDx), _mm_mul_ps(vDy, vDy))));
+		}
+		vSum = _mm_mul_ps(vSum, vScale);
+		// the padding templates past nTemplates are scored too, but not stored
+		if (t + 4 <= nTemplates) {
+			_mm_storeu_ps(aScores + t, vSum);
+		} else {
+			float aLast[4];
+			_mm_storeu_ps(aLast, vSum);
+			for (int j = 0; t + j < nTemplates; j++)
+				aScores[t + j] = aLast[j];
+		}
+	}
+}
+#endif
+
+#ifdef SHAPE_AVX
+SHAPE_TARGET_AVX
+void ScoreAVX(const ShapePath& path, const float* pX, const float* pY, int nStride, int nTemplates, float* aScores) {
+	const __m256 vScale = _mm256_set1_ps(1.0f / SHAPE_POINTS);
+	for (int t = 0; t < nTemplates; t += 8) {
+		__m256 vSum = _mm256_setzero_ps();
+		for (int i = 0; i < SHAPE_POINTS; i++) {
+			__m256 vDx = _mm256_sub_ps(_mm256_set1_ps(path.aX[i]), _mm256_loadu_ps(pX + i * nStride + t));
+			__m256 vDy = _mm256_sub_ps(_mm256_set1_ps(path.aY[i]), _mm256_loadu_ps(pY + i * nStride + t));
+			vSum = _mm256_add_ps(vSum, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vDx, vDx), _mm256_mul_ps(vDy, vDy))));
+		}
+		vSum = _mm256_mul_ps(vSum, vScale);
+		if (t + 8 <= nTemplates) {
+			_mm256_storeu_ps(aScores + t, vSum);
+		} else {
+			float aLast[8];
+			_mm256_storeu_ps(aLast, vSum);
+			for (int j = 0; t + j < nTemplates; j++)
+				aScores[t + j] = aLast[j];
+		}
+	}
+	// avoid the AVX to SSE transition penalty in the caller
+	_mm256_zeroupper();
+}
+#endif
+
+}
+
+ShapeTemplates::ShapeTemplates() : m_nTemplates(0), m_nStride(0) {}
+
+bool ShapeTemplates::add(const GesturePoint* aPoints, int nPoints, StrokeCommand command) {
+	ShapePath path;
+	if (!NormalizeShape(aPoints, nPoints, path))
+		return false;
+	if (m_nTemplates == m_nStride) {
+		// lay the templates out again with twice the room
+		int nStride = m_nStride ? 2 * m_nStride : 8;
+		std::vector<float> vX(SHAPE_POINTS * nStride, 0.0f), vY(SHAPE_POINTS * nStride, 0.0f);
+		for (int i = 0; i < SHAPE_POINTS; i++) {
+			for (int t = 0; t < m_nTemplates; t++) {
+				vX[i * nStride + t] = m_vX[i * m_nStride + t];
+				vY[i * nStride + t] = m_vY[i * m_nStride + t];
+			}
+		}
+		m_vX.swap(vX);
+		m_vY.swap(vY);
+		m_nStride = nStride;
+	}
+	for (int i = 0; i < SHAPE_POINTS; i++) {
+		m_vX[i * m_nStride + m_nTemplates] = path.aX[i];
+		m_vY[i * m_nStride + m_nTemplates] = path.aY[i];
+	}
+	m_vCommands.push_back(command);
+	m_nTemplates++;
+	return true;
+}
+
+void ShapeTemplates::score(const ShapePath& path, float* aScores, ShapeKernel kernel) const {
+	if (m_nTemplates == 0)
+		return;
+	switch (kernel) {
+#ifdef SHAPE_AVX
+	case SK_AVX:
+		ScoreAVX(path, m_vX.data(), m_vY.data(), m_nStride, m_nTemplates, aScores);
+		break;
+#endif
+#ifdef GESTURE_CORE_SSE2
+	case SK_SSE2:
+		ScoreSSE2(path, m_vX.data(), m_vY.data(), m_nStride, m_nTemplates, aScores);
+		break;
+#endif
+	default:
+		ScoreScalar(path, m_vX.data(), m_vY.data(), m_nStride, m_nTemplates, aScores);
+		break;
+	}
+}
+
+bool ShapeTemplates::match(const ShapePath& path, ShapeMatch& match, ShapeKernel kernel) const {
+	// scored in chunks so that any number of templates fits on the stack
+	const int CHUNK = 256;
+	float aScores[CHUNK];
+	match.iTemplate = -1;
+	match.meanDistance = SHAPE_MATCH_THRESHOLD;
+	for (int tFirst = 0; tFirst < m_nTemplates; tFirst += CHUNK) {
+		int nChunk = m_nTemplates - tFirst < CHUNK ? m_nTemplates - tFirst : CHUNK;
+		switch (kernel) {
+#ifdef SHAPE_AVX
+		case SK_AVX:
+			ScoreAVX(path, m_vX.data() + tFirst, m_vY.data() + tFirst, m_nStride, nChunk, aScores);
+			break;
+#endif
+#ifdef GESTURE_CORE_SSE2
+		case SK_SSE2:
+			ScoreSSE2(path, m_vX.data() + tFirst, m_vY.data() + tFirst, m_nStride, nChunk, aScores);
+			break;
+#endif
+		default:
+			ScoreScalar(path, m_vX.data() + tFirst, m_vY.data() + tFirst, m_nStride, nChunk, aScores);
+			break;
+		}
+		for (int t = 0; t < nChunk; t++) {
+			if (aScores[t] < match.meanDistance) {
+				match.meanDistance = aScores[t];
+				match.iTemplate = tFirst + t;
+			}
+		}
+	}
+	if (match.iTemplate < 0)
+		return false;
+	match.command = m_vCommands[match.iTemplate];
+	return true;
+}
+
+ShapeLibrary::ShapeLibrary() : m_kernel(BestShapeKernel()) {
+	m_pCurrent.store(NULL, std::memory_order_relaxed);
+}
+
+ShapeLibrary::~ShapeLibrary() {
+	delete m_pCurrent.load(std::memory_order_relaxed);
+	for (const ShapeTemplates* pTemplates : m_vRetired)
+		delete pTemplates;
+}
+
+void ShapeLibrary::replace(const ShapeTemplates* pTemplates) {
+	const ShapeTemplates* pOld = m_pCurrent.exchange(pTemplates, std::memory_order_acq_rel);
+	if (pOld)
+		m_vRetired.push_back(pOld);
+}
+
+static int ReadInt16(const uint8_t* p) {
+	return static_cast<int16_t>(p[0] | (p[1] << 8));
+}
+
+bool ShapeLibrary::load(const uint8_t* pBlob, size_t cbBlob) {
+	if (cbBlob < 1 || pBlob[0] != SHAPE_TEMPLATES_VERSION)
+		return false;
+
+	ShapeTemplates* pTemplates = new ShapeTemplates();
+	std::vector<GesturePoint> vPoints;
+	size_t i = 1;
+	while (i < cbBlob) {
+		int nPoints = pBlob[i];
+		size_t cbEntry = 1 + 4 * static_cast<size_t>(nPoints) + 2;
+		if (nPoints < 2 || cbBlob - i < cbEntry) {
+			delete pTemplates;
+			return false;
+		}
+		vPoints.resize(nPoints);
+		for (int iPoint = 0; iPoint < nPoints; iPoint++) {
+			vPoints[iPoint].x = ReadInt16(pBlob + i + 1 + 4 * iPoint);
+			vPoints[iPoint].y = ReadInt16(pBlob + i + 3 + 4 * iPoint);
+		}
+		StrokeCommand command = { pBlob[i + cbEntry - 2], pBlob[i + cbEntry - 1] };
+		if ((command.modifiers & ~(GHM_Alt | GHM_Ctrl | GHM_Shift)) || !pTemplates->add(vPoints.data(), nPoints, command)) {
+			delete pTemplates;
+			return false;
+		}
+		i += cbEntry;
+	}
+	replace(pTemplates->size() ? pTemplates : NULL);
+	if (pTemplates->size() == 0)
+		delete pTemplates;
+	return true;
+}
+
+void ShapeLibrary::clear() {
+	replace(NULL);
+}
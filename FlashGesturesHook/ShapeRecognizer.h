@@ -0,0 +1,139 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Recognizes shape gestures (circles, checkmarks, letters) inside the hook. The trace is resampled
+// to SHAPE_POINTS equidistant points, centered and scaled, then compared against every template of
+// the library. Templates are stored as structure of arrays, point i of all templates next to each
+// other, so that SSE2 and AVX score 4 or 8 templates per instruction.
+
+#include "StrokeRecognizer.h"
+
+#include <atomic>
+#include <vector>
+
+/* Points of a normalized shape, a multiple of 8 */
+const int SHAPE_POINTS = 32;
+/* Raw points kept per stroke, longer strokes are thinned out evenly */
+const int SHAPE_MAX_TRACE = 256;
+/* Mean distance between corresponding points, in units of half the shape's size, above which nothing matches */
+const float SHAPE_MATCH_THRESHOLD = 0.3f;
+
+/* The raw points of one stroke */
+class ShapeTrace {
+public:
+	ShapeTrace();
+
+	void begin(GesturePoint pt);
+	void addPoint(GesturePoint pt);
+	/* The release point is always kept */
+	void end(GesturePoint pt);
+
+	int size() const { return m_nPoints; }
+	const GesturePoint* points() const { return m_aPoints; }
+private:
+	GesturePoint m_aPoints[SHAPE_MAX_TRACE];
+	int m_nPoints;
+	/* only every m_nStride-th point is kept, doubled each time the buffer fills up */
+	int m_nStride;
+	int m_nSeen;
+
+	void thinOut();
+};
+
+/* A stroke resampled to SHAPE_POINTS points along its path, centroid at the origin, larger side 2 units long */
+struct ShapePath {
+	float aX[SHAPE_POINTS];
+	float aY[SHAPE_POINTS];
+};
+
+/* Returns false for strokes without extent, which have no shape */
+bool NormalizeShape(const GesturePoint* aPoints, int nPoints, ShapePath& path);
+
+enum ShapeKernel {
+	SK_Scalar,
+	SK_SSE2,
+	SK_AVX,
+};
+
+/* The fastest kernel this processor runs */
+ShapeKernel BestShapeKernel();
+const char* GetShapeKernelName(ShapeKernel kernel);
+
+struct ShapeMatch {
+	int iTemplate;
+	float meanDistance;
+	StrokeCommand command;
+};
+
+class ShapeTemplates {
+public:
+	ShapeTemplates();
+
+	/* Returns false if the points have no shape */
+	bool add(const GesturePoint* aPoints, int nPoints, StrokeCommand command);
+	int size() const { return m_nTemplates; }
+
+	/* aScores[t] is the mean point distance between path and template t */
+	void score(const ShapePath& path, float* aScores, ShapeKernel kernel) const;
+	/* The closest template, false if none is within SHAPE_MATCH_THRESHOLD */
+	bool match(const ShapePath& path, ShapeMatch& match, ShapeKernel kernel) const;
+private:
+	/* coordinate i of template t is at m_vX[i * m_nStride + t], m_nStride is a multiple of 8 */
+	std::vector<float> m_vX;
+	std::vector<float> m_vY;
+	std::vector<StrokeCommand> m_vCommands;
+	int m_nTemplates;
+	int m_nStride;
+};
+
+/*
+ * Template blob, as passed to FGH_SetShapeTemplates:
+ *   byte 0       SHAPE_TEMPLATES_VERSION
+ *   then entries point count n (2 to 255), n points as little endian int16 x and y,
+ *                virtual-key code, GestureHotkeyModifier flags
+ */
+const uint8_t SHAPE_TEMPLATES_VERSION = 1;
+
+/*
+ * The templates hook threads match against. A new blob replaces the whole set at once; replaced
+ * sets stay allocated until the library is destroyed, as a hook thread may still be scoring them.
+ * Replacing happens when the user changes the configuration, so they do not pile up.
+ */
+class ShapeLibrary {
+public:
+	ShapeLibrary();
+	~ShapeLibrary();
+
+	/* NULL while there are no templates */
+	const ShapeTemplates* get() const { return m_pCurrent.load(std::memory_order_acquire); }
+	ShapeKernel getKernel() const { return m_kernel; }
+
+	/* Returns false and keeps the current templates if the blob is malformed. Not thread safe against itself. */
+	bool load(const uint8_t* pBlob, size_t cbBlob);
+	void clear();
+private:
+	std::atomic<const ShapeTemplates*> m_pCurrent;
+	std::vector<const ShapeTemplates*> m_vRetired;
+	ShapeKernel m_kernel;
+
+	void replace(const ShapeTemplates* pTemplates);
+
+	ShapeLibrary(const ShapeLibrary&);
+	ShapeLibrary& operator=(const ShapeLibrary&);
+};
@@ -0,0 +1,116 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "SharedConfig.h"
+
+#include <string.h>
+#include <thread>
+
+static_assert(sizeof(SharedConfig) % sizeof(uint32_t) == 0, "SharedConfig is copied in whole words");
+static_assert(SHARED_CONFIG_MIN_SIZE <= sizeof(SharedConfig) &&
+			  sizeof(SharedConfig) <= SharedConfigBlock::CAPACITY_WORDS * sizeof(uint32_t),
+			  "SharedConfig must fit the block of every build");
+
+bool IsValidSharedConfig(const SharedConfig& config) {
+	if (config.cbSize < SHARED_CONFIG_MIN_SIZE || config.cbHotkeyRules > SHARED_CONFIG_MAX_HOTKEY_RULES)
+		return false;
+	if (config.cbHotkeyRules) {
+		HotkeyRules rules;
+		if (!rules.load(config.aHotkeyRules, config.cbHotkeyRules))
+			return false;
+	}
+	return true;
+}
+
+bool SharedConfigBlock::write(const SharedConfig& config) {
+	uint32_t aWords[WORDS];
+	memcpy(aWords, &config, sizeof(aWords));
+
+	// take the sequence from even to odd, only one writer can
+	uint32_t sequence;
+	for (int nAttempts = 0;; nAttempts++) {
+		if (nAttempts == WRITE_ATTEMPTS)
+			return false;
+		sequence = m_sequence.load(std::memory_order_relaxed);
+		if (!(sequence & 1) && m_sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_relaxed))
+			break;
+		std::this_thread::yield();
+	}
+	// no word may become visible before the odd sequence
+	std::atomic_thread_fence(std::memory_order_release);
+	for (int i = 0; i < WORDS; i++)
+		m_aWords[i].store(aWords[i], std::memory_order_relaxed);
+	// 0 stands for a block nothing was written to
+	m_sequence.store(sequence + 2 ? sequence + 2 : 2, std::memory_order_release);
+	return true;
+}
+
+uint32_t SharedConfigBlock::read(SharedConfig& config) const {
+	uint32_t aWords[WORDS];
+	for (int nAttempts = 0; nAttempts < READ_ATTEMPTS; nAttempts++) {
+		uint32_t sequence = m_sequence.load(std::memory_order_acquire);
+		if (sequence == 0)
+			return 0;
+		if (sequence & 1)
+			continue;
+		for (int i = 0; i < WORDS; i++)
+			aWords[i] = m_aWords[i].load(std::memory_order_relaxed);
+		// no word may be read after the sequence is checked again
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_sequence.load(std::memory_order_relaxed) == sequence) {
+			memcpy(&config, aWords, sizeof(aWords));
+			// the rest of the words are left over from a newer writer or were never written
+			if (config.cbSize >= SHARED_CONFIG_MIN_SIZE && config.cbSize < sizeof(config))
+				memset(reinterpret_cast<char*>(&config) + config.cbSize, 0, sizeof(config) - config.cbSize);
+			return sequence;
+		}
+	}
+	return 0;
+}
+
+SharedConfigSync::SharedConfigSync(HotkeyRules& rules, MoveDecimation& decimation) :
+m_rules(rules), m_decimation(decimation) {
+	m_processVersion.store(0, std::memory_order_relaxed);
+	m_flags.store(0, std::memory_order_relaxed);
+}
+
+void SharedConfigSync::syncChanged(const SharedConfigBlock& block, GestureHandlers& handlers, uint32_t& threadVersion) {
+	SharedConfig config;
+	uint32_t version = block.read(config);
+	// a block written by another build may not be valid for this one, it is then ignored until the next write
+	if (version == 0 || !IsValidSharedConfig(config)) {
+		if (version)
+			threadVersion = version;
+		return;
+	}
+	if (m_processVersion.exchange(version, std::memory_order_relaxed) != version) {
+		m_decimation.set(config.moveMinDistance, config.msMoveMaxInterval);
+		if (config.cbHotkeyRules)
+			m_rules.load(config.aHotkeyRules, config.cbHotkeyRules);
+		else
+			m_rules.loadDefaults();
+		m_flags.store(config.flags & SCF_Known, std::memory_order_relaxed);
+	}
+	// a handler disabled mid-gesture would never forward what it swallowed, this thread takes the mask and
+	// the version once its gesture is over
+	if (!handlers.allInactive())
+		return;
+	// handlers of a newer build are not there to enable
+	handlers.setEnabledMask(config.enabledGestures & ((1u << GestureHandlers::Pipeline::SIZE) - 1));
+	threadVersion = version;
+}
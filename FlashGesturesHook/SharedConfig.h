@@ -0,0 +1,140 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// One configuration for every process the hook dll is loaded into. Settings made through the
+// other exports only reach the process that calls them, plugin processes read this block instead.
+
+#include "GestureHandler.h"
+#include "HotkeyRules.h"
+#include "MoveDecimator.h"
+
+#include <atomic>
+
+/* Room for a hotkey rule blob with a rule for every virtual-key code */
+const int SHARED_CONFIG_MAX_HOTKEY_RULES = 516;
+
+/* Bits of SharedConfig::flags */
+enum SharedConfigFlag {
+	/* every hooked process writes what its hook threads see to an input trace, see InputTrace.h */
+	SCF_CaptureInput = 0x0001,
+	/* plugin processes forward to firefox through the gesture channel rather than posting, see GestureChannel.h */
+	SCF_GestureChannel = 0x0002,
+	/* the bits this build knows, it ignores the others */
+	SCF_Known = SCF_CaptureInput | SCF_GestureChannel
+};
+
+/*
+ * As passed to FGH_SetSharedConfig. The extension builds this through js-ctypes, and hook dlls
+ * of different builds share one block, so fields may only be appended, and 0 must keep the
+ * behaviour of the builds before them. A dll reads the fields it knows: a larger cbSize comes from
+ * a newer build, fields past a smaller one read as 0. Gestures and flags it does not know are ignored.
+ */
+struct SharedConfig {
+	uint32_t cbSize;
+	/* bit i enables handler i of GestureHandlers::getHandlerNames, i.e. 1 trace, 2 rocker, 4 wheel */
+	uint32_t enabledGestures;
+	/* see MoveDecimationConfig, 0 px forwards every move */
+	uint16_t moveMinDistance;
+	uint16_t msMoveMaxInterval;
+	/* a FGH_SetHotkeyRules blob, none keeps the default rules */
+	uint16_t cbHotkeyRules;
+	/* SCF_* bits, 0 in blocks of builds that did not know any */
+	uint16_t flags;
+	uint8_t aHotkeyRules[SHARED_CONFIG_MAX_HOTKEY_RULES];
+};
+
+/* Size of the first published SharedConfig, no build writes less */
+const uint32_t SHARED_CONFIG_MIN_SIZE = 532;
+
+/* Checks what the hook would otherwise apply blindly in every process */
+bool IsValidSharedConfig(const SharedConfig& config);
+
+/*
+ * A seqlock around a SharedConfig, laid out to live in memory mapped by several processes.
+ * Zeroed memory is an empty block. The sequence is odd while a write is in progress and
+ * changes with every write, so it doubles as the config version: readers compare it against
+ * the version they last applied and only copy the config when it differs. A reader copies the
+ * words, then checks the sequence did not move meanwhile; it never blocks a writer.
+ */
+class SharedConfigBlock {
+public:
+	/* A writer waits this many time slices for another write to finish */
+	static const int WRITE_ATTEMPTS = 1 << 16;
+	/* A reader gives up after this many torn copies and keeps what it has, it retries on the next message */
+	static const int READ_ATTEMPTS = 64;
+
+	/* Changes with every write, even and nonzero once a config has been written, 0 before */
+	uint32_t getVersion() const { return m_sequence.load(std::memory_order_acquire); }
+
+	/*
+	 * Writers are serialized by the sequence itself. Returns false if another write did not finish
+	 * in time: a writer that died mid-write leaves the block odd for good, readers then keep the
+	 * config they have, and further writes fail until every process has unmapped the block.
+	 */
+	bool write(const SharedConfig& config);
+	/*
+	 * Copies a consistent config and returns its version, 0 if nothing has been written or no copy succeeded.
+	 * Fields the writer's build did not have are zeroed.
+	 */
+	uint32_t read(SharedConfig& config) const;
+
+	/* Room for the SharedConfig of later builds, which must keep the block's size to map it */
+	static const int CAPACITY_WORDS = 512;
+private:
+	static const int WORDS = sizeof(SharedConfig) / sizeof(uint32_t);
+
+	std::atomic<uint32_t> m_sequence;
+	std::atomic<uint32_t> m_aWords[CAPACITY_WORDS];
+};
+
+/*
+ * Brings one process's settings up to date with a SharedConfigBlock. Hook threads call sync
+ * for every message they look at; it is a single load unless the block changed. The gesture mask
+ * applies per thread, the move decimation, the hotkey rules and the flags once per process and version.
+ */
+class SharedConfigSync {
+public:
+	SharedConfigSync(HotkeyRules& rules, MoveDecimation& decimation);
+
+	/*
+	 * threadVersion is the version the calling thread applied last, 0 initially. The process-wide settings
+	 * apply at once, the enabled gestures only while none of the thread's handlers is active.
+	 */
+	void sync(const SharedConfigBlock& block, GestureHandlers& handlers, uint32_t& threadVersion) {
+		if (block.getVersion() != threadVersion)
+			syncChanged(block, handlers, threadVersion);
+	}
+	/* SCF_* bits of the config applied last */
+	uint16_t getFlags() const { return m_flags.load(std::memory_order_relaxed); }
+	/* Forgets the version applied last, for when the block is closed: one opened anew counts from the start again */
+	void reset() {
+		m_processVersion.store(0, std::memory_order_relaxed);
+		m_flags.store(0, std::memory_order_relaxed);
+	}
+private:
+	HotkeyRules& m_rules;
+	MoveDecimation& m_decimation;
+	std::atomic<uint32_t> m_processVersion;
+	std::atomic<uint16_t> m_flags;
+
+	void syncChanged(const SharedConfigBlock& block, GestureHandlers& handlers, uint32_t& threadVersion);
+
+	SharedConfigSync(const SharedConfigSync&);
+	SharedConfigSync& operator=(const SharedConfigSync&);
+};
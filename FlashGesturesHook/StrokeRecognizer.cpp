@@ -0,0 +1,157 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "StrokeRecognizer.h"
+
+namespace {
+
+const int ENTRY_LENGTH_SHIFT = 16;
+const int ENTRY_KEY_SHIFT = 20;
+const int ENTRY_MODIFIERS_SHIFT = 28;
+
+/* 0 to 3 for 'U', 'D', 'L', 'R', -1 for anything else */
+int DirectionCode(char direction) {
+	switch (direction) {
+	case 'U': return 0;
+	case 'D': return 1;
+	case 'L': return 2;
+	case 'R': return 3;
+	default: return -1;
+	}
+}
+
+/* The key part of an entry, 0 if the directions cannot be encoded */
+uint32_t EncodeDirections(const char* pDirections, int nDirections) {
+	if (nDirections < 1 || nDirections > STROKE_MAX_DIRECTIONS)
+		return 0;
+	uint32_t code = 0;
+	for (int i = 0; i < nDirections; i++) {
+		int iDirection = DirectionCode(pDirections[i]);
+		if (iDirection < 0)
+			return 0;
+		code |= static_cast<uint32_t>(iDirection) << (2 * i);
+	}
+	return code | (static_cast<uint32_t>(nDirections) << ENTRY_LENGTH_SHIFT);
+}
+
+const uint32_t ENTRY_DIRECTIONS_MASK = (1u << ENTRY_KEY_SHIFT) - 1;
+
+}
+
+StrokeRecognizer::StrokeRecognizer() : m_ptAnchor(), m_nDirections(0), m_bOverflowed(false) {
+	m_szDirections[0] = '\0';
+}
+
+void StrokeRecognizer::begin(GesturePoint pt) {
+	m_ptAnchor = pt;
+	m_nDirections = 0;
+	m_bOverflowed = false;
+	m_szDirections[0] = '\0';
+}
+
+void StrokeRecognizer::addPoint(GesturePoint pt) {
+	int dx = pt.x - m_ptAnchor.x, dy = pt.y - m_ptAnchor.y;
+	char last = m_nDirections ? m_szDirections[m_nDirections - 1] : '\0';
+	if (last) {
+		// while the stroke keeps going mostly the same way the anchor follows its tip, so drift across
+		// the direction never adds up and the next turn is measured from where it really starts
+		int along = last == 'R' ? dx : last == 'L' ? -dx : last == 'D' ? dy : -dy;
+		int across = last == 'R' || last == 'L' ? dy : dx;
+		if (across < 0)
+			across = -across;
+		if (along >= across) {
+			if (along > 0)
+				m_ptAnchor = pt;
+			return;
+		}
+	}
+
+	int adx = dx < 0 ? -dx : dx, ady = dy < 0 ? -dy : dy;
+	int major = adx > ady ? adx : ady, minor = adx > ady ? ady : adx;
+	// too short or too diagonal to tell yet, keep the anchor so the movement adds up until it is clear
+	if (major < (last ? TURN_MIN_LENGTH : SEGMENT_MIN_LENGTH) || (last && 100 * major < TURN_RATIO_PERCENT * minor))
+		return;
+
+	// client coordinates grow downwards
+	char direction = adx > ady ? (dx > 0 ? 'R' : 'L') : (dy > 0 ? 'D' : 'U');
+	if (m_nDirections == STROKE_MAX_DIRECTIONS) {
+		m_bOverflowed = true;
+	} else {
+		m_szDirections[m_nDirections++] = direction;
+		m_szDirections[m_nDirections] = '\0';
+	}
+	m_ptAnchor = pt;
+}
+
+StrokeCommands::StrokeCommands() {
+	clear();
+}
+
+bool StrokeCommands::find(const StrokeRecognizer& stroke, StrokeCommand& command) const {
+	if (stroke.isOverflowed())
+		return false;
+	uint32_t directions = EncodeDirections(stroke.getDirections(), stroke.getDirectionCount());
+	if (directions == 0)
+		return false;
+	for (int i = 0; i < STROKE_MAX_COMMANDS; i++) {
+		uint32_t entry = m_aEntries[i].load(std::memory_order_relaxed);
+		if ((entry & ENTRY_DIRECTIONS_MASK) == directions) {
+			command.virtualKey = static_cast<uint8_t>(entry >> ENTRY_KEY_SHIFT);
+			command.modifiers = static_cast<uint8_t>(entry >> ENTRY_MODIFIERS_SHIFT);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool StrokeCommands::load(const uint8_t* pBlob, size_t cbBlob) {
+	if (cbBlob < 1 || pBlob[0] != STROKE_COMMANDS_VERSION)
+		return false;
+
+	uint32_t aEntries[STROKE_MAX_COMMANDS] = { 0 };
+	int nEntries = 0;
+	size_t i = 1;
+	while (i < cbBlob) {
+		int nDirections = pBlob[i];
+		if (nEntries == STROKE_MAX_COMMANDS || cbBlob - i < static_cast<size_t>(nDirections) + 3)
+			return false;
+		uint32_t directions = EncodeDirections(reinterpret_cast<const char*>(pBlob + i + 1), nDirections);
+		uint8_t modifiers = pBlob[i + nDirections + 2];
+		if (directions == 0 || modifiers & ~(GHM_Alt | GHM_Ctrl | GHM_Shift))
+			return false;
+		for (int iEntry = 0; iEntry < nEntries; iEntry++) {
+			// the same stroke twice is most likely a mistake in the configuration
+			if ((aEntries[iEntry] & ENTRY_DIRECTIONS_MASK) == directions)
+				return false;
+		}
+		aEntries[nEntries++] = directions | (static_cast<uint32_t>(pBlob[i + nDirections + 1]) << ENTRY_KEY_SHIFT)
+			| (static_cast<uint32_t>(modifiers) << ENTRY_MODIFIERS_SHIFT);
+		i += nDirections + 3;
+	}
+
+	for (int iEntry = 0; iEntry < STROKE_MAX_COMMANDS; iEntry++)
+		m_aEntries[iEntry].store(aEntries[iEntry], std::memory_order_relaxed);
+	m_bEnabled.store(true, std::memory_order_relaxed);
+	return true;
+}
+
+void StrokeCommands::clear() {
+	m_bEnabled.store(false, std::memory_order_relaxed);
+	for (int i = 0; i < STROKE_MAX_COMMANDS; i++)
+		m_aEntries[i].store(0, std::memory_order_relaxed);
+}
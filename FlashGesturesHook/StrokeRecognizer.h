@@ -0,0 +1,101 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Recognizes trace gestures inside the hook: the stroke is quantized into up/down/left/right
+// segments while it is drawn, and on button release firefox gets the hotkey configured for the
+// resulting direction string instead of every mouse move of the stroke.
+
+#include "GestureCore.h"
+
+#include <stddef.h>
+#include <atomic>
+
+const int STROKE_MAX_DIRECTIONS = 8;
+
+/* Quantizes the points of one stroke into a string of 'U', 'D', 'L' and 'R' */
+class StrokeRecognizer {
+public:
+	/* Distance the pointer must travel before the stroke is measured again */
+	static const int SEGMENT_MIN_LENGTH = 16;
+	/*
+	 * Hysteresis between directions: continuing in the current direction only needs it to be the
+	 * dominant axis, turning needs TURN_MIN_LENGTH along the new axis and at least 1.5 times as much
+	 * as along the other one. Jitter, slightly diagonal lines and the sideways bulge of a
+	 * rounded U-turn therefore do not add spurious segments.
+	 */
+	static const int TURN_MIN_LENGTH = 32;
+	static const int TURN_RATIO_PERCENT = 150;
+
+	StrokeRecognizer();
+
+	void begin(GesturePoint pt);
+	void addPoint(GesturePoint pt);
+
+	/* NUL terminated, e.g. "DR" for down then right */
+	const char* getDirections() const { return m_szDirections; }
+	int getDirectionCount() const { return m_nDirections; }
+	/* The stroke turned more than STROKE_MAX_DIRECTIONS times, it matches no command */
+	bool isOverflowed() const { return m_bOverflowed; }
+private:
+	GesturePoint m_ptAnchor;
+	char m_szDirections[STROKE_MAX_DIRECTIONS + 1];
+	int m_nDirections;
+	bool m_bOverflowed;
+};
+
+/* The hotkey firefox receives for a recognized stroke */
+struct StrokeCommand {
+	uint8_t virtualKey;
+	/* GestureHotkeyModifier flags */
+	uint8_t modifiers;
+};
+
+/*
+ * Command blob, as passed to FGH_SetStrokeCommands:
+ *   byte 0       STROKE_COMMANDS_VERSION
+ *   then entries length n (1 to STROKE_MAX_DIRECTIONS), n direction characters 'U', 'D', 'L' or 'R',
+ *                virtual-key code, GestureHotkeyModifier flags
+ * At most STROKE_MAX_COMMANDS entries.
+ */
+const uint8_t STROKE_COMMANDS_VERSION = 1;
+const int STROKE_MAX_COMMANDS = 32;
+
+/* Direction strings to hotkeys; without commands, strokes are forwarded to firefox move by move */
+class StrokeCommands {
+public:
+	StrokeCommands();
+
+	bool isEnabled() const { return m_bEnabled.load(std::memory_order_relaxed); }
+	bool find(const StrokeRecognizer& stroke, StrokeCommand& command) const;
+
+	/*
+	 * Replaces all commands and enables recognition, returns false and keeps the current ones if the
+	 * blob is malformed. Lookups on other threads see each command's old or new value, never a mix.
+	 */
+	bool load(const uint8_t* pBlob, size_t cbBlob);
+	/* Turns recognition off */
+	void clear();
+private:
+	/* An entry packs 2 bits per direction, the direction count, the key and the modifiers, 0 is unused */
+	std::atomic<uint32_t> m_aEntries[STROKE_MAX_COMMANDS];
+	std::atomic<bool> m_bEnabled;
+
+	StrokeCommands(const StrokeCommands&);
+	StrokeCommands& operator=(const StrokeCommands&);
+};
@@ -23,6 +23,10 @@ along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
 using namespace std;
 
 extern DWORD g_dwTlsIndex;
+extern StrokeCommands g_strokeCommands;
+extern ShapeLibrary g_shapeLibrary;
+extern GestureScriptLibrary g_gestureScripts;
+extern MoveDecimation g_moveDecimation;
 static unordered_set<ThreadLocalStorage*> g_setAllocatedTLS;
 
 class SimpleMutex {
@@ -44,19 +48,29 @@ public:
 };
 
 SimpleMutex g_mtxAllocatedTLS;
+// statistics of threads whose storage has been freed, guarded by g_mtxAllocatedTLS
+static HookStatsSnapshot g_retiredSnapshot = { sizeof(HookStatsSnapshot) };
 
-ThreadLocalStorage::ThreadLocalStorage() : bGetMsgHookReentranceGuard(false) {
+// Storage that outgrew the pool slots would silently come from the heap for every thread
+static_assert(sizeof(ThreadLocalStorage) <= HOOK_POOL_SLOT_SIZE, "ThreadLocalStorage must fit a HookThreadState pool slot");
+
+ThreadLocalStorage::ThreadLocalStorage() : HookThreadState(GetCurrentThreadId()) {
+	gestureHandlers.setStrokeCommands(&g_strokeCommands);
+	gestureHandlers.setShapeLibrary(&g_shapeLibrary);
+	gestureHandlers.setScriptLibrary(&g_gestureScripts);
+	gestureHandlers.setMoveDecimation(&g_moveDecimation);
 	SimpleLock lock(g_mtxAllocatedTLS);
 	g_setAllocatedTLS.insert(this);
 }
 
 ThreadLocalStorage::~ThreadLocalStorage() {
 	SimpleLock lock(g_mtxAllocatedTLS);
+	hookStats.addTo(g_retiredSnapshot);
 	g_setAllocatedTLS.erase(this);
 }
 
 ThreadLocalStorage& ThreadLocalStorage::GetInstance() {
-	ThreadLocalStorage* pData = reinterpret_cast<ThreadLocalStorage*>(TlsGetValue(g_dwTlsIndex));
+	ThreadLocalStorage* pData = GetExisting();
 	if (pData == NULL) {
 		pData = new ThreadLocalStorage();
 		TlsSetValue(g_dwTlsIndex, reinterpret_cast<void*>(pData));
@@ -64,6 +78,10 @@ ThreadLocalStorage& ThreadLocalStorage::GetInstance() {
 	return *pData;
 }
 
+ThreadLocalStorage* ThreadLocalStorage::GetExisting() {
+	return reinterpret_cast<ThreadLocalStorage*>(TlsGetValue(g_dwTlsIndex));
+}
+
 void ThreadLocalStorage::FreeAllInstances() {
 	vector<ThreadLocalStorage*> vInstancesToClear;
 	{
@@ -78,3 +96,21 @@ void ThreadLocalStorage::FreeAllInstances() {
 
 	ATLASSERT(g_setAllocatedTLS.size() == 0);
 }
+
+void ThreadLocalStorage::SnapshotStats(HookStatsSnapshot& snapshot) {
+	SimpleLock lock(g_mtxAllocatedTLS);
+	snapshot = g_retiredSnapshot;
+	snapshot.nThreads = static_cast<uint32_t>(g_setAllocatedTLS.size());
+	for (ThreadLocalStorage* pTLS : g_setAllocatedTLS)
+		pTLS->hookStats.addTo(snapshot);
+}
+
+void ThreadLocalStorage::SnapshotFlightRecorders(vector<FlightDumpRing>& vRings) {
+	SimpleLock lock(g_mtxAllocatedTLS);
+	for (ThreadLocalStorage* pTLS : g_setAllocatedTLS) {
+		FlightDumpRing ring;
+		ring.idThread = pTLS->flightRecorder.getThreadId();
+		pTLS->flightRecorder.snapshot(ring.vRecords);
+		vRings.push_back(ring);
+	}
+}
@@ -17,19 +17,20 @@ along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
-class GestureHandler;
-struct GestureHandlers {
-	~GestureHandlers();
-	std::vector<GestureHandler*> m_vHandlers;
-};
-
-struct ThreadLocalStorage {
-	GestureHandlers gestureHandlers;
-	bool bGetMsgHookReentranceGuard;
+#include "HookThreadState.h"
 
+/* HookThreadState of a hooked thread, registered so that it can be enumerated and freed from any thread */
+struct ThreadLocalStorage : HookThreadState {
 	ThreadLocalStorage();
 	~ThreadLocalStorage();
 
+	/* Creates the calling thread's storage on first use */
 	static ThreadLocalStorage& GetInstance();
+	/* The calling thread's storage, or NULL if it has none yet */
+	static ThreadLocalStorage* GetExisting();
 	static void FreeAllInstances();
+	/* Totals over all threads, including the ones that have already exited */
+	static void SnapshotStats(HookStatsSnapshot& snapshot);
+	/* Appends a snapshot of every live thread's flight recorder */
+	static void SnapshotFlightRecorders(std::vector<FlightDumpRing>& vRings);
 };
@@ -0,0 +1,57 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "WakeupBroadcast.h"
+
+WakeupReport WakeUpWindows(WakeupChannel& channel, const std::vector<GestureWindow>& vWindows, uint32_t msDeadline) {
+	WakeupReport report = { static_cast<uint32_t>(vWindows.size()), 0, 0, 0, 0, 0 };
+	uint64_t msStart = channel.nowMs();
+
+	uint32_t nPending = 0;
+	for (size_t i = 0; i < vWindows.size(); i++) {
+		switch (channel.send(vWindows[i], static_cast<uint32_t>(i))) {
+		case WSR_Sent:
+			nPending++;
+			break;
+		case WSR_Hung:
+			report.nHung++;
+			break;
+		default:
+			report.nFailed++;
+			break;
+		}
+	}
+
+	std::vector<uint32_t> vCompleted;
+	while (nPending) {
+		uint64_t msElapsed = channel.nowMs() - msStart;
+		if (msElapsed >= msDeadline)
+			break;
+		vCompleted.clear();
+		channel.waitCompleted(static_cast<uint32_t>(msDeadline - msElapsed), vCompleted);
+		uint32_t nCompleted = static_cast<uint32_t>(vCompleted.size());
+		if (nCompleted > nPending)
+			nCompleted = nPending;
+		report.nCompleted += nCompleted;
+		nPending -= nCompleted;
+	}
+
+	report.nTimedOut = nPending;
+	report.msElapsed = static_cast<uint32_t>(channel.nowMs() - msStart);
+	return report;
+}
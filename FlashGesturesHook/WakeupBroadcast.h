@@ -0,0 +1,67 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Wakes up the message loops of the hooked threads on shutdown, so that they unload the hook dll.
+// All wake-ups are sent at once and collected under a single deadline, instead of one thread at
+// a time with a timeout each, so that hung plugin threads cannot add up.
+
+#include <stdint.h>
+#include <vector>
+
+#include "GestureCore.h"
+
+enum WakeupSendResult {
+	WSR_Sent,
+	/* the window's thread has not responded for a while, there is no point in waiting for it */
+	WSR_Hung,
+	WSR_Failed
+};
+
+/* Delivers wake-ups and reports their completion, implemented with SendMessageCallback in the hook dll */
+class WakeupChannel {
+public:
+	/* Sends a message to hwnd without waiting for it */
+	virtual WakeupSendResult send(GestureWindow hwnd, uint32_t cookie) = 0;
+	/* Waits up to msTimeout for wake-ups to complete, appends the cookies of the completed ones */
+	virtual void waitCompleted(uint32_t msTimeout, std::vector<uint32_t>& vCompleted) = 0;
+	/* Monotonic time */
+	virtual uint64_t nowMs() = 0;
+protected:
+	~WakeupChannel() {}
+};
+
+struct WakeupReport {
+	uint32_t nWindows;
+	/* wake-ups that the target thread processed in time */
+	uint32_t nCompleted;
+	/* windows of threads that were already hung, skipped */
+	uint32_t nHung;
+	/* wake-ups that could not be sent at all */
+	uint32_t nFailed;
+	/* wake-ups still pending at the deadline, hung or slow threads */
+	uint32_t nTimedOut;
+	uint32_t msElapsed;
+};
+
+/* Total time allowed for all wake-ups, used to be the timeout of each thread */
+const uint32_t WAKEUP_DEADLINE_MS = 200;
+
+/* Wakes up the thread of every window in vWindows, returns after all completed or msDeadline passed */
+WakeupReport WakeUpWindows(WakeupChannel& channel, const std::vector<GestureWindow>& vWindows,
+						   uint32_t msDeadline = WAKEUP_DEADLINE_MS);
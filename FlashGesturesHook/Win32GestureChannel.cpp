@@ -0,0 +1,144 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "Win32GestureChannel.h"
+#include "Win32SharedConfig.h"
+
+extern bool g_bIsInProcessHook;
+
+// The layout is part of the name, like the shared config's
+static const wchar_t GESTURE_CHANNEL_NAME[] = L"Local\\FlashGesturesHookChannel.1";
+
+GestureChannel* g_pGestureChannel = NULL;
+static HANDLE s_hMapping = NULL;
+
+// Stateless, safe to share among all hooked threads
+Win32GestureChannelSystem g_gestureChannelSystem;
+
+void OpenGestureChannel() {
+	// Zeroed pages are an empty ring without a consumer. Producers in sandboxed plugin processes write
+	// to it too, without it they post directly.
+	s_hMapping = CreateSharedMapping(GESTURE_CHANNEL_NAME, sizeof(GestureChannel));
+	if (s_hMapping == NULL) {
+		ATLTRACE(_T("ERROR: CreateFileMapping failed for the gesture channel, posting directly, last error = %d\n"), GetLastError());
+		return;
+	}
+	g_pGestureChannel = reinterpret_cast<GestureChannel*>(MapViewOfFile(s_hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(GestureChannel)));
+	if (g_pGestureChannel == NULL) {
+		ATLTRACE(_T("ERROR: MapViewOfFile failed for the gesture channel, posting directly, last error = %d\n"), GetLastError());
+		CloseHandle(s_hMapping);
+		s_hMapping = NULL;
+	}
+}
+
+void CloseGestureChannel() {
+	if (g_pGestureChannel) {
+		UnmapViewOfFile(g_pGestureChannel);
+		g_pGestureChannel = NULL;
+	}
+	if (s_hMapping) {
+		CloseHandle(s_hMapping);
+		s_hMapping = NULL;
+	}
+}
+
+uint32_t Win32GestureChannelSystem::currentProcessId() {
+	return GetCurrentProcessId();
+}
+
+bool Win32GestureChannelSystem::isProcessAlive(uint32_t idProcess) {
+	HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, idProcess);
+	if (hProcess == NULL) {
+		// a process we may not open is still there, the slot waits for it
+		return GetLastError() != ERROR_INVALID_PARAMETER;
+	}
+	bool bAlive = WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT;
+	CloseHandle(hProcess);
+	return bAlive;
+}
+
+GestureChannelWakeResult Win32GestureChannelSystem::wakeConsumer(uint32_t idConsumer) {
+	if (PostThreadMessage(idConsumer, USERMESSAGE_CHANNEL_WAKEUP, 0, 0))
+		return GCW_Posted;
+	DWORD dwError = GetLastError();
+	ATLTRACE(_T("ERROR: PostThreadMessage(USERMESSAGE_CHANNEL_WAKEUP) failed, last error = %d\n"), dwError);
+	// a full queue drains again, a thread that is gone does not
+	return dwError == ERROR_INVALID_THREAD_ID ? GCW_ConsumerGone : GCW_Failed;
+}
+
+void Win32ChannelForwarder::postMessage(GestureWindow hwnd, const GestureMessage& msg) {
+	// only the browser process runs the hook manage thread, in plugin processes firefox is always remote.
+	// Off unless the extension asks for it, in ChannelBench the ring only reliably beats posting with a single producer
+	if (hwnd == m_hwndFirefox && !g_bIsInProcessHook && g_pGestureChannel
+		&& (g_sharedConfigSync.getFlags() & SCF_GestureChannel))
+	{
+		GestureChannelEvent event = { static_cast<uint32_t>(hwnd), msg.message, static_cast<uint32_t>(msg.wParam),
+									  static_cast<uint32_t>(msg.lParam) };
+		// Posting past a full ring would overtake this thread's events still in it, so wait for the consumer
+		// to catch up, but not on a consumer that died with its wake-up pending or hangs
+		GestureChannelPushResult result;
+		DWORD msStart = GetTickCount();
+		while ((result = g_pGestureChannel->push(g_gestureChannelSystem, event)) == GCP_Full) {
+			if (GetTickCount() - msStart >= CHANNEL_FULL_WAIT_MS) {
+				g_pGestureChannel->checkConsumer(g_gestureChannelSystem);
+				break;
+			}
+			Sleep(1);
+		}
+		if (result == GCP_Queued)
+			return;
+	}
+	Win32GestureForwarder::postMessage(hwnd, msg);
+}
+
+static void DeliverQueuedEvents() {
+	g_pGestureChannel->rearm();
+	GestureChannelEvent event;
+	while (g_pGestureChannel->pop(g_gestureChannelSystem, event)) {
+		// handles are sign extended from their 32 significant bits, points and key states zero extended
+		HWND hwnd = reinterpret_cast<HWND>(static_cast<intptr_t>(static_cast<int32_t>(event.hwnd)));
+		::PostMessage(hwnd, event.message, static_cast<WPARAM>(event.wParam), static_cast<LPARAM>(event.lParam));
+	}
+}
+
+void AttachGestureChannelConsumer() {
+	if (g_pGestureChannel == NULL)
+		return;
+	if (!g_pGestureChannel->attachConsumer(GetCurrentThreadId())) {
+		// plugin processes of this firefox then keep posting directly
+		ATLTRACE(_T("Gesture channel already consumed by thread %d\n"), g_pGestureChannel->getConsumer());
+		return;
+	}
+	// a consumer that went away may have left events behind
+	DeliverQueuedEvents();
+}
+
+void DeliverGestureChannelEvents() {
+	if (g_pGestureChannel && g_pGestureChannel->getConsumer() == GetCurrentThreadId())
+		DeliverQueuedEvents();
+}
+
+void DetachGestureChannelConsumer() {
+	if (g_pGestureChannel == NULL || g_pGestureChannel->getConsumer() != GetCurrentThreadId())
+		return;
+	g_pGestureChannel->detachConsumer(GetCurrentThreadId());
+	// what producers still finish after this waits for the next consumer
+	DeliverQueuedEvents();
+	if (g_pGestureChannel->getSkippedCount())
+		ATLTRACE(_T("Gesture channel skipped %d event(s) of crashed plugin processes\n"), g_pGestureChannel->getSkippedCount());
+}
@@ -0,0 +1,64 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "GestureChannel.h"
+#include "Win32GestureForwarder.h"
+
+/* The consumer's wake-up, posted to the hook manage thread of the browser process */
+const UINT USERMESSAGE_CHANNEL_WAKEUP = WM_USER + 25;
+
+/* The ring every process with the hook dll loaded maps under one name, NULL if it could not be mapped */
+extern GestureChannel* g_pGestureChannel;
+
+/* Called from DllMain, only kernel32 is used */
+void OpenGestureChannel();
+void CloseGestureChannel();
+
+/* Process handles and thread messages */
+class Win32GestureChannelSystem : public GestureChannelSystem {
+public:
+	uint32_t currentProcessId();
+	bool isProcessAlive(uint32_t idProcess);
+	GestureChannelWakeResult wakeConsumer(uint32_t idConsumer);
+};
+
+extern Win32GestureChannelSystem g_gestureChannelSystem;
+
+/*
+ * Posts to the firefox window through the channel when the hook runs in a plugin process, everything
+ * else is forwarded directly. A full ring is waited on for up to CHANNEL_FULL_WAIT_MS, as posting
+ * directly would overtake the queued events. Past that the consumer is checked, and the message is
+ * posted directly: a consumer that has exited is detached, one that hangs is overtaken.
+ */
+class Win32ChannelForwarder : public Win32GestureForwarder {
+public:
+	/* How long a plugin thread waits for room in the ring, it is the thread that draws the plugin */
+	static const DWORD CHANNEL_FULL_WAIT_MS = 50;
+
+	explicit Win32ChannelForwarder(GestureWindow hwndFirefox) : m_hwndFirefox(hwndFirefox) {}
+	void postMessage(GestureWindow hwnd, const GestureMessage& msg);
+private:
+	GestureWindow m_hwndFirefox;
+};
+
+/* The consumer side, run by the hook manage thread */
+void AttachGestureChannelConsumer();
+/* Posts the queued events to their windows, on USERMESSAGE_CHANNEL_WAKEUP */
+void DeliverGestureChannelEvents();
+void DetachGestureChannelConsumer();
@@ -0,0 +1,118 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "Win32GestureForwarder.h"
+
+// Stateless, safe to share among all hooked threads
+Win32GestureForwarder g_gestureForwarder;
+
+void Win32GestureForwarder::sendMessage(GestureWindow hwnd, const GestureMessage& msg) {
+	::SendMessage(ToHWND(hwnd), msg.message, msg.wParam, msg.lParam);
+}
+
+void Win32GestureForwarder::postMessage(GestureWindow hwnd, const GestureMessage& msg) {
+	::PostMessage(ToHWND(hwnd), msg.message, msg.wParam, msg.lParam);
+}
+
+GesturePoint Win32GestureForwarder::getClientOffset(GestureWindow hwndFrom, GestureWindow hwndTo) {
+	// Same as ClientToScreen followed by ScreenToClient, in one call.
+	// Neither plugin nor firefox windows use right-to-left layout, so this is a pure translation.
+	CPoint ptOrigin(0, 0);
+	MapWindowPoints(ToHWND(hwndFrom), ToHWND(hwndTo), &ptOrigin, 1);
+	GesturePoint offset = { ptOrigin.x, ptOrigin.y };
+	return offset;
+}
+
+// lParam of a typed key message: repeat count 1, the scan code, the context code for Alt, and the transition bits for a release
+static LPARAM HotkeyLParam(WORD vk, bool bAlt, bool bUp) {
+	LPARAM lParam = 1 | (static_cast<LPARAM>(MapVirtualKey(vk, MAPVK_VK_TO_VSC)) << 16);
+	if (bAlt)
+		lParam |= 1 << 29;
+	if (bUp)
+		lParam |= 0xC0000000;
+	return lParam;
+}
+
+UINT HotkeyCommandMessage() {
+	// every process gets the same number for the name; racing threads register it twice at worst
+	static UINT s_message = 0;
+	if (s_message == 0)
+		s_message = RegisterWindowMessageW(L"FlashGesturesHook.HotkeyCommand");
+	return s_message;
+}
+
+void Win32GestureForwarder::postHotkey(GestureWindow hwnd, uint8_t virtualKey, uint8_t modifiers) {
+	// Posted key messages would not change the modifier state firefox reads with GetKeyState, so the
+	// hotkey goes to the firefox window as a command that the hook in its thread types there, see
+	// TypeHotkeyCommand. Through postMessage it takes the gesture channel like the forwarded messages.
+	UINT message = HotkeyCommandMessage();
+	if (message == 0) {
+		ATLTRACE(_T("ERROR: RegisterWindowMessage failed for hotkey %x, last error = %d\n"), virtualKey, GetLastError());
+		return;
+	}
+	GestureMessage press = { hwnd, message, virtualKey, modifiers };
+	GestureMessage release = { hwnd, message, virtualKey, modifiers | HOTKEY_COMMAND_RELEASE };
+	postMessage(hwnd, press);
+	postMessage(hwnd, release);
+}
+
+void TypeHotkeyCommand(MSG* pMsg) {
+	static const struct { GestureHotkeyModifier modifier; BYTE vk, vkLeft, vkRight; } s_aModifierKeys[] = {
+		{ GHM_Ctrl, VK_CONTROL, VK_LCONTROL, VK_RCONTROL },
+		{ GHM_Shift, VK_SHIFT, VK_LSHIFT, VK_RSHIFT },
+		{ GHM_Alt, VK_MENU, VK_LMENU, VK_RMENU },
+	};
+	WORD vk = static_cast<WORD>(pMsg->wParam & 0xff);
+	uint8_t modifiers = static_cast<uint8_t>(pMsg->lParam);
+	bool bRelease = (pMsg->lParam & HOTKEY_COMMAND_RELEASE) != 0;
+	bool bAlt = (modifiers & GHM_Alt) != 0;
+	// the command itself never reaches the window
+	pMsg->message = WM_NULL;
+
+	BYTE abKeyState[256];
+	if (!GetKeyboardState(abKeyState)) {
+		ATLTRACE(_T("ERROR: GetKeyboardState failed for hotkey %x, last error = %d\n"), vk, GetLastError());
+		return;
+	}
+	// The press holds exactly the command's modifiers, as the left keys. The release does not restore what
+	// the press replaced: another command may have come in between, and the keys may have been let go of
+	// since, so the modifiers follow the physical keyboard again. The toggle bits are kept.
+	for (const auto& key : s_aModifierKeys) {
+		const BYTE aVks[] = { key.vk, key.vkLeft, key.vkRight };
+		for (BYTE vkModifier : aVks) {
+			bool bDown;
+			if (bRelease)
+				bDown = GetAsyncKeyState(vkModifier) < 0;
+			else
+				bDown = (modifiers & key.modifier) && vkModifier != key.vkRight;
+			abKeyState[vkModifier] = (abKeyState[vkModifier] & 0x01) | (bDown ? 0x80 : 0);
+		}
+	}
+	if (!SetKeyboardState(abKeyState)) {
+		ATLTRACE(_T("ERROR: SetKeyboardState failed for hotkey %x, last error = %d\n"), vk, GetLastError());
+		return;
+	}
+	// While Alt is held the keys go as WM_SYSKEY* messages with the context code set, which is how
+	// firefox tells an Alt combination
+	if (bRelease)
+		pMsg->message = bAlt ? WM_SYSKEYUP : WM_KEYUP;
+	else
+		pMsg->message = bAlt ? WM_SYSKEYDOWN : WM_KEYDOWN;
+	pMsg->wParam = vk;
+	pMsg->lParam = HotkeyLParam(vk, bAlt, bRelease);
+}
@@ -0,0 +1,63 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "GestureCore.h"
+
+/* Forwards gesture messages with SendMessage/PostMessage */
+class Win32GestureForwarder : public GestureForwarder {
+public:
+	void sendMessage(GestureWindow hwnd, const GestureMessage& msg);
+	void postMessage(GestureWindow hwnd, const GestureMessage& msg);
+	GesturePoint getClientOffset(GestureWindow hwndFrom, GestureWindow hwndTo);
+	void postHotkey(GestureWindow hwnd, uint8_t virtualKey, uint8_t modifiers);
+};
+
+extern Win32GestureForwarder g_gestureForwarder;
+
+/*
+ * The registered message postHotkey sends a hotkey as: wParam is the virtual key, lParam the
+ * GestureHotkeyModifier flags, with HOTKEY_COMMAND_RELEASE set for the second half.
+ */
+UINT HotkeyCommandMessage();
+const LPARAM HOTKEY_COMMAND_RELEASE = 0x100;
+
+inline bool IsHotkeyCommandMessage(UINT message) {
+	// registered messages start at 0xC000, the common case needs no call
+	return message >= 0xC000 && message == HotkeyCommandMessage();
+}
+
+/*
+ * Called by GetMsgHook in the thread of the window a hotkey command was posted to: turns it into the key
+ * message it stands for and, as firefox reads modifiers with GetKeyState, holds the modifiers in the
+ * thread's keyboard state for the press and gives them back to the physical keyboard for the release.
+ */
+void TypeHotkeyCommand(MSG* pMsg);
+
+inline GestureWindow ToGestureWindow(HWND hwnd) {
+	return reinterpret_cast<GestureWindow>(hwnd);
+}
+
+inline HWND ToHWND(GestureWindow hwnd) {
+	return reinterpret_cast<HWND>(hwnd);
+}
+
+inline GestureMessage ToGestureMessage(const MSG* pMsg) {
+	GestureMessage msg = { ToGestureWindow(pMsg->hwnd), pMsg->message, pMsg->wParam, pMsg->lParam };
+	return msg;
+}
@@ -0,0 +1,273 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "Win32InputCapture.h"
+#include "InputTrace.h"
+#include "Win32GestureForwarder.h"
+#include "Win32WindowTree.h"
+
+#include <deque>
+
+using namespace std;
+
+extern HotkeyRules g_hotkeyRules;
+
+std::atomic<bool> g_bInputCaptureOpen(false);
+
+// One lock for every thread's encoder and the chunks on their way to the file. It only ever covers work
+// in memory: hook threads encode into their own chunk and queue it when it is full, and a writer thread
+// started with the capture takes the chunks to the disk, so no hook thread waits for the file.
+class CaptureSection {
+private:
+	CRITICAL_SECTION m_cs;
+public:
+	CaptureSection() { InitializeCriticalSectionAndSpinCount(&m_cs, 4096); }
+	~CaptureSection() { DeleteCriticalSection(&m_cs); }
+
+	void Lock() { EnterCriticalSection(&m_cs); }
+	void Unlock() { LeaveCriticalSection(&m_cs); }
+};
+static CaptureSection s_csCapture;
+
+class CaptureLock {
+public:
+	CaptureLock() { s_csCapture.Lock(); }
+	~CaptureLock() { s_csCapture.Unlock(); }
+};
+
+/* One trace file and its writer thread, which frees it once the capture has ended and the file is closed */
+struct CaptureFile {
+	uint32_t generation;
+	wchar_t szPath[MAX_PATH + 64];
+	/* only touched by the writer thread, or by CloseInputCapture once the writer is gone */
+	FILE* pFile;
+	/* auto reset, set when chunks are queued and when the capture ends */
+	HANDLE hWakeup;
+	/* keeps the dll loaded while the writer thread runs */
+	HMODULE hPinnedModule;
+	// guarded by s_csCapture
+	deque<vector<uint8_t> > queueChunks;
+	/* no more chunks will be queued, the writer closes the file once it has written the queue */
+	bool bEnded;
+	/* the file could not be opened, the capture encodes nothing */
+	bool bFailed;
+};
+
+// guarded by s_csCapture
+static CaptureFile* s_pCapture = NULL;
+// counts the captures started, encoders of an earlier one are stale
+static uint32_t s_generation = 0;
+// a capture that could not start is not retried until the capture is turned off and on again
+static bool s_bStartFailed = false;
+static vector<InputTraceEncoder*> s_vEncoders;
+// the writer of the last capture, a new one only starts once it has finished
+static uintptr_t s_hWriterThread = 0;
+static CaptureFile* s_pWriting = NULL;
+
+static bool GetTraceFilePath(CaptureFile& capture) {
+	wchar_t szDirectory[MAX_PATH];
+	DWORD cchDirectory = GetTempPathW(MAX_PATH, szDirectory);
+	if (cchDirectory == 0 || cchDirectory >= MAX_PATH) {
+		ATLTRACE(_T("ERROR: no temp directory for the input trace, last error = %d\n"), GetLastError());
+		return false;
+	}
+	swprintf_s(capture.szPath, L"%lsFlashGesturesInput.%u.%u.fgit", szDirectory, GetCurrentProcessId(), capture.generation);
+	return true;
+}
+
+static FILE* OpenTraceFile(const wchar_t* szPath) {
+	FILE* pFile = NULL;
+	if (_wfopen_s(&pFile, szPath, L"wb") != 0 || pFile == NULL) {
+		ATLTRACE(_T("ERROR: cannot open input trace %ls\n"), szPath);
+		return NULL;
+	}
+	vector<uint8_t> vHeader;
+	AppendInputTraceHeader(vHeader);
+	fwrite(&vHeader[0], vHeader.size(), 1, pFile);
+	return pFile;
+}
+
+static void WriteChunks(FILE* pFile, const deque<vector<uint8_t> >& queueChunks) {
+	for (const vector<uint8_t>& vChunk : queueChunks) {
+		if (fwrite(&vChunk[0], vChunk.size(), 1, pFile) != 1)
+			ATLTRACE(_T("ERROR: failed to write %d bytes of input trace\n"), static_cast<int>(vChunk.size()));
+	}
+}
+
+static unsigned int __stdcall CaptureWriterThread(void* pvCapture) {
+	CaptureFile* pCapture = static_cast<CaptureFile*>(pvCapture);
+	pCapture->pFile = OpenTraceFile(pCapture->szPath);
+	if (pCapture->pFile == NULL) {
+		CaptureLock lock;
+		pCapture->bFailed = true;
+	}
+	for (bool bEnded = false; !bEnded;) {
+		WaitForSingleObject(pCapture->hWakeup, INFINITE);
+		deque<vector<uint8_t> > queueChunks;
+		{
+			CaptureLock lock;
+			queueChunks.swap(pCapture->queueChunks);
+			bEnded = pCapture->bEnded;
+		}
+		if (pCapture->pFile)
+			WriteChunks(pCapture->pFile, queueChunks);
+	}
+	if (pCapture->pFile)
+		fclose(pCapture->pFile);
+	HMODULE hPinnedModule = pCapture->hPinnedModule;
+	{
+		CaptureLock lock;
+		CloseHandle(pCapture->hWakeup);
+		delete pCapture;
+		s_pWriting = NULL;
+	}
+	// Never returns, the dll may be unloaded right away
+	FreeLibraryAndExitThread(hPinnedModule, 0);
+	return 0;
+}
+
+static bool StartCapture() {
+	CaptureFile* pCapture = new CaptureFile();
+	pCapture->generation = s_generation + 1;
+	pCapture->pFile = NULL;
+	pCapture->bEnded = false;
+	pCapture->bFailed = false;
+	pCapture->hPinnedModule = NULL;
+	if (!GetTraceFilePath(*pCapture)) {
+		delete pCapture;
+		return false;
+	}
+	pCapture->hWakeup = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (pCapture->hWakeup == NULL) {
+		ATLTRACE(_T("ERROR: cannot create the input trace writer's event, last error = %d\n"), GetLastError());
+		delete pCapture;
+		return false;
+	}
+	if (!GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, reinterpret_cast<LPCWSTR>(CaptureWriterThread),
+		&pCapture->hPinnedModule))
+	{
+		ATLTRACE(_T("ERROR: cannot pin the dll for the input trace writer, last error = %d\n"), GetLastError());
+		CloseHandle(pCapture->hWakeup);
+		delete pCapture;
+		return false;
+	}
+	uintptr_t hThread = _beginthreadex(NULL, 0, CaptureWriterThread, pCapture, 0, NULL);
+	if (hThread == 0) {
+		ATLTRACE(_T("ERROR: cannot create the input trace writer, last error = %d\n"), _doserrno);
+		FreeLibrary(pCapture->hPinnedModule);
+		CloseHandle(pCapture->hWakeup);
+		delete pCapture;
+		return false;
+	}
+	if (s_hWriterThread)
+		CloseHandle(reinterpret_cast<HANDLE>(s_hWriterThread));
+	s_hWriterThread = hThread;
+	s_pWriting = pCapture;
+	s_pCapture = pCapture;
+	s_generation = pCapture->generation;
+	return true;
+}
+
+static void QueueChunk(CaptureFile& capture, InputTraceEncoder& encoder) {
+	vector<uint8_t> vChunk;
+	encoder.takeChunk(vChunk);
+	if (vChunk.empty())
+		return;
+	capture.queueChunks.push_back(vector<uint8_t>());
+	capture.queueChunks.back().swap(vChunk);
+}
+
+/* Queues what every thread has pending and leaves the file to its writer */
+static void EndCapture() {
+	for (InputTraceEncoder* pEncoder : s_vEncoders) {
+		if (s_pCapture && !s_pCapture->bFailed)
+			QueueChunk(*s_pCapture, *pEncoder);
+		delete pEncoder;
+	}
+	s_vEncoders.clear();
+	if (s_pCapture) {
+		s_pCapture->bEnded = true;
+		SetEvent(s_pCapture->hWakeup);
+		s_pCapture = NULL;
+	}
+	s_bStartFailed = false;
+	g_bInputCaptureOpen = false;
+}
+
+void CaptureInput(ThreadLocalStorage& tls, const MSG* pMsg, bool bCapture) {
+	GestureMessage msg = ToGestureMessage(pMsg);
+	if (bCapture && !MaskCapturedMessage(msg, tls.modifiers, g_hotkeyRules))
+		return;
+
+	CaptureLock lock;
+	if (!bCapture) {
+		if (g_bInputCaptureOpen)
+			EndCapture();
+		return;
+	}
+	if (s_pCapture == NULL) {
+		g_bInputCaptureOpen = true;
+		// the file of the previous capture is still being written, messages until then are not captured
+		if (s_bStartFailed || s_pWriting)
+			return;
+		if (!StartCapture()) {
+			s_bStartFailed = true;
+			return;
+		}
+	}
+	if (s_pCapture->bFailed)
+		return;
+	if (tls.pInputTrace == NULL || tls.inputTraceGeneration != s_generation) {
+		tls.pInputTrace = new InputTraceEncoder(GetCurrentThreadId());
+		tls.inputTraceGeneration = s_generation;
+		s_vEncoders.push_back(tls.pInputTrace);
+	}
+	tls.pInputTrace->append(msg, pMsg->time, g_windowTree, g_gestureForwarder);
+	if (tls.pInputTrace->getPendingSize() >= InputTraceEncoder::CHUNK_SIZE) {
+		QueueChunk(*s_pCapture, *tls.pInputTrace);
+		SetEvent(s_pCapture->hWakeup);
+	}
+}
+
+void CloseInputCapture() {
+	HANDLE hWriterThread;
+	{
+		CaptureLock lock;
+		if (g_bInputCaptureOpen)
+			EndCapture();
+		hWriterThread = s_pWriting ? reinterpret_cast<HANDLE>(s_hWriterThread) : NULL;
+	}
+	// The writer pins the dll, so it has been terminated if the process is exiting, and the wait returns at
+	// once; it is then left to this thread to finish the file. A writer unloading the dll has already let go.
+	if (hWriterThread)
+		WaitForSingleObject(hWriterThread, INFINITE);
+	CaptureLock lock;
+	if (s_pWriting) {
+		if (s_pWriting->pFile) {
+			WriteChunks(s_pWriting->pFile, s_pWriting->queueChunks);
+			fclose(s_pWriting->pFile);
+		}
+		CloseHandle(s_pWriting->hWakeup);
+		delete s_pWriting;
+		s_pWriting = NULL;
+	}
+	if (s_hWriterThread) {
+		CloseHandle(reinterpret_cast<HANDLE>(s_hWriterThread));
+		s_hWriterThread = 0;
+	}
+}
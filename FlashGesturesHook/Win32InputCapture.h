@@ -0,0 +1,36 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "ThreadLocal.h"
+
+#include <atomic>
+
+/* Set while a capture is running, so that GetMsgHook notices when the shared config ends it */
+extern std::atomic<bool> g_bInputCaptureOpen;
+
+/*
+ * Called by GetMsgHook for every message a thread with storage removes, while SCF_CaptureInput is set
+ * or a capture is still running. With bCapture, key and mouse messages go into the thread's input trace,
+ * masked by MaskCapturedMessage. The first one starts a writer thread, which writes the chunks the hook
+ * threads fill to %TEMP%\FlashGesturesInput.<process id>.<capture>.fgit and keeps the dll loaded until
+ * the file is closed. Without bCapture, what every thread has pending goes to the writer, which finishes the file.
+ */
+void CaptureInput(ThreadLocalStorage& tls, const MSG* pMsg, bool bCapture);
+/* Ends the capture and finishes the trace file, called from DllMain */
+void CloseInputCapture();
@@ -0,0 +1,104 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "Win32SharedConfig.h"
+
+// Every build maps a block of the same size under this name, SharedConfig grows within its capacity.
+// Only a change of SharedConfigBlock itself needs another name.
+static const wchar_t SHARED_CONFIG_NAME[] = L"Local\\FlashGesturesHookConfig.2";
+
+// S:(ML;;NW;;;LW) as a self-relative security descriptor: a SACL with a low mandatory label, which only
+// denies writes from below low integrity, and no DACL, so the creator's default DACL applies. Spelled out
+// as ConvertStringSecurityDescriptorToSecurityDescriptor is in advapi32, which DllMain may not call.
+static const union {
+	BYTE ab[48];
+	DWORD dwAlign;
+} s_lowIntegrityDescriptor = { {
+	// SECURITY_DESCRIPTOR_RELATIVE: revision 1, SE_SACL_PRESENT | SE_SELF_RELATIVE, the SACL at 20
+	1, 0, 0x10, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 20, 0, 0, 0, 0, 0, 0, 0,
+	// ACL: revision 2, 28 bytes, one ACE
+	2, 0, 28, 0, 1, 0, 0, 0,
+	// SYSTEM_MANDATORY_LABEL_ACE_TYPE, 20 bytes, SYSTEM_MANDATORY_LABEL_NO_WRITE_UP
+	0x11, 0, 20, 0, 1, 0, 0, 0,
+	// S-1-16-4096, SECURITY_MANDATORY_LOW_RID
+	1, 1, 0, 0, 0, 0, 0, 16, 0x00, 0x10, 0, 0
+} };
+
+const SharedConfigBlock* g_pSharedConfig = NULL;
+static HANDLE s_hMapping = NULL;
+static SharedConfigBlock* s_pWritableConfig = NULL;
+
+HANDLE CreateSharedMapping(const wchar_t* szName, DWORD cbMapping) {
+	SECURITY_ATTRIBUTES sa = { sizeof(sa), const_cast<BYTE*>(s_lowIntegrityDescriptor.ab), FALSE };
+	HANDLE hMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE, 0, cbMapping, szName);
+	// XP knows no mandatory labels and may refuse the SACL
+	if (hMapping == NULL && GetLastError() != ERROR_ACCESS_DENIED)
+		hMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, cbMapping, szName);
+	return hMapping;
+}
+
+void OpenSharedConfig() {
+	// Only the writer needs write access, which a sandboxed process may not get to a block another
+	// process created. The first process creates the block, zeroed pages are an empty block.
+	s_hMapping = OpenFileMappingW(FILE_MAP_READ, FALSE, SHARED_CONFIG_NAME);
+	if (s_hMapping == NULL && GetLastError() == ERROR_FILE_NOT_FOUND)
+		s_hMapping = CreateSharedMapping(SHARED_CONFIG_NAME, sizeof(SharedConfigBlock));
+	if (s_hMapping == NULL) {
+		ATLTRACE(_T("ERROR: CreateFileMapping failed for the shared config, last error = %d\n"), GetLastError());
+		return;
+	}
+	g_pSharedConfig = reinterpret_cast<const SharedConfigBlock*>(MapViewOfFile(s_hMapping, FILE_MAP_READ, 0, 0, sizeof(SharedConfigBlock)));
+	if (g_pSharedConfig == NULL) {
+		ATLTRACE(_T("ERROR: MapViewOfFile failed for the shared config, last error = %d\n"), GetLastError());
+		CloseHandle(s_hMapping);
+		s_hMapping = NULL;
+	}
+}
+
+void CloseSharedConfig() {
+	g_sharedConfigSync.reset();
+	if (s_pWritableConfig) {
+		UnmapViewOfFile(s_pWritableConfig);
+		s_pWritableConfig = NULL;
+	}
+	if (g_pSharedConfig) {
+		UnmapViewOfFile(g_pSharedConfig);
+		g_pSharedConfig = NULL;
+	}
+	if (s_hMapping) {
+		CloseHandle(s_hMapping);
+		s_hMapping = NULL;
+	}
+}
+
+SharedConfigBlock* OpenSharedConfigForWrite() {
+	// only the extension writes, from one thread of the browser process
+	if (s_pWritableConfig || g_pSharedConfig == NULL)
+		return s_pWritableConfig;
+	HANDLE hMapping = OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, SHARED_CONFIG_NAME);
+	if (hMapping == NULL) {
+		ATLTRACE(_T("ERROR: OpenFileMapping failed for writing the shared config, last error = %d\n"), GetLastError());
+		return NULL;
+	}
+	s_pWritableConfig = reinterpret_cast<SharedConfigBlock*>(MapViewOfFile(hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(SharedConfigBlock)));
+	if (s_pWritableConfig == NULL)
+		ATLTRACE(_T("ERROR: MapViewOfFile failed for writing the shared config, last error = %d\n"), GetLastError());
+	// the view keeps the mapping alive
+	CloseHandle(hMapping);
+	return s_pWritableConfig;
+}
@@ -0,0 +1,40 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "SharedConfig.h"
+
+/*
+ * The block every process with the hook dll loaded maps under one name, NULL if it could not be mapped.
+ * It is mapped read-only, only the writer maps it writable, see OpenSharedConfigForWrite.
+ */
+extern const SharedConfigBlock* g_pSharedConfig;
+/* What this process applied of it, defined with the hook in GetMsgHook.cpp */
+extern SharedConfigSync g_sharedConfigSync;
+
+/*
+ * Creates a named page file mapping of cbMapping bytes, or opens the existing one, labeled low integrity so
+ * that sandboxed plugin processes may open it too. Without labels, before Vista, default security applies.
+ */
+HANDLE CreateSharedMapping(const wchar_t* szName, DWORD cbMapping);
+
+/* Called from DllMain, only kernel32 is used */
+void OpenSharedConfig();
+void CloseSharedConfig();
+/* The writable view of the block for SetSharedConfig, mapped on first use; NULL if it could not be mapped */
+SharedConfigBlock* OpenSharedConfigForWrite();
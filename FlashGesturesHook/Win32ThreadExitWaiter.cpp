@@ -0,0 +1,69 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "Win32ThreadExitWaiter.h"
+
+// Stateless, every wait carries its own context
+Win32ThreadExitWaiter g_threadExitWaiter;
+
+namespace {
+
+struct ThreadWait {
+	HANDLE hThread;
+	HANDLE hWait;
+	HookSlot slot;
+	ThreadExitSink* pSink;
+};
+
+VOID CALLBACK ThreadExitedCallback(PVOID pvContext, BOOLEAN bTimedOut) {
+	ThreadWait* pWait = reinterpret_cast<ThreadWait*>(pvContext);
+	pWait->pSink->threadExited(pWait->slot);
+}
+
+}
+
+uintptr_t Win32ThreadExitWaiter::watch(uint32_t idThread, HookSlot slot, ThreadExitSink& sink) {
+	HANDLE hThread = OpenThread(SYNCHRONIZE, FALSE, idThread);
+	if (hThread == NULL) {
+		ATLTRACE(_T("ERROR: cannot open thread %d, last error = %d\n"), idThread, GetLastError());
+		return 0;
+	}
+	ThreadWait* pWait = new ThreadWait();
+	pWait->hThread = hThread;
+	pWait->hWait = NULL;
+	pWait->slot = slot;
+	pWait->pSink = &sink;
+	if (!RegisterWaitForSingleObject(&pWait->hWait, hThread, ThreadExitedCallback, pWait, INFINITE,
+									 WT_EXECUTEONLYONCE | WT_EXECUTEINWAITTHREAD)) {
+		ATLTRACE(_T("ERROR: cannot wait for thread %d, last error = %d\n"), idThread, GetLastError());
+		CloseHandle(hThread);
+		delete pWait;
+		return 0;
+	}
+	return reinterpret_cast<uintptr_t>(pWait);
+}
+
+void Win32ThreadExitWaiter::unwatch(uintptr_t wait) {
+	ThreadWait* pWait = reinterpret_cast<ThreadWait*>(wait);
+	if (pWait == NULL)
+		return;
+	// blocks until a callback that is already running has returned, so pWait can be freed
+	UnregisterWaitEx(pWait->hWait, INVALID_HANDLE_VALUE);
+	CloseHandle(pWait->hThread);
+	delete pWait;
+}
@@ -0,0 +1,32 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "HookRegistry.h"
+
+/*
+ * Registers a thread pool wait on each watched thread's handle. The system spreads the waits
+ * over as many wait threads as needed, so there is no limit of MAXIMUM_WAIT_OBJECTS threads.
+ */
+class Win32ThreadExitWaiter : public ThreadExitWaiter {
+public:
+	uintptr_t watch(uint32_t idThread, HookSlot slot, ThreadExitSink& sink);
+	void unwatch(uintptr_t wait);
+};
+
+extern Win32ThreadExitWaiter g_threadExitWaiter;
@@ -0,0 +1,66 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "Win32WakeupChannel.h"
+#include "HookStats.h"
+#include "Win32GestureForwarder.h"
+
+// The channel SendAsyncProc reports to, there is only ever one as only the hook manage thread shuts down
+static Win32WakeupChannel* s_pChannel = NULL;
+
+Win32WakeupChannel::Win32WakeupChannel() {
+	ATLASSERT(s_pChannel == NULL);
+	s_pChannel = this;
+}
+
+Win32WakeupChannel::~Win32WakeupChannel() {
+	// completions arriving later are dropped
+	s_pChannel = NULL;
+}
+
+VOID CALLBACK Win32WakeupChannel::SendAsyncProc(HWND hwnd, UINT uMsg, ULONG_PTR dwData, LRESULT lResult) {
+	if (s_pChannel)
+		s_pChannel->m_vCompleted.push_back(static_cast<uint32_t>(dwData));
+}
+
+WakeupSendResult Win32WakeupChannel::send(GestureWindow hwnd, uint32_t cookie) {
+	// same as the SMTO_ABORTIFHUNG the wake-ups used to be sent with
+	if (IsHungAppWindow(ToHWND(hwnd)))
+		return WSR_Hung;
+	if (SendMessageCallback(ToHWND(hwnd), WM_NULL, 0, 0, SendAsyncProc, cookie))
+		return WSR_Sent;
+	ATLTRACE(_T("ERROR: SendMessageCallback failed, last error = %d\n"), GetLastError());
+	return WSR_Failed;
+}
+
+void Win32WakeupChannel::waitCompleted(uint32_t msTimeout, std::vector<uint32_t>& vCompleted) {
+	if (m_vCompleted.empty()) {
+		MsgWaitForMultipleObjects(0, NULL, FALSE, msTimeout, QS_ALLINPUT);
+		// retrieving messages calls SendAsyncProc for the replies that arrived, other messages are
+		// no longer of interest while shutting down
+		MSG msg;
+		while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+			;
+	}
+	vCompleted.insert(vCompleted.end(), m_vCompleted.begin(), m_vCompleted.end());
+	m_vCompleted.clear();
+}
+
+uint64_t Win32WakeupChannel::nowMs() {
+	return HookTimestampNs() / 1000000;
+}
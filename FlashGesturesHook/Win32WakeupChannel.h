@@ -0,0 +1,41 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "WakeupBroadcast.h"
+
+/*
+ * Sends WM_NULL with SendMessageCallback. The completions are delivered to the sending thread
+ * while it retrieves messages, so a channel may only be used by the thread that created it, and
+ * only one channel may exist at a time.
+ */
+class Win32WakeupChannel : public WakeupChannel {
+public:
+	Win32WakeupChannel();
+	~Win32WakeupChannel();
+
+	WakeupSendResult send(GestureWindow hwnd, uint32_t cookie);
+	void waitCompleted(uint32_t msTimeout, std::vector<uint32_t>& vCompleted);
+	uint64_t nowMs();
+private:
+	std::vector<uint32_t> m_vCompleted;
+
+	static VOID CALLBACK SendAsyncProc(HWND hwnd, UINT uMsg, ULONG_PTR dwData, LRESULT lResult);
+	Win32WakeupChannel(const Win32WakeupChannel&);
+	Win32WakeupChannel& operator=(const Win32WakeupChannel&);
+};
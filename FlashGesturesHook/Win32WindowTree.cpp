@@ -0,0 +1,86 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "Win32WindowTree.h"
+#include "Win32GestureForwarder.h"
+
+using namespace std;
+
+extern bool g_bIsInProcessHook;
+extern DWORD g_idCurrentProcess;
+
+// Stateless, safe to share among all hooked threads
+Win32WindowTree g_windowTree;
+
+//
+// Returns the real parent window
+// Same as GetParent(), but doesn't return the owner
+//
+GestureWindow Win32WindowTree::getParent(GestureWindow hwnd) {
+	HWND hParent;
+
+	hParent = GetAncestor(ToHWND(hwnd), GA_PARENT);
+	if (!hParent || hParent == GetDesktopWindow())
+		return 0;
+
+	return ToGestureWindow(hParent);
+}
+
+GestureWindow Win32WindowTree::getRoot(GestureWindow hwnd) {
+	return ToGestureWindow(GetAncestor(ToHWND(hwnd), GA_ROOT));
+}
+
+int Win32WindowTree::getClassName(GestureWindow hwnd, char* szBuffer, int cchBuffer) {
+	return GetClassNameA(ToHWND(hwnd), szBuffer, cchBuffer);
+}
+
+uint32_t Win32WindowTree::getClassAtom(GestureWindow hwnd) {
+	// Read from the class in the desktop heap, without the kernel call GetClassName makes
+	return static_cast<uint32_t>(GetClassLongPtr(ToHWND(hwnd), GCW_ATOM));
+}
+
+bool Win32WindowTree::isInProcess(GestureWindow hwnd) {
+	if (!g_bIsInProcessHook) return false;
+
+	DWORD idProcess = 0;
+	GetWindowThreadProcessId(ToHWND(hwnd), &idProcess);
+	return idProcess == g_idCurrentProcess;
+}
+
+static BOOL CALLBACK GetChildWindowsCallback(HWND hwnd, LPARAM lParam) {
+	vector<GestureWindow>& vWindows = *(reinterpret_cast<vector<GestureWindow>*>(lParam));
+	vWindows.push_back(ToGestureWindow(hwnd));
+	return TRUE;
+}
+
+static BOOL CALLBACK GetTopLevelWindowsCallback(HWND hwnd, LPARAM lParam) {
+	EnumChildWindows(hwnd, GetChildWindowsCallback, lParam);
+	return TRUE;
+}
+
+void Win32WindowTree::getChildWindowsOfThread(uint32_t idThread, vector<GestureWindow>& vWindows) {
+	EnumThreadWindows(idThread, GetTopLevelWindowsCallback, reinterpret_cast<LPARAM>(&vWindows));
+}
+
+uint32_t Win32WindowTree::getWindowThread(GestureWindow hwnd, uint32_t* pidProcess) {
+	DWORD idProcess = 0;
+	DWORD idThread = GetWindowThreadProcessId(ToHWND(hwnd), &idProcess);
+	if (pidProcess)
+		*pidProcess = idProcess;
+	return idThread;
+}
@@ -0,0 +1,34 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "WindowTree.h"
+
+/* Window hierarchy of the current desktop, queried with GetAncestor/GetClassName */
+class Win32WindowTree : public WindowTree {
+public:
+	GestureWindow getParent(GestureWindow hwnd);
+	GestureWindow getRoot(GestureWindow hwnd);
+	int getClassName(GestureWindow hwnd, char* szBuffer, int cchBuffer);
+	uint32_t getClassAtom(GestureWindow hwnd);
+	bool isInProcess(GestureWindow hwnd);
+	void getChildWindowsOfThread(uint32_t idThread, std::vector<GestureWindow>& vWindows);
+	uint32_t getWindowThread(GestureWindow hwnd, uint32_t* pidProcess);
+};
+
+extern Win32WindowTree g_windowTree;
@@ -0,0 +1,107 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "GestureCore.h"
+
+// The plugin window classes VerifyAndGetTopMozillaWindowClassWindow looks for, compiled into a perfect
+// hash: a key made of the length and three characters of a name picks one slot, and one comparison
+// tells whether the name is that slot's class. The slots are laid out while compiling, and adding a
+// class that cannot be told apart from another by its key stops the build.
+
+// VS2013 has no constexpr, it builds the same table while the dll loads and leaves the checks to other compilers
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define WINDOW_CLASS_CONSTEXPR_FN inline
+#define WINDOW_CLASS_CONSTEXPR const
+#else
+#define WINDOW_CLASS_CONSTEXPR_FN constexpr
+#define WINDOW_CLASS_CONSTEXPR constexpr
+#define WINDOW_CLASS_STATIC_CHECKS
+#endif
+
+/* More plugin window classes to accept out of process, as a list that starts with a comma: , "Foo", "Bar" */
+#ifndef FGH_EXTRA_PLUGIN_WINDOW_CLASSES
+#define FGH_EXTRA_PLUGIN_WINDOW_CLASSES
+#endif
+
+/* Index of each built-in class in g_aszPluginWindowClasses, the configured additions follow */
+enum PluginWindowClass {
+	/* firefox windows, the only class accepted in process */
+	PWC_MOZILLA_WINDOW,
+	PWC_GECKO_PLUGIN_WINDOW,
+	/* sandboxed flash, whose root window class cannot be read from a low integrity process */
+	PWC_GECKO_FP_SANDBOX_CHILD
+};
+
+WINDOW_CLASS_CONSTEXPR const char* const g_aszPluginWindowClasses[] = {
+	"MozillaWindowClass", "GeckoPluginWindow", "GeckoFPSandboxChildWindow" FGH_EXTRA_PLUGIN_WINDOW_CLASSES
+};
+WINDOW_CLASS_CONSTEXPR int PLUGIN_WINDOW_CLASS_COUNT = sizeof(g_aszPluginWindowClasses) / sizeof(g_aszPluginWindowClasses[0]);
+
+const int WINDOW_CLASS_SLOT_BITS = 4;
+const int WINDOW_CLASS_SLOTS = 1 << WINDOW_CLASS_SLOT_BITS;
+/* Returned by the seed search when no seed separates the classes */
+const uint32_t WINDOW_CLASS_NO_SEED = 0xffffffff;
+const uint32_t WINDOW_CLASS_MAX_SEEDS = 256;
+
+WINDOW_CLASS_CONSTEXPR_FN int WindowClassLength(const char* sz) {
+	return *sz ? 1 + WindowClassLength(sz + 1) : 0;
+}
+
+/* Length, first, middle and last character of a class name, cch must not be 0 */
+WINDOW_CLASS_CONSTEXPR_FN uint32_t WindowClassKey(const char* sz, int cch) {
+	return static_cast<uint32_t>(cch) ^ (static_cast<uint32_t>(static_cast<uint8_t>(sz[0])) << 8) ^
+		   (static_cast<uint32_t>(static_cast<uint8_t>(sz[cch / 2])) << 16) ^
+		   (static_cast<uint32_t>(static_cast<uint8_t>(sz[cch - 1])) << 24);
+}
+
+WINDOW_CLASS_CONSTEXPR_FN int WindowClassSlot(uint32_t key, uint32_t seed) {
+	return static_cast<int>(((key ^ seed) * 0x9e3779b1u) >> (32 - WINDOW_CLASS_SLOT_BITS));
+}
+
+WINDOW_CLASS_CONSTEXPR_FN int PluginWindowClassSlot(int iClass, uint32_t seed) {
+	return WindowClassSlot(WindowClassKey(g_aszPluginWindowClasses[iClass],
+						   WindowClassLength(g_aszPluginWindowClasses[iClass])), seed);
+}
+
+/* true if class i shares its slot with class j or any class after it */
+WINDOW_CLASS_CONSTEXPR_FN bool CollidesWithLaterClass(uint32_t seed, int i, int j) {
+	return j < PLUGIN_WINDOW_CLASS_COUNT &&
+		   (PluginWindowClassSlot(i, seed) == PluginWindowClassSlot(j, seed) || CollidesWithLaterClass(seed, i, j + 1));
+}
+
+WINDOW_CLASS_CONSTEXPR_FN bool HasWindowClassCollision(uint32_t seed, int i) {
+	return i < PLUGIN_WINDOW_CLASS_COUNT && (CollidesWithLaterClass(seed, i, i + 1) || HasWindowClassCollision(seed, i + 1));
+}
+
+/* First seed from which every class gets a slot of its own */
+WINDOW_CLASS_CONSTEXPR_FN uint32_t FindWindowClassSeed(uint32_t seed) {
+	return seed == WINDOW_CLASS_MAX_SEEDS ? WINDOW_CLASS_NO_SEED :
+		   HasWindowClassCollision(seed, 0) ? FindWindowClassSeed(seed + 1) : seed;
+}
+
+WINDOW_CLASS_CONSTEXPR uint32_t WINDOW_CLASS_SEED = FindWindowClassSeed(0);
+
+#ifdef WINDOW_CLASS_STATIC_CHECKS
+static_assert(PLUGIN_WINDOW_CLASS_COUNT <= WINDOW_CLASS_SLOTS / 2, "too many plugin window classes for the slots");
+static_assert(WINDOW_CLASS_SEED != WINDOW_CLASS_NO_SEED,
+			  "two plugin window classes share length, first, middle and last character");
+#endif
+
+/* Index of szClassName in g_aszPluginWindowClasses, -1 if it is none of them. No heap, no loop over the classes */
+int FindPluginWindowClass(const char* szClassName, int cchClassName);
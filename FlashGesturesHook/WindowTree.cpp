@@ -0,0 +1,190 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "WindowTree.h"
+#include "WindowClassSet.h"
+
+#include <atomic>
+
+struct WindowClassSlotEntry {
+	/* -1 for an empty slot */
+	int8_t iClass;
+	uint8_t cchClassName;
+};
+
+WINDOW_CLASS_CONSTEXPR_FN int FindWindowClassInSlot(int slot, int iClass) {
+	return iClass == PLUGIN_WINDOW_CLASS_COUNT ? -1 :
+		   PluginWindowClassSlot(iClass, WINDOW_CLASS_SEED) == slot ? iClass : FindWindowClassInSlot(slot, iClass + 1);
+}
+
+WINDOW_CLASS_CONSTEXPR_FN WindowClassSlotEntry MakeWindowClassSlotEntry(int iClass) {
+	return WindowClassSlotEntry {
+		static_cast<int8_t>(iClass),
+		static_cast<uint8_t>(iClass < 0 ? 0 : WindowClassLength(g_aszPluginWindowClasses[iClass]))
+	};
+}
+
+#define WINDOW_CLASS_SLOT_ENTRY(slot) MakeWindowClassSlotEntry(FindWindowClassInSlot(slot, 0))
+
+static_assert(WINDOW_CLASS_SLOTS == 16, "s_aWindowClassSlots lists every slot");
+static WINDOW_CLASS_CONSTEXPR WindowClassSlotEntry s_aWindowClassSlots[WINDOW_CLASS_SLOTS] = {
+	WINDOW_CLASS_SLOT_ENTRY(0), WINDOW_CLASS_SLOT_ENTRY(1), WINDOW_CLASS_SLOT_ENTRY(2), WINDOW_CLASS_SLOT_ENTRY(3),
+	WINDOW_CLASS_SLOT_ENTRY(4), WINDOW_CLASS_SLOT_ENTRY(5), WINDOW_CLASS_SLOT_ENTRY(6), WINDOW_CLASS_SLOT_ENTRY(7),
+	WINDOW_CLASS_SLOT_ENTRY(8), WINDOW_CLASS_SLOT_ENTRY(9), WINDOW_CLASS_SLOT_ENTRY(10), WINDOW_CLASS_SLOT_ENTRY(11),
+	WINDOW_CLASS_SLOT_ENTRY(12), WINDOW_CLASS_SLOT_ENTRY(13), WINDOW_CLASS_SLOT_ENTRY(14), WINDOW_CLASS_SLOT_ENTRY(15)
+};
+
+int FindPluginWindowClass(const char* szClassName, int cchClassName) {
+	if (cchClassName <= 0)
+		return -1;
+	const WindowClassSlotEntry& entry =
+		s_aWindowClassSlots[WindowClassSlot(WindowClassKey(szClassName, cchClassName), WINDOW_CLASS_SEED)];
+	if (entry.cchClassName != cchClassName || memcmp(g_aszPluginWindowClasses[entry.iClass], szClassName, cchClassName) != 0)
+		return -1;
+	return entry.iClass;
+}
+
+// Atoms of the plugin window classes, learned from the first window of each class whose name matched,
+// so that later windows of the class are recognized without reading the name. Only classes that matched
+// are remembered: the atom of any other class is freed when it is unregistered and may come back for a
+// plugin window class. Firefox registers its classes before any plugin window exists and keeps them
+// for its lifetime, as does the plugin process, so a remembered atom stays valid while the hook is loaded.
+// Zero until learned; any hook thread may learn one, they all learn the same value.
+static std::atomic<uint32_t> s_aPluginWindowClassAtoms[PLUGIN_WINDOW_CLASS_COUNT];
+
+/* Returned by MatchPluginWindowClass when the class cannot be read, because the window is gone */
+static const int CLASS_UNREADABLE = -2;
+
+/* Index of hwnd's class among the first nClasses plugin window classes, -1 if it is none of them */
+static int MatchPluginWindowClass(WindowTree& tree, GestureWindow hwnd, int nClasses) {
+	uint32_t atom = tree.getClassAtom(hwnd);
+	if (atom) {
+		for (int i = 0; i < nClasses; i++) {
+			if (s_aPluginWindowClassAtoms[i].load(std::memory_order_relaxed) == atom)
+				return i;
+		}
+	}
+
+	char szClassName[MAX_WINDOW_CLASS_NAME];
+	int cchClassName = tree.getClassName(hwnd, szClassName, MAX_WINDOW_CLASS_NAME);
+	if (cchClassName == 0)
+		return CLASS_UNREADABLE;
+
+	int iClass = FindPluginWindowClass(szClassName, cchClassName);
+	if (iClass < 0)
+		return -1;
+	if (atom)
+		s_aPluginWindowClassAtoms[iClass].store(atom, std::memory_order_relaxed);
+	return iClass < nClasses ? iClass : -1;
+}
+
+static GestureWindow GetParentWindowOfPluginWindowClass(WindowTree& tree, GestureWindow hwnd, int nClasses,
+														int maxLevelsUp, int& iClass) {
+	int levels = 0;
+	iClass = -1;
+	GestureWindow hwndParent = hwnd;
+	while (hwndParent && levels <= maxLevelsUp && iClass < 0) {
+		hwnd = hwndParent;
+		hwndParent = tree.getParent(hwnd);
+
+		iClass = MatchPluginWindowClass(tree, hwnd, nClasses);
+		if (iClass == CLASS_UNREADABLE)
+			return 0;
+
+		levels++;
+	}
+
+	return (iClass < 0) ? 0 : hwnd;
+}
+
+GestureWindow VerifyAndGetTopMozillaWindowClassWindow(WindowTree& tree, GestureWindow hwndChild) {
+	int iIntermediateClass;
+	GestureWindow hwndIntermediate =
+		GetParentWindowOfPluginWindowClass(tree, hwndChild, tree.isInProcess(hwndChild) ? 1 : PLUGIN_WINDOW_CLASS_COUNT,
+										   10, iIntermediateClass);
+	if (!hwndIntermediate)
+		return 0;
+
+	GestureWindow hwndTop = tree.getRoot(hwndIntermediate);
+	if (hwndTop == hwndIntermediate)
+		return 0;
+
+	// Bypass root window class checking, as we can't do it reliably in a low integrity process
+	if (iIntermediateClass == PWC_GECKO_FP_SANDBOX_CHILD)
+		return hwndTop;
+
+	// Check root window class name
+	if (MatchPluginWindowClass(tree, hwndTop, 1) != PWC_MOZILLA_WINDOW)
+		return 0;
+
+	return hwndTop;
+}
+
+FirefoxRootCache::FirefoxRootCache() :
+m_iNextVictim(0), m_nHits(0), m_nMisses(0), m_nInvalidations(0) {
+	clear();
+}
+
+GestureWindow FirefoxRootCache::resolve(WindowTree& tree, GestureWindow hwnd) {
+	Entry* pSlot = NULL;
+	for (int i = 0; i < CAPACITY; i++) {
+		Entry& entry = m_entries[i];
+		if (entry.hwnd != hwnd)
+			continue;
+		// A single lookup is much cheaper than the walk, and tells us whether the window moved. The root
+		// also changes when an ancestor moves, as the plugin host does when a tab is torn off
+		if (entry.hwndRoot ? tree.getRoot(hwnd) == entry.hwndRoot : tree.getParent(hwnd) == entry.hwndParent) {
+			m_nHits++;
+			return entry.hwndRoot;
+		}
+		// Reparented or destroyed, so are the windows cached beneath it
+		invalidateWindow(hwnd);
+		pSlot = &entry;
+		break;
+	}
+
+	m_nMisses++;
+	if (pSlot == NULL) {
+		pSlot = &m_entries[m_iNextVictim];
+		m_iNextVictim = (m_iNextVictim + 1) % CAPACITY;
+	}
+	pSlot->hwnd = hwnd;
+	pSlot->hwndRoot = VerifyAndGetTopMozillaWindowClassWindow(tree, hwnd);
+	pSlot->hwndParent = pSlot->hwndRoot ? 0 : tree.getParent(hwnd);
+	return pSlot->hwndRoot;
+}
+
+void FirefoxRootCache::invalidateWindow(GestureWindow hwnd) {
+	if (hwnd == 0)
+		return;
+	for (int i = 0; i < CAPACITY; i++) {
+		Entry& entry = m_entries[i];
+		if (entry.hwnd != 0 && (entry.hwnd == hwnd || entry.hwndParent == hwnd || entry.hwndRoot == hwnd)) {
+			entry.hwnd = 0;
+			m_nInvalidations++;
+		}
+	}
+}
+
+void FirefoxRootCache::clear() {
+	for (int i = 0; i < CAPACITY; i++) {
+		m_entries[i].hwnd = 0;
+		m_entries[i].hwndParent = 0;
+		m_entries[i].hwndRoot = 0;
+	}
+}
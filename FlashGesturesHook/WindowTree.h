@@ -0,0 +1,82 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "GestureCore.h"
+
+#include <vector>
+
+/* Same limit as the Win32 window class name length */
+const int MAX_WINDOW_CLASS_NAME = 256;
+
+/* Read-only view of the window hierarchy, implemented with user32 calls in the hook dll */
+class WindowTree {
+public:
+	/* Real parent window (not the owner), 0 for top level windows */
+	virtual GestureWindow getParent(GestureWindow hwnd) = 0;
+	/* Same as GetAncestor(hwnd, GA_ROOT) */
+	virtual GestureWindow getRoot(GestureWindow hwnd) = 0;
+	/* Copies the class name into szBuffer, returns the number of characters copied, 0 on failure */
+	virtual int getClassName(GestureWindow hwnd, char* szBuffer, int cchBuffer) = 0;
+	/* Atom of the window class, same for every window of a class while it is registered, 0 on failure */
+	virtual uint32_t getClassAtom(GestureWindow hwnd) = 0;
+	/* true if the window belongs to the process that installed the hooks */
+	virtual bool isInProcess(GestureWindow hwnd) = 0;
+	/* Appends every descendant of idThread's top level windows, like EnumThreadWindows followed by EnumChildWindows */
+	virtual void getChildWindowsOfThread(uint32_t idThread, std::vector<GestureWindow>& vWindows) = 0;
+	/* Thread that created the window, 0 if it is gone. Stores the owning process in *pidProcess if not NULL */
+	virtual uint32_t getWindowThread(GestureWindow hwnd, uint32_t* pidProcess) = 0;
+protected:
+	~WindowTree() {}
+};
+
+/* Returns the top MozillaWindowClass window that hosts the plugin window hwndChild, or 0 if there is none */
+GestureWindow VerifyAndGetTopMozillaWindowClassWindow(WindowTree& tree, GestureWindow hwndChild);
+
+/* Remembers the firefox window (or the lack of one) found for recently seen source windows */
+class FirefoxRootCache {
+public:
+	static const int CAPACITY = 8;
+
+	FirefoxRootCache();
+
+	/* Same as VerifyAndGetTopMozillaWindowClassWindow, but only walks the tree on a miss */
+	GestureWindow resolve(WindowTree& tree, GestureWindow hwnd);
+	/* Drops any entry that involves hwnd, call when it is destroyed or reparented. resolve does so when a hit turns out stale */
+	void invalidateWindow(GestureWindow hwnd);
+	void clear();
+
+	size_t getHits() const { return m_nHits; }
+	size_t getMisses() const { return m_nMisses; }
+	/* Entries dropped because they involved a reparented or destroyed window */
+	size_t getInvalidations() const { return m_nInvalidations; }
+private:
+	struct Entry {
+		GestureWindow hwnd;
+		/* parent at the time of caching, checked on every hit of a negative result to detect reparenting */
+		GestureWindow hwndParent;
+		/* 0 for a negative result, a positive one is checked against the current root of hwnd */
+		GestureWindow hwndRoot;
+	};
+
+	Entry m_entries[CAPACITY];
+	int m_iNextVictim;
+	size_t m_nHits;
+	size_t m_nMisses;
+	size_t m_nInvalidations;
+};
@@ -17,6 +17,9 @@ along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "stdafx.h"
 #include "ThreadLocal.h"
+#include "Win32GestureChannel.h"
+#include "Win32InputCapture.h"
+#include "Win32SharedConfig.h"
 
 DWORD g_dwTlsIndex = 0;
 
@@ -29,6 +32,8 @@ BOOL APIENTRY DllMain(HMODULE hModule,
 	case DLL_PROCESS_ATTACH:
 		if ((g_dwTlsIndex = TlsAlloc()) == TLS_OUT_OF_INDEXES)
 			return FALSE;
+		OpenSharedConfig();
+		OpenGestureChannel();
 		// fall through
 	case DLL_THREAD_ATTACH:
 		TlsSetValue(g_dwTlsIndex, NULL);
@@ -46,6 +51,9 @@ BOOL APIENTRY DllMain(HMODULE hModule,
 			delete pData;
 		TlsFree(g_dwTlsIndex);
 		ThreadLocalStorage::FreeAllInstances();
+		CloseInputCapture();
+		CloseGestureChannel();
+		CloseSharedConfig();
 		break;
 	}
 	return TRUE;
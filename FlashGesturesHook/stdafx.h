@@ -1,5 +1,7 @@
 #pragma once
 
+#ifdef _WIN32
+
 #include "targetver.h"
 
 #define WIN32_LEAN_AND_MEAN
@@ -16,4 +18,22 @@
 #include <atlstr.h>
 #include <atltypes.h>
 
+#elif defined(FGH_FAKE_WIN32)
+
+// The Win32 sources of the hook on top of the simulated user32 and kernel32 in bench/FakeWin32.h
+#include "FakeWin32.h"
+
+#else
+
+// Portable build of the gesture core (see bench/), no Win32 or ATL available
+#include <cassert>
+#include <cstring>
+#include <cstdlib>
+
+#define ATLTRACE(...) ((void)0)
+#define ATLASSERT(expr) assert(expr)
+#define _ASSERT(expr) assert(expr)
+
+#endif
+
 #include <vector>
@@ -0,0 +1,196 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Shared helpers for the portable benchmarks: synthetic input streams, a counting
+// forwarder standing in for user32, and timing/reporting.
+
+#include "stdafx.h"
+#include "GestureCore.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+const GestureWindow BENCH_HWND_PLUGIN = 0x1000;
+const GestureWindow BENCH_HWND_FIREFOX = 0x2000;
+
+/* Counts forwarded messages instead of delivering them */
+class CountingForwarder : public GestureForwarder {
+public:
+	size_t nSent;
+	size_t nPosted;
+	size_t nOffsetLookups;
+	size_t nHotkeys;
+	intptr_t checksum;
+
+	CountingForwarder() : nSent(0), nPosted(0), nOffsetLookups(0), nHotkeys(0), checksum(0) {}
+
+	void sendMessage(GestureWindow hwnd, const GestureMessage& msg) {
+		nSent++;
+		checksum += msg.message ^ msg.lParam;
+	}
+	void postMessage(GestureWindow hwnd, const GestureMessage& msg) {
+		nPosted++;
+		checksum += msg.message ^ msg.lParam;
+	}
+	GesturePoint getClientOffset(GestureWindow hwndFrom, GestureWindow hwndTo) {
+		nOffsetLookups++;
+		// plugin window sits at (100, 200) inside the firefox window
+		GesturePoint offset = { 100, 200 };
+		return offset;
+	}
+	void postHotkey(GestureWindow hwnd, uint8_t virtualKey, uint8_t modifiers) {
+		nHotkeys++;
+		checksum += virtualKey | (modifiers << 8);
+	}
+};
+
+/* Deterministic xorshift generator, so every run replays the same streams */
+class BenchRandom {
+private:
+	uint32_t m_state;
+public:
+	explicit BenchRandom(uint32_t seed = 2463534242u) : m_state(seed) {}
+	uint32_t next() {
+		m_state ^= m_state << 13;
+		m_state ^= m_state >> 17;
+		m_state ^= m_state << 5;
+		return m_state;
+	}
+	/* uniform in [lo, hi] */
+	int range(int lo, int hi) { return lo + static_cast<int>(next() % static_cast<uint32_t>(hi - lo + 1)); }
+};
+
+/* Builds synthetic mouse input as the hook would see it on a plugin window */
+class MessageStreamBuilder {
+private:
+	std::vector<GestureMessage> m_vMessages;
+	BenchRandom m_random;
+	GesturePoint m_pt;
+
+	void push(unsigned int message, uintptr_t wParam) {
+		GestureMessage msg = { BENCH_HWND_PLUGIN, message, wParam, m_pt.toLParam() };
+		m_vMessages.push_back(msg);
+	}
+	void moveBy(int dx, int dy, uintptr_t keys) {
+		m_pt.x += dx;
+		m_pt.y += dy;
+		push(GMSG_MOUSEMOVE, keys);
+	}
+public:
+	explicit MessageStreamBuilder(uint32_t seed = 2463534242u) : m_random(seed) {
+		m_pt.x = 300;
+		m_pt.y = 300;
+	}
+
+	/* Plain hovering, no buttons held */
+	void idleMoves(int count) {
+		for (int i = 0; i < count; i++)
+			moveBy(m_random.range(-3, 3), m_random.range(-3, 3), 0);
+	}
+	/* Right button drag that leaves the dead zone */
+	void traceStroke(int moves) {
+		push(GMSG_RBUTTONDOWN, GMK_RBUTTON);
+		int dx = m_random.range(-4, 4), dy = m_random.range(-4, 4);
+		if (dx == 0 && dy == 0) dx = 4;
+		for (int i = 0; i < moves; i++)
+			moveBy(dx + m_random.range(-1, 1), dy + m_random.range(-1, 1), GMK_RBUTTON);
+		push(GMSG_RBUTTONUP, 0);
+	}
+	/* Right button held while jiggling inside the dead zone */
+	void deadZoneJiggle(int moves) {
+		GesturePoint ptStart = m_pt;
+		push(GMSG_RBUTTONDOWN, GMK_RBUTTON);
+		for (int i = 0; i < moves; i++) {
+			m_pt.x = ptStart.x + m_random.range(-5, 5);
+			m_pt.y = ptStart.y + m_random.range(-5, 5);
+			push(GMSG_MOUSEMOVE, GMK_RBUTTON);
+		}
+		push(GMSG_RBUTTONUP, 0);
+	}
+	/* Left held, right clicked (left->right rocker) */
+	void rockerClick(int moves) {
+		push(GMSG_LBUTTONDOWN, GMK_LBUTTON);
+		for (int i = 0; i < moves; i++)
+			moveBy(m_random.range(-1, 1), m_random.range(-1, 1), GMK_LBUTTON);
+		push(GMSG_RBUTTONDOWN, GMK_LBUTTON | GMK_RBUTTON);
+		push(GMSG_RBUTTONUP, GMK_LBUTTON);
+		push(GMSG_LBUTTONUP, 0);
+	}
+	/* Right held, wheel scrolled */
+	void wheelGesture(int notches) {
+		push(GMSG_RBUTTONDOWN, GMK_RBUTTON);
+		for (int i = 0; i < notches; i++)
+			push(GMSG_MOUSEWHEEL, GMK_RBUTTON | (static_cast<uintptr_t>(i & 1 ? 120 : 0xff88) << 16));
+		push(GMSG_RBUTTONUP, 0);
+	}
+	/* count right button presses, releases and wheel notches, with a small move after each */
+	void clickAndScroll(int count) {
+		for (int i = 0; i < count; i++) {
+			switch (i % 3) {
+			case 0: push(GMSG_RBUTTONDOWN, GMK_RBUTTON); break;
+			case 1: push(GMSG_MOUSEWHEEL, GMK_RBUTTON | (static_cast<uintptr_t>(120) << 16)); break;
+			case 2: push(GMSG_RBUTTONUP, 0); break;
+			}
+			moveBy(1, 0, i % 3 == 2 ? 0 : GMK_RBUTTON);
+		}
+	}
+	/* An ordinary left click */
+	void click() {
+		push(GMSG_LBUTTONDOWN, GMK_LBUTTON);
+		push(GMSG_LBUTTONUP, 0);
+	}
+
+	BenchRandom& random() { return m_random; }
+	const std::vector<GestureMessage>& messages() const { return m_vMessages; }
+};
+
+class BenchTimer {
+private:
+	std::chrono::steady_clock::time_point m_start;
+public:
+	BenchTimer() : m_start(std::chrono::steady_clock::now()) {}
+	double elapsedNs() const {
+		return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - m_start).count());
+	}
+};
+
+/* Runs fn() nRuns times and returns the fastest run in ns */
+template <class Fn>
+double BenchBestOf(int nRuns, Fn fn) {
+	double best = 0;
+	for (int i = 0; i < nRuns; i++) {
+		BenchTimer timer;
+		fn();
+		double ns = timer.elapsedNs();
+		if (i == 0 || ns < best)
+			best = ns;
+	}
+	return best;
+}
+
+inline void BenchPrintHeader(const char* szFirstColumn) {
+	printf("%-32s %12s %14s %12s\n", szFirstColumn, "ns/msg", "msgs/sec", "forwarded");
+}
+
+inline void BenchPrintRow(const char* szName, size_t nMessages, double ns, size_t nForwarded) {
+	double nsPerMessage = ns / static_cast<double>(nMessages);
+	printf("%-32s %12.2f %14.0f %12zu\n", szName, nsPerMessage, 1e9 / nsPerMessage, nForwarded);
+}
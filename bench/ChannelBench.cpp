@@ -0,0 +1,362 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Gesture channel: stress tests of the shared-memory ring with fork()ed producer processes of
+// several threads each, checked for lost, duplicated and reordered events, plus a producer that
+// crashes in the middle of a push. Then compares the throughput against one syscall per event,
+// which stands in for the cross-process PostMessage per forwarded message the hooks did before.
+
+#include "BenchUtil.h"
+#include "GestureChannel.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <thread>
+
+/* Memory shared by the consumer and all producer processes, zeroed by mmap */
+struct SharedArea {
+	GestureChannel channel;
+	std::atomic<uint32_t> nWakeups;
+	std::atomic<uint32_t> nFull;
+};
+
+/* Wake-ups are bytes in a pipe the consumer polls */
+class PipeChannelSystem : public GestureChannelSystem {
+public:
+	SharedArea* pArea;
+	int fdWake;
+	/* The next nFailures wake-ups fail with failure instead of being written */
+	int nFailures;
+	GestureChannelWakeResult failure;
+
+	PipeChannelSystem(SharedArea* pArea, int fdWake) : pArea(pArea), fdWake(fdWake), nFailures(0), failure(GCW_Failed) {}
+	uint32_t currentProcessId() { return static_cast<uint32_t>(getpid()); }
+	bool isProcessAlive(uint32_t idProcess) {
+		// an exited child stays a zombie until it is waited for, look without reaping it
+		siginfo_t info;
+		info.si_pid = 0;
+		if (waitid(P_PID, idProcess, &info, WEXITED | WNOHANG | WNOWAIT) == 0)
+			return info.si_pid == 0;
+		return kill(static_cast<pid_t>(idProcess), 0) == 0 || errno == EPERM;
+	}
+	GestureChannelWakeResult wakeConsumer(uint32_t) {
+		pArea->nWakeups.fetch_add(1, std::memory_order_relaxed);
+		if (nFailures) {
+			nFailures--;
+			return failure;
+		}
+		char b = 1;
+		// a full pipe wakes the consumer just as well
+		return write(fdWake, &b, 1) == 1 || errno == EAGAIN ? GCW_Posted : GCW_ConsumerGone;
+	}
+};
+
+const uint32_t CONSUMER_ID = 1;
+
+static SharedArea* MapSharedArea() {
+	void* p = mmap(NULL, sizeof(SharedArea), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	return p == MAP_FAILED ? NULL : static_cast<SharedArea*>(p);
+}
+
+static void MakePipe(int afd[2]) {
+	if (pipe(afd) != 0) {
+		perror("pipe");
+		exit(1);
+	}
+	fcntl(afd[0], F_SETFL, O_NONBLOCK);
+	fcntl(afd[1], F_SETFL, O_NONBLOCK);
+}
+
+static GestureChannelEvent MakeEvent(uint32_t idProducer, uint32_t seq) {
+	GestureChannelEvent event = { idProducer, GMSG_MOUSEMOVE, seq, seq * 2654435761u ^ idProducer };
+	return event;
+}
+
+/* Pushes nEvents per thread, retrying while the ring is full; exits the process */
+static void RunProducer(SharedArea* pArea, int fdWake, int iProcess, int nThreads, uint32_t nEvents) {
+	PipeChannelSystem system(pArea, fdWake);
+	std::atomic<bool> bFailed(false);
+	std::vector<std::thread> vThreads;
+	for (int iThread = 0; iThread < nThreads; iThread++) {
+		vThreads.push_back(std::thread([&, iThread]() {
+			uint32_t idProducer = static_cast<uint32_t>(iProcess * 16 + iThread);
+			for (uint32_t seq = 0; seq < nEvents; seq++) {
+				GestureChannelPushResult result;
+				while ((result = pArea->channel.push(system, MakeEvent(idProducer, seq))) == GCP_Full)
+					pArea->nFull.fetch_add(1, std::memory_order_relaxed);
+				if (result != GCP_Queued)
+					bFailed = true;
+			}
+		}));
+	}
+	for (std::thread& thread : vThreads)
+		thread.join();
+	_exit(bFailed ? 2 : 0);
+}
+
+/* Pops until nExpected events arrived, checking each producer's order; false on a mismatch or a stall */
+static bool Consume(SharedArea* pArea, PipeChannelSystem& system, int fdRead, size_t nExpected,
+					std::vector<uint32_t>& vNextSeq) {
+	size_t nReceived = 0;
+	while (nReceived < nExpected) {
+		pollfd fd = { fdRead, POLLIN, 0 };
+		if (poll(&fd, 1, 5000) == 0) {
+			printf("consumer stalled after %zu of %zu events\n", nReceived, nExpected);
+			return false;
+		}
+		char abDrain[256];
+		while (read(fdRead, abDrain, sizeof(abDrain)) > 0)
+			;
+		pArea->channel.rearm();
+		GestureChannelEvent event;
+		while (pArea->channel.pop(system, event)) {
+			uint32_t seq = event.wParam;
+			if (event.hwnd >= vNextSeq.size() || seq != vNextSeq[event.hwnd] || event.message != GMSG_MOUSEMOVE ||
+				event.lParam != MakeEvent(event.hwnd, seq).lParam) {
+				printf("producer %u: got event %u, expected %u\n", event.hwnd, seq,
+					   event.hwnd < vNextSeq.size() ? vNextSeq[event.hwnd] : 0);
+				return false;
+			}
+			vNextSeq[event.hwnd]++;
+			nReceived++;
+		}
+	}
+	return true;
+}
+
+static bool WaitForProducers(const std::vector<pid_t>& vPids) {
+	bool bSucceeded = true;
+	for (pid_t pid : vPids) {
+		int status = 0;
+		if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			bSucceeded = false;
+	}
+	return bSucceeded;
+}
+
+struct StressResult {
+	bool bSucceeded;
+	double ns;
+	uint32_t nWakeups;
+	uint32_t nFull;
+};
+
+static StressResult StressRing(int nProcesses, int nThreads, uint32_t nEvents) {
+	StressResult result = { false, 0, 0, 0 };
+	SharedArea* pArea = MapSharedArea();
+	if (pArea == NULL)
+		return result;
+	int afd[2];
+	MakePipe(afd);
+	PipeChannelSystem system(pArea, afd[1]);
+	pArea->channel.attachConsumer(CONSUMER_ID);
+
+	BenchTimer timer;
+	std::vector<pid_t> vPids;
+	for (int iProcess = 0; iProcess < nProcesses; iProcess++) {
+		pid_t pid = fork();
+		if (pid == 0)
+			RunProducer(pArea, afd[1], iProcess, nThreads, nEvents);
+		vPids.push_back(pid);
+	}
+	std::vector<uint32_t> vNextSeq(nProcesses * 16, 0);
+	bool bConsumed = Consume(pArea, system, afd[0], static_cast<size_t>(nProcesses) * nThreads * nEvents, vNextSeq);
+	if (!bConsumed) {
+		for (pid_t pid : vPids)
+			kill(pid, SIGKILL);
+	}
+	result.bSucceeded = WaitForProducers(vPids) && bConsumed && pArea->channel.getSkippedCount() == 0;
+	result.ns = timer.elapsedNs();
+	result.nWakeups = pArea->nWakeups.load();
+	result.nFull = pArea->nFull.load();
+	close(afd[0]);
+	close(afd[1]);
+	munmap(pArea, sizeof(SharedArea));
+	return result;
+}
+
+/* The old way: every event is a syscall that may wake the consumer */
+static double StressSyscalls(int nProcesses, int nThreads, uint32_t nEvents) {
+	int afd[2];
+	if (pipe(afd) != 0)
+		return 0;
+	BenchTimer timer;
+	std::vector<pid_t> vPids;
+	for (int iProcess = 0; iProcess < nProcesses; iProcess++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			std::vector<std::thread> vThreads;
+			for (int iThread = 0; iThread < nThreads; iThread++) {
+				vThreads.push_back(std::thread([&, iThread]() {
+					for (uint32_t seq = 0; seq < nEvents; seq++) {
+						GestureChannelEvent event = MakeEvent(static_cast<uint32_t>(iProcess * 16 + iThread), seq);
+						if (write(afd[1], &event, sizeof(event)) != sizeof(event))
+							_exit(2);
+					}
+				}));
+			}
+			for (std::thread& thread : vThreads)
+				thread.join();
+			_exit(0);
+		}
+		vPids.push_back(pid);
+	}
+	size_t cbExpected = static_cast<size_t>(nProcesses) * nThreads * nEvents * sizeof(GestureChannelEvent), cbRead = 0;
+	char abBuffer[4096];
+	while (cbRead < cbExpected) {
+		ssize_t cb = read(afd[0], abBuffer, sizeof(abBuffer));
+		if (cb <= 0)
+			break;
+		cbRead += static_cast<size_t>(cb);
+	}
+	double ns = timer.elapsedNs();
+	close(afd[0]);
+	close(afd[1]);
+	return WaitForProducers(vPids) && cbRead == cbExpected ? ns : 0;
+}
+
+/* A producer dies between claiming a slot and filling it; the consumer must skip the slot, not stall */
+static bool CheckCrashedProducer() {
+	SharedArea* pArea = MapSharedArea();
+	if (pArea == NULL)
+		return false;
+	int afd[2];
+	MakePipe(afd);
+	PipeChannelSystem system(pArea, afd[1]);
+	pArea->channel.attachConsumer(CONSUMER_ID);
+
+	// the event lives on a page it may not read, the copy after the claim faults
+	long cbPage = sysconf(_SC_PAGESIZE);
+	void* pNoAccess = mmap(NULL, cbPage, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	pid_t pid = fork();
+	if (pid == 0) {
+		signal(SIGSEGV, SIG_DFL);
+		pArea->channel.push(system, *static_cast<const GestureChannelEvent*>(pNoAccess));
+		_exit(0);
+	}
+	// wait for the crash but leave the zombie, the consumer still has to find the writer dead
+	siginfo_t info;
+	bool bCrashed = waitid(P_PID, pid, &info, WEXITED | WNOWAIT) == 0 && info.si_code != CLD_EXITED;
+
+	// a live producer behind it must still get through
+	std::vector<pid_t> vPids;
+	pid_t pidNext = fork();
+	if (pidNext == 0)
+		RunProducer(pArea, afd[1], 0, 1, 3 * GestureChannel::CAPACITY);
+	vPids.push_back(pidNext);
+	std::vector<uint32_t> vNextSeq(16, 0);
+	bool bConsumed = Consume(pArea, system, afd[0], 3 * GestureChannel::CAPACITY, vNextSeq);
+	if (!bConsumed)
+		kill(pidNext, SIGKILL);
+	bool bSucceeded = bCrashed && WaitForProducers(vPids) && bConsumed && pArea->channel.getSkippedCount() == 1;
+	waitpid(pid, NULL, 0);
+	munmap(pNoAccess, cbPage);
+	close(afd[0]);
+	close(afd[1]);
+	munmap(pArea, sizeof(SharedArea));
+	return bSucceeded;
+}
+
+/* Single process: no consumer, a full ring, detaching and reattaching */
+static bool CheckConsumerStates() {
+	SharedArea* pArea = MapSharedArea();
+	if (pArea == NULL)
+		return false;
+	int afd[2];
+	MakePipe(afd);
+	PipeChannelSystem system(pArea, afd[1]);
+	GestureChannel& channel = pArea->channel;
+	bool bSucceeded = channel.push(system, MakeEvent(0, 0)) == GCP_NoConsumer;
+
+	bSucceeded = bSucceeded && channel.attachConsumer(CONSUMER_ID) && !channel.attachConsumer(CONSUMER_ID + 1);
+	for (uint32_t seq = 0; seq < GestureChannel::CAPACITY; seq++)
+		bSucceeded = bSucceeded && channel.push(system, MakeEvent(0, seq)) == GCP_Queued;
+	bSucceeded = bSucceeded && channel.push(system, MakeEvent(0, GestureChannel::CAPACITY)) == GCP_Full;
+	// one wake-up for the whole batch, nobody rearmed
+	bSucceeded = bSucceeded && pArea->nWakeups.load() == 1;
+
+	// events left behind by a consumer are delivered to the next one
+	channel.detachConsumer(CONSUMER_ID);
+	bSucceeded = bSucceeded && channel.getConsumer() == 0 && channel.attachConsumer(CONSUMER_ID + 1);
+	channel.rearm();
+	GestureChannelEvent event;
+	uint32_t nPopped = 0;
+	while (channel.pop(system, event))
+		bSucceeded = bSucceeded && event.wParam == nPopped++;
+	bSucceeded = bSucceeded && nPopped == GestureChannel::CAPACITY;
+	// rearmed, the next push wakes the consumer again
+	bSucceeded = bSucceeded && channel.push(system, MakeEvent(0, 0)) == GCP_Queued && pArea->nWakeups.load() == 2;
+
+	// a wake-up that could not be posted is posted by the next push
+	channel.rearm();
+	while (channel.pop(system, event)) {}
+	system.nFailures = 1;
+	bSucceeded = bSucceeded && channel.push(system, MakeEvent(0, 0)) == GCP_Queued && pArea->nWakeups.load() == 3;
+	bSucceeded = bSucceeded && channel.push(system, MakeEvent(0, 1)) == GCP_Queued && pArea->nWakeups.load() == 4;
+	bSucceeded = bSucceeded && channel.push(system, MakeEvent(0, 2)) == GCP_Queued && pArea->nWakeups.load() == 4;
+	// a consumer checked with its wake-up pending is woken anyway, and detached once it is gone
+	bSucceeded = bSucceeded && channel.checkConsumer(system) && pArea->nWakeups.load() == 5;
+	system.nFailures = 1;
+	system.failure = GCW_ConsumerGone;
+	bSucceeded = bSucceeded && !channel.checkConsumer(system) && channel.getConsumer() == 0 &&
+				 channel.push(system, MakeEvent(0, 3)) == GCP_NoConsumer;
+
+	close(afd[0]);
+	close(afd[1]);
+	munmap(pArea, sizeof(SharedArea));
+	return bSucceeded;
+}
+
+int main() {
+	if (!CheckConsumerStates()) {
+		printf("the channel mishandles its consumer or a full ring\n");
+		return 1;
+	}
+	if (!CheckCrashedProducer()) {
+		printf("a producer crashing mid-push wedges the channel\n");
+		return 1;
+	}
+	printf("consumer states and crashed producers handled\n\n");
+
+	struct { int nProcesses, nThreads; } aConfigs[] = { { 1, 1 }, { 2, 1 }, { 2, 2 }, { 4, 2 }, { 8, 1 } };
+	const uint32_t nEvents = 200000;
+	printf("%-10s %8s %10s %14s %14s %10s %14s\n", "processes", "threads", "events", "syscall ev/s", "ring ev/s",
+		   "speedup", "wakeups/1000");
+	for (auto& config : aConfigs) {
+		StressResult ring = StressRing(config.nProcesses, config.nThreads, nEvents);
+		if (!ring.bSucceeded) {
+			printf("%d process(es) x %d thread(s): events lost, duplicated or reordered\n", config.nProcesses,
+				   config.nThreads);
+			return 1;
+		}
+		double nsSyscalls = StressSyscalls(config.nProcesses, config.nThreads, nEvents);
+		if (nsSyscalls == 0) {
+			printf("syscall baseline failed\n");
+			return 1;
+		}
+		size_t nTotal = static_cast<size_t>(config.nProcesses) * config.nThreads * nEvents;
+		double evBefore = nTotal * 1e9 / nsSyscalls, evAfter = nTotal * 1e9 / ring.ns;
+		printf("%-10d %8d %10zu %14.0f %14.0f %9.2fx %14.2f\n", config.nProcesses, config.nThreads, nTotal, evBefore,
+			   evAfter, evAfter / evBefore, 1000.0 * ring.nWakeups / nTotal);
+	}
+	return 0;
+}
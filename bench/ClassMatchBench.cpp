@@ -0,0 +1,241 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Plugin window class matching, the perfect hash of WindowClassSet.h against the linear strcmp it
+// replaced. Realistic names are the classes found around a flash plugin on a desktop; adversarial
+// names are built to defeat the key: the same length, first, middle and last character as a plugin
+// window class, names that land in an occupied slot, prefixes, case changes and 255 character names.
+// The walk section runs the whole firefox window lookup, checks that it never touches the heap and
+// that class atoms spare the name reads for plugin window classes. Calls count every window tree
+// call, names only the GetClassName calls: the atom comes from the desktop heap without a kernel call.
+
+#include "BenchUtil.h"
+#include "FakeWindowTree.h"
+#include "LegacyWindowTree.h"
+#include "WindowClassSet.h"
+
+#include <cstdlib>
+#include <new>
+#include <string>
+
+static size_t s_nAllocations = 0;
+
+void* operator new(size_t cb) {
+	s_nAllocations++;
+	void* p = malloc(cb ? cb : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+static const char* const s_aszRealistic[] = {
+	"MozillaWindowClass", "GeckoPluginWindow", "GeckoFPSandboxChildWindow", "ShockwaveFlashFullScreen",
+	"Internet Explorer_Server", "MozillaDropShadowWindowClass", "MozillaHiddenWindowClass", "MozillaDialogClass",
+	"Chrome_WidgetWin_1", "Chrome_RenderWidgetHostHWND", "Shell_TrayWnd", "Progman", "WorkerW", "SHELLDLL_DefView",
+	"SysListView32", "Button", "Edit", "Static", "ComboBox", "#32770", "ConsoleWindowClass", "CabinetWClass",
+	"DirectUIHWND", "tooltips_class32", "MSCTFIME UI", "IME", "OleMainThreadWndClass", "CicMarshalWndClass",
+	"GDI+ Hook Window Class", "Windows.UI.Core.CoreWindow", "ApplicationFrameWindow", "ShockwaveFlash",
+};
+
+static std::string RandomName(BenchRandom& random, int cch) {
+	std::string str;
+	for (int i = 0; i < cch; i++)
+		str += static_cast<char>(random.range(0, 1) ? random.range('a', 'z') : random.range('A', 'Z'));
+	return str;
+}
+
+static int Slot(const std::string& str) {
+	return WindowClassSlot(WindowClassKey(str.c_str(), static_cast<int>(str.size())), WINDOW_CLASS_SEED);
+}
+
+static std::vector<std::string> BuildAdversarial() {
+	std::vector<std::string> vNames;
+	BenchRandom random(7);
+	for (int iClass = 0; iClass < PLUGIN_WINDOW_CLASS_COUNT; iClass++) {
+		std::string strClass = g_aszPluginWindowClasses[iClass];
+		int cch = static_cast<int>(strClass.size());
+		// same key: only the characters the key does not look at change
+		for (int i = 1; i < cch - 1; i++) {
+			if (i == cch / 2)
+				continue;
+			std::string str = strClass;
+			str[i] ^= 0x20;
+			vNames.push_back(str);
+		}
+		vNames.push_back(strClass.substr(0, cch - 1));
+		vNames.push_back(strClass + "X");
+		vNames.push_back(strClass + strClass);
+		std::string strLower = strClass;
+		for (char& c : strLower)
+			c = static_cast<char>(tolower(c));
+		vNames.push_back(strLower);
+		std::string strLong = strClass;
+		while (strLong.size() < MAX_WINDOW_CLASS_NAME - 1)
+			strLong += 'W';
+		vNames.push_back(strLong);
+		// random names of the same length in the same slot
+		for (int n = 0; n < 16;) {
+			std::string str = RandomName(random, cch);
+			if (Slot(str) == Slot(strClass)) {
+				vNames.push_back(str);
+				n++;
+			}
+		}
+	}
+	return vNames;
+}
+
+struct MatchResult {
+	double nsLinear;
+	double nsHash;
+	int nMatches;
+};
+
+static bool MatchNames(const std::vector<std::string>& vNames, MatchResult& result) {
+	result.nMatches = 0;
+	for (const std::string& str : vNames) {
+		int iLinear = legacy::FindClassName(legacy::aszTargetPluginWindowClassNames, legacy::nTargetPluginWindowClassNames, str.c_str());
+		int iHash = FindPluginWindowClass(str.c_str(), static_cast<int>(str.size()));
+		if (iLinear != iHash) {
+			printf("\"%s\": linear search says %d, perfect hash says %d\n", str.c_str(), iLinear, iHash);
+			return false;
+		}
+		result.nMatches += iHash >= 0 ? 1 : 0;
+	}
+
+	// names arrive from GetClassName in a buffer, with their length
+	std::vector<const char*> vszNames;
+	std::vector<int> vcchNames;
+	for (int i = 0; i < 200000; i++) {
+		const std::string& str = vNames[i % vNames.size()];
+		vszNames.push_back(str.c_str());
+		vcchNames.push_back(static_cast<int>(str.size()));
+	}
+	volatile int sink = 0;
+	result.nsLinear = BenchBestOf(7, [&]() {
+		int sum = 0;
+		for (const char* sz : vszNames)
+			sum += legacy::FindClassName(legacy::aszTargetPluginWindowClassNames, legacy::nTargetPluginWindowClassNames, sz);
+		sink = sum;
+	}) / vszNames.size();
+	result.nsHash = BenchBestOf(7, [&]() {
+		int sum = 0;
+		for (size_t i = 0; i < vszNames.size(); i++)
+			sum += FindPluginWindowClass(vszNames[i], vcchNames[i]);
+		sink = sum;
+	}) / vszNames.size();
+	return true;
+}
+
+/* Firefox with in and out of process plugins, a sandboxed plugin and windows that only look like firefox */
+static FakeWindowTree BuildMixedTree(std::vector<GestureWindow>& vLookups) {
+	BrowserWindowTree browser(4, 4);
+	FakeWindowTree& tree = browser.tree;
+	vLookups = browser.vPluginWindows;
+	vLookups.insert(vLookups.end(), browser.vForeignWindows.begin(), browser.vForeignWindows.end());
+	// in process, only firefox windows count, so this one resolves through its MozillaWindowClass parent
+	GestureWindow hwndContent = tree.addWindow(browser.hwndFirefox, "MozillaWindowClass", true);
+	GestureWindow hwndInProcess = tree.addWindow(hwndContent, "GeckoPluginWindow", true);
+	vLookups.push_back(tree.addWindow(hwndInProcess, "ShockwaveFlash", true));
+	// the sandbox child is accepted whatever its root is
+	GestureWindow hwndSandboxRoot = tree.addWindow(0, "Chrome_WidgetWin_1");
+	GestureWindow hwndSandbox = tree.addWindow(hwndSandboxRoot, "GeckoFPSandboxChildWindow");
+	vLookups.push_back(tree.addWindow(hwndSandbox, "ShockwaveFlashFullScreen"));
+	// a plugin window under a root of another application is not
+	GestureWindow hwndOtherRoot = tree.addWindow(0, "MozillaWindowClasS");
+	GestureWindow hwndPluginHost = tree.addWindow(hwndOtherRoot, "GeckoPluginWindow");
+	vLookups.push_back(tree.addWindow(hwndPluginHost, "Internet Explorer_Server"));
+	// look-alikes all the way up
+	GestureWindow hwnd = tree.addWindow(0, "MozillaWindowClasS");
+	const char* const aszLookAlikes[] = { "GeckoPluginWindoW", "MozillaWindowClas", "GeckoFPSandboxChildWindoW", "mozillawindowclass" };
+	for (const char* sz : aszLookAlikes)
+		hwnd = tree.addWindow(hwnd, sz);
+	vLookups.push_back(hwnd);
+	// the top level window itself
+	vLookups.push_back(browser.hwndFirefox);
+	return tree;
+}
+
+int main() {
+	printf("%u plugin window classes in %d slots, seed %u\n", static_cast<unsigned>(PLUGIN_WINDOW_CLASS_COUNT),
+		   WINDOW_CLASS_SLOTS, WINDOW_CLASS_SEED);
+
+	std::vector<std::string> vRealistic(s_aszRealistic, s_aszRealistic + sizeof(s_aszRealistic) / sizeof(s_aszRealistic[0]));
+	std::vector<std::string> vAdversarial = BuildAdversarial();
+	printf("\n%-14s %8s %8s %12s %12s\n", "names", "count", "matches", "ns/linear", "ns/hash");
+	MatchResult realistic, adversarial;
+	if (!MatchNames(vRealistic, realistic) || !MatchNames(vAdversarial, adversarial))
+		return 1;
+	printf("%-14s %8zu %8d %12.2f %12.2f\n", "realistic", vRealistic.size(), realistic.nMatches, realistic.nsLinear,
+		   realistic.nsHash);
+	printf("%-14s %8zu %8d %12.2f %12.2f\n", "adversarial", vAdversarial.size(), adversarial.nMatches,
+		   adversarial.nsLinear, adversarial.nsHash);
+	if (realistic.nMatches != 3 || adversarial.nMatches != 0) {
+		printf("unexpected number of matches\n");
+		return 1;
+	}
+
+	std::vector<GestureWindow> vLookups;
+	FakeWindowTree tree = BuildMixedTree(vLookups);
+	GestureWindow aExpected[] = { 1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 0, 0, 0 };
+	if (vLookups.size() != sizeof(aExpected) / sizeof(aExpected[0])) {
+		printf("mixed tree has %zu lookups\n", vLookups.size());
+		return 1;
+	}
+	for (size_t i = 0; i < vLookups.size(); i++) {
+		GestureWindow hwndLegacy = legacy::VerifyAndGetTopMozillaWindowClassWindow(tree, vLookups[i]);
+		GestureWindow hwndNew = VerifyAndGetTopMozillaWindowClassWindow(tree, vLookups[i]);
+		if (hwndLegacy != hwndNew) {
+			printf("lookup %zu: legacy found %d, new found %d\n", i, static_cast<int>(hwndLegacy), static_cast<int>(hwndNew));
+			return 1;
+		}
+		if ((hwndNew != 0) != (aExpected[i] != 0)) {
+			printf("lookup %zu: found %d\n", i, static_cast<int>(hwndNew));
+			return 1;
+		}
+	}
+
+	const int nRuns = 5;
+	const int nRounds = 20000;
+	printf("\n%-14s %12s %12s %12s %12s\n", "walk", "ns/lookup", "calls/lookup", "names/lookup", "allocations");
+	for (int iImpl = 0; iImpl < 2; iImpl++) {
+		GestureWindow checksum = 0;
+		tree.nCalls = 0;
+		tree.nClassNameReads = 0;
+		size_t nAllocationsBefore = s_nAllocations;
+		double ns = BenchBestOf(nRuns, [&]() {
+			for (int round = 0; round < nRounds; round++) {
+				for (GestureWindow hwnd : vLookups)
+					checksum += iImpl ? VerifyAndGetTopMozillaWindowClassWindow(tree, hwnd) :
+										legacy::VerifyAndGetTopMozillaWindowClassWindow(tree, hwnd);
+			}
+		});
+		size_t nAllocations = s_nAllocations - nAllocationsBefore;
+		double nLookups = static_cast<double>(nRounds) * vLookups.size();
+		printf("%-14s %12.2f %12.2f %12.2f %12zu\n", iImpl ? "perfect hash" : "linear", ns / nLookups,
+			   tree.nCalls / (nRuns * nLookups), tree.nClassNameReads / (nRuns * nLookups), nAllocations);
+		if (nAllocations) {
+			printf("the walk allocated\n");
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,87 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "HookRegistry.h"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/* Simulated threads for ThreadExitWaiter: exitThread() reports to every active wait on the thread */
+class FakeThreadExitWaiter : public ThreadExitWaiter {
+private:
+	struct Wait {
+		uintptr_t wait;
+		HookSlot slot;
+		ThreadExitSink* pSink;
+	};
+	std::unordered_multimap<uint32_t, Wait> m_mapWaitsByThread;
+	std::unordered_map<uintptr_t, uint32_t> m_mapThreadByWait;
+	std::unordered_set<uint32_t> m_setExited;
+	uintptr_t m_nextWait;
+public:
+	size_t nWatchCalls;
+	size_t nUnwatchCalls;
+
+	FakeThreadExitWaiter() : m_nextWait(1), nWatchCalls(0), nUnwatchCalls(0) {}
+
+	/* Ends a simulated thread, like the thread handle getting signaled */
+	void exitThread(uint32_t idThread) {
+		m_setExited.insert(idThread);
+		// the thread pool waits are registered to execute only once
+		auto range = m_mapWaitsByThread.equal_range(idThread);
+		std::vector<Wait> vSignaled;
+		for (auto iter = range.first; iter != range.second; ++iter)
+			vSignaled.push_back(iter->second);
+		m_mapWaitsByThread.erase(range.first, range.second);
+		for (const Wait& wait : vSignaled) {
+			m_mapThreadByWait.erase(wait.wait);
+			wait.pSink->threadExited(wait.slot);
+		}
+	}
+	bool hasExited(uint32_t idThread) const { return m_setExited.count(idThread) != 0; }
+	size_t activeWaits() const { return m_mapThreadByWait.size(); }
+
+	uintptr_t watch(uint32_t idThread, HookSlot slot, ThreadExitSink& sink) {
+		nWatchCalls++;
+		// OpenThread fails on a thread that is gone
+		if (hasExited(idThread))
+			return 0;
+		Wait wait = { m_nextWait++, slot, &sink };
+		m_mapWaitsByThread.insert(std::make_pair(idThread, wait));
+		m_mapThreadByWait[wait.wait] = idThread;
+		return wait.wait;
+	}
+	void unwatch(uintptr_t wait) {
+		if (wait == 0)
+			return;
+		nUnwatchCalls++;
+		auto iter = m_mapThreadByWait.find(wait);
+		if (iter == m_mapThreadByWait.end())
+			return;
+		auto range = m_mapWaitsByThread.equal_range(iter->second);
+		for (auto iterWait = range.first; iterWait != range.second; ++iterWait) {
+			if (iterWait->second.wait == wait) {
+				m_mapWaitsByThread.erase(iterWait);
+				break;
+			}
+		}
+		m_mapThreadByWait.erase(iter);
+	}
+};
@@ -0,0 +1,94 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "WakeupBroadcast.h"
+
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Simulated plugin threads answering wake-ups on a virtual clock, so that seconds of hung threads
+ * run instantly. Each window belongs to a thread that answers after a fixed latency, or never.
+ * Threads that never answer count as hung once they have been unresponsive for HUNG_AFTER_MS.
+ */
+class FakeWakeupChannel : public WakeupChannel {
+public:
+	static const uint32_t NEVER = 0xffffffff;
+	/* same as IsHungAppWindow */
+	static const uint32_t HUNG_AFTER_MS = 5000;
+private:
+	struct SimulatedThread {
+		uint32_t msLatency;
+		/* virtual time at which the thread stopped responding */
+		uint64_t msBusySince;
+	};
+	struct Pending {
+		uint64_t msDone;
+		uint32_t cookie;
+	};
+	std::unordered_map<GestureWindow, SimulatedThread> m_mapThreadByWindow;
+	std::vector<Pending> m_vPending;
+	uint64_t m_msNow;
+public:
+	size_t nSent;
+	size_t nWaits;
+
+	FakeWakeupChannel() : m_msNow(0), nSent(0), nWaits(0) {}
+
+	/* Windows without a thread have been destroyed, sending to them fails */
+	void addThread(GestureWindow hwnd, uint32_t msLatency, uint32_t msBusyFor = 0) {
+		// unsigned wrap-around keeps m_msNow - msBusySince == msBusyFor even at the start of the clock
+		SimulatedThread thread = { msLatency, m_msNow - msBusyFor };
+		m_mapThreadByWindow[hwnd] = thread;
+	}
+
+	WakeupSendResult send(GestureWindow hwnd, uint32_t cookie) {
+		auto iter = m_mapThreadByWindow.find(hwnd);
+		if (iter == m_mapThreadByWindow.end())
+			return WSR_Failed;
+		const SimulatedThread& thread = iter->second;
+		if (thread.msLatency == NEVER && m_msNow - thread.msBusySince >= HUNG_AFTER_MS)
+			return WSR_Hung;
+		nSent++;
+		if (thread.msLatency != NEVER) {
+			Pending pending = { m_msNow + thread.msLatency, cookie };
+			m_vPending.push_back(pending);
+		}
+		return WSR_Sent;
+	}
+	void waitCompleted(uint32_t msTimeout, std::vector<uint32_t>& vCompleted) {
+		nWaits++;
+		uint64_t msWake = m_msNow + msTimeout;
+		for (const Pending& pending : m_vPending) {
+			if (pending.msDone < msWake)
+				msWake = pending.msDone;
+		}
+		m_msNow = msWake;
+		for (size_t i = 0; i < m_vPending.size();) {
+			if (m_vPending[i].msDone <= m_msNow) {
+				vCompleted.push_back(m_vPending[i].cookie);
+				m_vPending[i] = m_vPending.back();
+				m_vPending.pop_back();
+			} else {
+				i++;
+			}
+		}
+	}
+	uint64_t nowMs() { return m_msNow; }
+};
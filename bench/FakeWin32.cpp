@@ -0,0 +1,684 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <set>
+#include <thread>
+
+using namespace std;
+
+FakeDesktop g_fakeDesktop;
+
+// Handles look like real ones: multiples of 16 above the desktop window, below 2^31 so that they survive
+// the 32-bit truncation the hook applies to window handles
+static const uintptr_t HWND_DESKTOP_VALUE = 0x10010;
+static const DWORD FIRST_THREAD_ID = 1000;
+
+static HWND WindowHandleOf(size_t iWindow) {
+	return reinterpret_cast<HWND>(HWND_DESKTOP_VALUE + 0x10 * (iWindow + 1));
+}
+
+// Process handles are odd, mappings are pointers to their Mapping
+static HANDLE ProcessHandleOf(DWORD idProcess) {
+	return reinterpret_cast<HANDLE>(static_cast<uintptr_t>(idProcess) << 1 | 1);
+}
+
+FakeDesktop::FakeDesktop() : m_idCurrentThread(0), m_nTlsIndices(0), m_hwndFocus(NULL) {
+	reset();
+}
+
+void FakeDesktop::reset() {
+	for (Mapping* pMapping : m_vMappings) {
+		free(pMapping->pView);
+		delete pMapping;
+	}
+	m_vMappings.clear();
+	m_vProcessesAlive.clear();
+	m_vThreads.clear();
+	m_vWindows.clear();
+	m_vDeliveries.clear();
+	memset(m_abAsyncKeyState, 0, sizeof(m_abAsyncKeyState));
+	m_hwndFocus = NULL;
+	m_idCurrentThread = addThread(addProcess());
+}
+
+uint64_t FakeDesktop::timestampNs() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+DWORD FakeDesktop::addProcess() {
+	m_vProcessesAlive.push_back(true);
+	return static_cast<DWORD>(m_vProcessesAlive.size());
+}
+
+void FakeDesktop::exitProcess(DWORD idProcess) {
+	if (idProcess && idProcess <= m_vProcessesAlive.size())
+		m_vProcessesAlive[idProcess - 1] = false;
+}
+
+bool FakeDesktop::isProcessAlive(DWORD idProcess) const {
+	return idProcess && idProcess <= m_vProcessesAlive.size() && m_vProcessesAlive[idProcess - 1];
+}
+
+DWORD FakeDesktop::addThread(DWORD idProcess) {
+	Thread thread;
+	thread.idThread = FIRST_THREAD_ID + static_cast<DWORD>(m_vThreads.size());
+	thread.idProcess = idProcess;
+	memset(thread.abKeyState, 0, sizeof(thread.abKeyState));
+	thread.pfnHook = NULL;
+	thread.dwLastError = 0;
+	m_vThreads.push_back(thread);
+	return thread.idThread;
+}
+
+FakeDesktop::Thread* FakeDesktop::findThread(DWORD idThread) {
+	size_t iThread = idThread - FIRST_THREAD_ID;
+	return idThread >= FIRST_THREAD_ID && iThread < m_vThreads.size() ? &m_vThreads[iThread] : NULL;
+}
+
+ATOM FakeDesktop::addAtom(const string& strClassName) {
+	for (size_t i = 0; i < m_vAtomNames.size(); i++) {
+		if (m_vAtomNames[i] == strClassName)
+			return static_cast<ATOM>(0xc000 + i);
+	}
+	m_vAtomNames.push_back(strClassName);
+	return static_cast<ATOM>(0xc000 + m_vAtomNames.size() - 1);
+}
+
+HWND FakeDesktop::addWindow(HWND hwndParent, const char* szClassName, DWORD idThread, int x, int y) {
+	Window window;
+	window.hwndParent = hwndParent;
+	window.strClassName = szClassName;
+	window.atom = addAtom(szClassName);
+	window.idThread = idThread;
+	window.ptOrigin.x = x;
+	window.ptOrigin.y = y;
+	if (Window* pParent = findWindow(hwndParent)) {
+		window.ptOrigin.x += pParent->ptOrigin.x;
+		window.ptOrigin.y += pParent->ptOrigin.y;
+	}
+	m_vWindows.push_back(window);
+	HWND hwnd = WindowHandleOf(m_vWindows.size() - 1);
+	if (Window* pParent = findWindow(hwndParent))
+		pParent->vChildren.push_back(hwnd);
+	return hwnd;
+}
+
+FakeDesktop::Window* FakeDesktop::findWindow(HWND hwnd) {
+	uintptr_t value = reinterpret_cast<uintptr_t>(hwnd);
+	if (value <= HWND_DESKTOP_VALUE || value % 0x10)
+		return NULL;
+	size_t iWindow = (value - HWND_DESKTOP_VALUE) / 0x10 - 1;
+	return iWindow < m_vWindows.size() ? &m_vWindows[iWindow] : NULL;
+}
+
+void FakeDesktop::setCurrentThread(DWORD idThread) {
+	assert(findThread(idThread));
+	m_idCurrentThread = idThread;
+}
+
+void FakeDesktop::setGetMessageHook(DWORD idThread, HOOKPROC pfnHook) {
+	findThread(idThread)->pfnHook = pfnHook;
+}
+
+static void UpdateKeyState(BYTE* abKeyState, const MSG& msg) {
+	if (msg.message == WM_KEYDOWN || msg.message == WM_SYSKEYDOWN)
+		abKeyState[msg.wParam & 0xff] = 0x80;
+	else if (msg.message == WM_KEYUP || msg.message == WM_SYSKEYUP)
+		abKeyState[msg.wParam & 0xff] = 0;
+}
+
+void FakeDesktop::queueInput(const MSG& msg) {
+	UpdateKeyState(m_abAsyncKeyState, msg);
+	Window* pWindow = findWindow(msg.hwnd);
+	if (pWindow)
+		findThread(pWindow->idThread)->inputQueue.push_back(msg);
+}
+
+bool FakeDesktop::hasMessages(DWORD idThread) const {
+	size_t iThread = idThread - FIRST_THREAD_ID;
+	return iThread < m_vThreads.size() && !(m_vThreads[iThread].queue.empty() && m_vThreads[iThread].inputQueue.empty());
+}
+
+bool FakeDesktop::getMessage(MSG& msg) {
+	Thread& thread = currentThread();
+	if (!thread.queue.empty()) {
+		msg = thread.queue.front();
+		thread.queue.pop_front();
+	} else if (!thread.inputQueue.empty()) {
+		msg = thread.inputQueue.front();
+		thread.inputQueue.pop_front();
+		// the thread's keyboard state follows the hardware key messages it removes, before any hook sees them
+		UpdateKeyState(thread.abKeyState, msg);
+	} else {
+		return false;
+	}
+	if (thread.pfnHook)
+		thread.pfnHook(HC_ACTION, PM_REMOVE, reinterpret_cast<LPARAM>(&msg));
+	return true;
+}
+
+void FakeDesktop::deliver(HWND hwnd, DWORD idThread, UINT message, WPARAM wParam, LPARAM lParam, FakeDeliveryKind kind) {
+	FakeDelivery delivery = { hwnd, idThread, message, wParam, lParam, kind, timestampNs() };
+	m_vDeliveries.push_back(delivery);
+	if (kind != FDK_Sent) {
+		MSG msg = { hwnd, message, wParam, lParam, 0 };
+		findThread(idThread)->queue.push_back(msg);
+	}
+}
+
+UINT FakeDesktop::registerMessage(const wstring& strName) {
+	for (size_t i = 0; i < m_vMessageNames.size(); i++) {
+		if (m_vMessageNames[i] == strName)
+			return static_cast<UINT>(0xc000 + i);
+	}
+	m_vMessageNames.push_back(strName);
+	return static_cast<UINT>(0xc000 + m_vMessageNames.size() - 1);
+}
+
+FakeDesktop::Mapping* FakeDesktop::openMapping(const wchar_t* szName, size_t cbView) {
+	for (Mapping* pMapping : m_vMappings) {
+		if (szName && pMapping->strName == szName) {
+			pMapping->nHandles++;
+			return pMapping;
+		}
+	}
+	// zeroed, like fresh pages of the page file
+	Mapping* pMapping = new Mapping;
+	pMapping->strName = szName ? szName : L"";
+	pMapping->pView = calloc(1, cbView);
+	pMapping->cbView = cbView;
+	pMapping->nHandles = 1;
+	m_vMappings.push_back(pMapping);
+	return pMapping;
+}
+
+FakeDesktop::Mapping* FakeDesktop::openExistingMapping(const wchar_t* szName) {
+	for (Mapping* pMapping : m_vMappings) {
+		if (pMapping->strName == szName) {
+			pMapping->nHandles++;
+			return pMapping;
+		}
+	}
+	return NULL;
+}
+
+void FakeDesktop::closeMapping(Mapping* pMapping) {
+	if (--pMapping->nHandles)
+		return;
+	for (size_t i = 0; i < m_vMappings.size(); i++) {
+		if (m_vMappings[i] == pMapping) {
+			m_vMappings.erase(m_vMappings.begin() + i);
+			break;
+		}
+	}
+	free(pMapping->pView);
+	delete pMapping;
+}
+
+FakeDesktop::Mapping* FakeDesktop::findMappingView(const void* pView) {
+	for (Mapping* pMapping : m_vMappings) {
+		if (pMapping->pView == pView)
+			return pMapping;
+	}
+	return NULL;
+}
+
+//
+// kernel32
+//
+
+DWORD GetCurrentThreadId() {
+	return g_fakeDesktop.currentThread().idThread;
+}
+
+DWORD GetCurrentProcessId() {
+	return g_fakeDesktop.currentThread().idProcess;
+}
+
+DWORD GetLastError() {
+	return g_fakeDesktop.currentThread().dwLastError;
+}
+
+void SetLastError(DWORD dwError) {
+	g_fakeDesktop.currentThread().dwLastError = dwError;
+}
+
+DWORD TlsAlloc() {
+	return g_fakeDesktop.allocTlsIndex();
+}
+
+BOOL TlsFree(DWORD) {
+	return TRUE;
+}
+
+LPVOID TlsGetValue(DWORD dwTlsIndex) {
+	vector<LPVOID>& vSlots = g_fakeDesktop.currentThread().vTlsSlots;
+	return dwTlsIndex < vSlots.size() ? vSlots[dwTlsIndex] : NULL;
+}
+
+BOOL TlsSetValue(DWORD dwTlsIndex, LPVOID pValue) {
+	vector<LPVOID>& vSlots = g_fakeDesktop.currentThread().vTlsSlots;
+	if (dwTlsIndex >= vSlots.size())
+		vSlots.resize(dwTlsIndex + 1, NULL);
+	vSlots[dwTlsIndex] = pValue;
+	return TRUE;
+}
+
+BOOL InitializeCriticalSectionAndSpinCount(CRITICAL_SECTION* pcs, DWORD) {
+	pcs->pMutex = new recursive_mutex;
+	return TRUE;
+}
+
+void DeleteCriticalSection(CRITICAL_SECTION* pcs) {
+	delete pcs->pMutex;
+	pcs->pMutex = NULL;
+}
+
+void EnterCriticalSection(CRITICAL_SECTION* pcs) {
+	pcs->pMutex->lock();
+}
+
+void LeaveCriticalSection(CRITICAL_SECTION* pcs) {
+	pcs->pMutex->unlock();
+}
+
+HANDLE CreateFileMappingW(HANDLE hFile, void*, DWORD, DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, const wchar_t* szName) {
+	// only page file backed mappings
+	if (hFile != INVALID_HANDLE_VALUE || dwMaximumSizeHigh) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return NULL;
+	}
+	return g_fakeDesktop.openMapping(szName, dwMaximumSizeLow);
+}
+
+HANDLE OpenFileMappingW(DWORD, BOOL, const wchar_t* szName) {
+	FakeDesktop::Mapping* pMapping = g_fakeDesktop.openExistingMapping(szName);
+	if (pMapping == NULL)
+		SetLastError(ERROR_FILE_NOT_FOUND);
+	return pMapping;
+}
+
+LPVOID MapViewOfFile(HANDLE hMapping, DWORD, DWORD, DWORD, size_t) {
+	return static_cast<FakeDesktop::Mapping*>(hMapping)->pView;
+}
+
+BOOL UnmapViewOfFile(const void* pBase) {
+	return g_fakeDesktop.findMappingView(pBase) != NULL;
+}
+
+// Events and threads are shared with real threads, unlike the rest of the simulation they are locked
+namespace {
+
+struct KernelObject {
+	bool bThread;
+	bool bManualReset;
+	bool bSignaled;
+	/* a thread whose handle was closed before it ended frees its object itself */
+	bool bClosed;
+	std::thread thread;
+};
+
+struct ThreadExit {};
+
+mutex s_mtxObjects;
+condition_variable s_cvObjects;
+set<KernelObject*> s_setObjects;
+
+KernelObject* FindKernelObject(HANDLE h) {
+	set<KernelObject*>::iterator it = s_setObjects.find(static_cast<KernelObject*>(h));
+	return it == s_setObjects.end() ? NULL : *it;
+}
+
+void RunThread(KernelObject* pObject, unsigned int (*pfnStart)(void*), void* pArg) {
+	try {
+		pfnStart(pArg);
+	} catch (const ThreadExit&) {
+	}
+	lock_guard<mutex> lock(s_mtxObjects);
+	pObject->bSignaled = true;
+	s_cvObjects.notify_all();
+	if (pObject->bClosed)
+		delete pObject;
+}
+
+}
+
+BOOL CloseHandle(HANDLE h) {
+	if (reinterpret_cast<uintptr_t>(h) & 1)
+		return TRUE;
+	{
+		lock_guard<mutex> lock(s_mtxObjects);
+		if (KernelObject* pObject = FindKernelObject(h)) {
+			s_setObjects.erase(pObject);
+			if (pObject->bThread && !pObject->bSignaled) {
+				pObject->thread.detach();
+				pObject->bClosed = true;
+				return TRUE;
+			}
+			if (pObject->thread.joinable())
+				pObject->thread.join();
+			delete pObject;
+			return TRUE;
+		}
+	}
+	g_fakeDesktop.closeMapping(static_cast<FakeDesktop::Mapping*>(h));
+	return TRUE;
+}
+
+HANDLE CreateEvent(void*, BOOL bManualReset, BOOL bInitialState, const wchar_t*) {
+	KernelObject* pObject = new KernelObject();
+	pObject->bThread = false;
+	pObject->bManualReset = bManualReset != FALSE;
+	pObject->bSignaled = bInitialState != FALSE;
+	pObject->bClosed = false;
+	lock_guard<mutex> lock(s_mtxObjects);
+	s_setObjects.insert(pObject);
+	return pObject;
+}
+
+BOOL SetEvent(HANDLE hEvent) {
+	lock_guard<mutex> lock(s_mtxObjects);
+	KernelObject* pObject = FindKernelObject(hEvent);
+	if (pObject == NULL || pObject->bThread)
+		return FALSE;
+	pObject->bSignaled = true;
+	s_cvObjects.notify_all();
+	return TRUE;
+}
+
+BOOL GetModuleHandleEx(DWORD, LPCWSTR, HMODULE* phModule) {
+	static char s_module;
+	*phModule = &s_module;
+	return TRUE;
+}
+
+BOOL FreeLibrary(HMODULE) {
+	return TRUE;
+}
+
+void FreeLibraryAndExitThread(HMODULE, DWORD) {
+	throw ThreadExit();
+}
+
+HANDLE OpenProcess(DWORD, BOOL, DWORD idProcess) {
+	// a process that has exited and been cleaned up is no longer found
+	if (!g_fakeDesktop.isProcessAlive(idProcess)) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return NULL;
+	}
+	return ProcessHandleOf(idProcess);
+}
+
+DWORD WaitForSingleObject(HANDLE h, DWORD dwMilliseconds) {
+	{
+		unique_lock<mutex> lock(s_mtxObjects);
+		if (KernelObject* pObject = FindKernelObject(h)) {
+			bool bSignaled = true;
+			if (dwMilliseconds == INFINITE)
+				s_cvObjects.wait(lock, [pObject]() { return pObject->bSignaled; });
+			else
+				bSignaled = s_cvObjects.wait_for(lock, chrono::milliseconds(dwMilliseconds), [pObject]() { return pObject->bSignaled; });
+			if (!bSignaled)
+				return WAIT_TIMEOUT;
+			if (!pObject->bThread && !pObject->bManualReset)
+				pObject->bSignaled = false;
+			return WAIT_OBJECT_0;
+		}
+	}
+	DWORD idProcess = static_cast<DWORD>(reinterpret_cast<uintptr_t>(h) >> 1);
+	return g_fakeDesktop.isProcessAlive(idProcess) ? WAIT_TIMEOUT : WAIT_OBJECT_0;
+}
+
+void Sleep(DWORD dwMilliseconds) {
+	this_thread::sleep_for(chrono::milliseconds(dwMilliseconds));
+}
+
+DWORD GetTickCount() {
+	return static_cast<DWORD>(chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+DWORD GetTempPathW(DWORD cchBuffer, wchar_t* szBuffer) {
+	static const wchar_t szTemp[] = L"/tmp/";
+	DWORD cchTemp = sizeof(szTemp) / sizeof(szTemp[0]) - 1;
+	if (cchBuffer <= cchTemp)
+		return cchTemp + 1;
+	wcscpy(szBuffer, szTemp);
+	return cchTemp;
+}
+
+//
+// CRT
+//
+
+// the paths the hook builds are ASCII
+static string NarrowPath(const wchar_t* sz) {
+	string str;
+	for (; *sz; sz++)
+		str += static_cast<char>(*sz);
+	return str;
+}
+
+int _wfopen_s(FILE** ppFile, const wchar_t* szPath, const wchar_t* szMode) {
+	*ppFile = fopen(NarrowPath(szPath).c_str(), NarrowPath(szMode).c_str());
+	return *ppFile ? 0 : errno;
+}
+
+uintptr_t _beginthreadex(void*, unsigned int, unsigned int (*pfnStart)(void*), void* pArg, unsigned int, unsigned int* pidThread) {
+	KernelObject* pObject = new KernelObject();
+	pObject->bThread = true;
+	pObject->bManualReset = true;
+	pObject->bSignaled = false;
+	pObject->bClosed = false;
+	if (pidThread)
+		*pidThread = 0;
+	lock_guard<mutex> lock(s_mtxObjects);
+	s_setObjects.insert(pObject);
+	pObject->thread = std::thread(RunThread, pObject, pfnStart, pArg);
+	return reinterpret_cast<uintptr_t>(pObject);
+}
+
+//
+// user32
+//
+
+HWND GetDesktopWindow() {
+	return reinterpret_cast<HWND>(HWND_DESKTOP_VALUE);
+}
+
+HWND GetAncestor(HWND hwnd, UINT gaFlags) {
+	FakeDesktop::Window* pWindow = g_fakeDesktop.findWindow(hwnd);
+	if (pWindow == NULL)
+		return NULL;
+	if (gaFlags == GA_PARENT)
+		return pWindow->hwndParent ? pWindow->hwndParent : GetDesktopWindow();
+	while (pWindow->hwndParent) {
+		hwnd = pWindow->hwndParent;
+		pWindow = g_fakeDesktop.findWindow(hwnd);
+	}
+	return hwnd;
+}
+
+int GetClassNameA(HWND hwnd, char* szClassName, int cchMaxCount) {
+	FakeDesktop::Window* pWindow = g_fakeDesktop.findWindow(hwnd);
+	if (pWindow == NULL || cchMaxCount <= 0) {
+		SetLastError(ERROR_INVALID_WINDOW_HANDLE);
+		return 0;
+	}
+	int cchCopied = static_cast<int>(pWindow->strClassName.size());
+	if (cchCopied >= cchMaxCount)
+		cchCopied = cchMaxCount - 1;
+	memcpy(szClassName, pWindow->strClassName.c_str(), cchCopied);
+	szClassName[cchCopied] = '\0';
+	return cchCopied;
+}
+
+ULONG_PTR GetClassLongPtr(HWND hwnd, int nIndex) {
+	FakeDesktop::Window* pWindow = g_fakeDesktop.findWindow(hwnd);
+	if (pWindow == NULL || nIndex != GCW_ATOM) {
+		SetLastError(pWindow ? ERROR_INVALID_PARAMETER : ERROR_INVALID_WINDOW_HANDLE);
+		return 0;
+	}
+	return pWindow->atom;
+}
+
+DWORD GetWindowThreadProcessId(HWND hwnd, DWORD* pidProcess) {
+	FakeDesktop::Window* pWindow = g_fakeDesktop.findWindow(hwnd);
+	if (pWindow == NULL) {
+		SetLastError(ERROR_INVALID_WINDOW_HANDLE);
+		return 0;
+	}
+	if (pidProcess)
+		*pidProcess = g_fakeDesktop.findThread(pWindow->idThread)->idProcess;
+	return pWindow->idThread;
+}
+
+static bool EnumDescendants(HWND hwnd, WNDENUMPROC pfn, LPARAM lParam) {
+	// copied, the callback may create windows
+	vector<HWND> vChildren = g_fakeDesktop.findWindow(hwnd)->vChildren;
+	for (HWND hwndChild : vChildren) {
+		if (!pfn(hwndChild, lParam) || !EnumDescendants(hwndChild, pfn, lParam))
+			return false;
+	}
+	return true;
+}
+
+BOOL EnumThreadWindows(DWORD idThread, WNDENUMPROC pfn, LPARAM lParam) {
+	vector<HWND> vTopLevel;
+	for (size_t i = 0;; i++) {
+		HWND hwnd = WindowHandleOf(i);
+		FakeDesktop::Window* pWindow = g_fakeDesktop.findWindow(hwnd);
+		if (pWindow == NULL)
+			break;
+		if (pWindow->hwndParent == NULL && pWindow->idThread == idThread)
+			vTopLevel.push_back(hwnd);
+	}
+	for (HWND hwnd : vTopLevel) {
+		if (!pfn(hwnd, lParam))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+BOOL EnumChildWindows(HWND hwndParent, WNDENUMPROC pfn, LPARAM lParam) {
+	if (g_fakeDesktop.findWindow(hwndParent) == NULL)
+		return FALSE;
+	EnumDescendants(hwndParent, pfn, lParam);
+	return TRUE;
+}
+
+static POINT OriginOf(HWND hwnd) {
+	FakeDesktop::Window* pWindow = g_fakeDesktop.findWindow(hwnd);
+	POINT ptOrigin = { 0, 0 };
+	return pWindow ? pWindow->ptOrigin : ptOrigin;
+}
+
+int MapWindowPoints(HWND hwndFrom, HWND hwndTo, POINT* aPoints, UINT nPoints) {
+	POINT ptFrom = OriginOf(hwndFrom), ptTo = OriginOf(hwndTo);
+	LONG dx = ptFrom.x - ptTo.x, dy = ptFrom.y - ptTo.y;
+	for (UINT i = 0; i < nPoints; i++) {
+		aPoints[i].x += dx;
+		aPoints[i].y += dy;
+	}
+	return static_cast<int>((dx & 0xffff) | (dy << 16));
+}
+
+BOOL ClientToScreen(HWND hwnd, POINT* pPoint) {
+	MapWindowPoints(hwnd, NULL, pPoint, 1);
+	return g_fakeDesktop.findWindow(hwnd) != NULL;
+}
+
+BOOL ScreenToClient(HWND hwnd, POINT* pPoint) {
+	MapWindowPoints(NULL, hwnd, pPoint, 1);
+	return g_fakeDesktop.findWindow(hwnd) != NULL;
+}
+
+HWND SetFocus(HWND hwnd) {
+	HWND hwndPrevious = g_fakeDesktop.getFocus();
+	g_fakeDesktop.setFocus(hwnd);
+	return hwndPrevious;
+}
+
+HWND GetFocus() {
+	return g_fakeDesktop.getFocus();
+}
+
+SHORT GetKeyState(int nVirtKey) {
+	BYTE state = g_fakeDesktop.currentThread().abKeyState[nVirtKey & 0xff];
+	return static_cast<SHORT>(((state & 0x80) ? 0x8000 : 0) | (state & 0x01));
+}
+
+SHORT GetAsyncKeyState(int vKey) {
+	return g_fakeDesktop.isKeyDown(vKey) ? static_cast<SHORT>(0x8000) : 0;
+}
+
+BOOL GetKeyboardState(BYTE* abKeyState) {
+	memcpy(abKeyState, g_fakeDesktop.currentThread().abKeyState, 256);
+	return TRUE;
+}
+
+BOOL SetKeyboardState(BYTE* abKeyState) {
+	memcpy(g_fakeDesktop.currentThread().abKeyState, abKeyState, 256);
+	return TRUE;
+}
+
+UINT RegisterWindowMessageW(LPCWSTR szString) {
+	return g_fakeDesktop.registerMessage(szString);
+}
+
+BOOL PostMessage(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam) {
+	FakeDesktop::Window* pWindow = g_fakeDesktop.findWindow(hwnd);
+	if (pWindow == NULL) {
+		SetLastError(ERROR_INVALID_WINDOW_HANDLE);
+		return FALSE;
+	}
+	g_fakeDesktop.deliver(hwnd, pWindow->idThread, message, wParam, lParam, FDK_Posted);
+	return TRUE;
+}
+
+LRESULT SendMessage(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam) {
+	FakeDesktop::Window* pWindow = g_fakeDesktop.findWindow(hwnd);
+	if (pWindow == NULL) {
+		SetLastError(ERROR_INVALID_WINDOW_HANDLE);
+		return 0;
+	}
+	g_fakeDesktop.deliver(hwnd, pWindow->idThread, message, wParam, lParam, FDK_Sent);
+	return 0;
+}
+
+BOOL PostThreadMessage(DWORD idThread, UINT message, WPARAM wParam, LPARAM lParam) {
+	FakeDesktop::Thread* pThread = g_fakeDesktop.findThread(idThread);
+	if (pThread == NULL || !g_fakeDesktop.isProcessAlive(pThread->idProcess)) {
+		SetLastError(ERROR_INVALID_THREAD_ID);
+		return FALSE;
+	}
+	g_fakeDesktop.deliver(NULL, idThread, message, wParam, lParam, FDK_Posted);
+	return TRUE;
+}
+
+UINT MapVirtualKey(UINT, UINT) {
+	return 0;
+}
+
+LRESULT CallNextHookEx(HHOOK, int, WPARAM, LPARAM) {
+	return 0;
+}
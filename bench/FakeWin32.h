@@ -0,0 +1,370 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Just enough of Win32 and ATL for the hook dll's message path to build and run on Linux:
+// GetMsgHook, the forwarders, the window tree, thread storage and the shared mappings compile
+// unmodified against it when stdafx.h sees FGH_FAKE_WIN32. The calls are implemented in
+// FakeWin32.cpp over FakeDesktop, a simulated session with processes, threads with message
+// queues and keyboard state, and a window tree. Everything runs on the calling OS thread;
+// FakeDesktop::setCurrentThread picks which simulated thread the calls act on. The exception are
+// threads started with _beginthreadex: they are real, and may only use events, critical sections
+// and the CRT.
+
+#include <cassert>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cwchar>
+#include <stdint.h>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define ATLTRACE(...) ((void)0)
+#define ATLASSERT(expr) assert(expr)
+#define _ASSERT(expr) assert(expr)
+#define _T(x) x
+
+#define CALLBACK
+#define WINAPI
+#define APIENTRY
+#define __stdcall
+
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef uint32_t DWORD;
+typedef unsigned int UINT;
+typedef int32_t LONG;
+typedef short SHORT;
+typedef uint16_t ATOM;
+typedef uintptr_t WPARAM;
+typedef intptr_t LPARAM;
+typedef intptr_t LRESULT;
+typedef uintptr_t ULONG_PTR;
+typedef void* LPVOID;
+typedef void* HANDLE;
+typedef void* HMODULE;
+typedef void* HHOOK;
+typedef const wchar_t* LPCWSTR;
+typedef struct HWND__* HWND;
+
+#define TRUE 1
+#define FALSE 0
+
+#define HIBYTE(w) (static_cast<BYTE>((static_cast<WORD>(w) >> 8) & 0xff))
+
+struct POINT {
+	LONG x;
+	LONG y;
+};
+
+class CPoint : public POINT {
+public:
+	CPoint(int xInit, int yInit) {
+		x = xInit;
+		y = yInit;
+	}
+};
+
+struct MSG {
+	HWND hwnd;
+	UINT message;
+	WPARAM wParam;
+	LPARAM lParam;
+	DWORD time;
+	POINT pt;
+};
+
+const UINT WM_NULL = 0x0000;
+const UINT WM_KEYFIRST = 0x0100;
+const UINT WM_KEYDOWN = 0x0100;
+const UINT WM_KEYUP = 0x0101;
+const UINT WM_CHAR = 0x0102;
+const UINT WM_SYSKEYDOWN = 0x0104;
+const UINT WM_SYSKEYUP = 0x0105;
+const UINT WM_KEYLAST = 0x0109;
+const UINT WM_MOUSEFIRST = 0x0200;
+const UINT WM_MOUSEMOVE = 0x0200;
+const UINT WM_MOUSEWHEEL = 0x020A;
+const UINT WM_MOUSELAST = 0x020E;
+const UINT WM_USER = 0x0400;
+
+const WPARAM PM_NOREMOVE = 0x0000;
+const WPARAM PM_REMOVE = 0x0001;
+const int HC_ACTION = 0;
+
+const UINT GA_PARENT = 1;
+const UINT GA_ROOT = 2;
+const int GCW_ATOM = -32;
+
+const int VK_SHIFT = 0x10;
+const int VK_CONTROL = 0x11;
+const int VK_MENU = 0x12;
+const int VK_LEFT = 0x25;
+const int VK_LSHIFT = 0xA0;
+const int VK_RSHIFT = 0xA1;
+const int VK_LCONTROL = 0xA2;
+const int VK_RCONTROL = 0xA3;
+const int VK_LMENU = 0xA4;
+const int VK_RMENU = 0xA5;
+
+const UINT MAPVK_VK_TO_VSC = 0;
+
+const DWORD ERROR_FILE_NOT_FOUND = 2;
+const DWORD ERROR_ACCESS_DENIED = 5;
+const DWORD ERROR_INVALID_PARAMETER = 87;
+const DWORD ERROR_INVALID_WINDOW_HANDLE = 1400;
+const DWORD ERROR_INVALID_THREAD_ID = 1444;
+
+#define INVALID_HANDLE_VALUE (reinterpret_cast<HANDLE>(static_cast<intptr_t>(-1)))
+const DWORD PAGE_READWRITE = 0x04;
+const DWORD FILE_MAP_WRITE = 0x0002;
+const DWORD FILE_MAP_READ = 0x0004;
+
+struct SECURITY_ATTRIBUTES {
+	DWORD nLength;
+	LPVOID lpSecurityDescriptor;
+	BOOL bInheritHandle;
+};
+const DWORD SYNCHRONIZE = 0x00100000;
+const DWORD WAIT_OBJECT_0 = 0;
+const DWORD WAIT_TIMEOUT = 258;
+const DWORD INFINITE = 0xffffffff;
+const DWORD GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT = 0x0002;
+const DWORD GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS = 0x0004;
+const DWORD TLS_OUT_OF_INDEXES = 0xffffffff;
+const DWORD MAX_PATH = 260;
+
+const DWORD DLL_PROCESS_DETACH = 0;
+const DWORD DLL_PROCESS_ATTACH = 1;
+const DWORD DLL_THREAD_ATTACH = 2;
+const DWORD DLL_THREAD_DETACH = 3;
+
+struct CRITICAL_SECTION {
+	std::recursive_mutex* pMutex;
+};
+
+typedef BOOL (CALLBACK* WNDENUMPROC)(HWND hwnd, LPARAM lParam);
+typedef LRESULT (CALLBACK* HOOKPROC)(int nCode, WPARAM wParam, LPARAM lParam);
+
+// kernel32
+DWORD GetCurrentThreadId();
+DWORD GetCurrentProcessId();
+DWORD GetLastError();
+void SetLastError(DWORD dwError);
+DWORD TlsAlloc();
+BOOL TlsFree(DWORD dwTlsIndex);
+LPVOID TlsGetValue(DWORD dwTlsIndex);
+BOOL TlsSetValue(DWORD dwTlsIndex, LPVOID pValue);
+BOOL InitializeCriticalSectionAndSpinCount(CRITICAL_SECTION* pcs, DWORD dwSpinCount);
+void DeleteCriticalSection(CRITICAL_SECTION* pcs);
+void EnterCriticalSection(CRITICAL_SECTION* pcs);
+void LeaveCriticalSection(CRITICAL_SECTION* pcs);
+HANDLE CreateFileMappingW(HANDLE hFile, void* pAttributes, DWORD flProtect, DWORD dwMaximumSizeHigh,
+						  DWORD dwMaximumSizeLow, const wchar_t* szName);
+HANDLE OpenFileMappingW(DWORD dwDesiredAccess, BOOL bInheritHandle, const wchar_t* szName);
+LPVOID MapViewOfFile(HANDLE hMapping, DWORD dwDesiredAccess, DWORD dwFileOffsetHigh, DWORD dwFileOffsetLow,
+					 size_t cbToMap);
+BOOL UnmapViewOfFile(const void* pBase);
+BOOL CloseHandle(HANDLE h);
+HANDLE OpenProcess(DWORD dwDesiredAccess, BOOL bInheritHandle, DWORD idProcess);
+/* Waits for an event, a thread or a process */
+DWORD WaitForSingleObject(HANDLE h, DWORD dwMilliseconds);
+HANDLE CreateEvent(void* pAttributes, BOOL bManualReset, BOOL bInitialState, const wchar_t* szName);
+BOOL SetEvent(HANDLE hEvent);
+void Sleep(DWORD dwMilliseconds);
+DWORD GetTickCount();
+/* There is only the one dll, which is never unloaded: any address is in it, and references are not counted */
+BOOL GetModuleHandleEx(DWORD dwFlags, LPCWSTR szModuleName, HMODULE* phModule);
+BOOL FreeLibrary(HMODULE hModule);
+/* Ends the calling thread, which must have been started by _beginthreadex */
+void FreeLibraryAndExitThread(HMODULE hModule, DWORD dwExitCode);
+/* Always /tmp/ */
+DWORD GetTempPathW(DWORD cchBuffer, wchar_t* szBuffer);
+
+// CRT
+int _wfopen_s(FILE** ppFile, const wchar_t* szPath, const wchar_t* szMode);
+/* Starts a real thread, its handle is signaled once it has ended */
+uintptr_t _beginthreadex(void* pSecurity, unsigned int cbStack, unsigned int (*pfnStart)(void*), void* pArg,
+						 unsigned int initFlag, unsigned int* pidThread);
+#define _doserrno errno
+
+template <size_t N>
+int swprintf_s(wchar_t (&szBuffer)[N], const wchar_t* szFormat, ...) {
+	va_list args;
+	va_start(args, szFormat);
+	int n = vswprintf(szBuffer, N, szFormat, args);
+	va_end(args);
+	return n;
+}
+
+// user32
+HWND GetDesktopWindow();
+HWND GetAncestor(HWND hwnd, UINT gaFlags);
+int GetClassNameA(HWND hwnd, char* szClassName, int cchMaxCount);
+ULONG_PTR GetClassLongPtr(HWND hwnd, int nIndex);
+DWORD GetWindowThreadProcessId(HWND hwnd, DWORD* pidProcess);
+BOOL EnumThreadWindows(DWORD idThread, WNDENUMPROC pfn, LPARAM lParam);
+BOOL EnumChildWindows(HWND hwndParent, WNDENUMPROC pfn, LPARAM lParam);
+int MapWindowPoints(HWND hwndFrom, HWND hwndTo, POINT* aPoints, UINT nPoints);
+BOOL ClientToScreen(HWND hwnd, POINT* pPoint);
+BOOL ScreenToClient(HWND hwnd, POINT* pPoint);
+HWND SetFocus(HWND hwnd);
+HWND GetFocus();
+SHORT GetKeyState(int nVirtKey);
+/* The physical keyboard, which follows hardware input as it is generated */
+SHORT GetAsyncKeyState(int vKey);
+BOOL GetKeyboardState(BYTE* abKeyState);
+BOOL SetKeyboardState(BYTE* abKeyState);
+/* Registered messages are numbered from 0xC000 in the order their names were first registered */
+UINT RegisterWindowMessageW(LPCWSTR szString);
+BOOL PostMessage(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
+LRESULT SendMessage(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
+BOOL PostThreadMessage(DWORD idThread, UINT message, WPARAM wParam, LPARAM lParam);
+/* There is no keyboard layout, every key maps to scan code 0 */
+UINT MapVirtualKey(UINT uCode, UINT uMapType);
+LRESULT CallNextHookEx(HHOOK hhook, int nCode, WPARAM wParam, LPARAM lParam);
+
+/* How a message reached its window */
+enum FakeDeliveryKind {
+	FDK_Posted,
+	FDK_Sent,
+};
+
+/* A message that arrived at a window or thread, hwnd is NULL for thread messages */
+struct FakeDelivery {
+	HWND hwnd;
+	DWORD idThread;
+	UINT message;
+	WPARAM wParam;
+	LPARAM lParam;
+	FakeDeliveryKind kind;
+	/* FakeDesktop::timestampNs() on arrival */
+	uint64_t ns;
+};
+
+/*
+ * The simulated session. Windows have no window procedures: a message posted or sent to a window is
+ * recorded as delivered the moment it arrives, and posted ones also land in the owning thread's queue.
+ * Every simulated process shares the hook dll's globals, as there is only one copy of the dll.
+ */
+class FakeDesktop {
+public:
+	FakeDesktop();
+
+	DWORD addProcess();
+	/* Process exit, as seen by OpenProcess; its threads and windows stay for inspection */
+	void exitProcess(DWORD idProcess);
+	DWORD addThread(DWORD idProcess);
+	/* x, y is the client origin in the parent's client coordinates, or on the screen for top level windows */
+	HWND addWindow(HWND hwndParent, const char* szClassName, DWORD idThread, int x, int y);
+
+	/* Simulated thread the Win32 calls act on, the first thread of the first process initially */
+	void setCurrentThread(DWORD idThread);
+	/* Like SetWindowsHookEx(WH_GETMESSAGE, pfnHook, NULL, idThread), NULL removes it */
+	void setGetMessageHook(DWORD idThread, HOOKPROC pfnHook);
+
+	/*
+	 * Hardware input for msg.hwnd, queued for its thread. The physical keyboard changes right away, the
+	 * thread's keyboard state once the thread removes it; posted key messages change neither.
+	 */
+	void queueInput(const MSG& msg);
+	/*
+	 * Removes the current thread's next message and passes it through its hook, like PeekMessage with PM_REMOVE:
+	 * posted messages before hardware input. false if both queues are empty
+	 */
+	bool getMessage(MSG& msg);
+	bool hasMessages(DWORD idThread) const;
+
+	const std::vector<FakeDelivery>& getDeliveries() const { return m_vDeliveries; }
+	void clearDeliveries() { m_vDeliveries.clear(); }
+
+	/* Drops every process, thread, window and mapping. Class atoms and registered messages stay, like the session's atom table. */
+	void reset();
+
+	static uint64_t timestampNs();
+
+	// used by the Win32 calls in FakeWin32.cpp
+	struct Window {
+		HWND hwndParent;
+		std::string strClassName;
+		ATOM atom;
+		DWORD idThread;
+		/* client origin in screen coordinates */
+		POINT ptOrigin;
+		std::vector<HWND> vChildren;
+	};
+	struct Thread {
+		DWORD idThread;
+		DWORD idProcess;
+		/* posted messages */
+		std::deque<MSG> queue;
+		std::deque<MSG> inputQueue;
+		BYTE abKeyState[256];
+		std::vector<LPVOID> vTlsSlots;
+		HOOKPROC pfnHook;
+		DWORD dwLastError;
+	};
+	struct Mapping {
+		std::wstring strName;
+		void* pView;
+		size_t cbView;
+		int nHandles;
+	};
+
+	Window* findWindow(HWND hwnd);
+	Thread* findThread(DWORD idThread);
+	Thread& currentThread() { return *findThread(m_idCurrentThread); }
+	bool isProcessAlive(DWORD idProcess) const;
+	HWND getFocus() const { return m_hwndFocus; }
+	bool isKeyDown(int vk) const { return m_abAsyncKeyState[vk & 0xff] != 0; }
+	UINT registerMessage(const std::wstring& strName);
+	void setFocus(HWND hwnd) { m_hwndFocus = hwnd; }
+	void deliver(HWND hwnd, DWORD idThread, UINT message, WPARAM wParam, LPARAM lParam, FakeDeliveryKind kind);
+
+	DWORD allocTlsIndex() { return m_nTlsIndices++; }
+	Mapping* openMapping(const wchar_t* szName, size_t cbView);
+	/* NULL if no mapping has that name */
+	Mapping* openExistingMapping(const wchar_t* szName);
+	void closeMapping(Mapping* pMapping);
+	Mapping* findMappingView(const void* pView);
+private:
+	std::vector<bool> m_vProcessesAlive;
+	std::vector<Thread> m_vThreads;
+	std::vector<Window> m_vWindows;
+	std::vector<Mapping*> m_vMappings;
+	std::vector<FakeDelivery> m_vDeliveries;
+	std::vector<std::string> m_vAtomNames;
+	std::vector<std::wstring> m_vMessageNames;
+	BYTE m_abAsyncKeyState[256];
+	DWORD m_idCurrentThread;
+	DWORD m_nTlsIndices;
+	HWND m_hwndFocus;
+
+	ATOM addAtom(const std::string& strClassName);
+
+	FakeDesktop(const FakeDesktop&);
+	FakeDesktop& operator=(const FakeDesktop&);
+};
+
+extern FakeDesktop g_fakeDesktop;
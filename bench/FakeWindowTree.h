@@ -0,0 +1,162 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "WindowTree.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+/* In-memory window hierarchy that counts the user32-equivalent calls made against it */
+class FakeWindowTree : public WindowTree {
+private:
+	struct Node {
+		GestureWindow hwndParent;
+		std::string strClassName;
+		uint32_t atom;
+		bool bInProcess;
+		uint32_t idThread;
+		std::vector<GestureWindow> vChildren;
+	};
+	std::vector<Node> m_vNodes;
+
+	void appendDescendants(GestureWindow hwnd, std::vector<GestureWindow>& vWindows) {
+		for (GestureWindow hwndChild : node(hwnd).vChildren) {
+			nCalls++;
+			vWindows.push_back(hwndChild);
+			appendDescendants(hwndChild, vWindows);
+		}
+	}
+
+	const Node& node(GestureWindow hwnd) const { return m_vNodes[hwnd - 1]; }
+
+	/* Stands in for the user atom table, which the whole session shares just like the hook's learned atoms */
+	static uint32_t addAtom(const std::string& strClassName) {
+		static std::map<std::string, uint32_t> s_mapAtoms;
+		uint32_t& atom = s_mapAtoms[strClassName];
+		if (atom == 0)
+			atom = 0xc000 + static_cast<uint32_t>(s_mapAtoms.size());
+		return atom;
+	}
+public:
+	size_t nCalls;
+	/* getClassName calls, the only ones that enter the kernel on Win32 */
+	size_t nClassNameReads;
+
+	FakeWindowTree() : nCalls(0), nClassNameReads(0) {}
+
+	/* Windows in the process that installed the hooks belong to FAKE_PROCESS_HOOKER, all others to FAKE_PROCESS_OTHER */
+	static const uint32_t FAKE_PROCESS_HOOKER = 1;
+	static const uint32_t FAKE_PROCESS_OTHER = 2;
+	static const uint32_t FAKE_MAIN_THREAD = 1;
+
+	GestureWindow addWindow(GestureWindow hwndParent, const char* szClassName, bool bInProcess = false,
+							uint32_t idThread = FAKE_MAIN_THREAD) {
+		Node n = { hwndParent, szClassName, addAtom(szClassName), bInProcess, idThread };
+		m_vNodes.push_back(n);
+		GestureWindow hwnd = static_cast<GestureWindow>(m_vNodes.size());
+		if (hwndParent)
+			m_vNodes[hwndParent - 1].vChildren.push_back(hwnd);
+		return hwnd;
+	}
+	void reparent(GestureWindow hwnd, GestureWindow hwndNewParent) {
+		if (node(hwnd).hwndParent) {
+			std::vector<GestureWindow>& vOldSiblings = m_vNodes[node(hwnd).hwndParent - 1].vChildren;
+			for (size_t i = 0; i < vOldSiblings.size(); i++) {
+				if (vOldSiblings[i] == hwnd) {
+					vOldSiblings.erase(vOldSiblings.begin() + i);
+					break;
+				}
+			}
+		}
+		m_vNodes[hwnd - 1].hwndParent = hwndNewParent;
+		if (hwndNewParent)
+			m_vNodes[hwndNewParent - 1].vChildren.push_back(hwnd);
+	}
+	size_t size() const { return m_vNodes.size(); }
+
+	GestureWindow getParent(GestureWindow hwnd) {
+		nCalls++;
+		return node(hwnd).hwndParent;
+	}
+	GestureWindow getRoot(GestureWindow hwnd) {
+		nCalls++;
+		while (node(hwnd).hwndParent)
+			hwnd = node(hwnd).hwndParent;
+		return hwnd;
+	}
+	int getClassName(GestureWindow hwnd, char* szBuffer, int cchBuffer) {
+		nCalls++;
+		nClassNameReads++;
+		const std::string& strClassName = node(hwnd).strClassName;
+		int nCopied = static_cast<int>(strClassName.size());
+		if (nCopied >= cchBuffer)
+			nCopied = cchBuffer - 1;
+		memcpy(szBuffer, strClassName.c_str(), nCopied);
+		szBuffer[nCopied] = '\0';
+		return nCopied;
+	}
+	uint32_t getClassAtom(GestureWindow hwnd) {
+		nCalls++;
+		return node(hwnd).atom;
+	}
+	bool isInProcess(GestureWindow hwnd) {
+		nCalls++;
+		return node(hwnd).bInProcess;
+	}
+	void getChildWindowsOfThread(uint32_t idThread, std::vector<GestureWindow>& vWindows) {
+		for (size_t i = 0; i < m_vNodes.size(); i++) {
+			if (m_vNodes[i].hwndParent == 0 && m_vNodes[i].idThread == idThread) {
+				nCalls++;
+				appendDescendants(static_cast<GestureWindow>(i + 1), vWindows);
+			}
+		}
+	}
+	uint32_t getWindowThread(GestureWindow hwnd, uint32_t* pidProcess) {
+		nCalls++;
+		if (pidProcess)
+			*pidProcess = node(hwnd).bInProcess ? FAKE_PROCESS_HOOKER : FAKE_PROCESS_OTHER;
+		return node(hwnd).idThread;
+	}
+};
+
+/* A firefox window hosting out-of-process plugins, plus unrelated windows of other applications */
+struct BrowserWindowTree {
+	FakeWindowTree tree;
+	GestureWindow hwndFirefox;
+	std::vector<GestureWindow> vPluginWindows;
+	std::vector<GestureWindow> vForeignWindows;
+
+	BrowserWindowTree(int nPlugins, int nForeign) {
+		hwndFirefox = tree.addWindow(0, "MozillaWindowClass", true);
+		GestureWindow hwndContent = tree.addWindow(hwndFirefox, "MozillaWindowClass", true);
+		for (int i = 0; i < nPlugins; i++) {
+			GestureWindow hwndPluginHost = tree.addWindow(hwndContent, "GeckoPluginWindow");
+			GestureWindow hwndFlash = tree.addWindow(hwndPluginHost, "ShockwaveFlashFullScreen");
+			vPluginWindows.push_back(tree.addWindow(hwndFlash, "Internet Explorer_Server"));
+		}
+		for (int i = 0; i < nForeign; i++) {
+			// deep hierarchies of other applications force the full 10 level walk
+			GestureWindow hwnd = tree.addWindow(0, "Chrome_WidgetWin_1");
+			for (int level = 0; level < 12; level++)
+				hwnd = tree.addWindow(hwnd, "Chrome_RenderWidgetHostHWND");
+			vForeignWindows.push_back(hwnd);
+		}
+	}
+};
@@ -0,0 +1,222 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Offline decoder of FGH_DumpFlightRecorder files: splits every thread's records into gestures
+// and prints one timeline per gesture, so stuck or slow gestures can be diagnosed from a release
+// build.
+//
+//   FlightDecode [-s] dump.bin
+//     -s  only print one summary line per gesture
+
+#include "stdafx.h"
+#include "FlightRecorder.h"
+#include "GestureHandler.h"
+
+#include <string>
+
+static const char* GetMessageName(unsigned int message) {
+	switch (message) {
+	case GMSG_KEYDOWN: return "WM_KEYDOWN";
+	case GMSG_KEYUP: return "WM_KEYUP";
+	case GMSG_SYSKEYDOWN: return "WM_SYSKEYDOWN";
+	case GMSG_SYSKEYUP: return "WM_SYSKEYUP";
+	case GMSG_MOUSEMOVE: return "WM_MOUSEMOVE";
+	case GMSG_LBUTTONDOWN: return "WM_LBUTTONDOWN";
+	case GMSG_LBUTTONUP: return "WM_LBUTTONUP";
+	case GMSG_LBUTTONDBLCLK: return "WM_LBUTTONDBLCLK";
+	case GMSG_RBUTTONDOWN: return "WM_RBUTTONDOWN";
+	case GMSG_RBUTTONUP: return "WM_RBUTTONUP";
+	case GMSG_RBUTTONDBLCLK: return "WM_RBUTTONDBLCLK";
+	case GMSG_MBUTTONDOWN: return "WM_MBUTTONDOWN";
+	case GMSG_MBUTTONUP: return "WM_MBUTTONUP";
+	case GMSG_MOUSEWHEEL: return "WM_MOUSEWHEEL";
+	default: return NULL;
+	}
+}
+
+static const char* GetResultName(uint8_t result) {
+	switch (result) {
+	case MHR_NotHandled: return "NotHandled";
+	case MHR_Initiated: return "Initiated";
+	case MHR_Swallowed: return "Swallowed";
+	case MHR_Discarded: return "Discarded";
+	case MHR_Triggered: return "Triggered";
+	case MHR_Canceled: return "Canceled";
+	case MHR_GestureEnd: return "GestureEnd";
+	default: return "?";
+	}
+}
+
+static bool HasResult(const FlightRecord& record, int nHandlers, MessageHandleResult res) {
+	for (int i = 0; i < nHandlers; i++) {
+		if (record.aResults[i] == res)
+			return true;
+	}
+	return false;
+}
+
+static bool WentThroughHandlers(const FlightRecord& record, int nHandlers) {
+	for (int i = 0; i < nHandlers; i++) {
+		if (record.aResults[i] != FLIGHT_NOT_RUN)
+			return true;
+	}
+	return false;
+}
+
+/* Some handler is still busy with a gesture after this record */
+static bool KeepsGestureAlive(const FlightRecord& record, int nHandlers) {
+	return HasResult(record, nHandlers, MHR_Initiated) || HasResult(record, nHandlers, MHR_Swallowed) ||
+		HasResult(record, nHandlers, MHR_Discarded) || HasResult(record, nHandlers, MHR_Triggered);
+}
+
+struct Gesture {
+	std::vector<size_t> vRecords;
+	/* the ring had already dropped the start of the gesture */
+	bool bStartLost;
+	const char* szOutcome;
+	std::string strTriggeredBy;
+};
+
+static std::vector<Gesture> SplitGestures(const std::vector<FlightRecord>& vRecords, const FlightDump& dump) {
+	int nHandlers = static_cast<int>(dump.vHandlerNames.size());
+	std::vector<Gesture> vGestures;
+	bool bInGesture = false;
+	bool bFirstMouseRecord = true;
+	for (size_t i = 0; i < vRecords.size(); i++) {
+		const FlightRecord& record = vRecords[i];
+		if (!WentThroughHandlers(record, nHandlers))
+			continue;
+		bool bInitiates = HasResult(record, nHandlers, MHR_Initiated);
+		bool bAlive = KeepsGestureAlive(record, nHandlers);
+		bool bEnded = HasResult(record, nHandlers, MHR_GestureEnd);
+		bool bCanceled = HasResult(record, nHandlers, MHR_Canceled) && !bAlive;
+		if (!bInGesture) {
+			bool bContinued = bFirstMouseRecord && !bInitiates && (bAlive || bEnded || bCanceled);
+			bFirstMouseRecord = false;
+			if (!bInitiates && !bContinued)
+				continue;
+			Gesture gesture;
+			gesture.bStartLost = bContinued;
+			gesture.szOutcome = "in progress when dumped";
+			vGestures.push_back(gesture);
+			bInGesture = true;
+		}
+		Gesture& gesture = vGestures.back();
+		gesture.vRecords.push_back(i);
+		for (int iHandler = 0; iHandler < nHandlers; iHandler++) {
+			if (record.aResults[iHandler] == MHR_Triggered)
+				gesture.strTriggeredBy = dump.vHandlerNames[iHandler];
+		}
+		if (bEnded || bCanceled) {
+			gesture.szOutcome = bEnded ? "ended" : "canceled";
+			bInGesture = false;
+		}
+	}
+	return vGestures;
+}
+
+static void PrintRecord(const FlightRecord& record, const FlightDump& dump, uint64_t nsOrigin) {
+	printf("    %+10.3f ms  ", (record.timestampNs - nsOrigin) / 1e6);
+	const char* szMessage = GetMessageName(record.message);
+	if (szMessage)
+		printf("%-18s", szMessage);
+	else
+		printf("0x%04x%12s", record.message, "");
+	GesturePoint pt = GesturePoint::fromLParam(static_cast<int32_t>(record.lParam));
+	printf(" (%5d, %5d) wParam=%08x ", pt.x, pt.y, record.wParam);
+	for (size_t i = 0; i < dump.vHandlerNames.size(); i++) {
+		if (record.aResults[i] != FLIGHT_NOT_RUN)
+			printf(" %s=%s", dump.vHandlerNames[i].c_str(), GetResultName(record.aResults[i]));
+	}
+	static const struct { uint8_t flag; const char* szName; } s_decisions[] = {
+		{ FD_Swallowed, "swallowed" }, { FD_ForwardedTarget, "->firefox" }, { FD_ForwardedOrigin, "->plugin" },
+		{ FD_ForwardedKey, "key->firefox" }, { FD_ForwardedZoom, "zoom->firefox" }, { FD_NoFirefox, "no-firefox" },
+	};
+	for (auto& decision : s_decisions) {
+		if (record.decision & decision.flag)
+			printf(" %s", decision.szName);
+	}
+	printf("  %.1f us\n", record.latencyNs / 1e3);
+}
+
+static void PrintRing(const FlightDumpRing& ring, const FlightDump& dump, bool bSummaryOnly) {
+	printf("thread %u: %zu records\n", ring.idThread, ring.vRecords.size());
+	if (ring.vRecords.empty())
+		return;
+	const uint64_t nsStalled = 1000000000ull;
+	uint64_t nsOrigin = ring.vRecords[0].timestampNs;
+	for (const Gesture& gesture : SplitGestures(ring.vRecords, dump)) {
+		const FlightRecord& first = ring.vRecords[gesture.vRecords.front()];
+		const FlightRecord& last = ring.vRecords[gesture.vRecords.back()];
+		uint32_t nsSlowest = 0;
+		uint64_t nsLongestGap = 0;
+		for (size_t i = 0; i < gesture.vRecords.size(); i++) {
+			const FlightRecord& record = ring.vRecords[gesture.vRecords[i]];
+			if (record.latencyNs > nsSlowest)
+				nsSlowest = record.latencyNs;
+			if (i && record.timestampNs - ring.vRecords[gesture.vRecords[i - 1]].timestampNs > nsLongestGap)
+				nsLongestGap = record.timestampNs - ring.vRecords[gesture.vRecords[i - 1]].timestampNs;
+		}
+		printf("  gesture at %+.3f ms%s: %s%s, %s, %zu messages in %.3f ms, slowest hook call %.1f us%s\n",
+			   (first.timestampNs - nsOrigin) / 1e6, gesture.bStartLost ? " (start not recorded)" : "",
+			   gesture.strTriggeredBy.empty() ? "not triggered" : "triggered by ", gesture.strTriggeredBy.c_str(),
+			   gesture.szOutcome, gesture.vRecords.size(),
+			   (last.timestampNs - first.timestampNs) / 1e6, nsSlowest / 1e3,
+			   nsLongestGap >= nsStalled ? ", STALLED" : "");
+		if (bSummaryOnly)
+			continue;
+		for (size_t i = 0; i < gesture.vRecords.size(); i++) {
+			const FlightRecord& record = ring.vRecords[gesture.vRecords[i]];
+			if (i) {
+				uint64_t nsGap = record.timestampNs - ring.vRecords[gesture.vRecords[i - 1]].timestampNs;
+				if (nsGap >= nsStalled)
+					printf("    ... no messages for %.3f s\n", nsGap / 1e9);
+			}
+			PrintRecord(record, dump, nsOrigin);
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	bool bSummaryOnly = false;
+	const char* szPath = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-s") == 0)
+			bSummaryOnly = true;
+		else
+			szPath = argv[i];
+	}
+	if (!szPath) {
+		fprintf(stderr, "usage: %s [-s] dump.bin\n", argv[0]);
+		return 2;
+	}
+	FILE* pFile = fopen(szPath, "rb");
+	if (!pFile) {
+		fprintf(stderr, "cannot open %s\n", szPath);
+		return 1;
+	}
+	FlightDump dump;
+	bool bRead = ReadFlightDump(pFile, dump);
+	fclose(pFile);
+	if (!bRead) {
+		fprintf(stderr, "%s is not a flight recorder dump, or it is truncated\n", szPath);
+		return 1;
+	}
+	for (const FlightDumpRing& ring : dump.vRings)
+		PrintRing(ring, dump, bSummaryOnly);
+	return 0;
+}
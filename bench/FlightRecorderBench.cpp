@@ -0,0 +1,187 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Cost of leaving the flight recorder on: the mixed gesture replay through a copy of GetMsgHook's
+// slow path with and without recording. Also hammers one ring with a writer and a concurrent
+// snapshotting thread to check that snapshots never contain torn records, and round-trips a dump.
+//
+//   FlightRecorderBench [dump.bin]   also writes the replay's ring to dump.bin for FlightDecode
+
+#include "BenchUtil.h"
+#include "GestureHandler.h"
+#include "FlightRecorder.h"
+
+#include <atomic>
+#include <thread>
+
+/* Same as GetMsgHook's RecordFlight */
+static void RecordFlight(FlightRecorder& recorder, const GestureMessage& msg, uint64_t nsStart, uint64_t nsLatency,
+						 uint8_t decision, const uint8_t* aResults) {
+	FlightRecord& record = recorder.next();
+	record.timestampNs = nsStart;
+	record.hwnd = static_cast<uint32_t>(msg.hwnd);
+	record.wParam = static_cast<uint32_t>(msg.wParam);
+	record.lParam = static_cast<uint32_t>(msg.lParam);
+	record.latencyNs = nsLatency > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(nsLatency);
+	record.message = static_cast<uint16_t>(msg.message);
+	record.decision = decision;
+	record.reserved = 0;
+	memcpy(record.aResults, aResults, sizeof(record.aResults));
+	recorder.commit();
+}
+
+static size_t Replay(GestureHandlers& handlers, FlightRecorder* pRecorder, CountingForwarder& forwarder,
+					 const std::vector<GestureMessage>& vMessages) {
+	size_t nSwallowed = 0;
+	for (const GestureMessage& msg : vMessages) {
+		if (msg.message == GMSG_MOUSEMOVE && handlers.allInactive())
+			continue;
+		uint64_t nsStart = HookTimestampNs();
+		bool bShouldSwallow = handlers.handleMouseMessage(forwarder, BENCH_HWND_FIREFOX, msg);
+		nSwallowed += bShouldSwallow;
+		uint64_t nsLatency = HookTimestampNs() - nsStart;
+		if (pRecorder) {
+			RecordFlight(*pRecorder, msg, nsStart, nsLatency, handlers.m_lastDecision | (bShouldSwallow ? FD_Swallowed : 0),
+						 handlers.m_aLastResults);
+		}
+	}
+	return nSwallowed;
+}
+
+/* Writer and reader on one ring at full speed, returns the number of torn records seen */
+static size_t CheckConcurrentSnapshots(size_t& nSnapshots, size_t& nRecordsChecked) {
+	FlightRecorder recorder(1);
+	std::atomic<bool> bStop(false);
+	std::thread writer([&]() {
+		for (uint64_t seq = 0; !bStop.load(std::memory_order_relaxed); seq++) {
+			FlightRecord& record = recorder.next();
+			record.timestampNs = seq;
+			record.wParam = static_cast<uint32_t>(seq);
+			record.lParam = ~static_cast<uint32_t>(seq);
+			record.latencyNs = static_cast<uint32_t>(seq * 3);
+			recorder.commit();
+		}
+	});
+	size_t nTorn = 0;
+	nSnapshots = nRecordsChecked = 0;
+	BenchTimer timer;
+	while (timer.elapsedNs() < 500e6) {
+		std::vector<FlightRecord> vRecords;
+		recorder.snapshot(vRecords);
+		for (size_t i = 0; i < vRecords.size(); i++) {
+			const FlightRecord& record = vRecords[i];
+			uint32_t seq = static_cast<uint32_t>(record.timestampNs);
+			if (record.wParam != seq || record.lParam != ~seq || record.latencyNs != seq * 3 ||
+				(i && record.timestampNs != vRecords[i - 1].timestampNs + 1))
+				nTorn++;
+		}
+		nSnapshots++;
+		nRecordsChecked += vRecords.size();
+	}
+	bStop = true;
+	writer.join();
+	return nTorn;
+}
+
+static bool CheckRoundTrip(const FlightDump& dump) {
+	FILE* pFile = tmpfile();
+	if (!pFile || !WriteFlightDump(pFile, dump))
+		return false;
+	rewind(pFile);
+	FlightDump readBack;
+	bool bRead = ReadFlightDump(pFile, readBack);
+	fclose(pFile);
+	if (!bRead || readBack.vHandlerNames != dump.vHandlerNames || readBack.vRings.size() != dump.vRings.size())
+		return false;
+	for (size_t i = 0; i < dump.vRings.size(); i++) {
+		const std::vector<FlightRecord>& vExpected = dump.vRings[i].vRecords;
+		const std::vector<FlightRecord>& vActual = readBack.vRings[i].vRecords;
+		if (readBack.vRings[i].idThread != dump.vRings[i].idThread || vActual.size() != vExpected.size() ||
+			(vExpected.size() && memcmp(&vActual[0], &vExpected[0], vExpected.size() * sizeof(FlightRecord)) != 0))
+			return false;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	static const char* const aszAll[] = { "trace", "rocker", "wheel" };
+	const int nRuns = 7;
+
+	MessageStreamBuilder mixed;
+	for (int i = 0; i < 200; i++) {
+		mixed.idleMoves(20);
+		switch (mixed.random().range(0, 4)) {
+		case 0: mixed.traceStroke(30); break;
+		case 1: mixed.rockerClick(3); break;
+		case 2: mixed.wheelGesture(5); break;
+		case 3: mixed.deadZoneJiggle(10); break;
+		default: mixed.click(); break;
+		}
+	}
+	const std::vector<GestureMessage>& vMessages = mixed.messages();
+	size_t nPasses = 2000000 / vMessages.size() + 1;
+	size_t nMessages = nPasses * vMessages.size();
+
+	GestureHandlers plainHandlers, recordedHandlers;
+	plainHandlers.setEnabledGestures(aszAll, 3);
+	recordedHandlers.setEnabledGestures(aszAll, 3);
+	FlightRecorder recorder(1);
+	CountingForwarder plainForwarder, recordedForwarder;
+	size_t nPlainSwallowed = 0, nRecordedSwallowed = 0;
+	double nsPlain = BenchBestOf(nRuns, [&]() {
+		for (size_t i = 0; i < nPasses; i++)
+			nPlainSwallowed += Replay(plainHandlers, NULL, plainForwarder, vMessages);
+	});
+	double nsRecorded = BenchBestOf(nRuns, [&]() {
+		for (size_t i = 0; i < nPasses; i++)
+			nRecordedSwallowed += Replay(recordedHandlers, &recorder, recordedForwarder, vMessages);
+	});
+	if (nPlainSwallowed != nRecordedSwallowed) {
+		printf("recording changed the hook's decisions\n");
+		return 1;
+	}
+	printf("stream: mixed (%zu messages)\n", vMessages.size());
+	printf("%-24s %12s\n", "hook", "ns/msg");
+	printf("%-24s %12.2f\n", "without recorder", nsPlain / nMessages);
+	printf("%-24s %12.2f\n", "with recorder", nsRecorded / nMessages);
+
+	size_t nSnapshots, nRecordsChecked;
+	size_t nTorn = CheckConcurrentSnapshots(nSnapshots, nRecordsChecked);
+	printf("\nconcurrent snapshots: %zu, records checked: %zu, torn: %zu\n", nSnapshots, nRecordsChecked, nTorn);
+	if (nTorn)
+		return 1;
+
+	FlightDump dump;
+	plainHandlers.getHandlerNames(dump.vHandlerNames);
+	FlightDumpRing ring;
+	ring.idThread = 1;
+	recorder.snapshot(ring.vRecords);
+	dump.vRings.push_back(ring);
+	if (!CheckRoundTrip(dump)) {
+		printf("dump did not survive a write and read\n");
+		return 1;
+	}
+	if (argc > 1) {
+		FILE* pFile = fopen(argv[1], "wb");
+		if (!pFile || !WriteFlightDump(pFile, dump)) {
+			printf("cannot write %s\n", argv[1]);
+			return 1;
+		}
+		fclose(pFile);
+	}
+	return 0;
+}
@@ -0,0 +1,222 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Replays synthetic mouse streams through the gesture handlers the way GetMsgHook does,
+// and reports the per-message cost for each combination of enabled handlers.
+// "before" is the virtual-dispatch implementation kept in LegacyGestureHandler.h, "after" is
+// the compile-time pipeline in the hook dll. Both must swallow exactly the same messages and
+// forward the same ones, except that the dll coalesces buffered mouse moves: a run of moves with
+// the same buttons held to the same window reaches it as its last move only.
+
+#include "BenchUtil.h"
+#include "GestureHandler.h"
+#include "LegacyGestureHandler.h"
+
+#include <algorithm>
+#include <string>
+#include <tuple>
+
+struct HandlerMix {
+	const char* szName;
+	const char* aszGestures[3];
+	int nGestures;
+};
+
+static const HandlerMix s_mixes[] = {
+	{ "trace", { "trace" }, 1 },
+	{ "rocker", { "rocker" }, 1 },
+	{ "wheel", { "wheel" }, 1 },
+	{ "all", { "trace", "rocker", "wheel" }, 3 },
+};
+
+struct StreamSpec {
+	const char* szName;
+	std::vector<GestureMessage> vMessages;
+};
+
+static std::vector<StreamSpec> BuildStreams() {
+	std::vector<StreamSpec> vStreams;
+	const int nRepeats = 200;
+
+	MessageStreamBuilder idle;
+	idle.idleMoves(nRepeats * 50);
+	StreamSpec specIdle = { "idle moves", idle.messages() };
+	vStreams.push_back(specIdle);
+
+	MessageStreamBuilder trace;
+	for (int i = 0; i < nRepeats; i++) {
+		trace.idleMoves(10);
+		trace.traceStroke(40);
+	}
+	StreamSpec specTrace = { "trace strokes", trace.messages() };
+	vStreams.push_back(specTrace);
+
+	MessageStreamBuilder rocker;
+	for (int i = 0; i < nRepeats; i++) {
+		rocker.idleMoves(10);
+		rocker.rockerClick(4);
+	}
+	StreamSpec specRocker = { "rocker clicks", rocker.messages() };
+	vStreams.push_back(specRocker);
+
+	MessageStreamBuilder wheel;
+	for (int i = 0; i < nRepeats; i++) {
+		wheel.idleMoves(10);
+		wheel.wheelGesture(8);
+	}
+	StreamSpec specWheel = { "wheel gestures", wheel.messages() };
+	vStreams.push_back(specWheel);
+
+	MessageStreamBuilder mixed;
+	for (int i = 0; i < nRepeats; i++) {
+		mixed.idleMoves(20);
+		switch (mixed.random().range(0, 4)) {
+		case 0: mixed.traceStroke(30); break;
+		case 1: mixed.rockerClick(3); break;
+		case 2: mixed.wheelGesture(5); break;
+		case 3: mixed.deadZoneJiggle(10); break;
+		default: mixed.click(); break;
+		}
+	}
+	StreamSpec specMixed = { "mixed", mixed.messages() };
+	vStreams.push_back(specMixed);
+
+	return vStreams;
+}
+
+/* Same filtering as GetMsgHook followed by ForwardFirefoxMouseMessage */
+template <class Handlers>
+static size_t ReplayStream(Handlers& handlers, CountingForwarder& forwarder,
+						   const std::vector<GestureMessage>& vMessages) {
+	size_t nSwallowed = 0;
+	for (const GestureMessage& msg : vMessages) {
+		if (msg.message == GMSG_MOUSEMOVE && handlers.allInactive())
+			continue;
+		if (handlers.handleMouseMessage(forwarder, BENCH_HWND_FIREFOX, msg))
+			nSwallowed++;
+	}
+	return nSwallowed;
+}
+
+struct ForwardedMessage {
+	GestureWindow hwnd;
+	GestureMessage msg;
+	bool bPosted;
+};
+
+class RecordingForwarder : public CountingForwarder {
+public:
+	std::vector<ForwardedMessage> vForwarded;
+
+	void sendMessage(GestureWindow hwnd, const GestureMessage& msg) {
+		CountingForwarder::sendMessage(hwnd, msg);
+		record(hwnd, msg, false);
+	}
+	void postMessage(GestureWindow hwnd, const GestureMessage& msg) {
+		CountingForwarder::postMessage(hwnd, msg);
+		record(hwnd, msg, true);
+	}
+
+private:
+	void record(GestureWindow hwnd, const GestureMessage& msg, bool bPosted) {
+		// keep only the last of a run of coalescable moves
+		if (msg.message == GMSG_MOUSEMOVE && !vForwarded.empty()) {
+			ForwardedMessage& last = vForwarded.back();
+			if (last.msg.message == GMSG_MOUSEMOVE && last.hwnd == hwnd && last.msg.wParam == msg.wParam) {
+				last.msg = msg;
+				last.bPosted = bPosted;
+				return;
+			}
+		}
+		ForwardedMessage forwarded = { hwnd, msg, bPosted };
+		vForwarded.push_back(forwarded);
+	}
+};
+
+static bool SameForwarded(const ForwardedMessage& a, const ForwardedMessage& b) {
+	return std::tie(a.hwnd, a.msg.message, a.msg.wParam, a.msg.lParam, a.bPosted) ==
+		   std::tie(b.hwnd, b.msg.message, b.msg.wParam, b.msg.lParam, b.bPosted);
+}
+
+/* One untimed pass of each, comparing what reaches firefox */
+static bool SameForwardedOutput(const HandlerMix& mix, const std::vector<GestureMessage>& vMessages) {
+	legacy::GestureHandlers before;
+	GestureHandlers after;
+	before.setEnabledGestures(mix.aszGestures, mix.nGestures);
+	after.setEnabledGestures(mix.aszGestures, mix.nGestures);
+	RecordingForwarder forwardedBefore, forwardedAfter;
+	ReplayStream(before, forwardedBefore, vMessages);
+	ReplayStream(after, forwardedAfter, vMessages);
+	if (forwardedBefore.nHotkeys != forwardedAfter.nHotkeys)
+		return false;
+	const std::vector<ForwardedMessage>& a = forwardedBefore.vForwarded;
+	const std::vector<ForwardedMessage>& b = forwardedAfter.vForwarded;
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), SameForwarded);
+}
+
+struct ReplayResult {
+	double ns;
+	size_t nSwallowed;
+	size_t nForwarded;
+};
+
+template <class Handlers>
+static ReplayResult MeasureReplay(const HandlerMix& mix, const std::vector<GestureMessage>& vMessages,
+								  int nRuns, size_t nPasses) {
+	Handlers handlers;
+	handlers.setEnabledGestures(mix.aszGestures, mix.nGestures);
+	CountingForwarder forwarder;
+	size_t nSwallowed = 0;
+	ReplayResult result;
+	result.ns = BenchBestOf(nRuns, [&]() {
+		for (size_t i = 0; i < nPasses; i++)
+			nSwallowed += ReplayStream(handlers, forwarder, vMessages);
+	});
+	result.nSwallowed = nSwallowed;
+	result.nForwarded = forwarder.nSent + forwarder.nPosted;
+	return result;
+}
+
+int main() {
+	const int nRuns = 7;
+	const size_t nTargetMessages = 2000000;
+	std::vector<StreamSpec> vStreams = BuildStreams();
+
+	for (const StreamSpec& stream : vStreams) {
+		printf("\nstream: %s (%zu messages)\n", stream.szName, stream.vMessages.size());
+		printf("%-12s %14s %14s %10s %14s %12s %12s\n", "handler mix", "before ns/msg", "after ns/msg", "speedup",
+			   "after msgs/sec", "fwd before", "fwd after");
+		size_t nPasses = nTargetMessages / stream.vMessages.size() + 1;
+		size_t nMessages = nPasses * stream.vMessages.size();
+		for (const HandlerMix& mix : s_mixes) {
+			ReplayResult before = MeasureReplay<legacy::GestureHandlers>(mix, stream.vMessages, nRuns, nPasses);
+			ReplayResult after = MeasureReplay<GestureHandlers>(mix, stream.vMessages, nRuns, nPasses);
+			if (before.nSwallowed != after.nSwallowed) {
+				printf("%s: pipeline decisions differ from the virtual-dispatch handlers\n", mix.szName);
+				return 1;
+			}
+			if (!SameForwardedOutput(mix, stream.vMessages)) {
+				printf("%s: pipeline forwards other messages than the virtual-dispatch handlers\n", mix.szName);
+				return 1;
+			}
+			double nsBefore = before.ns / nMessages, nsAfter = after.ns / nMessages;
+			printf("%-12s %14.2f %14.2f %9.2fx %14.0f %12zu %12zu\n", mix.szName, nsBefore, nsAfter, nsBefore / nsAfter,
+				   1e9 / nsAfter, before.nForwarded / (nRuns * nPasses), after.nForwarded / (nRuns * nPasses));
+		}
+	}
+	return 0;
+}
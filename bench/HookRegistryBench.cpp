@@ -0,0 +1,290 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Stress test of the hook bookkeeping with thousands of simulated hooked threads.
+// SimulatedHookManager does what HookManageThread does, against FakeThreadExitWaiter instead of
+// the thread pool. Threads exit, new ones get hooked, and hooks are uninstalled while exit
+// notifications are still queued. After every round each live thread must be hooked exactly
+// once and no exited thread may still be hooked.
+// "before" replays the same churn through the old bookkeeping, which only ever waited on the
+// first MAXIMUM_WAIT_OBJECTS - 1 thread handles and reopened all of them on every install.
+
+#include "BenchUtil.h"
+#include "FakeThreadExitWaiter.h"
+#include "HookRegistry.h"
+
+#include <algorithm>
+
+class SimulatedHookManager : public ThreadExitSink {
+private:
+	FakeThreadExitWaiter& m_waiter;
+	/* posted USERMESSAGE_THREAD_EXITED messages */
+	std::vector<HookSlot> m_vPosted;
+	std::unordered_set<uintptr_t> m_setLiveHooks;
+	uintptr_t m_nextHook;
+
+	void unhookEntry(const HookEntry& entry) {
+		m_waiter.unwatch(entry.wait);
+		if (!m_setLiveHooks.erase(entry.hook))
+			nBadUnhooks++;
+	}
+public:
+	HookRegistry registry;
+	size_t nBadUnhooks;
+	size_t nStaleNotifications;
+
+	explicit SimulatedHookManager(FakeThreadExitWaiter& waiter) :
+		m_waiter(waiter), m_nextHook(1), nBadUnhooks(0), nStaleNotifications(0) {}
+
+	void threadExited(HookSlot slot) { m_vPosted.push_back(slot); }
+
+	void installAllHooks(const std::vector<uint32_t>& vThreads) {
+		for (uint32_t idThread : vThreads) {
+			if (registry.find(idThread) != INVALID_HOOK_SLOT || m_waiter.hasExited(idThread))
+				continue;
+			uintptr_t hook = m_nextHook++;
+			m_setLiveHooks.insert(hook);
+			HookSlot slot = registry.insert(idThread, hook);
+			registry.get(slot)->wait = m_waiter.watch(idThread, slot, *this);
+		}
+	}
+	void uninstallAllHooks() {
+		for (const HookEntry& entry : registry)
+			unhookEntry(entry);
+		registry.clear();
+	}
+	void pumpMessages() {
+		for (HookSlot slot : m_vPosted) {
+			if (HookEntry* pEntry = registry.get(slot)) {
+				unhookEntry(*pEntry);
+				registry.remove(pEntry->slot);
+			} else {
+				nStaleNotifications++;
+			}
+		}
+		m_vPosted.clear();
+	}
+	size_t liveHooks() const { return m_setLiveHooks.size(); }
+};
+
+namespace legacy {
+
+/* HookManageThread's bookkeeping before HookRegistry, thread ids stand in for the thread handles */
+struct HookWaitList {
+	static const size_t MAX_WAIT = 63;
+
+	std::unordered_map<uint32_t, uintptr_t> mapHookByThreadId;
+	std::vector<uint32_t> vThreadsToWait;
+	std::vector<uint32_t> vThreadIdsToWait;
+	uintptr_t nextHook;
+	size_t nThreadOpens;
+
+	HookWaitList() : nextHook(1), nThreadOpens(0) {}
+
+	void installAllHooks(const std::vector<uint32_t>& vThreads, const FakeThreadExitWaiter& world) {
+		for (uint32_t idThread : vThreads) {
+			if (mapHookByThreadId.find(idThread) == mapHookByThreadId.end() && !world.hasExited(idThread))
+				mapHookByThreadId[idThread] = nextHook++;
+		}
+		vThreadsToWait.clear();
+		vThreadIdsToWait.clear();
+		for (auto pair : mapHookByThreadId) {
+			nThreadOpens++;
+			if (!world.hasExited(pair.first)) {
+				vThreadsToWait.push_back(pair.first);
+				vThreadIdsToWait.push_back(pair.first);
+			}
+		}
+	}
+	void uninstallAllHooks() {
+		vThreadsToWait.clear();
+		vThreadIdsToWait.clear();
+		mapHookByThreadId.clear();
+	}
+	/* MsgWaitForMultipleObjects returns the lowest signaled handle among the first MAX_WAIT */
+	void reapExited(const FakeThreadExitWaiter& world) {
+		for (size_t i = 0; i < std::min(vThreadsToWait.size(), MAX_WAIT);) {
+			if (!world.hasExited(vThreadsToWait[i])) {
+				i++;
+				continue;
+			}
+			uint32_t idThread = vThreadIdsToWait[i];
+			vThreadsToWait.erase(vThreadsToWait.begin() + i);
+			vThreadIdsToWait.erase(vThreadIdsToWait.begin() + i);
+			mapHookByThreadId.erase(idThread);
+			i = 0;
+		}
+	}
+	size_t deadHooks(const FakeThreadExitWaiter& world) const {
+		size_t n = 0;
+		for (auto pair : mapHookByThreadId)
+			n += world.hasExited(pair.first) ? 1 : 0;
+		return n;
+	}
+};
+
+}
+
+struct ChurnResult {
+	size_t nDeadHooks;
+	size_t nThreadOpens;
+};
+
+/* Hooks nThreads threads, then every round ends nChurn of them and starts as many new ones */
+static bool RunChurn(size_t nThreads, size_t nChurn, int nRounds, bool bLegacy, ChurnResult& result) {
+	FakeThreadExitWaiter world;
+	SimulatedHookManager manager(world);
+	legacy::HookWaitList legacyList;
+	BenchRandom random(12345);
+	std::vector<uint32_t> vLive;
+	uint32_t idNext = 4;
+	for (size_t i = 0; i < nThreads; i++, idNext += 4)
+		vLive.push_back(idNext);
+
+	if (bLegacy)
+		legacyList.installAllHooks(vLive, world);
+	else
+		manager.installAllHooks(vLive);
+
+	for (int round = 0; round < nRounds; round++) {
+		for (size_t i = 0; i < nChurn; i++) {
+			size_t iVictim = random.next() % vLive.size();
+			world.exitThread(vLive[iVictim]);
+			vLive[iVictim] = vLive.back();
+			vLive.pop_back();
+		}
+		// the extension uninstalls and reinstalls the hooks on focus changes, exits may still be queued
+		if (round % 8 == 3) {
+			if (bLegacy)
+				legacyList.uninstallAllHooks();
+			else
+				manager.uninstallAllHooks();
+		}
+		if (bLegacy)
+			legacyList.reapExited(world);
+		else
+			manager.pumpMessages();
+
+		for (size_t i = 0; i < nChurn; i++, idNext += 4)
+			vLive.push_back(idNext);
+		if (bLegacy)
+			legacyList.installAllHooks(vLive, world);
+		else
+			manager.installAllHooks(vLive);
+
+		if (bLegacy)
+			continue;
+		bool bConsistent = manager.registry.size() == vLive.size() && manager.liveHooks() == vLive.size() &&
+			world.activeWaits() == vLive.size() && manager.nBadUnhooks == 0;
+		for (uint32_t idThread : vLive) {
+			HookEntry* pEntry = manager.registry.get(manager.registry.find(idThread));
+			bConsistent = bConsistent && pEntry && pEntry->idThread == idThread && pEntry->wait != 0;
+		}
+		for (const HookEntry& entry : manager.registry)
+			bConsistent = bConsistent && !world.hasExited(entry.idThread);
+		if (!bConsistent) {
+			printf("round %d: %zu hooks for %zu live threads, %zu waits, %zu bad unhooks\n", round,
+				   manager.registry.size(), vLive.size(), world.activeWaits(), manager.nBadUnhooks);
+			return false;
+		}
+	}
+
+	result.nDeadHooks = bLegacy ? legacyList.deadHooks(world) : 0;
+	result.nThreadOpens = bLegacy ? legacyList.nThreadOpens : world.nWatchCalls;
+	if (!bLegacy && manager.nStaleNotifications == 0) {
+		printf("no stale notifications were exercised\n");
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Cost of reaping one exited thread and hooking a new one, bookkeeping only. The old code also
+ * rebuilt both vectors on every install, which is left out in its favor.
+ */
+static void MeasureBookkeeping(size_t nThreads, double& nsBefore, double& nsAfter) {
+	const int nIterations = 200000;
+	BenchRandom random;
+	std::vector<size_t> vVictims;
+	for (int i = 0; i < nIterations; i++)
+		vVictims.push_back(random.next() % nThreads);
+
+	nsBefore = BenchBestOf(5, [&]() {
+		std::unordered_map<uint32_t, uintptr_t> mapHookByThreadId;
+		std::vector<uintptr_t> vThreadsToWait;
+		std::vector<uint32_t> vThreadIdsToWait;
+		uint32_t idNext = 4;
+		for (size_t i = 0; i < nThreads; i++, idNext += 4) {
+			mapHookByThreadId[idNext] = idNext;
+			vThreadsToWait.push_back(idNext);
+			vThreadIdsToWait.push_back(idNext);
+		}
+		for (size_t nIndex : vVictims) {
+			uint32_t idThread = vThreadIdsToWait[nIndex];
+			uintptr_t hhook = mapHookByThreadId[idThread];
+			vThreadsToWait.erase(vThreadsToWait.begin() + nIndex);
+			vThreadIdsToWait.erase(vThreadIdsToWait.begin() + nIndex);
+			mapHookByThreadId.erase(idThread);
+
+			mapHookByThreadId[idNext] = hhook;
+			vThreadsToWait.push_back(idNext);
+			vThreadIdsToWait.push_back(idNext);
+			idNext += 4;
+		}
+	}) / nIterations;
+
+	nsAfter = BenchBestOf(5, [&]() {
+		HookRegistry registry;
+		std::vector<HookSlot> vSlots;
+		uint32_t idNext = 4;
+		for (size_t i = 0; i < nThreads; i++, idNext += 4)
+			vSlots.push_back(registry.insert(idNext, idNext));
+		for (size_t nIndex : vVictims) {
+			HookEntry* pEntry = registry.get(vSlots[nIndex]);
+			uintptr_t hook = pEntry->hook;
+			registry.remove(pEntry->slot);
+
+			vSlots[nIndex] = registry.insert(idNext, hook);
+			idNext += 4;
+		}
+	}) / nIterations;
+}
+
+int main() {
+	const int nRounds = 200;
+	printf("%d rounds of thread churn, then dead threads left hooked and thread handles opened\n", nRounds);
+	printf("%-8s %-6s %14s %14s %14s %14s\n", "threads", "churn", "dead before", "dead after",
+		   "opens before", "opens after");
+	const size_t aThreads[] = { 32, 256, 1024, 4096 };
+	for (size_t nThreads : aThreads) {
+		size_t nChurn = nThreads / 16 + 1;
+		ChurnResult before, after;
+		if (!RunChurn(nThreads, nChurn, nRounds, true, before) || !RunChurn(nThreads, nChurn, nRounds, false, after))
+			return 1;
+		printf("%-8zu %-6zu %14zu %14zu %14zu %14zu\n", nThreads, nChurn, before.nDeadHooks,
+			   after.nDeadHooks, before.nThreadOpens, after.nThreadOpens);
+	}
+
+	printf("\nreaping one exited thread and hooking a new one\n");
+	printf("%-8s %14s %14s %10s\n", "threads", "ns before", "ns after", "speedup");
+	for (size_t nThreads : aThreads) {
+		double nsBefore, nsAfter;
+		MeasureBookkeeping(nThreads, nsBefore, nsAfter);
+		printf("%-8zu %14.1f %14.1f %9.2fx\n", nThreads, nsBefore, nsAfter, nsBefore / nsAfter);
+	}
+	return 0;
+}
@@ -0,0 +1,521 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Runs the hook dll's own GetMsgHook, ForwardFirefoxMouseMessage, ForwardFirefoxKeyMessage and
+// ForwardZoomMessage, together with its window tree, thread storage, shared config and gesture
+// channel, against the simulated user32 of FakeWin32.h. Each scripted input is queued for a plugin
+// thread and every simulated thread then runs until the desktop is idle again, which measures the
+// latency from input to the message arriving at the firefox window.
+// Every scenario runs with the plugin in the browser process, in a plugin process posting directly,
+// and in a plugin process going through the gesture channel; all three must deliver the same messages.
+// A plugin process also captures one scenario into an input trace, which must read back as the input,
+// and recognized strokes must reach firefox as hotkeys typed with their modifiers held.
+
+#include "BenchUtil.h"
+#include "ExportFunctionsInternal.h"
+#include "InputTrace.h"
+#include "SharedConfig.h"
+#include "Win32GestureChannel.h"
+
+#include <algorithm>
+
+// Set by HookManage.cpp in the dll, which installs the hooks and has no part in the simulation
+bool g_bIsInProcessHook = false;
+DWORD g_idCurrentProcess = 0;
+
+BOOL APIENTRY DllMain(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserved);
+
+enum SimMode {
+	SM_InProcess,
+	SM_PluginDirect,
+	SM_PluginChannel,
+};
+
+static const char* const s_aszModeNames[] = { "in browser", "plugin, direct", "plugin, channel" };
+
+struct SimSession {
+	DWORD idBrowserThread;
+	DWORD idManageThread;
+	DWORD idPluginThread;
+	HWND hwndFirefox;
+	HWND hwndPlugin;
+};
+
+/* Every gesture enabled, flags of SharedConfigFlag */
+static void ApplySharedConfig(uint16_t flags) {
+	SharedConfig config;
+	memset(&config, 0, sizeof(config));
+	config.cbSize = sizeof(config);
+	config.enabledGestures = 1 | 2 | 4;
+	config.flags = flags;
+	SetSharedConfig(&config, sizeof(config));
+}
+
+/* A firefox window with one plugin, loads the dll and enables every gesture through the shared config */
+static SimSession StartSession(SimMode mode) {
+	g_fakeDesktop.reset();
+	SimSession session;
+	DWORD idBrowserProcess = GetCurrentProcessId();
+	session.idBrowserThread = GetCurrentThreadId();
+	session.idManageThread = g_fakeDesktop.addThread(idBrowserProcess);
+	DWORD idPluginProcess = mode == SM_InProcess ? idBrowserProcess : g_fakeDesktop.addProcess();
+	session.idPluginThread = g_fakeDesktop.addThread(idPluginProcess);
+
+	session.hwndFirefox = g_fakeDesktop.addWindow(NULL, "MozillaWindowClass", session.idBrowserThread, 100, 80);
+	HWND hwndContent = g_fakeDesktop.addWindow(session.hwndFirefox, "MozillaWindowClass", session.idBrowserThread, 0, 60);
+	HWND hwndHost = g_fakeDesktop.addWindow(hwndContent, "GeckoPluginWindow", session.idBrowserThread, 40, 120);
+	// the same geometry either way, so that all modes forward the same points
+	session.hwndPlugin = g_fakeDesktop.addWindow(hwndHost, mode == SM_InProcess ? "NativeWindowClass" : "GeckoFPSandboxChildWindow",
+												 session.idPluginThread, 0, 0);
+
+	g_bIsInProcessHook = mode == SM_InProcess;
+	g_idCurrentProcess = idPluginProcess;
+	DllMain(NULL, DLL_PROCESS_ATTACH, NULL);
+	ApplySharedConfig(mode == SM_PluginChannel ? SCF_GestureChannel : 0);
+	g_fakeDesktop.setGetMessageHook(session.idPluginThread, GetMsgHook);
+	// the browser's main thread is always hooked as well
+	g_fakeDesktop.setGetMessageHook(session.idBrowserThread, GetMsgHook);
+
+	if (mode == SM_PluginChannel) {
+		g_fakeDesktop.setCurrentThread(session.idManageThread);
+		AttachGestureChannelConsumer();
+		g_fakeDesktop.setCurrentThread(session.idBrowserThread);
+	}
+	return session;
+}
+
+static void EndSession(const SimSession& session, SimMode mode) {
+	if (mode == SM_PluginChannel) {
+		g_fakeDesktop.setCurrentThread(session.idManageThread);
+		DetachGestureChannelConsumer();
+	}
+	g_fakeDesktop.setCurrentThread(session.idBrowserThread);
+	DllMain(NULL, DLL_PROCESS_DETACH, NULL);
+}
+
+/* A key message the firefox window got, with the modifiers firefox would read with GetKeyState */
+struct SimTypedKey {
+	UINT message;
+	WPARAM wParam;
+	uint8_t modifiers;
+
+	bool operator==(const SimTypedKey& other) const {
+		return message == other.message && wParam == other.wParam && modifiers == other.modifiers;
+	}
+};
+
+/* GestureHotkeyModifier flags of the modifiers held in the current thread's keyboard state */
+static uint8_t HeldModifiers() {
+	return (GetKeyState(VK_MENU) < 0 ? GHM_Alt : 0) | (GetKeyState(VK_CONTROL) < 0 ? GHM_Ctrl : 0) |
+		(GetKeyState(VK_SHIFT) < 0 ? GHM_Shift : 0);
+}
+
+/*
+ * Runs every thread's message loop until all queues are empty, returns the plugin messages the hook swallowed.
+ * The key messages the browser thread removes for the firefox window go to pvTyped.
+ */
+static size_t RunUntilIdle(const SimSession& session, std::vector<SimTypedKey>* pvTyped = NULL) {
+	const DWORD aidThreads[] = { session.idPluginThread, session.idManageThread, session.idBrowserThread };
+	size_t nSwallowed = 0;
+	for (bool bBusy = true; bBusy;) {
+		bBusy = false;
+		for (DWORD idThread : aidThreads) {
+			g_fakeDesktop.setCurrentThread(idThread);
+			MSG msg;
+			while (g_fakeDesktop.getMessage(msg)) {
+				bBusy = true;
+				// what HookManage's message loop does with the channel's wake-up
+				if (idThread == session.idManageThread && msg.message == USERMESSAGE_CHANNEL_WAKEUP)
+					DeliverGestureChannelEvents();
+				else if (idThread == session.idPluginThread && msg.message == WM_NULL)
+					nSwallowed++;
+				else if (pvTyped && msg.hwnd == session.hwndFirefox && WM_KEYFIRST <= msg.message && msg.message <= WM_KEYLAST) {
+					SimTypedKey typed = { msg.message, msg.wParam, HeldModifiers() };
+					pvTyped->push_back(typed);
+				}
+			}
+		}
+	}
+	g_fakeDesktop.setCurrentThread(session.idBrowserThread);
+	return nSwallowed;
+}
+
+/* A delivery without its timestamp, what the modes must agree on */
+struct SimForward {
+	bool bToFirefox;
+	UINT message;
+	WPARAM wParam;
+	LPARAM lParam;
+	FakeDeliveryKind kind;
+
+	bool operator==(const SimForward& other) const {
+		return bToFirefox == other.bToFirefox && message == other.message && wParam == other.wParam &&
+			lParam == other.lParam && kind == other.kind;
+	}
+};
+
+struct SimResult {
+	size_t nSwallowed;
+	std::vector<SimForward> vForwards;
+	/* input to arrival at the firefox window, for each message that arrived there */
+	std::vector<uint64_t> vLatencyNs;
+};
+
+static SimResult RunScenario(SimMode mode, const std::vector<GestureMessage>& vInput) {
+	SimSession session = StartSession(mode);
+	SimResult result;
+	result.nSwallowed = 0;
+	DWORD time = 0;
+	for (const GestureMessage& input : vInput) {
+		MSG msg = { input.hwnd == BENCH_HWND_PLUGIN ? session.hwndPlugin : reinterpret_cast<HWND>(input.hwnd),
+					input.message, input.wParam, input.lParam, time += 8 };
+		g_fakeDesktop.clearDeliveries();
+		uint64_t nsInput = FakeDesktop::timestampNs();
+		g_fakeDesktop.queueInput(msg);
+		result.nSwallowed += RunUntilIdle(session);
+		for (const FakeDelivery& delivery : g_fakeDesktop.getDeliveries()) {
+			// the channel's wake-ups are bookkeeping, not forwarded messages
+			if (delivery.hwnd == NULL)
+				continue;
+			bool bToFirefox = delivery.hwnd == session.hwndFirefox;
+			SimForward forward = { bToFirefox, delivery.message, delivery.wParam, delivery.lParam, delivery.kind };
+			result.vForwards.push_back(forward);
+			if (bToFirefox)
+				result.vLatencyNs.push_back(delivery.ns - nsInput);
+		}
+	}
+	EndSession(session, mode);
+	return result;
+}
+
+/*
+ * Queues input for the plugin and runs until idle, appending the key and mouse messages the plugin
+ * thread removed to vRemoved: the input, then what the hooks posted back to the plugin window
+ */
+static void QueueInput(const SimSession& session, const GestureMessage& input, std::vector<MSG>& vRemoved) {
+	MSG msg = { session.hwndPlugin, input.message, input.wParam, input.lParam, static_cast<DWORD>(vRemoved.size() + 1) * 8 };
+	g_fakeDesktop.clearDeliveries();
+	g_fakeDesktop.queueInput(msg);
+	RunUntilIdle(session);
+	vRemoved.push_back(msg);
+	for (const FakeDelivery& delivery : g_fakeDesktop.getDeliveries()) {
+		bool bInput = (WM_KEYFIRST <= delivery.message && delivery.message <= WM_KEYLAST) ||
+			(WM_MOUSEFIRST <= delivery.message && delivery.message <= WM_MOUSELAST);
+		if (delivery.idThread == session.idPluginThread && delivery.kind != FDK_Sent && bInput) {
+			MSG posted = { delivery.hwnd, delivery.message, delivery.wParam, delivery.lParam, 0 };
+			vRemoved.push_back(posted);
+		}
+	}
+}
+
+static std::vector<GestureMessage> Keys(const int* aKeys, int nKeys);
+
+/*
+ * Captures vInput and some typing in a plugin process, then turns the capture off again, and reads the
+ * trace back: it must hold what the plugin thread removed from the first message the hook thread took
+ * the config on with to the last before it saw the capture end, with the plugin window and its ancestors
+ * described. Typed keys must be masked and characters left out, hotkeys and modifiers kept.
+ * Must be the first capture of the run, its file is the process's first.
+ */
+static bool CheckInputCapture(const std::vector<GestureMessage>& vInput) {
+	SimSession session = StartSession(SM_PluginDirect);
+	DWORD idPluginProcess = 0;
+	GetWindowThreadProcessId(session.hwndPlugin, &idPluginProcess);
+	ApplySharedConfig(SCF_CaptureInput);
+	std::vector<MSG> vRemoved;
+	// Ctrl+T and an Alt tap are kept, the A typed in between is not
+	static const int aKeys[] = { VK_CONTROL, 'T', -'T', -VK_CONTROL, 'A', -'A', VK_MENU, -VK_MENU };
+	std::vector<GestureMessage> vCaptured = vInput;
+	for (GestureMessage msg : Keys(aKeys, sizeof(aKeys) / sizeof(aKeys[0]))) {
+		msg.lParam |= 0x001e0000;
+		vCaptured.push_back(msg);
+		if (msg.wParam == 'A' && msg.message == WM_KEYDOWN) {
+			GestureMessage character = { msg.hwnd, WM_CHAR, 'a', msg.lParam };
+			vCaptured.push_back(character);
+		}
+	}
+	for (const GestureMessage& input : vCaptured)
+		QueueInput(session, input, vRemoved);
+	size_t nCaptureOn = vRemoved.size();
+	ApplySharedConfig(0);
+	// hovering alone does not look at the config, the click does
+	MessageStreamBuilder after;
+	after.idleMoves(5);
+	after.click();
+	after.idleMoves(5);
+	for (const GestureMessage& input : after.messages())
+		QueueInput(session, input, vRemoved);
+	EndSession(session, SM_PluginDirect);
+
+	// what the trace may know of the removed messages
+	std::vector<MSG> vExpected;
+	size_t nExpectedOn = 0;
+	for (size_t i = 0; i < vRemoved.size(); i++) {
+		MSG msg = vRemoved[i];
+		if (msg.message == WM_CHAR)
+			continue;
+		if ((msg.message == WM_KEYDOWN || msg.message == WM_KEYUP) && msg.wParam == 'A') {
+			msg.wParam = 0;
+			msg.lParam &= 0xe000ffff;
+		}
+		vExpected.push_back(msg);
+		if (i < nCaptureOn)
+			nExpectedOn++;
+	}
+	vRemoved.swap(vExpected);
+	nCaptureOn = nExpectedOn;
+
+	char szPath[64];
+	snprintf(szPath, sizeof(szPath), "/tmp/FlashGesturesInput.%u.1.fgit", idPluginProcess);
+	std::vector<uint8_t> vTrace;
+	FILE* pFile = fopen(szPath, "rb");
+	if (pFile) {
+		uint8_t aBuffer[4096];
+		for (size_t cb; (cb = fread(aBuffer, 1, sizeof(aBuffer), pFile)) > 0;)
+			vTrace.insert(vTrace.end(), aBuffer, aBuffer + cb);
+		fclose(pFile);
+		remove(szPath);
+	}
+	InputTraceReader reader(vTrace.empty() ? NULL : &vTrace[0], vTrace.size());
+	InputTraceMessage message;
+	size_t iFirst = 0, nCaptured = 0;
+	while (reader.next(message)) {
+		if (nCaptured == 0) {
+			while (iFirst < vRemoved.size() && (vRemoved[iFirst].time == 0 || vRemoved[iFirst].time != message.time))
+				iFirst++;
+		}
+		const MSG* pRemoved = iFirst + nCaptured < vRemoved.size() ? &vRemoved[iFirst + nCaptured] : NULL;
+		if (pRemoved == NULL || message.msg.hwnd != static_cast<uint32_t>(reinterpret_cast<uintptr_t>(pRemoved->hwnd)) ||
+			message.msg.message != pRemoved->message || message.msg.wParam != pRemoved->wParam || message.time != pRemoved->time ||
+			static_cast<uint32_t>(message.msg.lParam) != static_cast<uint32_t>(pRemoved->lParam) ||
+			message.idThread != session.idPluginThread) {
+			printf("input capture: message %zu differs from what the plugin thread removed\n", nCaptured);
+			return false;
+		}
+		nCaptured++;
+	}
+	const InputTraceWindow* pWindow = reader.findWindow(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(session.hwndPlugin)));
+	if (pWindow == NULL || pWindow->strClassName != "GeckoFPSandboxChildWindow") {
+		printf("input capture: the plugin window is not described\n");
+		return false;
+	}
+	while (pWindow && pWindow->hwndParent)
+		pWindow = reader.findWindow(pWindow->hwndParent);
+	size_t iEnd = iFirst + nCaptured;
+	if (pWindow == NULL || pWindow->strClassName != "MozillaWindowClass" || !reader.isValid() || reader.isCorrupt() ||
+		iFirst > nCaptureOn / 10 || iEnd < nCaptureOn || iEnd == vRemoved.size()) {
+		printf("input capture: captured messages %zu to %zu of %zu, the capture ended after %zu\n", iFirst, iEnd,
+			   vRemoved.size(), nCaptureOn);
+		return false;
+	}
+	printf("input capture: %zu of %zu messages in %zu bytes, %.2f bytes per message\n\n", nCaptured, vRemoved.size(),
+		   vTrace.size(), static_cast<double>(vTrace.size()) / nCaptured);
+	return true;
+}
+
+/* A right button drag of nMoves moves by dx, dy */
+static void AddStroke(std::vector<GestureMessage>& vMessages, int nMoves, int dx, int dy) {
+	GesturePoint pt = { 300, 300 };
+	GestureMessage down = { BENCH_HWND_PLUGIN, GMSG_RBUTTONDOWN, GMK_RBUTTON, pt.toLParam() };
+	vMessages.push_back(down);
+	for (int i = 0; i < nMoves; i++) {
+		pt.x += dx;
+		pt.y += dy;
+		GestureMessage move = { BENCH_HWND_PLUGIN, GMSG_MOUSEMOVE, GMK_RBUTTON, pt.toLParam() };
+		vMessages.push_back(move);
+	}
+	GestureMessage up = { BENCH_HWND_PLUGIN, GMSG_RBUTTONUP, 0, pt.toLParam() };
+	vMessages.push_back(up);
+}
+
+/*
+ * With stroke commands for R and L, strokes to the right and left must have the firefox thread see
+ * Ctrl+Shift+T and Alt+Left with exactly those modifiers held in its keyboard state, and nothing held
+ * afterwards, in every mode. Posting the modifiers' key messages would not change that state.
+ */
+static bool CheckStrokeHotkeys() {
+	static const uint8_t aCommands[] = {
+		STROKE_COMMANDS_VERSION,
+		1, 'R', 'T', GHM_Ctrl | GHM_Shift,
+		1, 'L', VK_LEFT, GHM_Alt,
+	};
+	static const SimTypedKey aExpected[] = {
+		{ WM_KEYDOWN, 'T', GHM_Ctrl | GHM_Shift },
+		{ WM_KEYUP, 'T', 0 },
+		{ WM_SYSKEYDOWN, VK_LEFT, GHM_Alt },
+		{ WM_SYSKEYUP, VK_LEFT, 0 },
+	};
+	std::vector<GestureMessage> vInput;
+	AddStroke(vInput, 30, 5, 0);
+	AddStroke(vInput, 30, -5, 0);
+	for (int mode = SM_InProcess; mode <= SM_PluginChannel; mode++) {
+		SimSession session = StartSession(static_cast<SimMode>(mode));
+		SetStrokeCommands(aCommands, sizeof(aCommands));
+		std::vector<SimTypedKey> vTyped;
+		DWORD time = 0;
+		for (const GestureMessage& input : vInput) {
+			MSG msg = { session.hwndPlugin, input.message, input.wParam, input.lParam, time += 8 };
+			g_fakeDesktop.queueInput(msg);
+			RunUntilIdle(session, &vTyped);
+		}
+		uint8_t heldAfter = HeldModifiers();
+		SetStrokeCommands(NULL, 0);
+		EndSession(session, static_cast<SimMode>(mode));
+		if (!(vTyped == std::vector<SimTypedKey>(aExpected, aExpected + sizeof(aExpected) / sizeof(aExpected[0]))) || heldAfter) {
+			printf("stroke hotkeys: %s typed %zu key(s) in firefox, %s\n", s_aszModeNames[mode], vTyped.size(),
+				   heldAfter ? "modifiers stay held" : "not the hotkeys with their modifiers");
+			return false;
+		}
+	}
+	printf("stroke hotkeys: typed with their modifiers held in every mode\n\n");
+	return true;
+}
+
+static std::vector<GestureMessage> Keys(const int* aKeys, int nKeys) {
+	// positive codes go down, negative ones up; Alt is a system key
+	std::vector<GestureMessage> vMessages;
+	for (int i = 0; i < nKeys; i++) {
+		int keyCode = aKeys[i] < 0 ? -aKeys[i] : aKeys[i];
+		bool bUp = aKeys[i] < 0;
+		bool bSystem = keyCode == VK_MENU;
+		GestureMessage msg = { BENCH_HWND_PLUGIN, bSystem ? (bUp ? WM_SYSKEYUP : WM_SYSKEYDOWN) : (bUp ? WM_KEYUP : WM_KEYDOWN),
+							   static_cast<uintptr_t>(keyCode), static_cast<intptr_t>(bUp ? 0xc0000001u : 1u) };
+		vMessages.push_back(msg);
+	}
+	return vMessages;
+}
+
+struct StreamSpec {
+	const char* szName;
+	std::vector<GestureMessage> vMessages;
+	/* false if nothing should reach the firefox window */
+	bool bForwards;
+};
+
+static std::vector<StreamSpec> BuildStreams() {
+	std::vector<StreamSpec> vStreams;
+	const int nRepeats = 100;
+
+	MessageStreamBuilder hover;
+	hover.idleMoves(nRepeats * 20);
+	StreamSpec specHover = { "hover", hover.messages(), false };
+	vStreams.push_back(specHover);
+
+	MessageStreamBuilder trace;
+	for (int i = 0; i < nRepeats; i++) {
+		trace.idleMoves(5);
+		trace.traceStroke(30);
+	}
+	StreamSpec specTrace = { "trace strokes", trace.messages(), true };
+	vStreams.push_back(specTrace);
+
+	MessageStreamBuilder rocker;
+	for (int i = 0; i < nRepeats; i++) {
+		rocker.idleMoves(5);
+		rocker.rockerClick(4);
+	}
+	StreamSpec specRocker = { "rocker clicks", rocker.messages(), true };
+	vStreams.push_back(specRocker);
+
+	MessageStreamBuilder wheel;
+	for (int i = 0; i < nRepeats; i++) {
+		wheel.idleMoves(5);
+		wheel.wheelGesture(6);
+	}
+	StreamSpec specWheel = { "wheel gestures", wheel.messages(), true };
+	vStreams.push_back(specWheel);
+
+	MessageStreamBuilder mixed;
+	for (int i = 0; i < nRepeats; i++) {
+		mixed.idleMoves(10);
+		switch (mixed.random().range(0, 4)) {
+		case 0: mixed.traceStroke(30); break;
+		case 1: mixed.rockerClick(3); break;
+		case 2: mixed.wheelGesture(5); break;
+		case 3: mixed.deadZoneJiggle(10); break;
+		default: mixed.click(); break;
+		}
+	}
+	StreamSpec specMixed = { "mixed", mixed.messages(), true };
+	vStreams.push_back(specMixed);
+
+	// Ctrl+T, F5, an Alt tap and plain typing
+	static const int aHotkeys[] = { VK_CONTROL, 'T', -'T', -VK_CONTROL, 0x74, -0x74, VK_MENU, -VK_MENU, 'A', -'A' };
+	StreamSpec specHotkeys = { "hotkeys", std::vector<GestureMessage>(), true };
+	for (int i = 0; i < nRepeats; i++) {
+		std::vector<GestureMessage> vKeys = Keys(aHotkeys, sizeof(aHotkeys) / sizeof(aHotkeys[0]));
+		specHotkeys.vMessages.insert(specHotkeys.vMessages.end(), vKeys.begin(), vKeys.end());
+	}
+	vStreams.push_back(specHotkeys);
+
+	// Ctrl+wheel
+	static const int aCtrlDown[] = { VK_CONTROL }, aCtrlUp[] = { -VK_CONTROL };
+	StreamSpec specZoom = { "ctrl+wheel zoom", std::vector<GestureMessage>(), true };
+	for (int i = 0; i < nRepeats; i++) {
+		std::vector<GestureMessage> vDown = Keys(aCtrlDown, 1), vUp = Keys(aCtrlUp, 1);
+		specZoom.vMessages.insert(specZoom.vMessages.end(), vDown.begin(), vDown.end());
+		for (int notch = 0; notch < 4; notch++) {
+			GestureMessage wheelMsg = { BENCH_HWND_PLUGIN, GMSG_MOUSEWHEEL, GMK_CONTROL | (static_cast<uintptr_t>(120) << 16),
+										GesturePoint::fromLParam(0).toLParam() };
+			specZoom.vMessages.push_back(wheelMsg);
+		}
+		specZoom.vMessages.insert(specZoom.vMessages.end(), vUp.begin(), vUp.end());
+	}
+	vStreams.push_back(specZoom);
+
+	return vStreams;
+}
+
+static uint64_t Percentile(std::vector<uint64_t>& vSorted, int percent) {
+	return vSorted.empty() ? 0 : vSorted[(vSorted.size() - 1) * percent / 100];
+}
+
+int main() {
+	std::vector<StreamSpec> vStreams = BuildStreams();
+	for (const StreamSpec& stream : vStreams) {
+		if (strcmp(stream.szName, "mixed") == 0 && !CheckInputCapture(stream.vMessages))
+			return 1;
+	}
+	if (!CheckStrokeHotkeys())
+		return 1;
+
+	printf("%-16s %-16s %8s %10s %10s %10s %10s %10s\n", "scenario", "plugin", "inputs", "swallowed", "to firefox",
+		   "other", "p50 ns", "p99 ns");
+	for (const StreamSpec& stream : vStreams) {
+		SimResult aResults[3];
+		for (int mode = SM_InProcess; mode <= SM_PluginChannel; mode++) {
+			SimResult& result = aResults[mode];
+			result = RunScenario(static_cast<SimMode>(mode), stream.vMessages);
+			if (result.nSwallowed != aResults[SM_InProcess].nSwallowed || !(result.vForwards == aResults[SM_InProcess].vForwards)) {
+				printf("%s: %s delivers other messages than %s\n", stream.szName, s_aszModeNames[mode],
+					   s_aszModeNames[SM_InProcess]);
+				return 1;
+			}
+			std::sort(result.vLatencyNs.begin(), result.vLatencyNs.end());
+			size_t nToFirefox = result.vLatencyNs.size();
+			printf("%-16s %-16s %8zu %10zu %10zu %10zu %10llu %10llu\n", stream.szName, s_aszModeNames[mode],
+				   stream.vMessages.size(), result.nSwallowed, nToFirefox, result.vForwards.size() - nToFirefox,
+				   static_cast<unsigned long long>(Percentile(result.vLatencyNs, 50)),
+				   static_cast<unsigned long long>(Percentile(result.vLatencyNs, 99)));
+		}
+		if (aResults[SM_InProcess].vLatencyNs.empty() == stream.bForwards) {
+			printf("%s: %s forwarded to firefox\n", stream.szName, stream.bForwards ? "nothing" : "something");
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,117 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Hotkey forwarding rules: checks the default HotkeyRules table against the old switch cascade
+// for every virtual-key code and modifier combination, checks loading rule blobs at runtime,
+// and compares the lookup cost of both.
+
+#include "BenchUtil.h"
+#include "HotkeyRules.h"
+#include "LegacyHotkeyFilter.h"
+
+static bool CheckDefaultRules(const HotkeyRules& rules) {
+	size_t nMismatches = 0;
+	for (int keyCode = 0; keyCode < 256; keyCode++) {
+		for (int iModifiers = 0; iModifiers < 8; iModifiers++) {
+			bool bAlt = (iModifiers & 1) != 0, bCtrl = (iModifiers & 2) != 0, bShift = (iModifiers & 4) != 0;
+			bool bExpected = legacy::FilterFirefoxKey(keyCode, bAlt, bCtrl, bShift);
+			if (rules.shouldForward(keyCode, bAlt, bCtrl, bShift) != bExpected) {
+				if (nMismatches++ < 10)
+					printf("key 0x%02x alt=%d ctrl=%d shift=%d: expected %d\n", keyCode, bAlt, bCtrl, bShift, bExpected);
+			}
+		}
+	}
+	return nMismatches == 0;
+}
+
+static bool CheckRuntimeRules() {
+	HotkeyRules rules;
+	// nothing is forwarded but Ctrl+Shift+K
+	const uint8_t abOnlyCtrlShiftK[] = { HOTKEY_RULES_VERSION, 0, 'K', HKM_ShiftCtrl };
+	if (!rules.load(abOnlyCtrlShiftK, sizeof(abOnlyCtrlShiftK)))
+		return false;
+	for (int keyCode = 0; keyCode < 256; keyCode++) {
+		for (int iModifiers = 0; iModifiers < 8; iModifiers++) {
+			bool bExpected = keyCode == 'K' && iModifiers == 6;
+			if (rules.shouldForward(keyCode, (iModifiers & 1) != 0, (iModifiers & 2) != 0, (iModifiers & 4) != 0) != bExpected)
+				return false;
+		}
+	}
+
+	// malformed blobs must leave the rules alone
+	const uint8_t abWrongVersion[] = { HOTKEY_RULES_VERSION + 1, 0xff };
+	const uint8_t abTruncatedPair[] = { HOTKEY_RULES_VERSION, 0xff, 'K' };
+	if (rules.load(abWrongVersion, sizeof(abWrongVersion)) || rules.load(abTruncatedPair, sizeof(abTruncatedPair)) ||
+		rules.load(abWrongVersion, 1) || rules.load(NULL, 0))
+		return false;
+	if (!rules.shouldForward('K', false, true, true) || rules.shouldForward('K', false, true, false))
+		return false;
+
+	rules.loadDefaults();
+	return CheckDefaultRules(rules);
+}
+
+int main() {
+	HotkeyRules rules;
+	if (!CheckDefaultRules(rules)) {
+		printf("default hotkey rules differ from FilterFirefoxKey\n");
+		return 1;
+	}
+	if (!CheckRuntimeRules()) {
+		printf("runtime hotkey rules misbehave\n");
+		return 1;
+	}
+	printf("default rules match FilterFirefoxKey for all 256x8 combinations\n\n");
+
+	// key presses as the hook sees them: mostly letters and navigation keys, some F keys
+	struct KeyPress { int keyCode; bool bAlt, bCtrl, bShift; };
+	std::vector<KeyPress> vPresses;
+	BenchRandom random;
+	for (int i = 0; i < 4096; i++) {
+		KeyPress press;
+		int kind = random.range(0, 3);
+		press.keyCode = kind == 0 ? random.range('A', 'Z') : kind == 1 ? random.range(GVK_END, GVK_DOWN) :
+			kind == 2 ? random.range(GVK_F1, GVK_F1 + 11) : random.range(0, 255);
+		press.bAlt = random.range(0, 3) == 0;
+		press.bCtrl = random.range(0, 1) == 0;
+		press.bShift = random.range(0, 3) == 0;
+		vPresses.push_back(press);
+	}
+
+	const int nRuns = 9;
+	const size_t nPasses = 1000;
+	size_t nLegacyForwarded = 0, nTableForwarded = 0;
+	double nsLegacy = BenchBestOf(nRuns, [&]() {
+		for (size_t i = 0; i < nPasses; i++)
+			for (const KeyPress& press : vPresses)
+				nLegacyForwarded += legacy::FilterFirefoxKey(press.keyCode, press.bAlt, press.bCtrl, press.bShift);
+	});
+	double nsTable = BenchBestOf(nRuns, [&]() {
+		for (size_t i = 0; i < nPasses; i++)
+			for (const KeyPress& press : vPresses)
+				nTableForwarded += rules.shouldForward(press.keyCode, press.bAlt, press.bCtrl, press.bShift);
+	});
+	if (nLegacyForwarded != nTableForwarded) {
+		printf("lookups disagree\n");
+		return 1;
+	}
+	size_t nLookups = nPasses * vPresses.size();
+	printf("%-24s %12s\n", "lookup", "ns/key");
+	printf("%-24s %12.3f\n", "switch cascade", nsLegacy / nLookups);
+	printf("%-24s %12.3f\n", "rule table", nsTable / nLookups);
+	return 0;
+}
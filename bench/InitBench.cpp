@@ -0,0 +1,204 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Time the browser's UI thread is blocked by hook initialization, with real threads standing in for
+// the hook manage thread. Thread startup is slowed down to mimic DLL_THREAD_ATTACH of every loaded
+// dll running under the loader lock, which is what made FGH_Initialize stall at browser startup.
+// "before" waits for the thread to start as FGH_Initialize does, "after" returns like FGH_InitializeAsync.
+// The second part races install, uninstall and stop requests against thread startup and checks that
+// HookInitStatus never loses a deferred install or runs a thread that was already stopped.
+
+#include "BenchUtil.h"
+#include "HookInitStatus.h"
+#include "HookStats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+static void SpinFor(uint64_t ns) {
+	uint64_t nsEnd = HookTimestampNs() + ns;
+	while (HookTimestampNs() < nsEnd)
+		std::this_thread::yield();
+}
+
+/* The hook manage thread: starts, installs if asked to, then waits for the stop request */
+class SimulatedManager {
+public:
+	HookInitStatus status;
+	/* what the thread saw when it started */
+	bool bRan;
+	bool bDeferredInstall;
+
+	SimulatedManager() : bRan(false), bDeferredInstall(false), m_bStarted(false), m_bExit(false) {}
+
+	void start(uint64_t nsStartup, uint32_t nHookedThreads, bool bWaitForStart) {
+		m_thread = std::thread([this, nsStartup, nHookedThreads]() {
+			SpinFor(nsStartup);
+			bRan = status.threadStarted(HookTimestampNs(), &bDeferredInstall);
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_bStarted = true;
+			}
+			m_cv.notify_all();
+			if (!bRan)
+				return;
+			if (bDeferredInstall)
+				status.installPassCompleted(nHookedThreads, HookTimestampNs());
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cv.wait(lock, [this]() { return m_bExit; });
+		});
+		if (bWaitForStart) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cv.wait(lock, [this]() { return m_bStarted; });
+		}
+	}
+	/* Same as Uninitialize, returns the phase the stop request found */
+	HookInitPhase stop() {
+		HookInitPhase phase = status.requestStop();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_bExit = true;
+		}
+		m_cv.notify_all();
+		m_thread.join();
+		status.stopped();
+		return phase;
+	}
+private:
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_bStarted;
+	bool m_bExit;
+};
+
+struct BlockedTimes {
+	double usMedianBlocked;
+	double usMedianFirstHook;
+};
+
+static BlockedTimes MeasureBlocked(uint64_t nsStartup, bool bWaitForStart, int nRounds) {
+	std::vector<double> vBlocked, vFirstHook;
+	for (int i = 0; i < nRounds; i++) {
+		SimulatedManager manager;
+		uint64_t nsBegin = HookTimestampNs();
+		manager.status.begin(nsBegin);
+		manager.start(nsStartup, 3, bWaitForStart);
+		// the extension asks for hooks right after initializing
+		if (!manager.status.deferInstall()) {
+			// too late to defer, the real InstallHook posts a message instead
+			manager.status.installPassCompleted(3, HookTimestampNs());
+		}
+		vBlocked.push_back((HookTimestampNs() - nsBegin) / 1e3);
+		HookInitSnapshot snapshot;
+		do {
+			std::this_thread::yield();
+			manager.status.snapshot(snapshot);
+		} while (snapshot.usFirstHook == 0);
+		vFirstHook.push_back(snapshot.usFirstHook);
+		manager.stop();
+	}
+	std::sort(vBlocked.begin(), vBlocked.end());
+	std::sort(vFirstHook.begin(), vFirstHook.end());
+	BlockedTimes times = { vBlocked[vBlocked.size() / 2], vFirstHook[vFirstHook.size() / 2] };
+	return times;
+}
+
+/* Races deferred requests and stops against startup, returns false on the first inconsistency */
+static bool CheckRaces(int nRounds) {
+	BenchRandom random;
+	int nStoppedEarly = 0, nDeferred = 0, nPosted = 0;
+	for (int round = 0; round < nRounds; round++) {
+		SimulatedManager manager;
+		if (!manager.status.begin(HookTimestampNs()) || manager.status.begin(HookTimestampNs())) {
+			printf("round %d: begin must succeed exactly once\n", round);
+			return false;
+		}
+		manager.start(random.range(0, 20000), 1, false);
+
+		// what the thread must find if it starts after the last request that could still be deferred
+		bool bExpectInstall = false;
+		bool bPosted = false;
+		int nRequests = random.range(0, 6);
+		for (int i = 0; i < nRequests; i++) {
+			bool bInstall = random.range(0, 2) != 0;
+			bool bDeferred = bInstall ? manager.status.deferInstall() : manager.status.deferUninstall();
+			if (bDeferred) {
+				if (bPosted) {
+					printf("round %d: request deferred after the thread had started\n", round);
+					return false;
+				}
+				bExpectInstall = bInstall;
+				nDeferred++;
+			} else {
+				bPosted = true;
+				nPosted++;
+			}
+			SpinFor(random.range(0, 5000));
+		}
+
+		HookInitPhase phaseStopped = manager.stop();
+		if (phaseStopped == HIP_Starting) {
+			nStoppedEarly++;
+			if (manager.bRan) {
+				printf("round %d: thread ran although it was stopped while starting\n", round);
+				return false;
+			}
+			continue;
+		}
+		if (!manager.bRan || (phaseStopped != HIP_ThreadStarted && phaseStopped != HIP_HooksInstalled)) {
+			printf("round %d: stop found phase %d, thread ran: %d\n", round, phaseStopped, manager.bRan);
+			return false;
+		}
+		if (manager.bDeferredInstall != bExpectInstall) {
+			printf("round %d: deferred install %s\n", round, bExpectInstall ? "lost" : "not undone");
+			return false;
+		}
+		HookInitSnapshot snapshot;
+		manager.status.snapshot(snapshot);
+		if (snapshot.phase != HIP_NotStarted || snapshot.usThreadStarted == 0 ||
+			(manager.bDeferredInstall && snapshot.usFirstHook == 0)) {
+			printf("round %d: inconsistent snapshot after stop\n", round);
+			return false;
+		}
+	}
+	printf("%d rounds: %d stopped while starting, %d requests deferred, %d posted\n", nRounds, nStoppedEarly, nDeferred,
+		   nPosted);
+	return true;
+}
+
+int main() {
+	const int nRounds = 51;
+	const uint64_t aStartupUs[] = { 0, 500, 2000, 10000 };
+	printf("UI thread blocked by initialization, median of %d runs\n", nRounds);
+	printf("%-12s %14s %14s %16s %16s\n", "startup us", "before us", "after us", "1st hook before", "1st hook after");
+	for (uint64_t usStartup : aStartupUs) {
+		BlockedTimes before = MeasureBlocked(usStartup * 1000, true, nRounds);
+		BlockedTimes after = MeasureBlocked(usStartup * 1000, false, nRounds);
+		printf("%-12llu %14.1f %14.1f %16.1f %16.1f\n", static_cast<unsigned long long>(usStartup), before.usMedianBlocked,
+			   after.usMedianBlocked, before.usMedianFirstHook, after.usMedianFirstHook);
+		if (usStartup >= 2000 && after.usMedianBlocked * 4 > usStartup) {
+			printf("initializing asynchronously still blocks for the thread startup\n");
+			return 1;
+		}
+	}
+	printf("\n");
+	return CheckRaces(2000) ? 0 : 1;
+}
@@ -0,0 +1,298 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Input traces: round trips synthetic and edge case messages through the encoder and reader,
+// reports bytes per message against a MSG and the encode and decode cost, checks that truncated
+// and damaged traces are detected instead of misread, and streams a large trace file through
+// its mapping with the resident memory staying bounded.
+
+#include "InputTraceUtil.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+typedef std::map<uint32_t, std::vector<InputTraceMessage> > ThreadMessages;
+
+/* Both keep the low 32 bits of handles, wParam and lParam */
+static bool SameMessage(const InputTraceMessage& a, const InputTraceMessage& b) {
+	return a.idThread == b.idThread && a.time == b.time && a.msg.message == b.msg.message &&
+		static_cast<uint32_t>(a.msg.hwnd) == static_cast<uint32_t>(b.msg.hwnd) &&
+		static_cast<uint32_t>(a.msg.wParam) == static_cast<uint32_t>(b.msg.wParam) &&
+		static_cast<uint32_t>(a.msg.lParam) == static_cast<uint32_t>(b.msg.lParam);
+}
+
+static void SynthesizeTrace(size_t nMessages, int nThreads, std::vector<uint8_t>& vTrace, ThreadMessages* pExpected) {
+	vTrace.clear();
+	SynthesizeInputTrace(nMessages, nThreads, 7, [&](const std::vector<uint8_t>& vBytes) {
+		vTrace.insert(vTrace.end(), vBytes.begin(), vBytes.end());
+	}, [&](uint32_t idThread, const GestureMessage& msg, uint32_t time) {
+		if (pExpected) {
+			InputTraceMessage message = { idThread, msg, time };
+			(*pExpected)[idThread].push_back(message);
+		}
+	});
+}
+
+/* Decodes the whole trace into vMessages, in file order; false if it does not end cleanly */
+static bool DecodeTrace(const std::vector<uint8_t>& vTrace, size_t cbTrace, std::vector<InputTraceMessage>& vMessages) {
+	InputTraceReader reader(vTrace.empty() ? NULL : &vTrace[0], cbTrace);
+	InputTraceMessage message;
+	while (reader.next(message))
+		vMessages.push_back(message);
+	return reader.isValid() && !reader.isCorrupt() && reader.getOffset() == cbTrace;
+}
+
+static bool CheckRoundTrip() {
+	ThreadMessages expected;
+	std::vector<uint8_t> vTrace;
+	SynthesizeTrace(300000, 4, vTrace, &expected);
+
+	InputTraceReader reader(&vTrace[0], vTrace.size());
+	std::map<uint32_t, size_t> mapNext;
+	InputTraceMessage message;
+	size_t nMessages = 0;
+	while (reader.next(message)) {
+		std::vector<InputTraceMessage>& vExpected = expected[message.idThread];
+		size_t& iNext = mapNext[message.idThread];
+		if (iNext == vExpected.size() || !SameMessage(vExpected[iNext], message)) {
+			printf("message %zu of thread %u differs\n", iNext, message.idThread);
+			return false;
+		}
+		iNext++;
+		nMessages++;
+		// the window and its ancestors are known by the time of its first message
+		const InputTraceWindow* pWindow = reader.findWindow(static_cast<uint32_t>(message.msg.hwnd));
+		if (pWindow == NULL || pWindow->strClassName != "Internet Explorer_Server" || pWindow->flags & ITW_InProcess) {
+			printf("window %08x of thread %u is not described\n", static_cast<uint32_t>(message.msg.hwnd), message.idThread);
+			return false;
+		}
+		while (pWindow && pWindow->hwndParent)
+			pWindow = reader.findWindow(pWindow->hwndParent);
+		if (pWindow == NULL || pWindow->strClassName != "MozillaWindowClass" || !(pWindow->flags & ITW_InProcess)) {
+			printf("ancestors of window %08x are not described\n", static_cast<uint32_t>(message.msg.hwnd));
+			return false;
+		}
+	}
+	if (reader.isCorrupt() || nMessages != 300000 || reader.getOffset() != vTrace.size()) {
+		printf("synthetic trace: %zu of 300000 messages decoded%s\n", nMessages, reader.isCorrupt() ? ", corrupt" : "");
+		return false;
+	}
+	// the root window, its content window and one chain of three per plugin thread
+	if (reader.getWindowCount() != 2 + 3 * 4) {
+		printf("synthetic trace: %zu windows described\n", reader.getWindowCount());
+		return false;
+	}
+
+	// fields far from their predecessors, no window, 32-bit wrap-arounds and points off the screen
+	static const GestureMessage aEdgeMessages[] = {
+		{ 0, GMSG_MOUSEMOVE, 0, 0 },
+		{ 3, GMSG_MOUSEMOVE, 0xffffffff, GesturePoint::fromLParam(0x80008000).toLParam() },
+		{ 1, GMSG_MOUSEMOVE, 0, GesturePoint::fromLParam(0x7fff7fff).toLParam() },
+		{ 1, GMSG_MOUSEWHEEL, 0xff880000, GesturePoint::fromLParam(0xfffe0001).toLParam() },
+		{ 1, GMSG_KEYUP, 0xffff, static_cast<intptr_t>(0xc0000001) },
+		{ 2, 0xffffffff, 0x80000000, static_cast<intptr_t>(-1) },
+		{ 0, GMSG_KEYDOWN, 'A', 0 },
+		{ 3, GMSG_MOUSEMOVE, 0, 0 },
+	};
+	static const uint32_t aEdgeTimes[] = { 0xfffffff0, 0xffffffff, 0, 5, 5, 0x7fffffff, 0x80000000, 0xfffffff0 };
+	FakeWindowTree tree;
+	GestureWindow hwndTop = tree.addWindow(0, "MozillaWindowClass", true);
+	tree.addWindow(tree.addWindow(hwndTop, "GeckoPluginWindow"), "ShockwaveFlashFullScreen");
+	CountingForwarder forwarder;
+	InputTraceEncoder encoder(9);
+	vTrace.clear();
+	AppendInputTraceHeader(vTrace);
+	for (size_t i = 0; i < sizeof(aEdgeTimes) / sizeof(aEdgeTimes[0]); i++) {
+		// one chunk per message at the end, so that the restarts of the delta coding are covered too
+		encoder.append(aEdgeMessages[i], aEdgeTimes[i], tree, forwarder);
+		if (i >= 4)
+			encoder.takeChunk(vTrace);
+	}
+	encoder.takeChunk(vTrace);
+	std::vector<InputTraceMessage> vDecoded;
+	bool bClean = DecodeTrace(vTrace, vTrace.size(), vDecoded);
+	for (size_t i = 0; i < vDecoded.size(); i++) {
+		InputTraceMessage message = { 9, aEdgeMessages[i], aEdgeTimes[i] };
+		if (!SameMessage(vDecoded[i], message)) {
+			printf("edge case message %zu differs\n", i);
+			return false;
+		}
+	}
+	if (!bClean || vDecoded.size() != sizeof(aEdgeTimes) / sizeof(aEdgeTimes[0])) {
+		printf("edge cases: %zu messages decoded\n", vDecoded.size());
+		return false;
+	}
+	return true;
+}
+
+static bool CheckDamagedTraces() {
+	std::vector<uint8_t> vTrace;
+	SynthesizeTrace(60000, 3, vTrace, NULL);
+	std::vector<InputTraceMessage> vAll;
+	DecodeTrace(vTrace, vTrace.size(), vAll);
+
+	// the chunk boundaries are the only places a trace may end
+	std::vector<size_t> vBoundaries;
+	for (size_t offset = sizeof(InputTraceHeader); offset < vTrace.size();) {
+		vBoundaries.push_back(offset);
+		InputTraceChunkHeader header;
+		memcpy(&header, &vTrace[offset], sizeof(header));
+		offset += sizeof(header) + header.cbPayload;
+	}
+
+	// every truncation yields a prefix of the messages and is reported unless it falls on a boundary
+	BenchRandom random(11);
+	for (int i = 0; i < 1000; i++) {
+		size_t cbTruncated = i < 64 ? i : random.range(0, static_cast<int>(vTrace.size()));
+		std::vector<InputTraceMessage> vPrefix;
+		bool bClean = DecodeTrace(vTrace, cbTruncated, vPrefix);
+		bool bBoundary = std::find(vBoundaries.begin(), vBoundaries.end(), cbTruncated) != vBoundaries.end();
+		bool bPrefix = vPrefix.size() <= vAll.size();
+		for (size_t j = 0; bPrefix && j < vPrefix.size(); j++)
+			bPrefix = SameMessage(vPrefix[j], vAll[j]);
+		if (!bPrefix || bClean != bBoundary) {
+			printf("trace truncated to %zu bytes: %zu messages decoded, %s\n", cbTruncated, vPrefix.size(),
+				   bClean ? "not reported" : "reported");
+			return false;
+		}
+	}
+
+	// damage may go unnoticed, but the reader must neither crash nor read past the end
+	for (int i = 0; i < 1000; i++) {
+		std::vector<uint8_t> vDamaged(vTrace);
+		for (int j = random.range(1, 4); j > 0; j--)
+			vDamaged[random.range(sizeof(InputTraceHeader), static_cast<int>(vDamaged.size()) - 1)] ^= 1 << random.range(0, 7);
+		std::vector<InputTraceMessage> vMessages;
+		DecodeTrace(vDamaged, vDamaged.size(), vMessages);
+	}
+
+	std::vector<uint8_t> vForeign(vTrace);
+	vForeign[0] ^= 0xff;
+	InputTraceReader foreign(&vForeign[0], vForeign.size());
+	InputTraceMessage message;
+	if (foreign.isValid() || foreign.next(message)) {
+		printf("a trace with a foreign magic is read\n");
+		return false;
+	}
+	return true;
+}
+
+static void MeasureCoding() {
+	const size_t nMessages = 1000000;
+	std::vector<uint8_t> vTrace;
+	double nsEncode = BenchBestOf(5, [&]() { SynthesizeTrace(nMessages, 4, vTrace, NULL); });
+	// what the synthesis itself costs, without the encoder
+	double nsSynthesize = BenchBestOf(5, [&]() {
+		BrowserWindowTree browser(4, 0);
+		std::vector<SyntheticSession> vSessions;
+		for (int i = 0; i < 4; i++)
+			vSessions.push_back(SyntheticSession(browser.vPluginWindows[i], 7 * 31 + i));
+		GestureMessage msg;
+		uint32_t time, checksum = 0;
+		for (size_t i = 0; i < nMessages; i++) {
+			vSessions[i % 4].next(msg, time);
+			checksum += time;
+		}
+		if (checksum == 1)
+			printf(" ");
+	});
+	size_t nDecoded = 0;
+	double nsDecode = BenchBestOf(5, [&]() {
+		InputTraceReader reader(&vTrace[0], vTrace.size());
+		InputTraceMessage message;
+		while (reader.next(message))
+			nDecoded++;
+	});
+	printf("%-32s %14s %14s %14s\n", "format", "bytes/msg", "encode ns/msg", "decode ns/msg");
+	// a MSG of a 32-bit process, the hooked plugin containers are
+	printf("%-32s %14d %14s %14s\n", "MSG", 28, "-", "-");
+	printf("%-32s %14.2f %14.2f %14.2f\n", "input trace", static_cast<double>(vTrace.size()) / nMessages,
+		   (nsEncode - nsSynthesize) / nMessages, nsDecode / nMessages);
+}
+
+static size_t ResidentKB() {
+	FILE* pFile = fopen("/proc/self/status", "r");
+	if (!pFile)
+		return 0;
+	char szLine[256];
+	size_t kb = 0;
+	while (fgets(szLine, sizeof(szLine), pFile)) {
+		if (strncmp(szLine, "VmRSS:", 6) == 0)
+			kb = strtoul(szLine + 6, NULL, 10);
+	}
+	fclose(pFile);
+	return kb;
+}
+
+/* Writes a trace of about 64 MB and streams it back through its mapping */
+static bool CheckLargeTrace() {
+	char szPath[] = "/tmp/InputTraceBench.XXXXXX";
+	int fd = mkstemp(szPath);
+	if (fd < 0) {
+		printf("cannot create a temporary trace\n");
+		return false;
+	}
+	FILE* pFile = fdopen(fd, "wb");
+	const size_t nMessages = 16 * 1000 * 1000;
+	SynthesizeInputTrace(nMessages, 8, 3, [&](const std::vector<uint8_t>& vBytes) {
+		fwrite(&vBytes[0], vBytes.size(), 1, pFile);
+	}, [](uint32_t, const GestureMessage&, uint32_t) {});
+	fclose(pFile);
+
+	InputTraceFile file;
+	bool bOpened = file.open(szPath);
+	unlink(szPath);
+	if (!bOpened) {
+		printf("cannot map the temporary trace\n");
+		return false;
+	}
+	InputTraceReader reader(file.data(), file.size());
+	InputTraceMessage message;
+	size_t nDecoded = 0;
+	size_t kbBefore = ResidentKB(), kbPeak = kbBefore;
+	BenchTimer timer;
+	while (reader.next(message)) {
+		if (++nDecoded % (64 * 1024) == 0) {
+			file.releaseBefore(reader.getOffset());
+			size_t kb = ResidentKB();
+			if (kb > kbPeak)
+				kbPeak = kb;
+		}
+	}
+	double ns = timer.elapsedNs();
+	printf("\nstreamed %.1f MB, %zu messages in %.0f ms, %.0f MB/s, resident memory grew by %zu KB at most\n",
+		   file.size() / 1048576.0, nDecoded, ns / 1e6, file.size() / 1048576.0 / (ns / 1e9), kbPeak - kbBefore);
+	if (reader.isCorrupt() || nDecoded != nMessages) {
+		printf("large trace: %zu of %zu messages decoded\n", nDecoded, nMessages);
+		return false;
+	}
+	// the mapping is released behind the reader, far less than the file stays resident
+	if ((kbPeak - kbBefore) * 1024 > file.size() / 4) {
+		printf("large trace: released pages stay resident\n");
+		return false;
+	}
+	return true;
+}
+
+int main() {
+	if (!CheckRoundTrip() || !CheckDamagedTraces())
+		return 1;
+	MeasureCoding();
+	return CheckLargeTrace() ? 0 : 1;
+}
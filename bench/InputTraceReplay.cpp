@@ -0,0 +1,169 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Replays a corpus of input traces through the current gestures and a candidate configuration on
+// all cores, and reports the messages they decide differently and what each costs per message.
+//
+//   InputTraceReplay [options] trace.fgit|directory...
+//     -j workers     one per core by default
+//     -b gestures    of the baseline, trace,rocker,wheel by default
+//     -g gestures    of the candidate, the baseline's by default
+//     -s script      gesture script for the candidate's script handler
+//     -d px,ms       move decimation of the candidate
+//     -n diffs       diffs to print, 10 by default
+//
+// Exits with 0 if the candidate decides every message like the baseline, 1 if not, 2 on errors.
+
+#include "InputTraceReplay.h"
+
+#include <cstring>
+#include <dirent.h>
+
+static void SplitGestures(const char* szGestures, std::vector<std::string>& vGestures) {
+	vGestures.clear();
+	for (const char* sz = szGestures; *sz;) {
+		const char* szEnd = strchr(sz, ',');
+		if (!szEnd)
+			szEnd = sz + strlen(sz);
+		if (szEnd != sz)
+			vGestures.push_back(std::string(sz, szEnd));
+		sz = *szEnd ? szEnd + 1 : szEnd;
+	}
+}
+
+static bool ReadText(const char* szPath, std::string& strText) {
+	FILE* pFile = fopen(szPath, "rb");
+	if (!pFile)
+		return false;
+	char aBuffer[4096];
+	for (size_t cb; (cb = fread(aBuffer, 1, sizeof(aBuffer), pFile)) > 0;)
+		strText.append(aBuffer, cb);
+	fclose(pFile);
+	return true;
+}
+
+/* Adds the file at szPath, or every .fgit file in the directory, in name order */
+static bool AddSessions(const char* szPath, std::vector<ReplaySession>& vSessions) {
+	struct stat st;
+	if (stat(szPath, &st) != 0) {
+		fprintf(stderr, "cannot find %s\n", szPath);
+		return false;
+	}
+	if (!S_ISDIR(st.st_mode)) {
+		ReplaySession session = { szPath, NULL, static_cast<size_t>(st.st_size) };
+		vSessions.push_back(session);
+		return true;
+	}
+	DIR* pDir = opendir(szPath);
+	if (!pDir) {
+		fprintf(stderr, "cannot read %s\n", szPath);
+		return false;
+	}
+	std::vector<std::string> vNames;
+	while (struct dirent* pEntry = readdir(pDir)) {
+		size_t cchName = strlen(pEntry->d_name);
+		if (cchName > 5 && strcmp(pEntry->d_name + cchName - 5, ".fgit") == 0)
+			vNames.push_back(pEntry->d_name);
+	}
+	closedir(pDir);
+	std::sort(vNames.begin(), vNames.end());
+	for (const std::string& strName : vNames) {
+		std::string strPath = std::string(szPath) + "/" + strName;
+		if (stat(strPath.c_str(), &st) == 0 && !S_ISDIR(st.st_mode)) {
+			ReplaySession session = { strPath, NULL, static_cast<size_t>(st.st_size) };
+			vSessions.push_back(session);
+		}
+	}
+	return true;
+}
+
+static int Usage(const char* szProgram) {
+	fprintf(stderr, "usage: %s [-j workers] [-b gestures] [-g gestures] [-s script] [-d px,ms] [-n diffs] "
+			"trace.fgit|directory...\n", szProgram);
+	return 2;
+}
+
+int main(int argc, char* argv[]) {
+	int nWorkers = static_cast<int>(std::thread::hardware_concurrency());
+	const char* szBaseline = "trace,rocker,wheel";
+	const char* szCandidate = NULL;
+	const char* szScript = NULL;
+	const char* szDecimation = NULL;
+	size_t nPrintedDiffs = 10;
+	std::vector<ReplaySession> vSessions;
+	for (int i = 1; i < argc; i++) {
+		bool bOption = argv[i][0] == '-' && argv[i][1] && !argv[i][2];
+		if (bOption && i + 1 == argc)
+			return Usage(argv[0]);
+		switch (bOption ? argv[i][1] : 0) {
+		case 'j': nWorkers = atoi(argv[++i]); break;
+		case 'b': szBaseline = argv[++i]; break;
+		case 'g': szCandidate = argv[++i]; break;
+		case 's': szScript = argv[++i]; break;
+		case 'd': szDecimation = argv[++i]; break;
+		case 'n': nPrintedDiffs = strtoul(argv[++i], NULL, 10); break;
+		case 0:
+			if (!AddSessions(argv[i], vSessions))
+				return 2;
+			break;
+		default:
+			return Usage(argv[0]);
+		}
+	}
+	if (vSessions.empty())
+		return Usage(argv[0]);
+
+	ReplayConfig aConfigs[2];
+	SplitGestures(szBaseline, aConfigs[RS_Baseline].vGestures);
+	SplitGestures(szCandidate ? szCandidate : szBaseline, aConfigs[RS_Candidate].vGestures);
+	GestureScriptLibrary library;
+	if (szScript) {
+		std::string strScript, strError;
+		if (!ReadText(szScript, strScript)) {
+			fprintf(stderr, "cannot read %s\n", szScript);
+			return 2;
+		}
+		if (!library.load(strScript.c_str(), strError)) {
+			fprintf(stderr, "%s: %s\n", szScript, strError.c_str());
+			return 2;
+		}
+		aConfigs[RS_Candidate].pScripts = &library;
+	}
+	MoveDecimation decimation;
+	if (szDecimation) {
+		int minDistance = 0;
+		unsigned int msMaxInterval = 0;
+		if (sscanf(szDecimation, "%d,%u", &minDistance, &msMaxInterval) != 2 || !decimation.set(minDistance, msMaxInterval)) {
+			fprintf(stderr, "move decimation %s is not px,ms in range\n", szDecimation);
+			return 2;
+		}
+		aConfigs[RS_Candidate].pDecimation = &decimation;
+	}
+
+	std::vector<std::string> vNames;
+	for (const ReplaySession& session : vSessions)
+		vNames.push_back(session.strName);
+	nWorkers = std::max(1, std::min(nWorkers, static_cast<int>(vSessions.size())));
+	BenchTimer timer;
+	ReplayReport report = ReplayCorpus(vSessions, aConfigs, nWorkers);
+	double ns = timer.elapsedNs();
+	report.print(vNames, nPrintedDiffs);
+	printf("replayed on %d workers in %.1f ms, %.0f messages/s\n", nWorkers, ns / 1e6, report.nMessages / (ns / 1e9));
+	if (report.nCorruptSessions)
+		return 2;
+	return report.nDiffs ? 1 : 0;
+}
@@ -0,0 +1,438 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Replays input traces through two configurations of the gesture engine side by side, the current
+// one and a candidate, to see what a change to the state machines or the forwarding policy would
+// decide differently on recorded sessions and what it costs per message. Sessions are spread over
+// worker threads with work stealing; every hooked thread of a session gets its own GestureHandlers,
+// and each worker adds to its own ReplayReport, which are merged once all sessions are done.
+
+#include "InputTraceUtil.h"
+#include "GestureHandler.h"
+#include "HookThreadState.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+/* How a GestureHandlers is set up for the replay */
+struct ReplayConfig {
+	std::vector<std::string> vGestures;
+	/* NULL: the script handler has nothing to run */
+	const GestureScriptLibrary* pScripts;
+	/* NULL: triggered gestures forward every move */
+	const MoveDecimation* pDecimation;
+
+	ReplayConfig() : pScripts(NULL), pDecimation(NULL) {}
+
+	void apply(GestureHandlers& handlers) const {
+		std::vector<const char*> vNames;
+		for (const std::string& strGesture : vGestures)
+			vNames.push_back(strGesture.c_str());
+		handlers.setEnabledGestures(vNames.empty() ? NULL : &vNames[0], static_cast<int>(vNames.size()));
+		handlers.setScriptLibrary(pScripts);
+		handlers.setMoveDecimation(pDecimation);
+		handlers.setBaseInterest(HookThreadState::BaseInterest());
+	}
+};
+
+/* What one configuration did with a message */
+struct ReplayDecision {
+	bool bSwallowed;
+	uint32_t nForwarded;
+	/* of the forwarded messages, their windows and the way they were delivered */
+	uint64_t forwardHash;
+
+	bool operator==(const ReplayDecision& other) const {
+		return bSwallowed == other.bSwallowed && nForwarded == other.nForwarded && forwardHash == other.forwardHash;
+	}
+	bool operator!=(const ReplayDecision& other) const { return !(*this == other); }
+};
+
+struct ReplayDiff {
+	uint32_t iSession;
+	uint32_t idThread;
+	/* in the order of the session's trace */
+	uint64_t iMessage;
+	GestureMessage msg;
+	ReplayDecision baseline;
+	ReplayDecision candidate;
+
+	bool operator<(const ReplayDiff& other) const {
+		return iSession != other.iSession ? iSession < other.iSession : iMessage < other.iMessage;
+	}
+};
+
+/* Histogram of the time a configuration spent per message it looked at, in 4 ns steps */
+struct ReplayTiming {
+	static const int STEP_NS = 4;
+	static const int BUCKETS = 1024;
+
+	uint64_t nMessages;
+	uint64_t nsTotal;
+	/* the last bucket also counts everything slower */
+	uint64_t aBuckets[BUCKETS];
+
+	ReplayTiming() : nMessages(0), nsTotal(0) { memset(aBuckets, 0, sizeof(aBuckets)); }
+
+	void add(uint64_t ns) {
+		nMessages++;
+		nsTotal += ns;
+		aBuckets[std::min<uint64_t>(ns / STEP_NS, BUCKETS - 1)]++;
+	}
+	void merge(const ReplayTiming& other) {
+		nMessages += other.nMessages;
+		nsTotal += other.nsTotal;
+		for (int i = 0; i < BUCKETS; i++)
+			aBuckets[i] += other.aBuckets[i];
+	}
+	/* Upper bound of the bucket the percent-th percentile falls into */
+	uint64_t percentile(int percent) const {
+		uint64_t nBelow = 0, nWanted = (nMessages * percent + 99) / 100;
+		for (int i = 0; i < BUCKETS; i++) {
+			nBelow += aBuckets[i];
+			if (nBelow >= nWanted && nBelow)
+				return static_cast<uint64_t>(i + 1) * STEP_NS;
+		}
+		return 0;
+	}
+};
+
+enum ReplaySide {
+	RS_Baseline,
+	RS_Candidate,
+};
+
+struct ReplayReport {
+	/* diffs kept per session, and in the merged report */
+	static const size_t MAX_KEPT_DIFFS = 32;
+
+	uint64_t nSessions;
+	/* sessions whose trace ended in a corrupt or truncated record, replayed up to there */
+	uint64_t nCorruptSessions;
+	uint64_t nMessages;
+	/* messages with a different decision, and the ones among them swallowed by only one side */
+	uint64_t nDiffs;
+	uint64_t nSwallowDiffs;
+	uint64_t aLookedAt[2];
+	uint64_t aSwallowed[2];
+	uint64_t aForwarded[2];
+	ReplayTiming aTiming[2];
+	/* the first diffs in session and message order */
+	std::vector<ReplayDiff> vDiffs;
+
+	ReplayReport() : nSessions(0), nCorruptSessions(0), nMessages(0), nDiffs(0), nSwallowDiffs(0) {
+		for (int side = RS_Baseline; side <= RS_Candidate; side++)
+			aLookedAt[side] = aSwallowed[side] = aForwarded[side] = 0;
+	}
+
+	void merge(const ReplayReport& other) {
+		nSessions += other.nSessions;
+		nCorruptSessions += other.nCorruptSessions;
+		nMessages += other.nMessages;
+		nDiffs += other.nDiffs;
+		nSwallowDiffs += other.nSwallowDiffs;
+		for (int side = RS_Baseline; side <= RS_Candidate; side++) {
+			aLookedAt[side] += other.aLookedAt[side];
+			aSwallowed[side] += other.aSwallowed[side];
+			aForwarded[side] += other.aForwarded[side];
+			aTiming[side].merge(other.aTiming[side]);
+		}
+		vDiffs.insert(vDiffs.end(), other.vDiffs.begin(), other.vDiffs.end());
+		std::sort(vDiffs.begin(), vDiffs.end());
+		if (vDiffs.size() > MAX_KEPT_DIFFS)
+			vDiffs.resize(MAX_KEPT_DIFFS);
+	}
+	/* Everything but the timing, which no two runs agree on */
+	bool sameDecisions(const ReplayReport& other) const {
+		if (nSessions != other.nSessions || nCorruptSessions != other.nCorruptSessions || nMessages != other.nMessages ||
+			nDiffs != other.nDiffs || nSwallowDiffs != other.nSwallowDiffs || vDiffs.size() != other.vDiffs.size())
+			return false;
+		for (int side = RS_Baseline; side <= RS_Candidate; side++) {
+			if (aLookedAt[side] != other.aLookedAt[side] || aSwallowed[side] != other.aSwallowed[side] ||
+				aForwarded[side] != other.aForwarded[side])
+				return false;
+		}
+		for (size_t i = 0; i < vDiffs.size(); i++) {
+			if (vDiffs[i] < other.vDiffs[i] || other.vDiffs[i] < vDiffs[i] || vDiffs[i].baseline != other.vDiffs[i].baseline ||
+				vDiffs[i].candidate != other.vDiffs[i].candidate)
+				return false;
+		}
+		return true;
+	}
+
+	/* vSessionNames names the sessions in vDiffs */
+	void print(const std::vector<std::string>& vSessionNames, size_t nPrintedDiffs) const {
+		static const char* const s_aszSides[] = { "baseline", "candidate" };
+		printf("%llu sessions, %llu messages", static_cast<unsigned long long>(nSessions),
+			   static_cast<unsigned long long>(nMessages));
+		if (nCorruptSessions)
+			printf(", %llu sessions corrupt or truncated", static_cast<unsigned long long>(nCorruptSessions));
+		printf("\n%-10s %12s %12s %12s %10s %10s %10s\n", "", "looked at", "swallowed", "forwarded", "mean ns", "p50 ns",
+			   "p99 ns");
+		for (int side = RS_Baseline; side <= RS_Candidate; side++) {
+			const ReplayTiming& timing = aTiming[side];
+			printf("%-10s %12llu %12llu %12llu %10.1f %10llu %10llu\n", s_aszSides[side],
+				   static_cast<unsigned long long>(aLookedAt[side]), static_cast<unsigned long long>(aSwallowed[side]),
+				   static_cast<unsigned long long>(aForwarded[side]),
+				   timing.nMessages ? static_cast<double>(timing.nsTotal) / timing.nMessages : 0.0,
+				   static_cast<unsigned long long>(timing.percentile(50)), static_cast<unsigned long long>(timing.percentile(99)));
+		}
+		printf("%llu messages decided differently, %llu of them swallowed by one side only\n",
+			   static_cast<unsigned long long>(nDiffs), static_cast<unsigned long long>(nSwallowDiffs));
+		for (size_t i = 0; i < vDiffs.size() && i < nPrintedDiffs; i++) {
+			const ReplayDiff& diff = vDiffs[i];
+			GesturePoint pt = diff.msg.getPoint();
+			printf("  %s, thread %u, message %llu: 0x%04x (%d, %d) wParam=%08x: baseline %s %u, candidate %s %u\n",
+				   diff.iSession < vSessionNames.size() ? vSessionNames[diff.iSession].c_str() : "?", diff.idThread,
+				   static_cast<unsigned long long>(diff.iMessage), diff.msg.message, pt.x, pt.y,
+				   static_cast<uint32_t>(diff.msg.wParam), diff.baseline.bSwallowed ? "swallowed, forwarded" : "passed, forwarded",
+				   diff.baseline.nForwarded, diff.candidate.bSwallowed ? "swallowed, forwarded" : "passed, forwarded",
+				   diff.candidate.nForwarded);
+		}
+	}
+};
+
+/*
+ * Delivers nothing: hashes what would have been forwarded, and takes the offsets between windows from
+ * the client origins in the trace's window table
+ */
+class ReplayForwarder : public GestureForwarder {
+private:
+	const InputTraceReader& m_reader;
+
+	void record(uint32_t kind, GestureWindow hwnd, const GestureMessage& msg) {
+		const uint64_t aValues[] = { kind, static_cast<uint32_t>(hwnd), msg.message, static_cast<uint32_t>(msg.wParam),
+									 static_cast<uint32_t>(msg.lParam) };
+		// FNV-1a over the fields, in the order of the calls
+		for (uint64_t value : aValues)
+			decision.forwardHash = (decision.forwardHash ^ value) * 0x100000001b3ull;
+		decision.nForwarded++;
+	}
+public:
+	/* what was forwarded since reset */
+	ReplayDecision decision;
+
+	explicit ReplayForwarder(const InputTraceReader& reader) : m_reader(reader) { reset(); }
+
+	void reset() {
+		decision.bSwallowed = false;
+		decision.nForwarded = 0;
+		decision.forwardHash = 0xcbf29ce484222325ull;
+	}
+	void sendMessage(GestureWindow hwnd, const GestureMessage& msg) { record(0, hwnd, msg); }
+	void postMessage(GestureWindow hwnd, const GestureMessage& msg) { record(1, hwnd, msg); }
+	GesturePoint getClientOffset(GestureWindow hwndFrom, GestureWindow hwndTo) {
+		const InputTraceWindow* pFrom = m_reader.findWindow(static_cast<uint32_t>(hwndFrom));
+		const InputTraceWindow* pTo = m_reader.findWindow(static_cast<uint32_t>(hwndTo));
+		GesturePoint offset = { 0, 0 };
+		if (pFrom && pTo) {
+			offset.x = pFrom->ptOrigin.x - pTo->ptOrigin.x;
+			offset.y = pFrom->ptOrigin.y - pTo->ptOrigin.y;
+		}
+		return offset;
+	}
+	void postHotkey(GestureWindow hwnd, uint8_t virtualKey, uint8_t modifiers) {
+		GestureMessage msg = { hwnd, virtualKey, modifiers, 0 };
+		record(2, hwnd, msg);
+	}
+};
+
+/* A trace to replay: in memory, or with pData NULL the file strName, which the worker maps when it gets to it */
+struct ReplaySession {
+	std::string strName;
+	const void* pData;
+	/* the file's size too, the largest sessions are dealt first */
+	size_t cbData;
+};
+
+/* The two engines of one hooked thread */
+struct ReplayThread {
+	GestureHandlers aHandlers[2];
+};
+
+/* Top level ancestor of hwnd in the window table, what GetMsgHook finds as the firefox window */
+inline GestureWindow FindReplayTarget(const InputTraceReader& reader, uint32_t hwnd) {
+	const InputTraceWindow* pWindow = reader.findWindow(hwnd);
+	// a corrupt table may loop
+	for (int i = 0; pWindow && pWindow->hwndParent && i < 64; i++) {
+		hwnd = pWindow->hwndParent;
+		pWindow = reader.findWindow(hwnd);
+	}
+	return pWindow ? hwnd : 0;
+}
+
+/* Runs the handlers of one side on msg, the way GetMsgHook and ForwardFirefoxMouseMessage do */
+inline void ReplayMessage(GestureHandlers& handlers, ReplayForwarder& forwarder, const InputTraceReader& reader,
+					   const InputTraceMessage& message, ReplayTiming& timing, ReplayDecision& decision, bool& bLookedAt) {
+	forwarder.reset();
+	bLookedAt = (handlers.getInterest() & MessageInterestBit(message.msg.message)) != 0 &&
+		(message.msg.message & ~0xfu) == GMSG_MOUSEMOVE;
+	if (bLookedAt) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		GestureWindow hwndTarget = FindReplayTarget(reader, static_cast<uint32_t>(message.msg.hwnd));
+		forwarder.decision.bSwallowed = handlers.handleMouseMessage(forwarder, hwndTarget, message.msg, message.time);
+		timing.add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count()));
+	}
+	decision = forwarder.decision;
+}
+
+/* Replays one session's trace through both configurations into report */
+inline void ReplayTrace(const ReplayConfig aConfigs[2], uint32_t iSession, const void* pData, size_t cbData,
+						InputTraceFile* pFile, ReplayReport& report) {
+	InputTraceReader reader(pData, cbData);
+	ReplayForwarder forwarder(reader);
+	std::unordered_map<uint32_t, std::unique_ptr<ReplayThread> > mapThreads;
+	InputTraceMessage message;
+	uint64_t iMessage = 0;
+	size_t nKeptDiffs = 0;
+	while (reader.next(message)) {
+		std::unique_ptr<ReplayThread>& pThread = mapThreads[message.idThread];
+		if (!pThread) {
+			pThread.reset(new ReplayThread);
+			aConfigs[RS_Baseline].apply(pThread->aHandlers[RS_Baseline]);
+			aConfigs[RS_Candidate].apply(pThread->aHandlers[RS_Candidate]);
+		}
+		ReplayDecision aDecisions[2];
+		for (int side = RS_Baseline; side <= RS_Candidate; side++) {
+			bool bLookedAt;
+			ReplayMessage(pThread->aHandlers[side], forwarder, reader, message, report.aTiming[side], aDecisions[side], bLookedAt);
+			report.aLookedAt[side] += bLookedAt;
+			report.aSwallowed[side] += aDecisions[side].bSwallowed;
+			report.aForwarded[side] += aDecisions[side].nForwarded;
+		}
+		if (aDecisions[RS_Baseline] != aDecisions[RS_Candidate]) {
+			report.nDiffs++;
+			report.nSwallowDiffs += aDecisions[RS_Baseline].bSwallowed != aDecisions[RS_Candidate].bSwallowed;
+			if (nKeptDiffs++ < ReplayReport::MAX_KEPT_DIFFS) {
+				ReplayDiff diff = { iSession, message.idThread, iMessage, message.msg, aDecisions[RS_Baseline],
+									aDecisions[RS_Candidate] };
+				report.vDiffs.push_back(diff);
+			}
+		}
+		if (++iMessage % (64 * 1024) == 0 && pFile)
+			pFile->releaseBefore(reader.getOffset());
+	}
+	report.nSessions++;
+	report.nCorruptSessions += !reader.isValid() || reader.isCorrupt();
+	report.nMessages += iMessage;
+}
+
+/* A worker's sessions; the owner takes from the front, thieves from the back */
+class ReplayQueue {
+private:
+	std::mutex m_mutex;
+	std::deque<uint32_t> m_dequeSessions;
+	// keeps the queues of different workers off each other's cache lines
+	char m_aPadding[64];
+public:
+	void push(uint32_t iSession) { m_dequeSessions.push_back(iSession); }
+	bool take(uint32_t& iSession) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_dequeSessions.empty())
+			return false;
+		iSession = m_dequeSessions.front();
+		m_dequeSessions.pop_front();
+		return true;
+	}
+	bool steal(uint32_t& iSession) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_dequeSessions.empty())
+			return false;
+		iSession = m_dequeSessions.back();
+		m_dequeSessions.pop_back();
+		return true;
+	}
+};
+
+/* What each worker did, to see how evenly stealing spread the sessions */
+struct ReplayWorkerStats {
+	uint32_t nSessions;
+	uint32_t nStolen;
+};
+
+/*
+ * Replays every session on nWorkers threads and merges their reports. The sessions are dealt round
+ * robin, largest first, so every worker starts on its biggest ones; a worker that runs out steals the
+ * smallest left over from the others, which evens out the end. The merged decisions do not depend on
+ * the number of workers or on who replayed what.
+ */
+inline ReplayReport ReplayCorpus(const std::vector<ReplaySession>& vSessions, const ReplayConfig aConfigs[2], int nWorkers,
+								 std::vector<ReplayWorkerStats>* pWorkerStats = NULL) {
+	std::vector<uint32_t> vOrder;
+	for (uint32_t i = 0; i < vSessions.size(); i++)
+		vOrder.push_back(i);
+	std::stable_sort(vOrder.begin(), vOrder.end(), [&](uint32_t a, uint32_t b) {
+		return vSessions[a].cbData > vSessions[b].cbData;
+	});
+	std::vector<std::unique_ptr<ReplayQueue> > vQueues;
+	std::vector<std::unique_ptr<ReplayReport> > vReports;
+	std::vector<ReplayWorkerStats> vStats(nWorkers);
+	for (int i = 0; i < nWorkers; i++) {
+		vQueues.push_back(std::unique_ptr<ReplayQueue>(new ReplayQueue));
+		vReports.push_back(std::unique_ptr<ReplayReport>(new ReplayReport));
+	}
+	for (size_t i = 0; i < vOrder.size(); i++)
+		vQueues[i % nWorkers]->push(vOrder[i]);
+
+	auto worker = [&](int iWorker) {
+		ReplayWorkerStats stats = { 0, 0 };
+		for (;;) {
+			uint32_t iSession;
+			bool bStolen = false;
+			if (!vQueues[iWorker]->take(iSession)) {
+				for (int i = 1; i < nWorkers && !bStolen; i++)
+					bStolen = vQueues[(iWorker + i) % nWorkers]->steal(iSession);
+				// nothing is queued after the start, empty queues stay empty
+				if (!bStolen)
+					break;
+			}
+			const ReplaySession& session = vSessions[iSession];
+			if (session.pData)
+				ReplayTrace(aConfigs, iSession, session.pData, session.cbData, NULL, *vReports[iWorker]);
+			else {
+				InputTraceFile file;
+				file.open(session.strName.c_str());
+				ReplayTrace(aConfigs, iSession, file.data(), file.size(), &file, *vReports[iWorker]);
+			}
+			stats.nSessions++;
+			stats.nStolen += bStolen;
+		}
+		vStats[iWorker] = stats;
+	};
+	std::vector<std::thread> vThreads;
+	for (int i = 1; i < nWorkers; i++)
+		vThreads.push_back(std::thread(worker, i));
+	worker(0);
+	for (std::thread& thread : vThreads)
+		thread.join();
+
+	ReplayReport report;
+	for (const std::unique_ptr<ReplayReport>& pReport : vReports)
+		report.merge(*pReport);
+	if (pWorkerStats)
+		*pWorkerStats = vStats;
+	return report;
+}
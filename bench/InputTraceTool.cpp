@@ -0,0 +1,188 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Inspects input traces captured with SCF_CaptureInput, and synthesizes traces to try the reader
+// and the replay on. Traces are mapped and streamed, so their size only costs address space.
+//
+//   InputTraceTool stats trace.fgit                  totals, per thread and per message
+//   InputTraceTool dump trace.fgit                   one line per message and described window
+//   InputTraceTool synth trace.fgit n [threads]      writes n synthetic messages of 4 threads, or as many as given
+
+#include "InputTraceUtil.h"
+
+#include <cstring>
+#include <map>
+#include <unordered_set>
+
+// pages behind the reader are released every so many messages
+static const size_t RELEASE_INTERVAL = 64 * 1024;
+
+static const char* GetMessageName(unsigned int message) {
+	switch (message) {
+	case GMSG_KEYDOWN: return "WM_KEYDOWN";
+	case GMSG_KEYUP: return "WM_KEYUP";
+	case GMSG_SYSKEYDOWN: return "WM_SYSKEYDOWN";
+	case GMSG_SYSKEYUP: return "WM_SYSKEYUP";
+	case GMSG_MOUSEMOVE: return "WM_MOUSEMOVE";
+	case GMSG_LBUTTONDOWN: return "WM_LBUTTONDOWN";
+	case GMSG_LBUTTONUP: return "WM_LBUTTONUP";
+	case GMSG_LBUTTONDBLCLK: return "WM_LBUTTONDBLCLK";
+	case GMSG_RBUTTONDOWN: return "WM_RBUTTONDOWN";
+	case GMSG_RBUTTONUP: return "WM_RBUTTONUP";
+	case GMSG_RBUTTONDBLCLK: return "WM_RBUTTONDBLCLK";
+	case GMSG_MBUTTONDOWN: return "WM_MBUTTONDOWN";
+	case GMSG_MBUTTONUP: return "WM_MBUTTONUP";
+	case GMSG_MOUSEWHEEL: return "WM_MOUSEWHEEL";
+	default: return NULL;
+	}
+}
+
+static bool OpenTrace(const char* szPath, InputTraceFile& file) {
+	if (!file.open(szPath)) {
+		fprintf(stderr, "cannot open %s\n", szPath);
+		return false;
+	}
+	return true;
+}
+
+/* Reports how reading ended, false if the trace is broken */
+static bool CheckEnd(const char* szPath, const InputTraceReader& reader) {
+	if (!reader.isValid()) {
+		fprintf(stderr, "%s is not an input trace\n", szPath);
+		return false;
+	}
+	if (reader.isCorrupt()) {
+		fprintf(stderr, "%s is corrupt or truncated at offset %zu\n", szPath, reader.getOffset());
+		return false;
+	}
+	return true;
+}
+
+struct ThreadStats {
+	size_t nMessages;
+	uint32_t firstTime;
+	uint32_t lastTime;
+};
+
+static int Stats(const char* szPath) {
+	InputTraceFile file;
+	if (!OpenTrace(szPath, file))
+		return 1;
+	InputTraceReader reader(file.data(), file.size());
+	std::map<uint32_t, ThreadStats> mapThreads;
+	std::map<unsigned int, size_t> mapMessages;
+	InputTraceMessage message;
+	size_t nMessages = 0;
+	while (reader.next(message)) {
+		ThreadStats& thread = mapThreads[message.idThread];
+		if (thread.nMessages++ == 0)
+			thread.firstTime = message.time;
+		thread.lastTime = message.time;
+		mapMessages[message.msg.message]++;
+		if (++nMessages % RELEASE_INTERVAL == 0)
+			file.releaseBefore(reader.getOffset());
+	}
+	bool bComplete = CheckEnd(szPath, reader);
+	if (!reader.isValid())
+		return 1;
+
+	printf("%zu messages in %zu bytes, %.2f bytes per message, %zu chunks, %zu windows\n", nMessages,
+		   reader.getOffset(), nMessages ? static_cast<double>(reader.getOffset()) / nMessages : 0.0,
+		   reader.getChunkCount(), reader.getWindowCount());
+	for (auto& thread : mapThreads) {
+		printf("  thread %u: %zu messages in %.3f s\n", thread.first, thread.second.nMessages,
+			   (thread.second.lastTime - thread.second.firstTime) / 1e3);
+	}
+	for (auto& count : mapMessages) {
+		const char* szMessage = GetMessageName(count.first);
+		if (szMessage)
+			printf("  %-18s %zu\n", szMessage, count.second);
+		else
+			printf("  0x%04x%12s %zu\n", count.first, "", count.second);
+	}
+	return bComplete ? 0 : 1;
+}
+
+/* Prints hwnd and its ancestors, top level first, unless printed before */
+static void PrintWindows(const InputTraceReader& reader, uint32_t hwnd, std::unordered_set<uint32_t>& setPrinted) {
+	const InputTraceWindow* pWindow = reader.findWindow(hwnd);
+	if (pWindow == NULL || !setPrinted.insert(hwnd).second)
+		return;
+	PrintWindows(reader, pWindow->hwndParent, setPrinted);
+	printf("window %08x parent %08x thread %u at (%d, %d) %s%s\n", pWindow->hwnd, pWindow->hwndParent,
+		   pWindow->idThread, pWindow->ptOrigin.x, pWindow->ptOrigin.y, pWindow->strClassName.c_str(),
+		   pWindow->flags & ITW_InProcess ? " in process" : "");
+}
+
+static int Dump(const char* szPath) {
+	InputTraceFile file;
+	if (!OpenTrace(szPath, file))
+		return 1;
+	InputTraceReader reader(file.data(), file.size());
+	InputTraceMessage message;
+	std::unordered_set<uint32_t> setPrinted;
+	size_t nMessages = 0;
+	while (reader.next(message)) {
+		PrintWindows(reader, static_cast<uint32_t>(message.msg.hwnd), setPrinted);
+		printf("%5u %10u %08x ", message.idThread, message.time, static_cast<uint32_t>(message.msg.hwnd));
+		const char* szMessage = GetMessageName(message.msg.message);
+		if (szMessage)
+			printf("%-18s", szMessage);
+		else
+			printf("0x%04x%12s", message.msg.message, "");
+		if ((message.msg.message & ~0xfu) == GMSG_MOUSEMOVE) {
+			GesturePoint pt = message.msg.getPoint();
+			printf(" (%5d, %5d)", pt.x, pt.y);
+		} else
+			printf(" lParam=%08x   ", static_cast<uint32_t>(message.msg.lParam));
+		printf(" wParam=%08x\n", static_cast<uint32_t>(message.msg.wParam));
+		if (++nMessages % RELEASE_INTERVAL == 0)
+			file.releaseBefore(reader.getOffset());
+	}
+	return CheckEnd(szPath, reader) ? 0 : 1;
+}
+
+static int Synthesize(const char* szPath, size_t nMessages, int nThreads) {
+	FILE* pFile = fopen(szPath, "wb");
+	if (!pFile) {
+		fprintf(stderr, "cannot create %s\n", szPath);
+		return 1;
+	}
+	bool bWritten = true;
+	SynthesizeInputTrace(nMessages, nThreads, 1, [&](const std::vector<uint8_t>& vBytes) {
+		bWritten = bWritten && fwrite(&vBytes[0], vBytes.size(), 1, pFile) == 1;
+	}, [](uint32_t, const GestureMessage&, uint32_t) {});
+	if (fclose(pFile) != 0 || !bWritten) {
+		fprintf(stderr, "failed to write %s\n", szPath);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc == 3 && strcmp(argv[1], "stats") == 0)
+		return Stats(argv[2]);
+	if (argc == 3 && strcmp(argv[1], "dump") == 0)
+		return Dump(argv[2]);
+	if ((argc == 4 || argc == 5) && strcmp(argv[1], "synth") == 0) {
+		int nThreads = argc == 5 ? atoi(argv[4]) : 4;
+		return Synthesize(argv[2], strtoull(argv[3], NULL, 10), nThreads > 0 ? nThreads : 1);
+	}
+	fprintf(stderr, "usage: %s stats|dump trace.fgit\n       %s synth trace.fgit messages [threads]\n", argv[0],
+			argv[0]);
+	return 2;
+}
@@ -0,0 +1,179 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Input traces on the Linux side: mapping trace files for streaming reads, and synthesizing traces
+// to try the reader and the replay on without a captured corpus.
+
+#include "BenchUtil.h"
+#include "FakeWindowTree.h"
+#include "InputTrace.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Read-only mapping of a trace file. Readers walk it front to back, and the pages they are done with
+ * can be given back with releaseBefore, so a trace of several GB streams through a few MB of memory.
+ */
+class InputTraceFile {
+private:
+	void* m_pData;
+	size_t m_cbData;
+	size_t m_cbReleased;
+
+	InputTraceFile(const InputTraceFile&);
+	InputTraceFile& operator=(const InputTraceFile&);
+public:
+	InputTraceFile() : m_pData(NULL), m_cbData(0), m_cbReleased(0) {}
+	~InputTraceFile() { close(); }
+
+	bool open(const char* szPath) {
+		close();
+		int fd = ::open(szPath, O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		bool bMapped = fstat(fd, &st) == 0;
+		if (bMapped && st.st_size > 0) {
+			m_pData = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (m_pData == MAP_FAILED) {
+				m_pData = NULL;
+				bMapped = false;
+			} else {
+				m_cbData = static_cast<size_t>(st.st_size);
+				madvise(m_pData, m_cbData, MADV_SEQUENTIAL);
+			}
+		}
+		::close(fd);
+		return bMapped;
+	}
+	void close() {
+		if (m_pData)
+			munmap(m_pData, m_cbData);
+		m_pData = NULL;
+		m_cbData = m_cbReleased = 0;
+	}
+
+	const void* data() const { return m_pData; }
+	size_t size() const { return m_cbData; }
+
+	/* Drops the pages wholly before offset from memory, touching them again reads them back from the file */
+	void releaseBefore(size_t offset) {
+		size_t cbPage = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		size_t cbRelease = offset / cbPage * cbPage;
+		if (cbRelease <= m_cbReleased)
+			return;
+		madvise(static_cast<char*>(m_pData) + m_cbReleased, cbRelease - m_cbReleased, MADV_DONTNEED);
+		m_cbReleased = cbRelease;
+	}
+};
+
+const uint32_t SYNTHETIC_FIRST_THREAD = 100;
+
+/* One plugin thread of a synthetic trace: hovering, gestures, clicks and typing on its plugin window */
+class SyntheticSession {
+private:
+	GestureWindow m_hwnd;
+	uint32_t m_time;
+	BenchRandom m_random;
+	std::vector<GestureMessage> m_vMessages;
+	size_t m_iNext;
+
+	void refill() {
+		MessageStreamBuilder builder(m_random.next() | 1);
+		for (int i = 0; i < 16; i++) {
+			builder.idleMoves(builder.random().range(5, 40));
+			switch (builder.random().range(0, 5)) {
+			case 0: builder.traceStroke(builder.random().range(10, 40)); break;
+			case 1: builder.rockerClick(3); break;
+			case 2: builder.wheelGesture(builder.random().range(1, 6)); break;
+			case 3: builder.deadZoneJiggle(10); break;
+			default: builder.click(); break;
+			}
+		}
+		m_vMessages.clear();
+		for (size_t i = 0; i < builder.messages().size(); i++) {
+			m_vMessages.push_back(builder.messages()[i]);
+			m_vMessages.back().hwnd = m_hwnd;
+			if (i % 40 == 39) {
+				// a typed key with every fortieth message
+				uintptr_t keyCode = 'A' + m_random.range(0, 25);
+				GestureMessage down = { m_hwnd, GMSG_KEYDOWN, keyCode, 1 };
+				GestureMessage up = { m_hwnd, GMSG_KEYUP, keyCode, static_cast<intptr_t>(0xc0000001) };
+				m_vMessages.push_back(down);
+				m_vMessages.push_back(up);
+			}
+		}
+		m_iNext = 0;
+	}
+public:
+	SyntheticSession(GestureWindow hwnd, uint32_t seed) : m_hwnd(hwnd), m_time(seed * 7919), m_random(seed | 1),
+		m_iNext(0) {}
+
+	void next(GestureMessage& msg, uint32_t& time) {
+		if (m_iNext == m_vMessages.size())
+			refill();
+		msg = m_vMessages[m_iNext++];
+		time = m_time += m_random.range(1, 16);
+	}
+};
+
+/*
+ * Synthesizes a trace of nThreads plugin threads of a BrowserWindowTree, nMessages in all, chunks
+ * interleaved the way concurrently capturing threads write them. write(vBytes) gets the file header
+ * and then every chunk; onMessage(idThread, msg, time) every message, in each thread's order.
+ * The same seed gives the same trace.
+ */
+template <class WriteFn, class MessageFn>
+void SynthesizeInputTrace(size_t nMessages, int nThreads, uint32_t seed, WriteFn write, MessageFn onMessage) {
+	BrowserWindowTree browser(nThreads, 0);
+	CountingForwarder forwarder;
+	std::vector<uint8_t> vBytes;
+	AppendInputTraceHeader(vBytes);
+	write(vBytes);
+
+	std::vector<InputTraceEncoder*> vEncoders;
+	std::vector<SyntheticSession> vSessions;
+	for (int i = 0; i < nThreads; i++) {
+		vEncoders.push_back(new InputTraceEncoder(SYNTHETIC_FIRST_THREAD + i));
+		vSessions.push_back(SyntheticSession(browser.vPluginWindows[i], seed * 31 + i));
+	}
+	for (size_t i = 0; i < nMessages; i++) {
+		int iThread = static_cast<int>(i % nThreads);
+		GestureMessage msg;
+		uint32_t time;
+		vSessions[iThread].next(msg, time);
+		onMessage(SYNTHETIC_FIRST_THREAD + iThread, msg, time);
+		vEncoders[iThread]->append(msg, time, browser.tree, forwarder);
+		if (vEncoders[iThread]->getPendingSize() >= InputTraceEncoder::CHUNK_SIZE) {
+			vBytes.clear();
+			vEncoders[iThread]->takeChunk(vBytes);
+			write(vBytes);
+		}
+	}
+	for (InputTraceEncoder* pEncoder : vEncoders) {
+		vBytes.clear();
+		pEncoder->takeChunk(vBytes);
+		if (!vBytes.empty())
+			write(vBytes);
+		delete pEncoder;
+	}
+}
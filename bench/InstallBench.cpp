@@ -0,0 +1,118 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Window enumeration done by hook installation, counted as user32-equivalent calls against a
+// synthetic browser with a growing number of tabs.
+// "before" handles every plugin instantiation with a full FGH_InstallHook pass, as the extension
+// did; "after" hooks just the plugin window's thread with FGH_InstallHookForWindow. A burst of
+// requests that queue up in the hook manage thread is merged into a single batch.
+
+#include "BenchUtil.h"
+#include "FakeWindowTree.h"
+#include "HookInstall.h"
+
+/* One top level firefox window with nTabs tabs of a few content windows, plus plugins in their own threads */
+struct TabbedBrowser {
+	FakeWindowTree tree;
+	std::vector<GestureWindow> vPluginWindows;
+	std::vector<uint32_t> vPluginThreads;
+
+	TabbedBrowser(int nTabs, int nPlugins) {
+		GestureWindow hwndFirefox = tree.addWindow(0, "MozillaWindowClass", true);
+		std::vector<GestureWindow> vContent;
+		for (int i = 0; i < nTabs; i++) {
+			GestureWindow hwndTab = tree.addWindow(hwndFirefox, "MozillaWindowClass", true);
+			vContent.push_back(tree.addWindow(hwndTab, "MozillaWindowClass", true));
+			tree.addWindow(hwndTab, "MozillaCompositorWindowClass", true);
+			tree.addWindow(hwndTab, "MozillaDropShadowWindowClass", true);
+		}
+		for (int i = 0; i < nPlugins; i++) {
+			uint32_t idThread = 100 + i;
+			GestureWindow hwndHost = tree.addWindow(vContent[i % vContent.size()], "GeckoPluginWindow", false, idThread);
+			vPluginWindows.push_back(tree.addWindow(hwndHost, "ShockwaveFlashFullScreen", false, idThread));
+			vPluginThreads.push_back(idThread);
+		}
+	}
+};
+
+/* Runs a batch and returns the tree calls it took */
+static size_t CollectCalls(TabbedBrowser& browser, const HookInstallBatch& batch, ThreadProcessMap& mapThreads) {
+	size_t nCallsBefore = browser.tree.nCalls;
+	batch.collectThreads(browser.tree, FakeWindowTree::FAKE_MAIN_THREAD, FakeWindowTree::FAKE_PROCESS_HOOKER, mapThreads);
+	return browser.tree.nCalls - nCallsBefore;
+}
+
+int main() {
+	const int nBurst = 16;
+	const int aTabs[] = { 10, 100, 500, 2000 };
+	printf("tree calls to hook one new plugin, and a burst of %d plugins queued at once\n", nBurst);
+	printf("%-6s %8s %14s %14s %14s %14s\n", "tabs", "windows", "one before", "one after", "burst before",
+		   "burst after");
+	for (int nTabs : aTabs) {
+		TabbedBrowser browser(nTabs, nBurst);
+
+		// before: each plugin instantiation called FGH_InstallHook, one full pass per request
+		size_t nOneBefore = 0, nBurstBefore = 0;
+		ThreadProcessMap mapBefore;
+		for (int i = 0; i < nBurst; i++) {
+			HookInstallBatch batch;
+			batch.requestAll();
+			size_t nCalls = CollectCalls(browser, batch, mapBefore);
+			nBurstBefore += nCalls;
+			if (i == 0)
+				nOneBefore = nCalls;
+		}
+
+		// after: one targeted request, then the burst merged into one batch
+		size_t nOneAfter, nBurstAfter;
+		ThreadProcessMap mapOne, mapAfter;
+		{
+			HookInstallBatch batch;
+			batch.requestWindow(browser.vPluginWindows[0]);
+			nOneAfter = CollectCalls(browser, batch, mapOne);
+		}
+		{
+			HookInstallBatch batch;
+			for (GestureWindow hwnd : browser.vPluginWindows)
+				batch.requestWindow(hwnd);
+			nBurstAfter = CollectCalls(browser, batch, mapAfter);
+		}
+
+		// merged full passes enumerate once, however many requests there were
+		size_t nMergedAll;
+		ThreadProcessMap mapMergedAll;
+		{
+			HookInstallBatch batch;
+			for (int i = 0; i < nBurst; i++)
+				batch.requestAll();
+			nMergedAll = CollectCalls(browser, batch, mapMergedAll);
+		}
+
+		// every way must hook the main thread and the plugin threads, and nothing else
+		bool bSame = mapOne.size() == 2 && mapOne.count(browser.vPluginThreads[0]) &&
+			mapAfter == mapBefore && mapMergedAll == mapBefore && mapBefore.size() == browser.vPluginThreads.size() + 1;
+		for (uint32_t idThread : browser.vPluginThreads)
+			bSame = bSame && mapAfter[idThread] == FakeWindowTree::FAKE_PROCESS_OTHER;
+		if (!bSame || nMergedAll != nOneBefore) {
+			printf("%d tabs: targeted and merged installs hook different threads than a full pass\n", nTabs);
+			return 1;
+		}
+		printf("%-6d %8zu %14zu %14zu %14zu %14zu\n", nTabs, browser.tree.size(), nOneBefore, nOneAfter, nBurstBefore,
+			   nBurstAfter);
+	}
+	return 0;
+}
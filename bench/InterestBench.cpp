@@ -0,0 +1,264 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Interest masks: replays what a plugin thread of a busy browser sees, mostly paints, timers and
+// WM_USER traffic with the pointer moving in between, through GetMsgHook's old filtering and
+// through the interest mask test, and checks that both swallow exactly the same messages.
+// Neither includes the root window lookup or the flight recorder, which only the slow path pays.
+
+#include "BenchUtil.h"
+#include "GestureHandler.h"
+#include "HookThreadState.h"
+#include "HotkeyRules.h"
+#include "SharedConfig.h"
+
+const unsigned int MSG_PAINT = 0x000F, MSG_TIMER = 0x0113, MSG_USER = 0x0400;
+
+/* Stands in for GetKeyState, the streams never leave a modifier down */
+class NoKeysDown : public KeyStateSource {
+public:
+	bool isKeyDown(int) { return false; }
+};
+
+/* The hook's surroundings, shared by both filters */
+struct HookEnvironment {
+	NoKeysDown keyboard;
+	HotkeyRules rules;
+	MoveDecimation decimation;
+	SharedConfigBlock sharedConfig;
+	SharedConfigSync sharedConfigSync;
+	CountingForwarder forwarder;
+
+	HookEnvironment() : sharedConfigSync(rules, decimation) {}
+};
+
+static bool IsKeyMessage(unsigned int message) {
+	return GMSG_KEYDOWN <= message && message <= GMSG_KEYDOWN + 9;
+}
+
+static bool IsMouseMessage(unsigned int message) {
+	return GMSG_MOUSEMOVE <= message && message <= GMSG_MOUSEMOVE + 0xe;
+}
+
+/* Everything after the filter, the same for both */
+static bool SlowPath(HookEnvironment& env, HookThreadState& tls, const GestureMessage& msg, uint32_t time) {
+	tls.hookStats.count(HC_MessagesSeen);
+	if (IsKeyMessage(msg.message))
+		tls.modifiers.onKeyMessage(env.keyboard, msg, time);
+	else
+		tls.modifiers.onMouseMessage(msg);
+	env.sharedConfigSync.sync(env.sharedConfig, tls.gestureHandlers, tls.sharedConfigVersion);
+	tls.hookStats.count(HC_RootLookups);
+	if (!IsMouseMessage(msg.message) || !tls.gestureHandlers.handleMouseMessage(env.forwarder, BENCH_HWND_FIREFOX, msg, time))
+		return false;
+	tls.hookStats.count(HC_Swallowed);
+	return true;
+}
+
+/* GetMsgHook before the interest masks */
+static bool LegacyHook(HookEnvironment& env, HookThreadState& tls, const GestureMessage& msg, uint32_t time) {
+	if (tls.bGetMsgHookReentranceGuard)
+		return false;
+	tls.bGetMsgHookReentranceGuard = true;
+	bool bShouldSwallow = false;
+	if (IsKeyMessage(msg.message) || IsMouseMessage(msg.message)) {
+		if (msg.message == GMSG_MOUSEMOVE && tls.gestureHandlers.allInactive()) {
+			// the old fast exit came after the bookkeeping
+			tls.hookStats.count(HC_MessagesSeen);
+			tls.modifiers.onMouseMessage(msg);
+			env.sharedConfigSync.sync(env.sharedConfig, tls.gestureHandlers, tls.sharedConfigVersion);
+			tls.hookStats.count(HC_FastExits);
+		} else
+			bShouldSwallow = SlowPath(env, tls, msg, time);
+	}
+	tls.bGetMsgHookReentranceGuard = false;
+	return bShouldSwallow;
+}
+
+/* GetMsgHook with the interest mask test in front */
+static bool InterestHook(HookEnvironment& env, HookThreadState& tls, const GestureMessage& msg, uint32_t time) {
+	uint32_t interestBit = MessageInterestBit(msg.message);
+	if (!(tls.gestureHandlers.getInterest() & interestBit)) {
+		if (interestBit)
+			tls.hookStats.count(HC_FastExits);
+		return false;
+	}
+	if (tls.bGetMsgHookReentranceGuard)
+		return false;
+	tls.bGetMsgHookReentranceGuard = true;
+	bool bShouldSwallow = SlowPath(env, tls, msg, time);
+	tls.bGetMsgHookReentranceGuard = false;
+	return bShouldSwallow;
+}
+
+static bool CheckInterestBits() {
+	uint32_t seen = 0;
+	for (unsigned int message = 0; message < 0x10000; message++) {
+		uint32_t bit = MessageInterestBit(message);
+		bool bExpected = (message & ~0xfu) == 0x100 || (message & ~0xfu) == 0x200;
+		if ((bit != 0) != bExpected || (bit & (bit - 1)) || (bit & seen)) {
+			printf("MessageInterestBit(0x%x) = 0x%x\n", message, bit);
+			return false;
+		}
+		seen |= bit;
+	}
+	return MessageInterestBit(0xffffffffu) == 0 && MessageInterestBit(0x100 + 0x10000) == 0 &&
+		(MessageInterestBit(GMSG_MOUSEMOVE) & INTEREST_MOUSE) && (MessageInterestBit(GMSG_KEYUP) & INTEREST_KEYS);
+}
+
+struct StreamSpec {
+	const char* szName;
+	std::vector<GestureMessage> vMessages;
+};
+
+/* Inserts nNoise paints, timers and posted WM_USER messages after every input message */
+static std::vector<GestureMessage> AddNoise(const std::vector<GestureMessage>& vInput, int nNoise, uint32_t seed) {
+	BenchRandom random(seed);
+	std::vector<GestureMessage> vMessages;
+	for (const GestureMessage& input : vInput) {
+		vMessages.push_back(input);
+		for (int i = 0; i < nNoise; i++) {
+			GestureMessage msg = { BENCH_HWND_PLUGIN, MSG_TIMER, 1, 0 };
+			switch (random.range(0, 3)) {
+			case 0: msg.message = MSG_PAINT; break;
+			case 1: msg.message = MSG_TIMER; msg.wParam = random.range(1, 8); break;
+			default: msg.message = MSG_USER + random.range(0, 0xff); break;
+			}
+			vMessages.push_back(msg);
+		}
+	}
+	return vMessages;
+}
+
+static void Type(std::vector<GestureMessage>& vMessages, int nKeys, BenchRandom& random) {
+	for (int i = 0; i < nKeys; i++) {
+		uintptr_t keyCode = 'A' + random.range(0, 25);
+		GestureMessage down = { BENCH_HWND_PLUGIN, GMSG_KEYDOWN, keyCode, 1 };
+		GestureMessage up = { BENCH_HWND_PLUGIN, GMSG_KEYUP, keyCode, static_cast<intptr_t>(0xc0000001) };
+		vMessages.push_back(down);
+		vMessages.push_back(up);
+	}
+}
+
+static std::vector<StreamSpec> BuildStreams() {
+	std::vector<StreamSpec> vStreams;
+
+	MessageStreamBuilder hover;
+	hover.idleMoves(4000);
+	StreamSpec specHover = { "busy page, hovering", AddNoise(hover.messages(), 4, 1) };
+	vStreams.push_back(specHover);
+
+	MessageStreamBuilder gestures;
+	for (int i = 0; i < 200; i++) {
+		gestures.idleMoves(20);
+		switch (gestures.random().range(0, 4)) {
+		case 0: gestures.traceStroke(30); break;
+		case 1: gestures.rockerClick(3); break;
+		case 2: gestures.wheelGesture(5); break;
+		case 3: gestures.deadZoneJiggle(10); break;
+		default: gestures.click(); break;
+		}
+	}
+	StreamSpec specGestures = { "busy page, gestures", AddNoise(gestures.messages(), 2, 2) };
+	vStreams.push_back(specGestures);
+	StreamSpec specPointer = { "pointer only, gestures", gestures.messages() };
+	vStreams.push_back(specPointer);
+
+	MessageStreamBuilder reading;
+	BenchRandom random(3);
+	std::vector<GestureMessage> vTyping;
+	for (int i = 0; i < 200; i++) {
+		reading.idleMoves(10);
+		reading.click();
+	}
+	for (size_t i = 0; i < reading.messages().size(); i++) {
+		vTyping.push_back(reading.messages()[i]);
+		if (i % 12 == 11)
+			Type(vTyping, 3, random);
+	}
+	StreamSpec specTyping = { "busy page, typing", AddNoise(vTyping, 3, 4) };
+	vStreams.push_back(specTyping);
+
+	return vStreams;
+}
+
+typedef bool (*HookFn)(HookEnvironment&, HookThreadState&, const GestureMessage&, uint32_t);
+
+struct ReplayResult {
+	double ns;
+	std::vector<bool> vSwallowed;
+	HookStatsSnapshot stats;
+};
+
+static ReplayResult MeasureReplay(HookFn hook, const std::vector<GestureMessage>& vMessages, int nRuns, size_t nPasses) {
+	static const char* const aszGestures[] = { "trace", "rocker", "wheel" };
+	HookEnvironment env;
+	HookThreadState* pTLS = new HookThreadState(1);
+	pTLS->gestureHandlers.setEnabledGestures(aszGestures, 3);
+	ReplayResult result;
+	uint32_t time = 0;
+	for (const GestureMessage& msg : vMessages)
+		result.vSwallowed.push_back(hook(env, *pTLS, msg, time += 8));
+	result.ns = BenchBestOf(nRuns, [&]() {
+		for (size_t i = 0; i < nPasses; i++) {
+			for (const GestureMessage& msg : vMessages)
+				hook(env, *pTLS, msg, time += 8);
+		}
+	});
+	InitHookStatsSnapshot(result.stats);
+	pTLS->hookStats.addTo(result.stats);
+	delete pTLS;
+	return result;
+}
+
+int main() {
+	if (!CheckInterestBits()) {
+		printf("interest bits overlap or cover the wrong messages\n");
+		return 1;
+	}
+
+	const int nRuns = 7;
+	const size_t nTargetMessages = 4000000;
+	std::vector<StreamSpec> vStreams = BuildStreams();
+
+	printf("%-24s %10s %14s %14s %10s %12s %12s\n", "stream", "messages", "before ns/msg", "after ns/msg", "speedup",
+		   "seen before", "seen after");
+	for (const StreamSpec& stream : vStreams) {
+		size_t nPasses = nTargetMessages / stream.vMessages.size() + 1;
+		size_t nMessages = nPasses * stream.vMessages.size();
+		ReplayResult before = MeasureReplay(LegacyHook, stream.vMessages, nRuns, nPasses);
+		ReplayResult after = MeasureReplay(InterestHook, stream.vMessages, nRuns, nPasses);
+		if (before.vSwallowed != after.vSwallowed) {
+			printf("%s: the interest mask changes which messages are swallowed\n", stream.szName);
+			return 1;
+		}
+		// both count every key and mouse message once, either as seen or as a fast exit
+		uint64_t nBeforeInput = before.stats.aCounters[HC_MessagesSeen];
+		uint64_t nAfterInput = after.stats.aCounters[HC_MessagesSeen] + after.stats.aCounters[HC_FastExits];
+		if (nBeforeInput != nAfterInput || before.stats.aCounters[HC_Swallowed] != after.stats.aCounters[HC_Swallowed]) {
+			printf("%s: statistics disagree\n", stream.szName);
+			return 1;
+		}
+		// share of the messages that paid for the modifier tracking and the config check
+		uint64_t nBeforeSeen = nBeforeInput, nAfterSeen = after.stats.aCounters[HC_MessagesSeen];
+		size_t nReplayed = (nRuns * nPasses + 1) * stream.vMessages.size();
+		double nsBefore = before.ns / nMessages, nsAfter = after.ns / nMessages;
+		printf("%-24s %10zu %14.2f %14.2f %9.2fx %11.1f%% %11.1f%%\n", stream.szName, stream.vMessages.size(), nsBefore,
+			   nsAfter, nsBefore / nsAfter, 100.0 * nBeforeSeen / nReplayed, 100.0 * nAfterSeen / nReplayed);
+	}
+	return 0;
+}
@@ -0,0 +1,480 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Frozen copy of the virtual-dispatch gesture handlers as they were before the compile-time
+// pipeline, used by the benchmarks as the "before" reference and to check equivalence.
+
+#include "GestureHandler.h"
+
+namespace legacy {
+
+/* Stands in for the ClientToScreen/ScreenToClient pair that used to be made for every message */
+inline GesturePoint MapPoint(GestureForwarder& forwarder, GestureWindow hwndFrom, GestureWindow hwndTo, GesturePoint pt) {
+	GesturePoint offset = forwarder.getClientOffset(hwndFrom, hwndTo);
+	GesturePoint ptResult = { pt.x + offset.x, pt.y + offset.y };
+	return ptResult;
+}
+
+struct GestureHandlers;
+
+/* Abstract class that determines whether we should forward mouse gesture related messages */
+class GestureHandler {
+private:
+	bool shouldKeepTrack(MessageHandleResult res) const;
+	static bool shouldUsePost(GestureWindow hTarget);
+
+	friend struct GestureHandlers;
+protected:
+	GestureState m_state;
+	bool m_bEnabled;
+
+	/* keep track of swallowed messages */
+	std::vector<GestureMessage> m_vMessages;
+
+	GestureHandler();
+	void setState(GestureState);
+
+	virtual MessageHandleResult handleMessageInternal(const GestureMessage&) = 0;
+	virtual ~GestureHandler();
+public:
+	virtual const char* getName() const = 0;
+	MessageHandleResult handleMessage(const GestureMessage&);
+	GestureState getState() const;
+	void setEnabled(bool);
+	bool getEnabled() const;
+	virtual void forwardAllOrigin(GestureForwarder& forwarder, GestureWindow origin);
+	virtual void forwardAllTarget(GestureForwarder& forwarder, GestureWindow origin, GestureWindow target);
+	virtual bool shouldSwallow(MessageHandleResult res) const;
+	void reset();
+
+	static void forwardOrigin(GestureForwarder& forwarder, const GestureMessage& msg);
+	static void forwardTarget(GestureForwarder& forwarder, const GestureMessage& msg, GestureWindow target);
+};
+
+/* The per-thread set of gesture handlers, created on first use */
+struct GestureHandlers {
+	~GestureHandlers();
+	std::vector<GestureHandler*> m_vHandlers;
+
+	const std::vector<GestureHandler*>& getHandlers();
+	void setEnabledGestures(const char* const aszGestureNames[], int iCount);
+
+	/* true if no enabled handler is initiated or triggered */
+	bool allInactive();
+	/* Runs a mouse message through the handlers, returns true if it should be swallowed */
+	bool handleMouseMessage(GestureForwarder& forwarder, GestureWindow hwndTarget, const GestureMessage& msg);
+};
+
+// Automatically cleanup at program exit
+inline GestureHandlers::~GestureHandlers() {
+	if (m_vHandlers.size()) {
+		for (size_t i = 0; i < m_vHandlers.size(); i++)
+			delete m_vHandlers[i];
+		m_vHandlers.clear();
+		ATLTRACE(_T("Cleared gesture handlers.\n"));
+	}
+}
+
+inline GestureHandler::GestureHandler() :
+m_state(GS_None), m_bEnabled(true) {}
+
+inline GestureHandler::~GestureHandler() {}
+
+inline void GestureHandler::setState(GestureState state) {
+	this->m_state = state;
+}
+
+inline GestureState GestureHandler::getState() const {
+	return m_state;
+}
+
+inline bool GestureHandler::shouldUsePost(GestureWindow hTarget) {
+	return true;
+}
+
+inline void GestureHandler::forwardAllOrigin(GestureForwarder& forwarder, GestureWindow hOrigin) {
+	_ASSERT(hOrigin != 0);
+	for (std::vector<GestureMessage>::iterator iter = m_vMessages.begin();
+		 iter != m_vMessages.end() && (iter + 1) != m_vMessages.end(); ++iter) {
+		forwarder.sendMessage(hOrigin, *iter);
+	}
+	size_t size;
+	if ((size = m_vMessages.size()) != 0) {
+		forwarder.postMessage(hOrigin, m_vMessages[size - 1]);
+	}
+	m_vMessages.clear();
+}
+
+inline void GestureHandler::forwardAllTarget(GestureForwarder& forwarder, GestureWindow hOrigin, GestureWindow hTarget) {
+	_ASSERT(hOrigin != 0 && hTarget != 0);
+	bool bShouldUsePost = shouldUsePost(hTarget);
+	for (std::vector<GestureMessage>::iterator iter = m_vMessages.begin();
+		 iter != m_vMessages.end(); ++iter) {
+		GestureMessage msg = *iter;
+		msg.lParam = MapPoint(forwarder, hOrigin, hTarget, iter->getPoint()).toLParam();
+		if (bShouldUsePost)
+			forwarder.postMessage(hTarget, msg);
+		else
+			forwarder.sendMessage(hTarget, msg);
+	}
+	m_vMessages.clear();
+}
+
+inline void GestureHandler::reset() {
+	m_state = GS_None;
+	m_vMessages.clear();
+}
+
+inline bool GestureHandler::shouldKeepTrack(MessageHandleResult res) const {
+	return (m_state == GS_Initiated && res != MHR_Discarded) || res == MHR_Triggered || res == MHR_Canceled;
+}
+
+inline bool GestureHandler::shouldSwallow(MessageHandleResult res) const {
+	return m_state == GS_Initiated || res == MHR_Triggered || res == MHR_Canceled;
+}
+
+inline MessageHandleResult GestureHandler::handleMessage(const GestureMessage& msg) {
+	if (!m_bEnabled)
+		return MHR_NotHandled;
+
+	MessageHandleResult res = this->handleMessageInternal(msg);
+	if (shouldKeepTrack(res)) {
+		m_vMessages.push_back(msg);
+	}
+	return res;
+}
+
+inline void GestureHandler::forwardOrigin(GestureForwarder& forwarder, const GestureMessage& msg) {
+	forwarder.sendMessage(msg.hwnd, msg);
+}
+
+inline void GestureHandler::forwardTarget(GestureForwarder& forwarder, const GestureMessage& msg, GestureWindow hTarget) {
+	GestureMessage msgTarget = msg;
+	msgTarget.lParam = MapPoint(forwarder, msg.hwnd, hTarget, msg.getPoint()).toLParam();
+	if (shouldUsePost(hTarget))
+		forwarder.postMessage(hTarget, msgTarget);
+	else
+		forwarder.sendMessage(hTarget, msgTarget);
+}
+
+inline void GestureHandler::setEnabled(bool bEnabled) {
+	if (!bEnabled && m_bEnabled) {
+		reset();
+	}
+	if (bEnabled != m_bEnabled) {
+		ATLTRACE(_T("%s %S gesture handler.\n"), bEnabled ? _T("Enabled") : _T("Disabled"), this->getName());
+	}
+	m_bEnabled = bEnabled;
+}
+
+inline bool GestureHandler::getEnabled() const {
+	return m_bEnabled;
+}
+
+inline void GestureHandlers::setEnabledGestures(const char* const aszGestureNames[], int iCount) {
+	const std::vector<GestureHandler*>& vHandlers = getHandlers();
+
+	// initialize states to false
+	std::vector<bool> vStates;
+	vStates.reserve(vHandlers.size());
+	for (size_t iState = 0; iState < vHandlers.size(); iState++) {
+		vStates.push_back(false);
+	}
+
+	// enable those handlers specified in the array
+	for (int iName = 0; iName < iCount; iName++) {
+		const char* szName = aszGestureNames[iName];
+		for (size_t iHandler = 0; iHandler < vHandlers.size(); iHandler++) {
+			if (strcmp(vHandlers[iHandler]->getName(), szName) == 0) {
+				vStates[iHandler] = true;
+				break;
+			}
+		}
+	}
+
+	for (size_t iState = 0; iState < vHandlers.size(); iState++) {
+		vHandlers[iState]->setEnabled(vStates[iState]);
+	}
+}
+
+inline bool GestureHandlers::allInactive() {
+	for (GestureHandler* pHandler : getHandlers()) {
+		if (pHandler->getEnabled() && pHandler->getState() != GS_None)
+			return false;
+	}
+	return true;
+}
+
+inline bool GestureHandlers::handleMouseMessage(GestureForwarder& forwarder, GestureWindow hwndTarget, const GestureMessage& msg) {
+	const std::vector<GestureHandler*>& handlers = getHandlers();
+
+	// Forward the mouse message if any guesture handler is triggered.
+	for (std::vector<GestureHandler*>::const_iterator iter = handlers.begin();
+		 iter != handlers.end(); ++iter) {
+		if ((*iter)->getState() == GS_Triggered) {
+			GestureHandler* triggeredHandler = *iter;
+			MessageHandleResult res = triggeredHandler->handleMessage(msg);
+			if (res == MHR_GestureEnd) {
+				for (std::vector<GestureHandler*>::const_iterator iter = handlers.begin();
+					 iter != handlers.end(); ++iter) {
+					(*iter)->reset();
+				}
+			}
+			// Forward the mousemove message to let firefox track the guesture.
+			GestureHandler::forwardTarget(forwarder, msg, hwndTarget);
+			return true;
+		}
+	}
+
+	// Check if we could trigger a mouse guesture.
+	bool bShouldSwallow = false;
+	for (GestureHandler* handler: handlers) {
+		MessageHandleResult res = handler->handleMessage(msg);
+		bShouldSwallow = bShouldSwallow || handler->shouldSwallow(res);
+		if (res == MHR_Triggered) {
+			handler->forwardAllTarget(forwarder, msg.hwnd, hwndTarget);
+			break;
+		} else if (res == MHR_Canceled) {
+			bool bShouldForwardBack = true;
+			for (const GestureHandler* h : handlers) {
+				if (h->getState() != GS_None) {
+					bShouldForwardBack = false;
+					break;
+				}
+			}
+			if (bShouldForwardBack) {
+				handler->forwardAllOrigin(forwarder, msg.hwnd);
+				for (GestureHandler* h : handlers) {
+					h->reset();
+				}
+			}
+		}
+	}
+	return bShouldSwallow;
+}
+
+class TraceHandler : public GestureHandler {
+private:
+	GesturePoint m_ptStart;
+protected:
+	MessageHandleResult handleMessageInternal(const GestureMessage& msg);
+public:
+	const char* getName() const { return "trace"; }
+	TraceHandler();
+};
+
+class RockerHandler : public GestureHandler {
+private:
+	GesturePoint m_ptStart;
+	bool m_bLeft;
+protected:
+	MessageHandleResult handleMessageInternal(const GestureMessage& msg);
+public:
+	const char* getName() const { return "rocker"; }
+	RockerHandler();
+	bool shouldSwallow(MessageHandleResult) const;
+	void forwardAllOrigin(GestureForwarder& forwarder, GestureWindow origin);
+};
+
+class WheelHandler : public GestureHandler {
+private:
+	GesturePoint m_ptStart;
+protected:
+	MessageHandleResult handleMessageInternal(const GestureMessage& msg);
+public:
+	const char* getName() const { return "wheel"; }
+	WheelHandler();
+};
+
+inline TraceHandler::TraceHandler() :
+m_ptStart() {
+
+}
+
+inline MessageHandleResult TraceHandler::handleMessageInternal(const GestureMessage& msg) {
+	GesturePoint ptCurrent = msg.getPoint();
+	switch (getState()) {
+	case GS_None:
+		if (msg.message == GMSG_RBUTTONDOWN) {
+			m_ptStart = ptCurrent;
+			setState(GS_Initiated);
+			ATLTRACE(_T("Trace Gesture Initiated\n"));
+			return MHR_Initiated;
+		}
+		break;
+	case GS_Initiated:
+		if (msg.message == GMSG_MOUSEMOVE && (msg.wParam & GMK_RBUTTON)) {
+			if (abs(ptCurrent.x - m_ptStart.x) > 10 || abs(ptCurrent.y - m_ptStart.y) > 10) {
+				setState(GS_Triggered);
+				ATLTRACE(_T("Trace Gesture Triggered\n"));
+				return MHR_Triggered;
+			} else
+				return MHR_Swallowed;
+		} else if (msg.message == GMSG_RBUTTONDOWN || msg.message == GMSG_RBUTTONDBLCLK) {
+			ATLTRACE(_T("Duplicate Trace Gesture Initiation\n"));
+			return MHR_Discarded;
+		} else {
+			ATLTRACE(_T("Trace Gesture Canceled due to message no. %x\n"), msg.message);
+			setState(GS_None);
+			return MHR_Canceled;
+		}
+		break;
+	case GS_Triggered:
+		if (msg.message == GMSG_MOUSEMOVE && (msg.wParam & GMK_RBUTTON)) {
+			return MHR_Swallowed;
+		} else {
+			ATLTRACE(_T("Trace Gesture Ended\n"));
+			setState(GS_None);
+			return MHR_GestureEnd;
+		}
+		break;
+	}
+	return MHR_NotHandled;
+}
+
+inline RockerHandler::RockerHandler() :
+m_ptStart(), m_bLeft(false) {
+
+}
+
+inline MessageHandleResult RockerHandler::handleMessageInternal(const GestureMessage& msg) {
+	GesturePoint ptCurrent = msg.getPoint();
+	switch (getState()) {
+	case GS_None:
+		if (msg.message == GMSG_LBUTTONDOWN || msg.message == GMSG_RBUTTONDOWN) {
+			m_ptStart = ptCurrent;
+			m_bLeft = (msg.message == GMSG_LBUTTONDOWN);
+			setState(GS_Initiated);
+			ATLTRACE(CString(_T("Rocker Gesture Initiated: ")) + (m_bLeft ? _T(" Left\n") : _T(" Right\n")));
+			return MHR_Initiated;
+		}
+		break;
+	case GS_Initiated:
+		if (msg.message == GMSG_MOUSEMOVE && (msg.wParam & (m_bLeft ? GMK_LBUTTON : GMK_RBUTTON))) {
+			if (abs(ptCurrent.x - m_ptStart.x) > 10 || abs(ptCurrent.y - m_ptStart.y) > 10) {
+				setState(GS_None);
+				ATLTRACE(_T("Rocker Gesture Canceled due to mouse moved too far away\n"));
+				return MHR_Canceled;
+			} else
+				return MHR_Swallowed;
+		} else if (msg.message == (m_bLeft ? GMSG_RBUTTONDOWN : GMSG_LBUTTONDOWN)
+				   && (msg.wParam & (m_bLeft ? GMK_LBUTTON : GMK_RBUTTON))) {
+			ATLTRACE(_T("Rocker Gesture Triggered\n"));
+			setState(GS_Triggered);
+			return MHR_Triggered;
+		} else if (msg.message == GMSG_LBUTTONDOWN || msg.message == GMSG_RBUTTONDOWN
+				   || msg.message == GMSG_LBUTTONDBLCLK || msg.message == GMSG_RBUTTONDBLCLK) {
+			ATLTRACE(_T("Duplicate Rocker Gesture Initiation\n"));
+			return MHR_Discarded;
+		} else {
+			ATLTRACE(_T("Rocker Gesture Canceled due to message no. %x\n"), msg.message);
+			setState(GS_None);
+			return MHR_Canceled;
+		}
+		break;
+	case GS_Triggered:
+		if ((msg.wParam & (m_bLeft ? GMK_LBUTTON : GMK_RBUTTON)) == 0
+			|| (msg.message != (m_bLeft ? GMSG_RBUTTONDOWN : GMSG_LBUTTONDOWN)
+			&& msg.message != (m_bLeft ? GMSG_RBUTTONUP : GMSG_LBUTTONUP)
+			&& msg.message != GMSG_MOUSEMOVE)) {
+			ATLTRACE(_T("Rocker Gesture Ended\n"));
+			setState(GS_None);
+			return MHR_GestureEnd;
+		} else {
+			return MHR_Swallowed;
+		}
+		break;
+	}
+	return MHR_NotHandled;
+}
+
+inline bool RockerHandler::shouldSwallow(MessageHandleResult res) const {
+	// don't swallow anything related to left->right gesture except for the triggering message
+	if (m_bLeft && res != MHR_Triggered) return false;
+	return GestureHandler::shouldSwallow(res);
+}
+
+inline void RockerHandler::forwardAllOrigin(GestureForwarder& forwarder, GestureWindow hOrigin) {
+	// also don't forward anything to origin if gesture is left->right
+	if (m_bLeft) return;
+	GestureHandler::forwardAllOrigin(forwarder, hOrigin);
+}
+
+inline WheelHandler::WheelHandler() :
+m_ptStart() {
+
+}
+
+inline MessageHandleResult WheelHandler::handleMessageInternal(const GestureMessage& msg) {
+	GesturePoint ptCurrent = msg.getPoint();
+	switch (getState()) {
+	case GS_None:
+		if (msg.message == GMSG_RBUTTONDOWN) {
+			m_ptStart = ptCurrent;
+			setState(GS_Initiated);
+			ATLTRACE(_T("Wheel Gesture Initiated\n"));
+			return MHR_Initiated;
+		}
+		break;
+	case GS_Initiated:
+		if (msg.message == GMSG_MOUSEMOVE && (msg.wParam & GMK_RBUTTON)) {
+			if (abs(ptCurrent.x - m_ptStart.x) > 10 || abs(ptCurrent.y - m_ptStart.y) > 10) {
+				setState(GS_None);
+				ATLTRACE(_T("Wheel Gesture Canceled due to mouse moved too far away\n"));
+				return MHR_Canceled;
+			} else
+				return MHR_Swallowed;
+		} else if (msg.message == GMSG_MOUSEWHEEL && (msg.wParam & GMK_RBUTTON)) {
+			ATLTRACE(_T("Wheel Gesture Triggered\n"));
+			setState(GS_Triggered);
+			return MHR_Triggered;
+		} else if (msg.message == GMSG_RBUTTONDOWN || msg.message == GMSG_RBUTTONDBLCLK) {
+			ATLTRACE(_T("Duplicate Wheel Gesture Initiation\n"));
+			return MHR_Discarded;
+		} else {
+			ATLTRACE(_T("Wheel Gesture Canceled due to message no. %x\n"), msg.message);
+			setState(GS_None);
+			return MHR_Canceled;
+		}
+		break;
+	case GS_Triggered:
+		if ((msg.message == GMSG_MOUSEMOVE || msg.message == GMSG_MOUSEWHEEL) && (msg.wParam & GMK_RBUTTON)) {
+			return MHR_Swallowed;
+		} else {
+			ATLTRACE(_T("Wheel Gesture Ended\n"));
+			setState(GS_None);
+			return MHR_GestureEnd;
+		}
+		break;
+	}
+	return MHR_NotHandled;
+}
+
+inline const std::vector<GestureHandler*>& GestureHandlers::getHandlers() {
+	auto& vHandlers = m_vHandlers;
+	if (vHandlers.size() == 0) {
+		vHandlers.push_back(new TraceHandler());
+		vHandlers.push_back(new RockerHandler());
+		vHandlers.push_back(new WheelHandler());
+		ATLTRACE(_T("Created gesture handlers.\n"));
+	}
+	return vHandlers;
+}
+
+} // namespace legacy
@@ -0,0 +1,124 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Frozen copy of the switch cascade that decided which key presses reach firefox before the
+// rules became a table, used to check that the default HotkeyRules behave exactly the same.
+
+#include "stdafx.h"
+#include "HotkeyRules.h"
+
+namespace legacy {
+
+const int VK_RETURN = GVK_RETURN;
+const int VK_SHIFT = GVK_SHIFT;
+const int VK_CONTROL = GVK_CONTROL;
+const int VK_MENU = GVK_MENU;
+const int VK_SPACE = GVK_SPACE;
+const int VK_END = GVK_END;
+const int VK_HOME = GVK_HOME;
+const int VK_LEFT = GVK_LEFT;
+const int VK_UP = GVK_UP;
+const int VK_RIGHT = GVK_RIGHT;
+const int VK_DOWN = GVK_DOWN;
+const int VK_F2 = GVK_F1 + 1;
+const int VK_F3 = GVK_F1 + 2;
+const int VK_F4 = GVK_F1 + 3;
+const int VK_F5 = GVK_F1 + 4;
+const int VK_F6 = GVK_F1 + 5;
+const int VK_F7 = GVK_F1 + 6;
+const int VK_F8 = GVK_F1 + 7;
+const int VK_F10 = GVK_F1 + 9;
+const int VK_F11 = GVK_F1 + 10;
+const int VK_F12 = GVK_F1 + 11;
+const int VK_PROCESSKEY = GVK_PROCESSKEY;
+
+inline bool FilterFirefoxKey(int keyCode, bool bAltPressed, bool bCtrlPressed, bool bShiftPressed) {
+	if (bCtrlPressed && bAltPressed) {
+		// BUG FIX: Characters like @, #, € (and others that require AltGr on European keyboard layouts) cannot be entered in the plugin
+		// Suggested by Meyer Kuno (Helbling Technik): AltGr is represented in Windows massages as the combination of Alt+Ctrl, and that is used for text input, not for menu naviagation.
+		// 
+		switch (keyCode) {
+		case 'R': // Ctrl+Alt+R, Restart firefox
+			return true;
+		default:
+			return false;
+		}
+	} else if (bCtrlPressed) {
+		switch (keyCode) {
+		case VK_CONTROL: // Only Ctrl is pressed
+		case VK_MENU: // Might be in AltGr up sequence
+			return false;
+		case VK_SHIFT: // Ctrl-Shift switching IME, should not lose focus
+		case VK_SPACE:
+		case VK_PROCESSKEY:
+			ATLTRACE(_T("VK_SHIFT, VK_SPACE or VK_PROCESSKEY\n"));
+			return false;
+
+		// The following shortcut keys will be handle by the plugin only and won't be sent to Firefox
+		case 'C': // Ctrl+C, Copy
+		case 'V': // Ctrl+V, Paste
+		case 'X': // Ctrl+X, Cut
+		case 'A': // Ctrl+A, Select All
+		case 'Z': // Ctrl+Z, undo
+		case 'Y': // Ctrl+Y, redo 
+		case VK_HOME: // Ctrl+HOME, Scroll to Top
+		case VK_END:  // Ctrl+END, Scroll to end
+		case VK_LEFT: // Ctrl+L/R, Jump to prev/next word
+		case VK_RIGHT:
+		case VK_UP: // Ctrl+U/D, identical to Up/Down
+		case VK_DOWN:
+		case VK_RETURN: // Ctrl-Return, fast post on Baidu Tieba & potentially other places
+			return false;
+		default:
+			ATLTRACE(_T("Forwarded firefox key with keyCode = %d\n"), keyCode);
+			return true;
+		}
+	} else if (bAltPressed) {
+		return true;
+	} else {
+		switch (keyCode) {
+		case VK_F2: // Developer toolbar
+			return bShiftPressed;
+		case VK_F3: // find next, with shift: find prev
+			return true;
+		case VK_F4: // Shift-F4 opens Scratchpad which is very handy
+			return bShiftPressed;
+		case VK_F5: // Refresh or Performance tab in Developer Tools (Shift-F5)
+			return true;
+		case VK_F6: // Locate the address bar
+			return !bShiftPressed;
+		case VK_F7: // Style Editor
+			return bShiftPressed;
+		case VK_F8: // Shift-F8 opens WebIDE
+			return bShiftPressed;
+		case VK_F10: // Locate the menu bar
+			return !bShiftPressed;
+		case VK_F11: // full screen
+			return !bShiftPressed;
+		case VK_F12: // Firebug
+			return !bShiftPressed;
+		default:
+			return false;
+		}
+	}
+
+	return false;
+}
+
+} // namespace legacy
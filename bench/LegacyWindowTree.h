@@ -0,0 +1,97 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Frozen copy of the firefox window lookup from before the plugin window classes became a perfect
+// hash, used to check that the new matcher finds exactly the same windows.
+
+#include "stdafx.h"
+#include "WindowTree.h"
+
+#include <cstring>
+
+namespace legacy {
+
+inline int FindClassName(const char* const aszClassNames[], int nClassNames, const char* szClassName) {
+	for (int i = 0; i < nClassNames; i++) {
+		if (strcmp(aszClassNames[i], szClassName) == 0)
+			return i;
+	}
+	return -1;
+}
+
+inline GestureWindow GetParentWindowForAnyClassName(WindowTree& tree, GestureWindow hwnd,
+													const char* const aszTargetClassNames[], int nTargetClassNames,
+													int maxLevelsUp, char (&szClassName)[MAX_WINDOW_CLASS_NAME]) {
+	int levels = 0;
+	int index = -1;
+	GestureWindow hwndParent = hwnd;
+	while (hwndParent && levels <= maxLevelsUp && index < 0) {
+		hwnd = hwndParent;
+		hwndParent = tree.getParent(hwnd);
+
+		if (tree.getClassName(hwnd, szClassName, MAX_WINDOW_CLASS_NAME) == 0)
+			return 0;
+
+		index = FindClassName(aszTargetClassNames, nTargetClassNames, szClassName);
+
+		levels++;
+	}
+
+	return (index < 0) ? 0 : hwnd;
+}
+
+static const char* const aszTargetPluginWindowClassNames[] = {
+	"MozillaWindowClass", "GeckoPluginWindow", "GeckoFPSandboxChildWindow"
+};
+static const int nTargetPluginWindowClassNames = sizeof(aszTargetPluginWindowClassNames) / sizeof(aszTargetPluginWindowClassNames[0]);
+
+inline GestureWindow VerifyAndGetTopMozillaWindowClassWindow(WindowTree& tree, GestureWindow hwndChild) {
+	static const char* const szTargetWindowClassName = "MozillaWindowClass";
+	static const int nTargetPluginWindowClassNamesInProcess = 1;
+	static const char* const aszLowIntegrityWindowClassNames[] = {
+		"GeckoFPSandboxChildWindow"
+	};
+	static const int nLowIntegrityWindowClassNames = sizeof(aszLowIntegrityWindowClassNames) / sizeof(aszLowIntegrityWindowClassNames[0]);
+
+	char szIntermediateClassName[MAX_WINDOW_CLASS_NAME];
+	GestureWindow hwndIntermediate =
+		GetParentWindowForAnyClassName(tree, hwndChild, aszTargetPluginWindowClassNames,
+		tree.isInProcess(hwndChild) ? nTargetPluginWindowClassNamesInProcess : nTargetPluginWindowClassNames,
+		10, szIntermediateClassName);
+	if (!hwndIntermediate)
+		return 0;
+
+	GestureWindow hwndTop = tree.getRoot(hwndIntermediate);
+	if (hwndTop == hwndIntermediate)
+		return 0;
+
+	// Bypass root window class checking, as we can't do it reliably in a low integrity process
+	if (0 <= FindClassName(aszLowIntegrityWindowClassNames, nLowIntegrityWindowClassNames, szIntermediateClassName))
+		return hwndTop;
+
+	// Check root window class name
+	char szTopClassName[MAX_WINDOW_CLASS_NAME];
+	if (tree.getClassName(hwndTop, szTopClassName, MAX_WINDOW_CLASS_NAME) == 0
+		|| strcmp(szTopClassName, szTargetWindowClassName) != 0)
+		return 0;
+
+	return hwndTop;
+}
+
+} // namespace legacy
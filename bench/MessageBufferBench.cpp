@@ -0,0 +1,168 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Worst case for the swallowed-message buffer: the right button is held while the mouse jiggles
+// inside the dead zone, then released, so everything buffered is replayed to the plugin window.
+// Compares the unbounded vector of the virtual-dispatch handlers with GestureMessageBuffer.
+
+#include "BenchUtil.h"
+#include "GestureHandler.h"
+#include "LegacyGestureHandler.h"
+
+/* Records the replayed messages, so that their order can be compared */
+class RecordingForwarder : public CountingForwarder {
+public:
+	std::vector<GestureMessage> vReplayed;
+
+	void sendMessage(GestureWindow hwnd, const GestureMessage& msg) {
+		CountingForwarder::sendMessage(hwnd, msg);
+		vReplayed.push_back(msg);
+	}
+	void postMessage(GestureWindow hwnd, const GestureMessage& msg) {
+		CountingForwarder::postMessage(hwnd, msg);
+		vReplayed.push_back(msg);
+	}
+};
+
+static std::vector<GestureMessage> NonMoveMessages(const std::vector<GestureMessage>& vMessages) {
+	std::vector<GestureMessage> vResult;
+	for (const GestureMessage& msg : vMessages) {
+		if (msg.message != GMSG_MOUSEMOVE)
+			vResult.push_back(msg);
+	}
+	return vResult;
+}
+
+/* Stays undecided on every button and wheel message, like a script waiting for a chord */
+class UndecidedHandler : public GestureHandlerT<UndecidedHandler> {
+public:
+	static const char* getName() { return "undecided"; }
+	static const HookCounterId STATS_COUNTER = HC_ForwardedScript;
+	uint32_t getIdleInterest() const { return INTEREST_MOUSE; }
+	MessageHandleResult handleMessageInternal(const GestureMessage& msg) {
+		if (getState() == GS_None) {
+			setState(GS_Initiated);
+			return MHR_Initiated;
+		}
+		return MHR_Swallowed;
+	}
+};
+
+static bool SameMessages(const std::vector<GestureMessage>& vLeft, const std::vector<GestureMessage>& vRight) {
+	if (vLeft.size() != vRight.size())
+		return false;
+	for (size_t i = 0; i < vLeft.size(); i++) {
+		if (vLeft[i].message != vRight[i].message || vLeft[i].wParam != vRight[i].wParam || vLeft[i].lParam != vRight[i].lParam)
+			return false;
+	}
+	return true;
+}
+
+/* More button and wheel messages than the buffer holds must all be replayed, in order, when the gesture gives up */
+static bool CheckNoClickLost() {
+	MessageStreamBuilder builder;
+	builder.clickAndScroll(GestureMessageBuffer::CAPACITY + 4);
+	std::vector<GestureMessage> vClicks = NonMoveMessages(builder.messages());
+
+	GestureMessageBuffer buffer;
+	for (int i = 0; i < GestureMessageBuffer::CAPACITY; i++) {
+		if (!buffer.push(vClicks[i]) || buffer.isFull() != (i + 1 == GestureMessageBuffer::CAPACITY))
+			return false;
+	}
+	if (buffer.push(vClicks[GestureMessageBuffer::CAPACITY]))
+		return false;
+	std::vector<GestureMessage> vKept;
+	for (int i = 0; i < buffer.size(); i++)
+		vKept.push_back(buffer[i]);
+	if (!SameMessages(vKept, std::vector<GestureMessage>(vClicks.begin(), vClicks.begin() + GestureMessageBuffer::CAPACITY)))
+		return false;
+
+	// what reached the plugin, either passed through or replayed after a cancel
+	for (const std::vector<GestureMessage>& vMessages : { vClicks, builder.messages() }) {
+		UndecidedHandler handler;
+		RecordingForwarder forwarder;
+		for (const GestureMessage& msg : vMessages) {
+			MessageHandleResult res = handler.handleMessage(msg);
+			if (res == MHR_Canceled) {
+				handler.forwardAllOrigin(forwarder, msg.hwnd);
+				handler.reset();
+			} else if (!handler.shouldSwallow(res)) {
+				forwarder.vReplayed.push_back(msg);
+			}
+		}
+		handler.forwardAllOrigin(forwarder, BENCH_HWND_PLUGIN);
+		if (!SameMessages(NonMoveMessages(forwarder.vReplayed), vClicks))
+			return false;
+	}
+	return true;
+}
+
+template <class Handlers>
+static double MeasureGesture(const std::vector<GestureMessage>& vMessages, int nRuns, RecordingForwarder& forwarder) {
+	static const char* const aszTrace[] = { "trace" };
+	return BenchBestOf(nRuns, [&]() {
+		Handlers handlers;
+		handlers.setEnabledGestures(aszTrace, 1);
+		forwarder.vReplayed.clear();
+		for (const GestureMessage& msg : vMessages)
+			handlers.handleMouseMessage(forwarder, BENCH_HWND_FIREFOX, msg);
+	});
+}
+
+int main() {
+	const int nRuns = 9;
+	const int aJiggles[] = { 10, 100, 1000, 10000, 100000 };
+
+	printf("%-10s %14s %14s %14s %14s\n", "moves", "before us", "after us", "replayed bef", "replayed aft");
+	for (int nJiggles : aJiggles) {
+		MessageStreamBuilder builder;
+		builder.deadZoneJiggle(nJiggles);
+		// key state changes in between must split coalesced runs without reordering anything
+		MessageStreamBuilder shifted;
+		shifted.deadZoneJiggle(nJiggles);
+		std::vector<GestureMessage> vMessages = shifted.messages();
+		for (size_t i = 1; i + 1 < vMessages.size(); i += 7)
+			vMessages[i].wParam |= GMK_SHIFT;
+
+		RecordingForwarder before, after;
+		double nsBefore = MeasureGesture<legacy::GestureHandlers>(builder.messages(), nRuns, before);
+		double nsAfter = MeasureGesture<GestureHandlers>(builder.messages(), nRuns, after);
+		printf("%-10d %14.2f %14.2f %14zu %14zu\n", nJiggles, nsBefore / 1000, nsAfter / 1000,
+			   before.vReplayed.size(), after.vReplayed.size());
+
+		RecordingForwarder shiftedBefore, shiftedAfter;
+		MeasureGesture<legacy::GestureHandlers>(vMessages, 1, shiftedBefore);
+		MeasureGesture<GestureHandlers>(vMessages, 1, shiftedAfter);
+		std::vector<GestureMessage> vNonMoveBefore = NonMoveMessages(shiftedBefore.vReplayed);
+		std::vector<GestureMessage> vNonMoveAfter = NonMoveMessages(shiftedAfter.vReplayed);
+		bool bSameOrder = vNonMoveBefore.size() == vNonMoveAfter.size();
+		for (size_t i = 0; bSameOrder && i < vNonMoveBefore.size(); i++) {
+			bSameOrder = vNonMoveBefore[i].message == vNonMoveAfter[i].message
+				&& vNonMoveBefore[i].wParam == vNonMoveAfter[i].wParam;
+		}
+		if (!bSameOrder || shiftedAfter.vReplayed.size() > GestureMessageBuffer::CAPACITY
+			|| shiftedAfter.vReplayed.back().lParam != shiftedBefore.vReplayed.back().lParam) {
+			printf("buffer changed the order of button messages or lost the final message\n");
+			return 1;
+		}
+	}
+	if (!CheckNoClickLost()) {
+		printf("buffer lost button or wheel messages when it ran full\n");
+		return 1;
+	}
+	return 0;
+}
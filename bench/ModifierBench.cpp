@@ -0,0 +1,222 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Modifier tracking: replays AltGr, Alt-tap and Ctrl+Wheel sequences through ModifierTracker and
+// checks what reaches firefox, then counts the keyboard state queries (GetKeyState calls in the
+// hook dll) for a typing session against the three per key press the hook used to make.
+
+#include "BenchUtil.h"
+#include "HotkeyRules.h"
+#include "ModifierTracker.h"
+
+/* The true keyboard state, as GetKeyState would report it */
+class FakeKeyboard : public KeyStateSource {
+public:
+	bool abDown[256];
+	size_t nQueries;
+
+	FakeKeyboard() : nQueries(0) { memset(abDown, 0, sizeof(abDown)); }
+	bool isKeyDown(int keyCode) {
+		nQueries++;
+		return abDown[keyCode & 0xff];
+	}
+};
+
+const int SCAN_LCTRL = 0x1D, SCAN_LALT = 0x38, SCAN_LSHIFT = 0x2A, SCAN_RSHIFT = 0x36;
+const intptr_t EXTENDED = 0x01000000;
+
+/* Feeds key messages to a tracker the way GetMsgHook does and collects what it forwards */
+class KeySession {
+public:
+	FakeKeyboard keyboard;
+	ModifierTracker tracker;
+	HotkeyRules rules;
+	uint32_t time;
+	std::vector<GestureMessage> vPosted;
+	size_t nFilterCalls;
+
+	KeySession() : time(1000), nFilterCalls(0) { memset(m_abSides, 0, sizeof(m_abSides)); }
+
+	/* Returns true if the message was swallowed */
+	bool key(unsigned int message, int keyCode, int scanCode, bool bExtended = false, GestureWindow hwnd = BENCH_HWND_PLUGIN) {
+		bool bDown = message == GMSG_KEYDOWN || message == GMSG_SYSKEYDOWN;
+		keyboard.abDown[keyCode] = bDown;
+		if (keyCode == GVK_CONTROL || keyCode == GVK_MENU || keyCode == GVK_SHIFT) {
+			// GetKeyState reports the combined state of both keys
+			int side = bExtended || scanCode == SCAN_RSHIFT ? 1 : 0;
+			m_abSides[keyCode][side] = bDown;
+			keyboard.abDown[keyCode] = m_abSides[keyCode][0] || m_abSides[keyCode][1];
+		}
+		intptr_t lParam = (static_cast<intptr_t>(scanCode) << 16) | (bExtended ? EXTENDED : 0) | 1;
+		GestureMessage msg = { hwnd, message, static_cast<uintptr_t>(keyCode), lParam };
+		time += 30;
+		tracker.onKeyMessage(keyboard, msg, time);
+		if (message != GMSG_KEYDOWN && message != GMSG_SYSKEYDOWN && message != GMSG_SYSKEYUP)
+			return false;
+		nFilterCalls++;
+		KeyDecision decision = tracker.filterKey(msg, rules);
+		if (decision.bPostPendingAlt)
+			vPosted.push_back(decision.pendingAltDown);
+		if (decision.bForward)
+			vPosted.push_back(msg);
+		return decision.bForward;
+	}
+	/* Returns true if Ctrl+Wheel zooming would forward the wheel message */
+	bool wheel(uintptr_t keys) {
+		GestureMessage msg = { BENCH_HWND_PLUGIN, GMSG_MOUSEWHEEL, keys | (static_cast<uintptr_t>(120) << 16), 0 };
+		time += 30;
+		tracker.onMouseMessage(msg);
+		return tracker.isCtrlDown();
+	}
+private:
+	/* left and right key of each modifier */
+	bool m_abSides[256][2];
+};
+
+#define CHECK(expr) do { if (!(expr)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); return false; } } while (0)
+
+static bool CheckAltTap() {
+	KeySession session;
+	CHECK(!session.key(GMSG_SYSKEYDOWN, GVK_MENU, SCAN_LALT));
+	CHECK(session.vPosted.empty());
+	// the held back Alt down goes out with the Alt up, so firefox opens its menu bar
+	CHECK(session.key(GMSG_SYSKEYUP, GVK_MENU, SCAN_LALT));
+	CHECK(session.vPosted.size() == 2);
+	CHECK(session.vPosted[0].message == GMSG_SYSKEYDOWN && session.vPosted[0].wParam == GVK_MENU);
+	CHECK(session.vPosted[1].message == GMSG_SYSKEYUP && session.vPosted[1].wParam == GVK_MENU);
+	// Alt+D goes to firefox, the pending Alt down is dropped once Ctrl shows up
+	session.vPosted.clear();
+	session.key(GMSG_SYSKEYDOWN, GVK_MENU, SCAN_LALT);
+	CHECK(session.key(GMSG_SYSKEYDOWN, 'D', 0x20));
+	session.key(GMSG_KEYDOWN, GVK_CONTROL, SCAN_LCTRL);
+	session.key(GMSG_KEYUP, GVK_CONTROL, SCAN_LCTRL);
+	session.key(GMSG_SYSKEYUP, GVK_MENU, SCAN_LALT);
+	for (const GestureMessage& msg : session.vPosted)
+		CHECK(!(msg.message == GMSG_SYSKEYDOWN && msg.wParam == GVK_MENU));
+	return true;
+}
+
+static bool CheckAltGr() {
+	KeySession session;
+	// AltGr arrives as a left Ctrl down followed by a right Alt down
+	CHECK(!session.key(GMSG_KEYDOWN, GVK_CONTROL, SCAN_LCTRL));
+	CHECK(!session.key(GMSG_KEYDOWN, GVK_MENU, SCAN_LALT, true));
+	CHECK(!session.key(GMSG_KEYDOWN, 'Q', 0x10)); // @ on a German layout
+	CHECK(!session.key(GMSG_KEYDOWN, 'E', 0x12)); // euro sign
+	CHECK(!session.key(GMSG_SYSKEYUP, GVK_CONTROL, SCAN_LCTRL));
+	CHECK(!session.key(GMSG_KEYUP, GVK_MENU, SCAN_LALT, true));
+	CHECK(session.vPosted.empty());
+	// Ctrl+Alt+R is the one AltGr combination firefox wants
+	session.key(GMSG_KEYDOWN, GVK_CONTROL, SCAN_LCTRL);
+	session.key(GMSG_KEYDOWN, GVK_MENU, SCAN_LALT, true);
+	CHECK(session.key(GMSG_KEYDOWN, 'R', 0x13));
+	// releasing the right Alt keeps Ctrl down
+	session.key(GMSG_KEYUP, GVK_MENU, SCAN_LALT, true);
+	CHECK(session.tracker.isCtrlDown() && !session.tracker.isAltDown());
+	return true;
+}
+
+static bool CheckCtrlWheel() {
+	KeySession session;
+	CHECK(!session.wheel(0));
+	session.key(GMSG_KEYDOWN, GVK_CONTROL, SCAN_LCTRL);
+	CHECK(session.wheel(GMK_CONTROL));
+	session.key(GMSG_KEYUP, GVK_CONTROL, SCAN_LCTRL);
+	CHECK(!session.wheel(0));
+	// the Ctrl up went to another thread's window: the wheel's own key state corrects it
+	session.key(GMSG_KEYDOWN, GVK_CONTROL, SCAN_LCTRL);
+	CHECK(!session.wheel(0));
+	CHECK(!session.tracker.isCtrlDown());
+	return true;
+}
+
+static bool CheckBothShiftKeys() {
+	KeySession session;
+	session.key(GMSG_KEYDOWN, GVK_SHIFT, SCAN_LSHIFT);
+	session.key(GMSG_KEYDOWN, GVK_SHIFT, SCAN_RSHIFT);
+	session.key(GMSG_KEYUP, GVK_SHIFT, SCAN_RSHIFT);
+	CHECK(session.tracker.isShiftDown());
+	session.key(GMSG_KEYUP, GVK_SHIFT, SCAN_LSHIFT);
+	CHECK(!session.tracker.isShiftDown());
+	return true;
+}
+
+static bool CheckResync() {
+	KeySession session;
+	session.key(GMSG_KEYDOWN, GVK_CONTROL, SCAN_LCTRL);
+	// Ctrl was released while another thread had the focus, the next key press comes much later
+	session.keyboard.abDown[GVK_CONTROL] = false;
+	session.time += ModifierTracker::RESYNC_INTERVAL_MS * 4;
+	CHECK(!session.key(GMSG_KEYDOWN, 'T', 0x14));
+	CHECK(!session.tracker.isCtrlDown());
+	// same for a key press in another window right away
+	session.key(GMSG_KEYDOWN, GVK_CONTROL, SCAN_LCTRL);
+	session.keyboard.abDown[GVK_CONTROL] = false;
+	CHECK(!session.key(GMSG_KEYDOWN, 'T', 0x14, false, BENCH_HWND_PLUGIN + 1));
+	return true;
+}
+
+static bool CheckThreadsIndependent() {
+	// the pending Alt down used to be a process-wide static
+	KeySession thread1, thread2;
+	thread1.key(GMSG_SYSKEYDOWN, GVK_MENU, SCAN_LALT);
+	thread2.key(GMSG_KEYDOWN, GVK_CONTROL, SCAN_LCTRL);
+	thread1.key(GMSG_SYSKEYUP, GVK_MENU, SCAN_LALT);
+	CHECK(thread1.vPosted.size() == 2);
+	return true;
+}
+
+int main() {
+	if (!CheckAltTap() || !CheckAltGr() || !CheckCtrlWheel() || !CheckBothShiftKeys() || !CheckResync() ||
+		!CheckThreadsIndependent())
+		return 1;
+	printf("AltGr, Alt-tap, Ctrl+Wheel, shift pair, resync and per-thread checks passed\n\n");
+
+	// a typing session: words, shortcuts and wheel zooming, with a short pause after each word
+	KeySession session;
+	BenchRandom random;
+	size_t nWheels = 0;
+	for (int iWord = 0; iWord < 2000; iWord++) {
+		switch (random.range(0, 9)) {
+		case 0:
+			session.key(GMSG_KEYDOWN, GVK_CONTROL, SCAN_LCTRL);
+			session.key(GMSG_KEYDOWN, "CVXZT"[random.range(0, 4)], 0x2E);
+			session.key(GMSG_KEYUP, GVK_CONTROL, SCAN_LCTRL);
+			break;
+		case 1:
+			session.key(GMSG_KEYDOWN, GVK_CONTROL, SCAN_LCTRL);
+			for (int i = 0; i < 3; i++, nWheels++)
+				session.wheel(GMK_CONTROL);
+			session.key(GMSG_KEYUP, GVK_CONTROL, SCAN_LCTRL);
+			break;
+		default:
+			for (int i = random.range(2, 8); i > 0; i--) {
+				int keyCode = random.range('A', 'Z');
+				session.key(GMSG_KEYDOWN, keyCode, 0x1E);
+				session.key(GMSG_KEYUP, keyCode, 0x1E);
+			}
+			break;
+		}
+		session.time += random.range(100, 2000);
+	}
+	// GetKeyState for Alt, Ctrl and Shift on every filtered key message, plus Ctrl on every wheel
+	size_t nBefore = 3 * session.nFilterCalls + nWheels;
+	printf("%-32s %12s\n", "typing session", "GetKeyState");
+	printf("%-32s %12zu\n", "per key press (before)", nBefore);
+	printf("%-32s %12zu\n", "modifier tracker", session.keyboard.nQueries);
+	return 0;
+}
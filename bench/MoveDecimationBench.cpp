@@ -0,0 +1,304 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Moves forwarded to firefox during triggered gestures, every move versus decimated.
+// Gestures are recorded from a synthetic 1000 Hz mouse: strokes with corners, curves and pauses
+// at slow, normal and fast hand speeds, one report per millisecond. Fidelity is how far the raw
+// path strays from the polyline of forwarded positions, which must stay within minDistance.
+// The final position and every button message must always reach firefox.
+
+#include "BenchUtil.h"
+#include "GestureHandler.h"
+#include "MoveDecimator.h"
+
+#include <cmath>
+
+struct TimedMessage {
+	GestureMessage msg;
+	uint32_t time;
+};
+
+/* Records what reaches firefox, in origin coordinates */
+class RecordingForwarder : public CountingForwarder {
+public:
+	std::vector<GestureMessage> vMessages;
+
+	void postMessage(GestureWindow hwnd, const GestureMessage& msg) {
+		CountingForwarder::postMessage(hwnd, msg);
+		GestureMessage msgOrigin = msg;
+		GesturePoint pt = msg.getPoint();
+		pt.x -= 100;
+		pt.y -= 200;
+		msgOrigin.lParam = pt.toLParam();
+		vMessages.push_back(msgOrigin);
+	}
+};
+
+/* A mouse reporting every millisecond while a hand drags it along waypoints */
+class Mouse1000Hz {
+private:
+	BenchRandom m_random;
+	std::vector<TimedMessage> m_vMessages;
+	double m_x, m_y;
+	uint32_t m_time;
+
+	void report(unsigned int message, uintptr_t wParam) {
+		GesturePoint pt = { static_cast<int>(std::lround(m_x)), static_cast<int>(std::lround(m_y)) };
+		TimedMessage timed = { { BENCH_HWND_PLUGIN, message, wParam, pt.toLParam() }, m_time };
+		m_vMessages.push_back(timed);
+	}
+public:
+	explicit Mouse1000Hz(uint32_t seed) : m_random(seed), m_x(400), m_y(400), m_time(1000) {}
+
+	/* Straight to (x, y) at speed px/ms, only reporting when the sensor position changes */
+	void moveTo(double x, double y, double speed) {
+		double length = std::hypot(x - m_x, y - m_y);
+		int nSteps = static_cast<int>(length / speed);
+		double dx = (x - m_x) / (nSteps + 1), dy = (y - m_y) / (nSteps + 1);
+		for (int i = 0; i <= nSteps; i++) {
+			GesturePoint ptBefore = { static_cast<int>(std::lround(m_x)), static_cast<int>(std::lround(m_y)) };
+			m_x += dx;
+			m_y += dy;
+			m_time++;
+			if (std::lround(m_x) != ptBefore.x || std::lround(m_y) != ptBefore.y)
+				report(GMSG_MOUSEMOVE, GMK_RBUTTON);
+		}
+	}
+	/* Held still for ms with a one pixel tremor now and then */
+	void pause(int ms) {
+		for (int i = 0; i < ms; i++) {
+			m_time++;
+			if (m_random.range(0, 9) == 0) {
+				m_x += m_random.range(-1, 1);
+				m_y += m_random.range(-1, 1);
+				report(GMSG_MOUSEMOVE, GMK_RBUTTON);
+			}
+		}
+	}
+	void arc(double cx, double cy, double radius, double fromAngle, double toAngle, double speed) {
+		int nPieces = 24;
+		for (int i = 1; i <= nPieces; i++) {
+			double a = fromAngle + (toAngle - fromAngle) * i / nPieces;
+			moveTo(cx + radius * std::cos(a), cy + radius * std::sin(a), speed);
+		}
+	}
+	void press() {
+		m_time += 50;
+		report(GMSG_RBUTTONDOWN, GMK_RBUTTON);
+	}
+	void release() {
+		m_time += 5;
+		report(GMSG_RBUTTONUP, 0);
+		m_time += 200;
+	}
+	double x() const { return m_x; }
+	double y() const { return m_y; }
+	const std::vector<TimedMessage>& messages() const { return m_vMessages; }
+};
+
+static std::vector<TimedMessage> RecordGestures(double speed, int nGestures) {
+	Mouse1000Hz mouse(static_cast<uint32_t>(speed * 1000) + 1);
+	const double pi = 3.14159265358979;
+	for (int i = 0; i < nGestures; i++) {
+		double x = mouse.x(), y = mouse.y();
+		mouse.press();
+		switch (i % 4) {
+		case 0:
+			// down, then right
+			mouse.moveTo(x, y + 150, speed);
+			mouse.moveTo(x + 150, y + 150, speed);
+			mouse.moveTo(x, y, speed * 2);
+			break;
+		case 1:
+			// a circle
+			mouse.moveTo(x + 80, y, speed);
+			mouse.arc(x, y, 80, 0, 2 * pi, speed);
+			mouse.moveTo(x, y, speed * 2);
+			break;
+		case 2:
+			// up and back down with a pause at the top
+			mouse.moveTo(x, y - 120, speed);
+			mouse.pause(150);
+			mouse.moveTo(x + 5, y, speed);
+			mouse.moveTo(x, y, speed);
+			break;
+		default:
+			// a zigzag with sharp corners
+			for (int j = 0; j < 4; j++)
+				mouse.moveTo(x + (j + 1) * 30, y + (j & 1 ? 0 : 40), speed);
+			mouse.moveTo(x, y, speed * 2);
+			break;
+		}
+		mouse.release();
+	}
+	return mouse.messages();
+}
+
+static double DistanceToSegment(GesturePoint pt, GesturePoint a, GesturePoint b) {
+	double dx = b.x - a.x, dy = b.y - a.y;
+	double lengthSquared = dx * dx + dy * dy;
+	double t = lengthSquared ? ((pt.x - a.x) * dx + (pt.y - a.y) * dy) / lengthSquared : 0;
+	t = t < 0 ? 0 : t > 1 ? 1 : t;
+	return std::hypot(pt.x - (a.x + t * dx), pt.y - (a.y + t * dy));
+}
+
+struct DecimationResult {
+	size_t nMoves;
+	size_t nForwardedMoves;
+	double maxDeviation;
+	double meanDeviation;
+	double nsPerMessage;
+};
+
+static bool Replay(const std::vector<TimedMessage>& vRecorded, const MoveDecimation* pDecimation, DecimationResult& result) {
+	GestureHandlers handlers;
+	const char* const aszTrace[] = { "trace" };
+	handlers.setEnabledGestures(aszTrace, 1);
+	handlers.setMoveDecimation(pDecimation);
+	RecordingForwarder forwarder;
+	for (const TimedMessage& timed : vRecorded)
+		handlers.handleMouseMessage(forwarder, BENCH_HWND_FIREFOX, timed.msg, timed.time);
+
+	// the forwarded messages are a subsequence of the recorded ones, walk both together
+	result.nMoves = 0;
+	result.nForwardedMoves = 0;
+	result.maxDeviation = 0;
+	double sumDeviation = 0;
+	// moves are counted from the first position a gesture forwards, the dead zone before it is not decimated
+	size_t iForwarded = 0;
+	bool bHaveLast = false;
+	GesturePoint ptLast = {};
+	std::vector<GesturePoint> vSkipped;
+	for (const TimedMessage& timed : vRecorded) {
+		const GestureMessage& msg = timed.msg;
+		bool bForwarded = iForwarded < forwarder.vMessages.size() && forwarder.vMessages[iForwarded].message == msg.message &&
+						  forwarder.vMessages[iForwarded].lParam == msg.lParam;
+		if (msg.message != GMSG_MOUSEMOVE) {
+			if (msg.message == GMSG_RBUTTONUP && !bForwarded) {
+				printf("button up not forwarded\n");
+				return false;
+			}
+			if (msg.message == GMSG_RBUTTONUP && !vSkipped.empty()) {
+				printf("final position not forwarded before the button up\n");
+				return false;
+			}
+			bHaveLast = false;
+			vSkipped.clear();
+		} else if (bHaveLast) {
+			result.nMoves++;
+			if (!bForwarded)
+				vSkipped.push_back(msg.getPoint());
+		}
+		if (!bForwarded)
+			continue;
+		iForwarded++;
+		if (msg.message != GMSG_MOUSEMOVE)
+			continue;
+		GesturePoint pt = msg.getPoint();
+		if (bHaveLast) {
+			result.nForwardedMoves++;
+			for (GesturePoint ptSkipped : vSkipped) {
+				double deviation = DistanceToSegment(ptSkipped, ptLast, pt);
+				sumDeviation += deviation;
+				result.maxDeviation = deviation > result.maxDeviation ? deviation : result.maxDeviation;
+			}
+		}
+		vSkipped.clear();
+		ptLast = pt;
+		bHaveLast = true;
+	}
+	if (iForwarded != forwarder.vMessages.size()) {
+		printf("forwarded messages are not a subsequence of the recorded ones\n");
+		return false;
+	}
+	result.meanDeviation = result.nMoves ? sumDeviation / result.nMoves : 0;
+
+	GestureHandlers timed;
+	timed.setEnabledGestures(aszTrace, 1);
+	timed.setMoveDecimation(pDecimation);
+	CountingForwarder counting;
+	double ns = BenchBestOf(7, [&]() {
+		for (const TimedMessage& recorded : vRecorded)
+			timed.handleMouseMessage(counting, BENCH_HWND_FIREFOX, recorded.msg, recorded.time);
+	});
+	result.nsPerMessage = ns / vRecorded.size();
+	return true;
+}
+
+struct Policy {
+	const char* szName;
+	int minDistance;
+	uint32_t msMaxInterval;
+};
+
+static const Policy s_aPolicies[] = {
+	{ "every move", 0, 0 },
+	{ "2 px, 8 ms", 2, 8 },
+	{ "4 px, 16 ms", 4, 16 },
+	{ "8 px, 16 ms", 8, 16 },
+	{ "16 px, 33 ms", 16, 33 },
+};
+
+static bool CheckConfig() {
+	MoveDecimation decimation;
+	MoveDecimationConfig config = decimation.get();
+	if (config.minDistance != 0 || !decimation.set(12, 500) || decimation.set(-1, 10) ||
+		decimation.set(MoveDecimation::MAX_DISTANCE + 1, 10) || decimation.set(4, MoveDecimation::MAX_INTERVAL_MS + 1)) {
+		printf("move decimation range checks failed\n");
+		return false;
+	}
+	config = decimation.get();
+	if (config.minDistance != 12 || config.msMaxInterval != 500) {
+		printf("move decimation read back %d px, %u ms\n", config.minDistance, config.msMaxInterval);
+		return false;
+	}
+	return true;
+}
+
+int main() {
+	if (!CheckConfig())
+		return 1;
+
+	const double aSpeeds[] = { 0.3, 1.5, 4.0 };
+	const char* const aszSpeeds[] = { "slow", "normal", "fast" };
+	for (int iSpeed = 0; iSpeed < 3; iSpeed++) {
+		std::vector<TimedMessage> vRecorded = RecordGestures(aSpeeds[iSpeed], 40);
+		uint32_t msRecorded = vRecorded.back().time - vRecorded.front().time;
+		printf("\n%s hand, %.1f px/ms (%zu messages in %.1f s)\n", aszSpeeds[iSpeed], aSpeeds[iSpeed], vRecorded.size(),
+			   msRecorded / 1000.0);
+		printf("%-14s %10s %10s %12s %12s %10s\n", "policy", "moves", "moves/sec", "max dev px", "mean dev px", "ns/msg");
+		for (const Policy& policy : s_aPolicies) {
+			MoveDecimation decimation;
+			decimation.set(policy.minDistance, policy.msMaxInterval);
+			DecimationResult result;
+			if (!Replay(vRecorded, &decimation, result))
+				return 1;
+			printf("%-14s %10zu %10.0f %12.2f %12.3f %10.2f\n", policy.szName, result.nForwardedMoves,
+				   1000.0 * result.nForwardedMoves / msRecorded, result.maxDeviation, result.meanDeviation,
+				   result.nsPerMessage);
+			if (policy.minDistance && result.maxDeviation >= policy.minDistance) {
+				printf("path strays %.2f px from what firefox saw\n", result.maxDeviation);
+				return 1;
+			}
+			if (!policy.minDistance && result.nForwardedMoves != result.nMoves) {
+				printf("moves were dropped without decimation\n");
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
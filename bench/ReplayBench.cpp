@@ -0,0 +1,181 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Corpus replay: replays a synthetic corpus of sessions of different sizes and thread counts, one
+// of them truncated, through the current gestures and three candidates: the same configuration,
+// which must not differ at all, the trace gesture as a script with a larger dead zone, which starts
+// forwarding strokes later, and move decimation, which forwards fewer moves but swallows the same
+// messages. The merged report must not depend on the number of workers. Then measures how the replay scales with the workers.
+
+#include "InputTraceReplay.h"
+
+// the trace handler's state machine with a 20 px dead zone instead of 10
+static const char s_szWideTrace[] =
+	"gesture trace\n"
+	"  idle:\n"
+	"    rdown: initiate armed\n"
+	"  armed:\n"
+	"    move +R >20: trigger drawing\n"
+	"    move +R: swallow\n"
+	"    rdown rdblclk: discard\n"
+	"    any: cancel\n"
+	"  drawing:\n"
+	"    move +R: swallow\n"
+	"    any: end\n";
+
+struct Corpus {
+	std::vector<std::vector<uint8_t> > vTraces;
+	std::vector<ReplaySession> vSessions;
+	std::vector<std::string> vNames;
+	size_t nMessages;
+};
+
+static void BuildCorpus(Corpus& corpus, int nSessions) {
+	corpus.nMessages = 0;
+	corpus.vTraces.resize(nSessions);
+	for (int i = 0; i < nSessions; i++) {
+		size_t nMessages = 10000 + (i * 7919 % 40) * 2500;
+		std::vector<uint8_t>& vTrace = corpus.vTraces[i];
+		SynthesizeInputTrace(nMessages, 1 + i % 4, 100 + i, [&](const std::vector<uint8_t>& vBytes) {
+			vTrace.insert(vTrace.end(), vBytes.begin(), vBytes.end());
+		}, [](uint32_t, const GestureMessage&, uint32_t) {});
+		// the last session was cut off in the middle of a record
+		if (i == nSessions - 1)
+			vTrace.resize(vTrace.size() / 2 + 3);
+		else
+			corpus.nMessages += nMessages;
+	}
+	for (int i = 0; i < nSessions; i++) {
+		char szName[32];
+		snprintf(szName, sizeof(szName), "session %d", i);
+		corpus.vNames.push_back(szName);
+		ReplaySession session = { szName, &corpus.vTraces[i][0], corpus.vTraces[i].size() };
+		corpus.vSessions.push_back(session);
+	}
+}
+
+static ReplayConfig Gestures(const char* szGestures) {
+	ReplayConfig config;
+	for (const char* sz = szGestures; *sz;) {
+		const char* szEnd = strchr(sz, ',');
+		if (!szEnd)
+			szEnd = sz + strlen(sz);
+		config.vGestures.push_back(std::string(sz, szEnd));
+		sz = *szEnd ? szEnd + 1 : szEnd;
+	}
+	return config;
+}
+
+/* Replays with 1 and with several workers, which must agree */
+static bool Replay(const Corpus& corpus, const ReplayConfig aConfigs[2], const char* szName, ReplayReport& report) {
+	report = ReplayCorpus(corpus.vSessions, aConfigs, 1);
+	ReplayReport parallel = ReplayCorpus(corpus.vSessions, aConfigs, 7);
+	if (!report.sameDecisions(parallel)) {
+		printf("%s: the report depends on the number of workers\n", szName);
+		return false;
+	}
+	if (report.nSessions != corpus.vSessions.size() || report.nCorruptSessions != 1 ||
+		report.nMessages < corpus.nMessages) {
+		printf("%s: %llu sessions, %llu corrupt, %llu messages replayed\n", szName,
+			   static_cast<unsigned long long>(report.nSessions), static_cast<unsigned long long>(report.nCorruptSessions),
+			   static_cast<unsigned long long>(report.nMessages));
+		return false;
+	}
+	printf("== %s\n", szName);
+	report.print(corpus.vNames, 3);
+	printf("\n");
+	return true;
+}
+
+static bool CheckCandidates(const Corpus& corpus) {
+	ReplayReport report;
+	ReplayConfig aSame[2] = { Gestures("trace,rocker,wheel"), Gestures("trace,rocker,wheel") };
+	if (!Replay(corpus, aSame, "unchanged configuration", report))
+		return false;
+	if (report.nDiffs || !report.vDiffs.empty() || !report.aSwallowed[RS_Baseline] || !report.aForwarded[RS_Baseline]) {
+		printf("unchanged configuration: %llu diffs\n", static_cast<unsigned long long>(report.nDiffs));
+		return false;
+	}
+
+	GestureScriptLibrary library;
+	std::string strError;
+	if (!library.load(s_szWideTrace, strError)) {
+		printf("%s\n", strError.c_str());
+		return false;
+	}
+	ReplayConfig aScript[2] = { Gestures("trace"), Gestures("script") };
+	aScript[RS_Candidate].pScripts = &library;
+	if (!Replay(corpus, aScript, "trace with a 20 px dead zone", report))
+		return false;
+	if (report.vDiffs.size() != ReplayReport::MAX_KEPT_DIFFS || report.aForwarded[RS_Candidate] >= report.aForwarded[RS_Baseline]) {
+		printf("wider dead zone: %llu diffs\n", static_cast<unsigned long long>(report.nDiffs));
+		return false;
+	}
+
+	MoveDecimation decimation;
+	decimation.set(8, 50);
+	ReplayConfig aDecimated[2] = { Gestures("trace,rocker,wheel"), Gestures("trace,rocker,wheel") };
+	aDecimated[RS_Candidate].pDecimation = &decimation;
+	if (!Replay(corpus, aDecimated, "move decimation 8 px, 50 ms", report))
+		return false;
+	if (!report.nDiffs || report.nSwallowDiffs || report.aSwallowed[RS_Baseline] != report.aSwallowed[RS_Candidate] ||
+		report.aForwarded[RS_Candidate] >= report.aForwarded[RS_Baseline]) {
+		printf("move decimation: %llu diffs, %llu swallowed differently\n", static_cast<unsigned long long>(report.nDiffs),
+			   static_cast<unsigned long long>(report.nSwallowDiffs));
+		return false;
+	}
+	return true;
+}
+
+static bool MeasureScaling(const Corpus& corpus) {
+	ReplayConfig aConfigs[2] = { Gestures("trace,rocker,wheel"), Gestures("trace,rocker,wheel") };
+	int nCores = static_cast<int>(std::thread::hardware_concurrency());
+	printf("%d cores\n%-8s %10s %14s %10s %12s %14s\n", nCores, "workers", "ms", "messages/s", "speedup", "efficiency",
+		   "stolen");
+	ReplayReport first;
+	double nsFirst = 0;
+	for (int nWorkers = 1; nWorkers <= std::max(8, nCores); nWorkers *= 2) {
+		std::vector<ReplayWorkerStats> vStats;
+		ReplayReport report;
+		double ns = BenchBestOf(3, [&]() { report = ReplayCorpus(corpus.vSessions, aConfigs, nWorkers, &vStats); });
+		uint32_t nSessions = 0, nStolen = 0;
+		for (const ReplayWorkerStats& stats : vStats) {
+			nSessions += stats.nSessions;
+			nStolen += stats.nStolen;
+		}
+		if (nWorkers == 1) {
+			first = report;
+			nsFirst = ns;
+		}
+		if (!report.sameDecisions(first) || nSessions != corpus.vSessions.size()) {
+			printf("%d workers replayed %u of %zu sessions, or decided differently\n", nWorkers, nSessions,
+				   corpus.vSessions.size());
+			return false;
+		}
+		// efficiency against the cores that can actually run the workers
+		double speedup = nsFirst / ns;
+		printf("%-8d %10.1f %14.0f %9.2fx %11.0f%% %14u\n", nWorkers, ns / 1e6, report.nMessages / (ns / 1e9), speedup,
+			   100.0 * speedup / std::max(1, std::min(nWorkers, nCores)), nStolen);
+	}
+	return true;
+}
+
+int main() {
+	Corpus corpus;
+	BuildCorpus(corpus, 48);
+	return CheckCandidates(corpus) && MeasureScaling(corpus) ? 0 : 1;
+}
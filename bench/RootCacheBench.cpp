@@ -0,0 +1,121 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Compares the uncached firefox window lookup with FirefoxRootCache, counting the window tree
+// calls (each one is a user32 round-trip in the hook dll) as well as the time per lookup.
+
+#include "BenchUtil.h"
+#include "FakeWindowTree.h"
+
+struct LookupMix {
+	const char* szName;
+	int nPlugins;
+	int nForeign;
+	int percentForeign;
+};
+
+static const LookupMix s_mixes[] = {
+	{ "1 plugin", 1, 0, 0 },
+	{ "4 plugins", 4, 0, 0 },
+	{ "4 plugins, 10% foreign", 4, 4, 10 },
+	{ "16 plugins (over capacity)", 16, 0, 0 },
+	{ "2 plugins, 50% foreign", 2, 8, 50 },
+};
+
+static std::vector<GestureWindow> BuildLookups(const BrowserWindowTree& browser, int percentForeign, size_t nLookups) {
+	BenchRandom random;
+	std::vector<GestureWindow> vLookups;
+	vLookups.reserve(nLookups);
+	GestureWindow hwndCurrent = browser.vPluginWindows[0];
+	for (size_t i = 0; i < nLookups; i++) {
+		// input arrives in runs for the window under the mouse
+		if (random.range(0, 31) == 0) {
+			if (random.range(0, 99) < percentForeign)
+				hwndCurrent = browser.vForeignWindows[random.range(0, static_cast<int>(browser.vForeignWindows.size()) - 1)];
+			else
+				hwndCurrent = browser.vPluginWindows[random.range(0, static_cast<int>(browser.vPluginWindows.size()) - 1)];
+		}
+		vLookups.push_back(hwndCurrent);
+	}
+	return vLookups;
+}
+
+int main() {
+	const int nRuns = 5;
+	const size_t nLookups = 1000000;
+
+	printf("%-30s %10s %10s %12s %12s %8s\n", "lookup mix", "ns/uncach", "ns/cached", "calls/uncach", "calls/cached", "hit %");
+	for (const LookupMix& mix : s_mixes) {
+		BrowserWindowTree browser(mix.nPlugins, mix.nForeign);
+		std::vector<GestureWindow> vLookups = BuildLookups(browser, mix.percentForeign, nLookups);
+
+		GestureWindow checksumUncached = 0;
+		browser.tree.nCalls = 0;
+		double nsUncached = BenchBestOf(nRuns, [&]() {
+			for (GestureWindow hwnd : vLookups)
+				checksumUncached += VerifyAndGetTopMozillaWindowClassWindow(browser.tree, hwnd);
+		});
+		double callsUncached = static_cast<double>(browser.tree.nCalls) / (nRuns * nLookups);
+
+		GestureWindow checksumCached = 0;
+		FirefoxRootCache cache;
+		browser.tree.nCalls = 0;
+		double nsCached = BenchBestOf(nRuns, [&]() {
+			for (GestureWindow hwnd : vLookups)
+				checksumCached += cache.resolve(browser.tree, hwnd);
+		});
+		double callsCached = static_cast<double>(browser.tree.nCalls) / (nRuns * nLookups);
+
+		if (checksumCached != checksumUncached) {
+			printf("%s: cached lookup disagrees with uncached lookup\n", mix.szName);
+			return 1;
+		}
+		double hitRate = 100.0 * cache.getHits() / (cache.getHits() + cache.getMisses());
+		printf("%-30s %10.2f %10.2f %12.2f %12.2f %8.2f\n", mix.szName,
+			   nsUncached / nLookups, nsCached / nLookups, callsUncached, callsCached, hitRate);
+	}
+
+	// Reparenting a plugin window into another browser window must be picked up on the next lookup
+	BrowserWindowTree browser(1, 0);
+	GestureWindow hwndOtherFirefox = browser.tree.addWindow(0, "MozillaWindowClass", true);
+	GestureWindow hwndOtherContent = browser.tree.addWindow(hwndOtherFirefox, "GeckoPluginWindow");
+	FirefoxRootCache cache;
+	GestureWindow hwndPlugin = browser.vPluginWindows[0];
+	GestureWindow hwndBefore = cache.resolve(browser.tree, hwndPlugin);
+	browser.tree.reparent(hwndPlugin, hwndOtherContent);
+	GestureWindow hwndAfter = cache.resolve(browser.tree, hwndPlugin);
+	if (hwndBefore != browser.hwndFirefox || hwndAfter != hwndOtherFirefox || cache.getInvalidations() != 1) {
+		printf("reparented window was not invalidated\n");
+		return 1;
+	}
+
+	// Tearing off a tab moves the plugin host, the window that receives the input keeps its parent
+	BrowserWindowTree tabs(1, 0);
+	GestureWindow hwndTornOff = tabs.tree.addWindow(0, "MozillaWindowClass", true);
+	GestureWindow hwndTornOffContent = tabs.tree.addWindow(hwndTornOff, "MozillaWindowClass", true);
+	FirefoxRootCache tabCache;
+	GestureWindow hwndInput = tabs.vPluginWindows[0];
+	GestureWindow hwndPluginHost = tabs.tree.getParent(tabs.tree.getParent(hwndInput));
+	hwndBefore = tabCache.resolve(tabs.tree, hwndInput);
+	tabs.tree.reparent(hwndPluginHost, hwndTornOffContent);
+	hwndAfter = tabCache.resolve(tabs.tree, hwndInput);
+	if (hwndBefore != tabs.hwndFirefox || hwndAfter != hwndTornOff || tabCache.getInvalidations() != 1) {
+		printf("window under a torn off plugin host was not invalidated\n");
+		return 1;
+	}
+	return 0;
+}
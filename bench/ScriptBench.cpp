@@ -0,0 +1,339 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Gestures compiled from scripts against the handlers they reimplement. The trace, rocker and wheel
+// handlers are written down as scripts below; each runs alone through the pipeline next to the
+// built-in handler on realistic and random streams, and both must swallow the same messages, pass
+// through the same states and forward the same messages to the same windows in the same order.
+// The random streams mix every mouse message with arbitrary button states and jumps of the pointer.
+// Throughput is per message through the whole pipeline, GetMsgHook's filtering included.
+
+#include "BenchUtil.h"
+#include "GestureHandler.h"
+
+#include <string>
+
+static const char s_szTrace[] =
+	"# right button drag, forwarded to firefox once it left a 10 px box\n"
+	"gesture trace\n"
+	"  idle:\n"
+	"    rdown: initiate armed\n"
+	"  armed:\n"
+	"    move +R >10: trigger drawing\n"
+	"    move +R: swallow\n"
+	"    rdown rdblclk: discard\n"
+	"    any: cancel\n"
+	"  drawing:\n"
+	"    move +R: swallow\n"
+	"    any: end\n";
+
+static const char s_szRocker[] =
+	"# one button held, the other one clicked; left->right leaves the plugin's messages alone\n"
+	"gesture rocker\n"
+	"  idle:\n"
+	"    ldown: initiate left\n"
+	"    rdown: initiate right\n"
+	"  left passthrough:\n"
+	"    move +L >10: cancel\n"
+	"    move +L: swallow\n"
+	"    rdown +L: trigger left-rocked\n"
+	"    ldown rdown ldblclk rdblclk: discard\n"
+	"    any: cancel\n"
+	"  left-rocked passthrough:\n"
+	"    rdown rup move +L: swallow\n"
+	"    any: end\n"
+	"  right:\n"
+	"    move +R >10: cancel\n"
+	"    move +R: swallow\n"
+	"    ldown +R: trigger right-rocked\n"
+	"    ldown rdown ldblclk rdblclk: discard\n"
+	"    any: cancel\n"
+	"  right-rocked:\n"
+	"    ldown lup move +R: swallow\n"
+	"    any: end\n";
+
+static const char s_szWheel[] =
+	"# wheel turned while the right button is held\n"
+	"gesture wheel\n"
+	"  idle:\n"
+	"    rdown: initiate held\n"
+	"  held:\n"
+	"    move +R >10: cancel\n"
+	"    move +R: swallow\n"
+	"    wheel +R: trigger scrolling\n"
+	"    rdown rdblclk: discard\n"
+	"    any: cancel\n"
+	"  scrolling:\n"
+	"    move wheel +R: swallow\n"
+	"    any: end\n";
+
+struct ScriptedGesture {
+	const char* szName;
+	const char* szScript;
+};
+
+static const ScriptedGesture s_aGestures[] = {
+	{ "trace", s_szTrace },
+	{ "rocker", s_szRocker },
+	{ "wheel", s_szWheel },
+};
+
+/* Everything the handlers asked user32 to do, in order */
+class RecordingForwarder : public CountingForwarder {
+public:
+	std::vector<std::string> vCalls;
+
+	void record(const char* szCall, GestureWindow hwnd, const GestureMessage& msg) {
+		char sz[96];
+		snprintf(sz, sizeof(sz), "%s %d %x %llx %llx", szCall, static_cast<int>(hwnd), msg.message,
+				 static_cast<unsigned long long>(msg.wParam), static_cast<unsigned long long>(msg.lParam));
+		vCalls.push_back(sz);
+	}
+	void sendMessage(GestureWindow hwnd, const GestureMessage& msg) { record("send", hwnd, msg); }
+	void postMessage(GestureWindow hwnd, const GestureMessage& msg) { record("post", hwnd, msg); }
+};
+
+/* Any mouse message with any buttons held, and now and then the pointer far away */
+static std::vector<GestureMessage> BuildRandomStream(uint32_t seed, size_t nMessages) {
+	static const unsigned int aMessages[] = {
+		GMSG_MOUSEMOVE, GMSG_MOUSEMOVE, GMSG_MOUSEMOVE, GMSG_MOUSEMOVE, GMSG_MOUSEMOVE, GMSG_LBUTTONDOWN,
+		GMSG_LBUTTONUP, GMSG_LBUTTONDBLCLK, GMSG_RBUTTONDOWN, GMSG_RBUTTONDOWN, GMSG_RBUTTONUP,
+		GMSG_RBUTTONDBLCLK, GMSG_MBUTTONDOWN, GMSG_MBUTTONUP, GMSG_MOUSEWHEEL, GMSG_KEYDOWN
+	};
+	const int nKinds = sizeof(aMessages) / sizeof(aMessages[0]);
+	BenchRandom random(seed);
+	std::vector<GestureMessage> vMessages;
+	GesturePoint pt = { 300, 300 };
+	uintptr_t buttons = 0;
+	for (size_t i = 0; i < nMessages; i++) {
+		unsigned int message = aMessages[random.range(0, nKinds - 1)];
+		// mostly consistent button states, sometimes not at all
+		if (message == GMSG_LBUTTONDOWN || message == GMSG_LBUTTONDBLCLK)
+			buttons |= GMK_LBUTTON;
+		else if (message == GMSG_RBUTTONDOWN || message == GMSG_RBUTTONDBLCLK)
+			buttons |= GMK_RBUTTON;
+		else if (message == GMSG_MBUTTONDOWN)
+			buttons |= GMK_MBUTTON;
+		else if (message == GMSG_LBUTTONUP)
+			buttons &= ~static_cast<uintptr_t>(GMK_LBUTTON);
+		else if (message == GMSG_RBUTTONUP)
+			buttons &= ~static_cast<uintptr_t>(GMK_RBUTTON);
+		else if (message == GMSG_MBUTTONUP)
+			buttons &= ~static_cast<uintptr_t>(GMK_MBUTTON);
+		if (random.range(0, 15) == 0)
+			buttons = static_cast<uintptr_t>(random.range(0, 31));
+		if (random.range(0, 9) == 0) {
+			pt.x += random.range(-40, 40);
+			pt.y += random.range(-40, 40);
+		} else {
+			pt.x += random.range(-4, 4);
+			pt.y += random.range(-4, 4);
+		}
+		uintptr_t wParam = buttons;
+		if (message == GMSG_MOUSEWHEEL)
+			wParam |= static_cast<uintptr_t>(random.range(0, 1) ? 120 : 0xff88) << 16;
+		GestureMessage msg = { BENCH_HWND_PLUGIN, message, wParam, pt.toLParam() };
+		vMessages.push_back(msg);
+	}
+	return vMessages;
+}
+
+static std::vector<GestureMessage> BuildRealisticStream() {
+	MessageStreamBuilder mixed(99);
+	for (int i = 0; i < 400; i++) {
+		mixed.idleMoves(20);
+		switch (mixed.random().range(0, 4)) {
+		case 0: mixed.traceStroke(30); break;
+		case 1: mixed.rockerClick(3); break;
+		case 2: mixed.wheelGesture(5); break;
+		case 3: mixed.deadZoneJiggle(10); break;
+		default: mixed.click(); break;
+		}
+	}
+	return mixed.messages();
+}
+
+template <class Handler>
+static GestureState GetHandlerState(const GestureHandlers& handlers);
+
+template <>
+GestureState GetHandlerState<TraceHandler>(const GestureHandlers& handlers) { return handlers.m_pipeline.head.getState(); }
+template <>
+GestureState GetHandlerState<RockerHandler>(const GestureHandlers& handlers) { return handlers.m_pipeline.tail.head.getState(); }
+template <>
+GestureState GetHandlerState<WheelHandler>(const GestureHandlers& handlers) { return handlers.m_pipeline.tail.tail.head.getState(); }
+
+static GestureState GetScriptState(const GestureHandlers& handlers) {
+	return handlers.m_pipeline.tail.tail.tail.head.getState();
+}
+
+/* Same filtering as GetMsgHook followed by ForwardFirefoxMouseMessage */
+static bool Replay(GestureHandlers& handlers, GestureForwarder& forwarder, const GestureMessage& msg, bool& bSwallowed) {
+	if (msg.message == GMSG_MOUSEMOVE && handlers.allInactive())
+		return false;
+	bSwallowed = handlers.handleMouseMessage(forwarder, BENCH_HWND_FIREFOX, msg);
+	return true;
+}
+
+template <class Handler>
+static bool CheckEquivalence(const ScriptedGesture& gesture, GestureScriptLibrary& library,
+							 const std::vector<GestureMessage>& vMessages, const char* szStream) {
+	GestureHandlers builtin, scripted;
+	const char* const aszBuiltin[] = { gesture.szName };
+	const char* const aszScripted[] = { "script" };
+	builtin.setEnabledGestures(aszBuiltin, 1);
+	scripted.setEnabledGestures(aszScripted, 1);
+	scripted.setScriptLibrary(&library);
+	RecordingForwarder builtinForwarder, scriptedForwarder;
+	for (size_t i = 0; i < vMessages.size(); i++) {
+		bool bBuiltinSwallowed = false, bScriptedSwallowed = false;
+		bool bBuiltinRan = Replay(builtin, builtinForwarder, vMessages[i], bBuiltinSwallowed);
+		bool bScriptedRan = Replay(scripted, scriptedForwarder, vMessages[i], bScriptedSwallowed);
+		if (bBuiltinRan != bScriptedRan || bBuiltinSwallowed != bScriptedSwallowed ||
+			GetHandlerState<Handler>(builtin) != GetScriptState(scripted) ||
+			builtinForwarder.vCalls.size() != scriptedForwarder.vCalls.size()) {
+			printf("%s, %s stream, message %zu (%x): built-in %s in state %d, script %s in state %d\n", gesture.szName, szStream, i,
+				   vMessages[i].message, bBuiltinSwallowed ? "swallowed" : "passed", GetHandlerState<Handler>(builtin),
+				   bScriptedSwallowed ? "swallowed" : "passed", GetScriptState(scripted));
+			return false;
+		}
+	}
+	if (builtinForwarder.vCalls.empty()) {
+		printf("%s, %s stream: the gesture never forwarded anything\n", gesture.szName, szStream);
+		return false;
+	}
+	if (builtinForwarder.vCalls != scriptedForwarder.vCalls) {
+		printf("%s, %s stream: forwarded messages differ\n", gesture.szName, szStream);
+		return false;
+	}
+	return true;
+}
+
+static double MeasureThroughput(const char* szGesture, const GestureScriptLibrary* pLibrary,
+								const std::vector<GestureMessage>& vMessages) {
+	GestureHandlers handlers;
+	const char* const aszGestures[] = { szGesture };
+	handlers.setEnabledGestures(aszGestures, 1);
+	handlers.setScriptLibrary(pLibrary);
+	CountingForwarder forwarder;
+	const int nPasses = 10;
+	double ns = BenchBestOf(5, [&]() {
+		for (int pass = 0; pass < nPasses; pass++) {
+			for (const GestureMessage& msg : vMessages) {
+				bool bSwallowed;
+				Replay(handlers, forwarder, msg, bSwallowed);
+			}
+		}
+	});
+	return ns / (nPasses * vMessages.size());
+}
+
+static bool CheckErrors() {
+	struct BadScript {
+		const char* szScript;
+		int line;
+	};
+	static const BadScript s_aBad[] = {
+		{ "idle:\n  rdown: initiate a\n", 1 },
+		{ "gesture g\n  idle:\n    rdown: initiate a\n", 3 },
+		{ "gesture g\n  idle:\n    rdown: initiate a\n  a:\n    any: end\n", 5 },
+		{ "gesture g\n  idle:\n    rdown: initiate a\n  a:\n    any: cancel\n    move: swallow\n", 6 },
+		{ "gesture g\n  idle:\n    rdown: initiate a\n  a:\n    move >5: cancel\n    move >6: cancel\n", 6 },
+		{ "gesture g\n  idle:\n    rdown: initiate a\n  a:\n    rdown: trigger a\n", 5 },
+		{ "gesture g\n  idle:\n    rdown: initiate a\n  a:\n    any: cancel\n  b:\n    any: end\n", 6 },
+		{ "gesture g\n  idle:\n    rdown: initiate a\n  a:\n    any: cancel\n"
+		  "gesture h\n  idle:\n    rdown +R: initiate a\n  a:\n    any: cancel\n", 8 },
+		{ "gesture g\n  idle:\n    rdown +R -R: initiate a\n  a:\n    any: cancel\n", 3 },
+		{ "gesture g\n  idle:\n    xdown: initiate a\n", 3 },
+		{ "gesture g\ngesture h\n  idle:\n    rdown: initiate a\n  a:\n    any: cancel\n", 1 },
+	};
+	for (const BadScript& bad : s_aBad) {
+		GestureScript script;
+		std::string strError;
+		char szLine[32];
+		snprintf(szLine, sizeof(szLine), "line %d: ", bad.line);
+		if (script.compile(bad.szScript, strError) || strError.compare(0, strlen(szLine), szLine) != 0) {
+			printf("script was %s (%s):\n%s", strError.empty() ? "accepted" : "rejected at the wrong line", strError.c_str(),
+				   bad.szScript);
+			return false;
+		}
+	}
+
+	// a failed load keeps the script that was running
+	GestureScriptLibrary library;
+	std::string strError;
+	if (!library.load(s_szWheel, strError) || library.load(s_aBad[1].szScript, strError) || !library.get() ||
+		!library.load("# nothing\n", strError) || library.get()) {
+		printf("script library did not keep or clear its script\n");
+		return false;
+	}
+	return true;
+}
+
+int main() {
+	if (!CheckErrors())
+		return 1;
+
+	std::vector<GestureMessage> vRealistic = BuildRealisticStream();
+	std::vector<GestureMessage> vRandom = BuildRandomStream(1, 200000);
+	printf("%-10s %8s %10s %14s %14s %12s\n", "gesture", "states", "table KB", "ns/msg built", "ns/msg script", "compile us");
+	for (const ScriptedGesture& gesture : s_aGestures) {
+		GestureScriptLibrary library;
+		std::string strError;
+		if (!library.load(gesture.szScript, strError)) {
+			printf("%s: %s\n", gesture.szName, strError.c_str());
+			return 1;
+		}
+		bool bSame;
+		if (strcmp(gesture.szName, "trace") == 0) {
+			bSame = CheckEquivalence<TraceHandler>(gesture, library, vRealistic, "realistic") &&
+					CheckEquivalence<TraceHandler>(gesture, library, vRandom, "random");
+		} else if (strcmp(gesture.szName, "rocker") == 0) {
+			bSame = CheckEquivalence<RockerHandler>(gesture, library, vRealistic, "realistic") &&
+					CheckEquivalence<RockerHandler>(gesture, library, vRandom, "random");
+		} else {
+			bSame = CheckEquivalence<WheelHandler>(gesture, library, vRealistic, "realistic") &&
+					CheckEquivalence<WheelHandler>(gesture, library, vRandom, "random");
+		}
+		if (!bSame)
+			return 1;
+
+		const int nCompiles = 200;
+		double nsCompile = BenchBestOf(3, [&]() {
+			for (int i = 0; i < nCompiles; i++) {
+				GestureScript script;
+				script.compile(gesture.szScript, strError);
+			}
+		});
+		int nStates = library.get()->getStateCount();
+		printf("%-10s %8d %10.1f %14.2f %14.2f %12.1f\n", gesture.szName, nStates,
+			   nStates * SE_Count * SK_Count * sizeof(ScriptTransition) / 1024.0,
+			   MeasureThroughput(gesture.szName, NULL, vRealistic), MeasureThroughput("script", &library, vRealistic),
+			   nsCompile / nCompiles / 1000);
+	}
+
+	// all three in one script need separate start buttons, so rocker and wheel are combined
+	GestureScriptLibrary library;
+	std::string strCombined = std::string(s_szRocker) + s_szWheel, strError;
+	if (library.load(strCombined.c_str(), strError)) {
+		printf("rocker and wheel both start on rdown, the script must be rejected\n");
+		return 1;
+	}
+	printf("\nrocker + wheel in one script: %s\n", strError.c_str());
+	printf("%-24s %12.2f ns/msg\n", "no script loaded", MeasureThroughput("script", &library, vRealistic));
+	return 0;
+}
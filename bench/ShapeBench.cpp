@@ -0,0 +1,310 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Shape gestures matched against a growing template library, scalar versus SIMD kernels.
+// Templates are distorted copies of a few base shapes (circles, a triangle, a check mark,
+// letters), queries are drawn from the same shapes by a different hand. Every kernel must pick
+// the same template with the same scores; accuracy is the share of queries mapped to the command
+// of the shape they were drawn from. The replay checks the trace handler sends those hotkeys.
+
+#include "BenchUtil.h"
+#include "GestureHandler.h"
+#include "ShapeRecognizer.h"
+
+#include <cmath>
+
+struct BaseShape {
+	const char* szName;
+	/* corners of the ideal shape, in units of about half its size */
+	double aCorners[24][2];
+	int nCorners;
+};
+
+static const double PI = 3.14159265358979;
+
+/* Circles are given as many corners, the rest as polylines */
+static std::vector<BaseShape> MakeBaseShapes() {
+	std::vector<BaseShape> vShapes;
+	BaseShape cw = { "circle", {}, 24 }, ccw = { "circle ccw", {}, 24 };
+	for (int i = 0; i < 24; i++) {
+		double a = 2 * PI * i / 23;
+		cw.aCorners[i][0] = std::sin(a);
+		cw.aCorners[i][1] = -std::cos(a);
+		ccw.aCorners[i][0] = -std::sin(a);
+		ccw.aCorners[i][1] = -std::cos(a);
+	}
+	vShapes.push_back(cw);
+	vShapes.push_back(ccw);
+	BaseShape aPolylines[] = {
+		{ "triangle", { { 0, -1 }, { 0.87, 0.5 }, { -0.87, 0.5 }, { 0, -1 } }, 4 },
+		{ "check", { { -0.6, 0 }, { -0.1, 0.6 }, { 0.9, -0.9 } }, 3 },
+		{ "Z", { { -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 } }, 4 },
+		{ "N", { { -1, 1 }, { -1, -1 }, { 1, 1 }, { 1, -1 } }, 4 },
+		{ "M", { { -1, 1 }, { -0.6, -1 }, { 0, 0.4 }, { 0.6, -1 }, { 1, 1 } }, 5 },
+		{ "L", { { -0.7, -1 }, { -0.7, 1 }, { 0.9, 1 } }, 3 },
+	};
+	vShapes.insert(vShapes.end(), aPolylines, aPolylines + sizeof(aPolylines) / sizeof(aPolylines[0]));
+	return vShapes;
+}
+
+/* Draws shapes rotated, stretched, jittered and unevenly sampled, the way a hand would */
+class ShapeHand {
+private:
+	BenchRandom m_random;
+	double m_distortion;
+
+	double uniform(double lo, double hi) { return lo + (hi - lo) * (m_random.next() % 10001) / 10000.0; }
+public:
+	ShapeHand(uint32_t seed, double distortion) : m_random(seed), m_distortion(distortion) {}
+
+	std::vector<GesturePoint> draw(const BaseShape& shape) {
+		double angle = uniform(-15, 15) * m_distortion * PI / 180;
+		double size = uniform(60, 200), aspect = 1 + uniform(-0.2, 0.2) * m_distortion;
+		double cosA = std::cos(angle), sinA = std::sin(angle);
+		std::vector<GesturePoint> vPoints;
+		for (int i = 0; i + 1 < shape.nCorners; i++) {
+			const double* a = shape.aCorners[i];
+			const double* b = shape.aCorners[i + 1];
+			double length = std::hypot(b[0] - a[0], b[1] - a[1]) * size;
+			for (double traveled = 0; traveled < length; traveled += uniform(2, 10)) {
+				double x = (a[0] + (b[0] - a[0]) * traveled / length) * size * aspect;
+				double y = (a[1] + (b[1] - a[1]) * traveled / length) * size;
+				GesturePoint pt = { static_cast<int>(std::lround(500 + x * cosA - y * sinA + uniform(-2, 2) * m_distortion)),
+									static_cast<int>(std::lround(500 + x * sinA + y * cosA + uniform(-2, 2) * m_distortion)) };
+				vPoints.push_back(pt);
+			}
+		}
+		const double* last = shape.aCorners[shape.nCorners - 1];
+		GesturePoint ptEnd = { static_cast<int>(std::lround(500 + (last[0] * aspect * cosA - last[1] * sinA) * size)),
+							   static_cast<int>(std::lround(500 + (last[0] * aspect * sinA + last[1] * cosA) * size)) };
+		vPoints.push_back(ptEnd);
+		return vPoints;
+	}
+};
+
+static void AppendInt16(std::vector<uint8_t>& vBlob, int value) {
+	vBlob.push_back(static_cast<uint8_t>(value & 0xff));
+	vBlob.push_back(static_cast<uint8_t>((value >> 8) & 0xff));
+}
+
+/* nTemplates distorted copies of the base shapes, shape i sends F1 + i */
+static std::vector<uint8_t> BuildTemplateBlob(const std::vector<BaseShape>& vShapes, int nTemplates) {
+	std::vector<uint8_t> vBlob(1, SHAPE_TEMPLATES_VERSION);
+	ShapeHand hand(11, 0.5);
+	for (int t = 0; t < nTemplates; t++) {
+		size_t iShape = t % vShapes.size();
+		std::vector<GesturePoint> vPoints = hand.draw(vShapes[iShape]);
+		// templates are stored with at most 255 points
+		size_t nStep = (vPoints.size() + 254) / 255;
+		std::vector<GesturePoint> vKept;
+		for (size_t i = 0; i < vPoints.size(); i += nStep)
+			vKept.push_back(vPoints[i]);
+		vBlob.push_back(static_cast<uint8_t>(vKept.size()));
+		for (const GesturePoint& pt : vKept) {
+			AppendInt16(vBlob, pt.x);
+			AppendInt16(vBlob, pt.y);
+		}
+		vBlob.push_back(static_cast<uint8_t>(0x70 + iShape));
+		vBlob.push_back(GHM_Ctrl);
+	}
+	return vBlob;
+}
+
+static bool CheckBlobs(const std::vector<BaseShape>& vShapes) {
+	ShapeLibrary library;
+	std::vector<uint8_t> vBlob = BuildTemplateBlob(vShapes, 16);
+	if (library.get() || !library.load(vBlob.data(), vBlob.size()) || !library.get() || library.get()->size() != 16) {
+		printf("template blob rejected\n");
+		return false;
+	}
+	const uint8_t aMalformed[][12] = {
+		{ 2, 2, 0, 0, 0, 0, 10, 0, 10, 0, 0x70, GHM_Alt },      // wrong version
+		{ 1, 1, 0, 0, 0, 0, 0x70, GHM_Alt },                    // a single point
+		{ 1, 2, 0, 0, 0, 0, 10, 0, 10, 0, 0x70 },               // truncated
+		{ 1, 2, 0, 0, 0, 0, 10, 0, 10, 0, 0x70, 0x08 },         // unknown modifier
+		{ 1, 2, 5, 0, 5, 0, 5, 0, 5, 0, 0x70, GHM_Alt },        // no extent
+	};
+	const size_t acbMalformed[] = { 12, 8, 11, 12, 12 };
+	for (size_t i = 0; i < sizeof(acbMalformed) / sizeof(acbMalformed[0]); i++) {
+		if (library.load(aMalformed[i], acbMalformed[i])) {
+			printf("malformed template blob %zu accepted\n", i);
+			return false;
+		}
+	}
+	if (!library.get() || library.get()->size() != 16) {
+		printf("rejected blobs replaced the templates\n");
+		return false;
+	}
+	library.clear();
+	if (library.get()) {
+		printf("cleared library still has templates\n");
+		return false;
+	}
+	return true;
+}
+
+static const ShapeKernel s_aKernels[] = { SK_Scalar, SK_SSE2, SK_AVX };
+
+/* Every kernel the processor runs must score like the scalar one */
+static bool CheckKernelsAgree(const ShapeTemplates& templates, const std::vector<ShapePath>& vQueries) {
+	std::vector<float> vScalar(templates.size()), vScores(templates.size());
+	for (const ShapePath& path : vQueries) {
+		templates.score(path, vScalar.data(), SK_Scalar);
+		ShapeMatch scalarMatch;
+		bool bScalarMatched = templates.match(path, scalarMatch, SK_Scalar);
+		for (ShapeKernel kernel : s_aKernels) {
+			if (kernel > BestShapeKernel())
+				break;
+			templates.score(path, vScores.data(), kernel);
+			for (int t = 0; t < templates.size(); t++) {
+				if (std::fabs(vScores[t] - vScalar[t]) > 1e-4f) {
+					printf("%s scores template %d at %f, scalar at %f\n", GetShapeKernelName(kernel), t, vScores[t], vScalar[t]);
+					return false;
+				}
+			}
+			ShapeMatch match;
+			bool bMatched = templates.match(path, match, kernel);
+			if (bMatched != bScalarMatched || (bMatched && match.iTemplate != scalarMatch.iTemplate)) {
+				printf("%s matches template %d, scalar %d\n", GetShapeKernelName(kernel), bMatched ? match.iTemplate : -1,
+					   bScalarMatched ? scalarMatch.iTemplate : -1);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static void PushMessage(std::vector<GestureMessage>& vMessages, unsigned int message, uintptr_t wParam, GesturePoint pt) {
+	GestureMessage msg = { BENCH_HWND_PLUGIN, message, wParam, pt.toLParam() };
+	vMessages.push_back(msg);
+}
+
+int main() {
+	std::vector<BaseShape> vShapes = MakeBaseShapes();
+	if (!CheckBlobs(vShapes))
+		return 1;
+
+	// queries by a sloppier hand than the templates
+	const int nQueriesPerShape = 100;
+	ShapeHand hand(23, 1.0);
+	std::vector<std::vector<GesturePoint> > vDrawn;
+	std::vector<ShapePath> vQueries;
+	std::vector<size_t> vExpected;
+	for (int i = 0; i < nQueriesPerShape; i++) {
+		for (size_t iShape = 0; iShape < vShapes.size(); iShape++) {
+			vDrawn.push_back(hand.draw(vShapes[iShape]));
+			ShapeTrace trace;
+			trace.begin(vDrawn.back()[0]);
+			for (size_t j = 1; j < vDrawn.back().size(); j++)
+				trace.addPoint(vDrawn.back()[j]);
+			trace.end(vDrawn.back().back());
+			ShapePath path;
+			NormalizeShape(trace.points(), trace.size(), path);
+			vQueries.push_back(path);
+			vExpected.push_back(iShape);
+		}
+	}
+
+	printf("best kernel: %s\n\n", GetShapeKernelName(BestShapeKernel()));
+	printf("%-10s %10s %10s %10s %10s\n", "templates", "accuracy", "scalar", "sse2", "avx");
+	const int aTemplateCounts[] = { 16, 64, 256, 1024 };
+	for (int nTemplates : aTemplateCounts) {
+		ShapeLibrary library;
+		std::vector<uint8_t> vBlob = BuildTemplateBlob(vShapes, nTemplates);
+		library.load(vBlob.data(), vBlob.size());
+		const ShapeTemplates& templates = *library.get();
+		if (!CheckKernelsAgree(templates, vQueries))
+			return 1;
+
+		size_t nCorrect = 0;
+		for (size_t i = 0; i < vQueries.size(); i++) {
+			ShapeMatch match;
+			if (templates.match(vQueries[i], match, BestShapeKernel()) && match.command.virtualKey == 0x70 + vExpected[i])
+				nCorrect++;
+		}
+		double accuracy = 100.0 * nCorrect / vQueries.size();
+		printf("%-10d %9.2f%%", nTemplates, accuracy);
+		for (ShapeKernel kernel : s_aKernels) {
+			if (kernel > BestShapeKernel()) {
+				printf(" %10s", "-");
+				continue;
+			}
+			int nFound = 0;
+			double ns = BenchBestOf(5, [&]() {
+				for (const ShapePath& path : vQueries) {
+					ShapeMatch match;
+					nFound += templates.match(path, match, kernel) ? 1 : 0;
+				}
+			});
+			double usPerMatch = ns / vQueries.size() / 1000;
+			printf(" %8.2fus", usPerMatch);
+			// a stroke is matched once on button release, hundreds of templates must not delay it noticeably
+			if (nTemplates <= 256 && usPerMatch > 1000) {
+				printf("\nmatching %d templates takes over 1 ms\n", nTemplates);
+				return 1;
+			}
+		}
+		printf("\n");
+		if (accuracy < 97.0)
+			return 1;
+	}
+
+	// the shapes as right button drags over a plugin, recognized by the trace handler
+	ShapeLibrary library;
+	std::vector<uint8_t> vBlob = BuildTemplateBlob(vShapes, 64);
+	library.load(vBlob.data(), vBlob.size());
+	// straight strokes are left to the direction commands
+	static const BaseShape aLines[] = {
+		{ "right", { { -1, 0 }, { 1, 0 } }, 2 },
+		{ "down", { { 0, -1 }, { 0, 1 } }, 2 },
+		{ "up", { { 0, 1 }, { 0, -1 } }, 2 },
+	};
+	for (const BaseShape& line : aLines) {
+		for (int i = 0; i < 20; i++) {
+			std::vector<GesturePoint> vPoints = hand.draw(line);
+			ShapePath path;
+			ShapeMatch match;
+			if (NormalizeShape(vPoints.data(), static_cast<int>(vPoints.size()), path) &&
+				library.get()->match(path, match, library.getKernel())) {
+				printf("line %s matches shape %s\n", line.szName, vShapes[match.command.virtualKey - 0x70].szName);
+				return 1;
+			}
+		}
+	}
+	size_t nExpectedHotkeys = 0;
+	std::vector<GestureMessage> vMessages;
+	for (size_t i = 0; i < vDrawn.size(); i++) {
+		PushMessage(vMessages, GMSG_RBUTTONDOWN, GMK_RBUTTON, vDrawn[i][0]);
+		for (size_t j = 1; j < vDrawn[i].size(); j++)
+			PushMessage(vMessages, GMSG_MOUSEMOVE, GMK_RBUTTON, vDrawn[i][j]);
+		PushMessage(vMessages, GMSG_RBUTTONUP, 0, vDrawn[i].back());
+		ShapeMatch match;
+		nExpectedHotkeys += library.get()->match(vQueries[i], match, library.getKernel()) ? 1 : 0;
+	}
+	GestureHandlers handlers;
+	handlers.setShapeLibrary(&library);
+	CountingForwarder forwarder;
+	for (const GestureMessage& msg : vMessages)
+		handlers.handleMouseMessage(forwarder, BENCH_HWND_FIREFOX, msg);
+	if (forwarder.nSent + forwarder.nPosted != 0 || forwarder.nHotkeys != nExpectedHotkeys) {
+		printf("replay sent %zu messages and %zu hotkeys, expected %zu hotkeys\n", forwarder.nSent + forwarder.nPosted,
+			   forwarder.nHotkeys, nExpectedHotkeys);
+		return 1;
+	}
+	printf("\nreplayed %zu shapes, %zu hotkeys\n", vDrawn.size(), forwarder.nHotkeys);
+	return 0;
+}
@@ -0,0 +1,274 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The seqlock around the shared config, with readers and writers on real threads.
+// Every config a writer stores is derived from one stamp, so a reader can tell a torn copy from
+// a consistent one. "plain copy" reads the same words without the sequence check to show what the
+// seqlock prevents. The hot path cost is that of SharedConfigSync::sync on an unchanged block,
+// which every hook thread pays per message.
+
+#include "BenchUtil.h"
+#include "GestureHandler.h"
+#include "SharedConfig.h"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+/* Zeroed like a fresh file mapping */
+static SharedConfigBlock s_block;
+
+static void StampConfig(SharedConfig& config, uint32_t stamp) {
+	config.cbSize = sizeof(SharedConfig);
+	config.enabledGestures = stamp;
+	config.moveMinDistance = static_cast<uint16_t>(stamp * 3);
+	config.msMoveMaxInterval = static_cast<uint16_t>(stamp >> 16);
+	config.cbHotkeyRules = static_cast<uint16_t>(stamp % SHARED_CONFIG_MAX_HOTKEY_RULES);
+	config.flags = static_cast<uint16_t>(~stamp);
+	for (int i = 0; i < SHARED_CONFIG_MAX_HOTKEY_RULES; i++)
+		config.aHotkeyRules[i] = static_cast<uint8_t>(stamp * 31 + i);
+}
+
+static bool IsStamped(const SharedConfig& config) {
+	SharedConfig expected;
+	StampConfig(expected, config.enabledGestures);
+	return memcmp(&expected, &config, sizeof(config)) == 0;
+}
+
+/* The words of a block, copied the way a reader without the seqlock would */
+static void PlainCopy(const SharedConfigBlock& block, SharedConfig& config) {
+	const volatile uint32_t* pWords = reinterpret_cast<const volatile uint32_t*>(&block) + 1;
+	uint32_t* pOut = reinterpret_cast<uint32_t*>(&config);
+	for (size_t i = 0; i < sizeof(SharedConfig) / sizeof(uint32_t); i++)
+		pOut[i] = pWords[i];
+}
+
+struct StressResult {
+	uint64_t nWrites;
+	uint64_t nReads;
+	uint64_t nGaveUp;
+	uint64_t nTorn;
+	uint64_t nBackwards;
+};
+
+static StressResult Stress(int nReaders, int nWriters, int msDuration, bool bSeqlock) {
+	std::atomic<bool> bStop(false);
+	std::atomic<uint64_t> nWrites(0), nReads(0), nGaveUp(0), nTorn(0), nBackwards(0);
+	std::vector<std::thread> vThreads;
+	for (int iWriter = 0; iWriter < nWriters; iWriter++) {
+		vThreads.push_back(std::thread([&, iWriter]() {
+			SharedConfig config;
+			uint32_t stamp = static_cast<uint32_t>(iWriter + 1) << 24;
+			uint64_t n = 0;
+			while (!bStop.load(std::memory_order_relaxed)) {
+				StampConfig(config, ++stamp);
+				n += s_block.write(config) ? 1 : 0;
+			}
+			nWrites += n;
+		}));
+	}
+	for (int iReader = 0; iReader < nReaders; iReader++) {
+		vThreads.push_back(std::thread([&]() {
+			SharedConfig config;
+			uint32_t lastVersion = 0;
+			uint64_t n = 0, nFailed = 0, nBad = 0, nBack = 0;
+			while (!bStop.load(std::memory_order_relaxed)) {
+				if (bSeqlock) {
+					uint32_t version = s_block.read(config);
+					if (version == 0) {
+						nFailed++;
+						continue;
+					}
+					// versions only grow while far from wrapping around
+					if (version < lastVersion)
+						nBack++;
+					lastVersion = version;
+				} else {
+					PlainCopy(s_block, config);
+				}
+				n++;
+				if (!IsStamped(config))
+					nBad++;
+			}
+			nReads += n;
+			nGaveUp += nFailed;
+			nTorn += nBad;
+			nBackwards += nBack;
+		}));
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(msDuration));
+	bStop = true;
+	for (std::thread& thread : vThreads)
+		thread.join();
+	StressResult result = { nWrites, nReads, nGaveUp, nTorn, nBackwards };
+	return result;
+}
+
+static bool CheckSync() {
+	// value initialized, zeroed like a fresh file mapping
+	SharedConfigBlock* pBlock = new SharedConfigBlock();
+	HotkeyRules rules;
+	MoveDecimation decimation;
+	SharedConfigSync sync(rules, decimation);
+	GestureHandlers handlers;
+	uint32_t threadVersion = 0;
+
+	// nothing written yet, nothing changes
+	sync.sync(*pBlock, handlers, threadVersion);
+	std::vector<std::string> vNames;
+	handlers.getHandlerNames(vNames);
+	bool bOk = threadVersion == 0 && handlers.m_pipeline.head.getEnabled();
+
+	SharedConfig config;
+	memset(&config, 0, sizeof(config));
+	config.cbSize = sizeof(config);
+	config.enabledGestures = 1 << 2;
+	config.moveMinDistance = 6;
+	config.msMoveMaxInterval = 20;
+	const uint8_t aRules[] = { HOTKEY_RULES_VERSION, HKM_None, GVK_F1, HKM_Shift };
+	memcpy(config.aHotkeyRules, aRules, sizeof(aRules));
+	config.cbHotkeyRules = sizeof(aRules);
+	bOk = bOk && IsValidSharedConfig(config) && pBlock->write(config);
+	sync.sync(*pBlock, handlers, threadVersion);
+	bOk = bOk && threadVersion == pBlock->getVersion() && !handlers.m_pipeline.head.getEnabled() &&
+		  !handlers.m_pipeline.tail.head.getEnabled() && handlers.m_pipeline.tail.tail.head.getEnabled();
+	bOk = bOk && decimation.get().minDistance == 6 && decimation.get().msMaxInterval == 20;
+	bOk = bOk && rules.shouldForward(GVK_F1, false, false, true) && !rules.shouldForward(GVK_F1, false, false, false) &&
+		  rules.shouldForward('A', false, false, false);
+	if (!bOk) {
+		printf("shared config was not applied (%zu handlers)\n", vNames.size());
+		delete pBlock;
+		return false;
+	}
+
+	// a newer build's config: a larger struct, gestures and flags this build does not know, which it ignores
+	SharedConfig newer = config;
+	newer.cbSize = sizeof(newer) + 64;
+	newer.enabledGestures = (1 << vNames.size()) | 1;
+	newer.flags = 0x8000 | SCF_CaptureInput;
+	if (!IsValidSharedConfig(newer) || !pBlock->write(newer)) {
+		printf("config of a newer build rejected\n");
+		delete pBlock;
+		return false;
+	}
+	sync.sync(*pBlock, handlers, threadVersion);
+	bOk = threadVersion == pBlock->getVersion() && handlers.m_pipeline.head.getEnabled() &&
+		  !handlers.m_pipeline.tail.tail.head.getEnabled() && sync.getFlags() == SCF_CaptureInput;
+	if (!bOk) {
+		printf("config of a newer build not applied\n");
+		delete pBlock;
+		return false;
+	}
+
+	// a config no build can apply is skipped, the settings stay
+	SharedConfig invalid = config;
+	invalid.aHotkeyRules[0] = HOTKEY_RULES_VERSION + 1;
+	if (IsValidSharedConfig(invalid) || !pBlock->write(invalid)) {
+		printf("malformed hotkey rules accepted\n");
+		delete pBlock;
+		return false;
+	}
+	sync.sync(*pBlock, handlers, threadVersion);
+	bOk = threadVersion == pBlock->getVersion() && handlers.m_pipeline.head.getEnabled() &&
+		  rules.shouldForward(GVK_F1, false, false, true);
+	// back to the defaults
+	config.cbHotkeyRules = 0;
+	config.moveMinDistance = 0;
+	config.enabledGestures = 7;
+	pBlock->write(config);
+	sync.sync(*pBlock, handlers, threadVersion);
+	bOk = bOk && handlers.m_pipeline.head.getEnabled() && decimation.get().minDistance == 0 &&
+		  !rules.shouldForward('A', false, false, false);
+	if (!bOk) {
+		printf("shared config not reapplied\n");
+		delete pBlock;
+		return false;
+	}
+
+	// gestures disabled mid-gesture: the thread keeps its handlers until the button is up
+	CountingForwarder forwarder;
+	GestureMessage down = { 1, GMSG_RBUTTONDOWN, GMK_RBUTTON, 0 };
+	handlers.handleMouseMessage(forwarder, 2, down);
+	uint32_t versionBefore = threadVersion;
+	config.enabledGestures = 0;
+	config.moveMinDistance = 4;
+	pBlock->write(config);
+	sync.sync(*pBlock, handlers, threadVersion);
+	bOk = !handlers.allInactive() && threadVersion == versionBefore && handlers.m_pipeline.head.getEnabled() &&
+		  decimation.get().minDistance == 4;
+	GestureMessage up = { 1, GMSG_RBUTTONUP, 0, 0 };
+	handlers.handleMouseMessage(forwarder, 2, up);
+	sync.sync(*pBlock, handlers, threadVersion);
+	bOk = bOk && threadVersion == pBlock->getVersion() && !handlers.m_pipeline.head.getEnabled();
+	if (!bOk)
+		printf("enabled gestures changed mid-gesture\n");
+	delete pBlock;
+	return bOk;
+}
+
+int main() {
+	if (!CheckSync())
+		return 1;
+
+	printf("%-32s %10s %12s %10s %8s\n", "threads", "writes", "reads", "gave up", "torn");
+	const int aWriters[] = { 1, 3 };
+	for (int nWriters : aWriters) {
+		const int nReaders = 4;
+		char szName[64];
+		StressResult plain = Stress(nReaders, nWriters, 300, false);
+		snprintf(szName, sizeof(szName), "%d readers, %d writers, plain", nReaders, nWriters);
+		printf("%-32s %10llu %12llu %10s %8llu\n", szName, static_cast<unsigned long long>(plain.nWrites),
+			   static_cast<unsigned long long>(plain.nReads), "-", static_cast<unsigned long long>(plain.nTorn));
+		StressResult seqlock = Stress(nReaders, nWriters, 300, true);
+		snprintf(szName, sizeof(szName), "%d readers, %d writers, seqlock", nReaders, nWriters);
+		printf("%-32s %10llu %12llu %10llu %8llu\n", szName, static_cast<unsigned long long>(seqlock.nWrites),
+			   static_cast<unsigned long long>(seqlock.nReads), static_cast<unsigned long long>(seqlock.nGaveUp),
+			   static_cast<unsigned long long>(seqlock.nTorn));
+		if (seqlock.nTorn || seqlock.nBackwards || seqlock.nReads == 0 || seqlock.nWrites == 0) {
+			printf("seqlock returned %llu torn and %llu older configs\n", static_cast<unsigned long long>(seqlock.nTorn),
+				   static_cast<unsigned long long>(seqlock.nBackwards));
+			return 1;
+		}
+	}
+
+	// what every hooked message pays while the config does not change
+	HotkeyRules rules;
+	MoveDecimation decimation;
+	SharedConfigSync sync(rules, decimation);
+	GestureHandlers handlers;
+	SharedConfig config;
+	StampConfig(config, 7);
+	config.cbHotkeyRules = 0;
+	s_block.write(config);
+	uint32_t threadVersion = 0;
+	sync.sync(s_block, handlers, threadVersion);
+	const int nCalls = 10000000;
+	double nsUnchanged = BenchBestOf(5, [&]() {
+		for (int i = 0; i < nCalls; i++)
+			sync.sync(s_block, handlers, threadVersion);
+	});
+	const int nChanges = 100000;
+	double nsChanged = BenchBestOf(5, [&]() {
+		for (int i = 0; i < nChanges; i++) {
+			threadVersion = 0;
+			sync.sync(s_block, handlers, threadVersion);
+		}
+	});
+	printf("\nsync, unchanged block   %8.2f ns/message\n", nsUnchanged / nCalls);
+	printf("sync, changed block     %8.2f ns/change\n", nsChanged / nChanges);
+	return 0;
+}
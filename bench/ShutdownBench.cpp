@@ -0,0 +1,108 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Shutdown latency with a growing number of slow plugin threads, on simulated threads.
+// "before" is the old WakeUpMessageLoops: one SendMessageTimeout after the other, with
+// SMTO_ABORTIFHUNG | SMTO_NOTIMEOUTIFNOTHUNG, which returns at once for threads Windows already
+// considers hung, but waits as long as it takes for threads that are merely slow.
+// "after" is WakeUpWindows, which must stay within WAKEUP_DEADLINE_MS however many threads are slow,
+// and must not wait for the hung ones either.
+
+#include "BenchUtil.h"
+#include "FakeWakeupChannel.h"
+#include "WakeupBroadcast.h"
+
+struct SimulatedThread {
+	GestureWindow hwnd;
+	uint32_t msLatency;
+	/* not responding for long enough that IsHungAppWindow is true */
+	bool bHung;
+};
+
+namespace legacy {
+
+const uint32_t WAKEUP_TIMEOUT_MS = 200;
+
+/* Time the sequential SendMessageTimeout loop took */
+inline uint64_t WakeUpMessageLoopsMs(const std::vector<SimulatedThread>& vThreads) {
+	uint64_t ms = 0;
+	for (const SimulatedThread& thread : vThreads) {
+		if (!thread.bHung)
+			ms += thread.msLatency;
+	}
+	return ms;
+}
+
+}
+
+int main() {
+	const int aSlowThreads[] = { 0, 1, 4, 16, 64, 256 };
+	const int nResponsive = 8, nHung = 2;
+	printf("wake-ups of %d responsive and %d hung plugin threads plus a growing number of slow ones\n", nResponsive, nHung);
+	printf("%-6s %12s %12s %10s %10s %10s %10s\n", "slow", "before ms", "after ms", "completed", "hung", "timed out",
+		   "failed");
+	for (int nSlow : aSlowThreads) {
+		BenchRandom random(nSlow + 1);
+		std::vector<SimulatedThread> vThreads;
+		GestureWindow hwndNext = 0x100;
+		for (int i = 0; i < nResponsive; i++, hwndNext++) {
+			SimulatedThread thread = { hwndNext, static_cast<uint32_t>(random.range(0, 5)), false };
+			vThreads.push_back(thread);
+		}
+		for (int i = 0; i < nHung; i++, hwndNext++) {
+			SimulatedThread thread = { hwndNext, FakeWakeupChannel::NEVER, true };
+			vThreads.push_back(thread);
+		}
+		for (int i = 0; i < nSlow; i++, hwndNext++) {
+			// busy with a long script or a modal dialog, but not yet hung
+			SimulatedThread thread = { hwndNext, static_cast<uint32_t>(random.range(100, 3000)), false };
+			vThreads.push_back(thread);
+		}
+
+		FakeWakeupChannel channel;
+		std::vector<GestureWindow> vWindows;
+		for (const SimulatedThread& thread : vThreads) {
+			channel.addThread(thread.hwnd, thread.msLatency, thread.bHung ? FakeWakeupChannel::HUNG_AFTER_MS : 0);
+			vWindows.push_back(thread.hwnd);
+		}
+		// a plugin window destroyed between the enumeration and the wake-up
+		vWindows.push_back(hwndNext);
+
+		WakeupReport report = WakeUpWindows(channel, vWindows);
+		uint32_t nExpectedInTime = 0, msExpected = 0;
+		for (const SimulatedThread& thread : vThreads) {
+			if (thread.msLatency < WAKEUP_DEADLINE_MS) {
+				nExpectedInTime++;
+				msExpected = thread.msLatency > msExpected ? thread.msLatency : msExpected;
+			} else if (!thread.bHung) {
+				msExpected = WAKEUP_DEADLINE_MS;
+			}
+		}
+		if (report.msElapsed != msExpected || report.nFailed != 1 || report.nHung != nHung ||
+			report.nCompleted != nExpectedInTime ||
+			report.nCompleted + report.nHung + report.nTimedOut + report.nFailed != report.nWindows) {
+			printf("%d slow threads: %u ms (expected %u), %u completed (expected %u), %u hung, %u timed out, %u failed\n",
+				   nSlow, report.msElapsed, msExpected, report.nCompleted, nExpectedInTime, report.nHung,
+				   report.nTimedOut, report.nFailed);
+			return 1;
+		}
+		printf("%-6d %12llu %12u %10u %10u %10u %10u\n", nSlow,
+			   static_cast<unsigned long long>(legacy::WakeUpMessageLoopsMs(vThreads)), report.msElapsed,
+			   report.nCompleted, report.nHung, report.nTimedOut, report.nFailed);
+	}
+	return 0;
+}
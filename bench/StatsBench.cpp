@@ -0,0 +1,188 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Cost of the hook statistics: the gesture replay from GestureBench run through a copy of
+// GetMsgHook's filtering, without statistics, with counters only and with latency timestamps.
+// Also compares per-thread counters against one shared atomic counter under contention.
+
+#include "BenchUtil.h"
+#include "GestureHandler.h"
+#include "HookStats.h"
+#include "HookThreadState.h"
+
+#include <thread>
+
+/* GetMsgHook without the Win32 parts, instrumented the same way when pStats is set */
+static bool SimulateHook(GestureHandlers& handlers, HookThreadStats* pStats, bool bTimed, CountingForwarder& forwarder,
+						 const GestureMessage& msg) {
+	if (!(handlers.getInterest() & MessageInterestBit(msg.message))) {
+		if (pStats)
+			pStats->count(HC_FastExits);
+		return false;
+	}
+	if (pStats)
+		pStats->count(HC_MessagesSeen);
+	uint64_t nsStart = bTimed ? HookTimestampNs() : 0;
+	if (pStats)
+		pStats->count(HC_RootLookups);
+	bool bShouldSwallow = handlers.handleMouseMessage(forwarder, BENCH_HWND_FIREFOX, msg);
+	if (pStats) {
+		if (bShouldSwallow)
+			pStats->count(HC_Swallowed);
+		if (bTimed)
+			pStats->recordLatency(HookTimestampNs() - nsStart);
+	}
+	return bShouldSwallow;
+}
+
+static std::vector<GestureMessage> BuildMixedStream() {
+	MessageStreamBuilder mixed;
+	for (int i = 0; i < 200; i++) {
+		mixed.idleMoves(20);
+		switch (mixed.random().range(0, 4)) {
+		case 0: mixed.traceStroke(30); break;
+		case 1: mixed.rockerClick(3); break;
+		case 2: mixed.wheelGesture(5); break;
+		case 3: mixed.deadZoneJiggle(10); break;
+		default: mixed.click(); break;
+		}
+	}
+	return mixed.messages();
+}
+
+static bool CheckLatencyBuckets() {
+	struct { uint64_t ns; int iBucket; } aCases[] = {
+		{ 0, 0 }, { 1, 0 }, { 2, 1 }, { 3, 1 }, { 1023, 9 }, { 1024, 10 }, { 0xffffffffull, 31 }, { 1ull << 40, 31 },
+	};
+	for (auto& test : aCases) {
+		if (HookThreadStats::LatencyBucket(test.ns) != test.iBucket) {
+			printf("LatencyBucket(%llu) = %d, expected %d\n", static_cast<unsigned long long>(test.ns),
+				   HookThreadStats::LatencyBucket(test.ns), test.iBucket);
+			return false;
+		}
+	}
+	return true;
+}
+
+int main() {
+	if (!CheckLatencyBuckets())
+		return 1;
+
+	static const char* const aszAll[] = { "trace", "rocker", "wheel" };
+	const int nRuns = 7;
+	std::vector<GestureMessage> vMessages = BuildMixedStream();
+	size_t nPasses = 2000000 / vMessages.size() + 1;
+	size_t nMessages = nPasses * vMessages.size();
+
+	GestureHandlers plainHandlers, countedHandlers, timedHandlers;
+	plainHandlers.setEnabledGestures(aszAll, 3);
+	countedHandlers.setEnabledGestures(aszAll, 3);
+	timedHandlers.setEnabledGestures(aszAll, 3);
+	plainHandlers.setBaseInterest(HookThreadState::BaseInterest());
+	countedHandlers.setBaseInterest(HookThreadState::BaseInterest());
+	timedHandlers.setBaseInterest(HookThreadState::BaseInterest());
+	HookThreadStats countedStats, stats;
+	countedHandlers.setStats(&countedStats);
+	timedHandlers.setStats(&stats);
+	CountingForwarder plainForwarder, countedForwarder, timedForwarder;
+	size_t nPlainSwallowed = 0, nCountedSwallowed = 0, nTimedSwallowed = 0;
+
+	double nsPlain = BenchBestOf(nRuns, [&]() {
+		for (size_t i = 0; i < nPasses; i++)
+			for (const GestureMessage& msg : vMessages)
+				nPlainSwallowed += SimulateHook(plainHandlers, NULL, false, plainForwarder, msg);
+	});
+	double nsCounted = BenchBestOf(nRuns, [&]() {
+		for (size_t i = 0; i < nPasses; i++)
+			for (const GestureMessage& msg : vMessages)
+				nCountedSwallowed += SimulateHook(countedHandlers, &countedStats, false, countedForwarder, msg);
+	});
+	double nsTimed = BenchBestOf(nRuns, [&]() {
+		for (size_t i = 0; i < nPasses; i++)
+			for (const GestureMessage& msg : vMessages)
+				nTimedSwallowed += SimulateHook(timedHandlers, &stats, true, timedForwarder, msg);
+	});
+
+	HookStatsSnapshot snapshot;
+	InitHookStatsSnapshot(snapshot);
+	stats.addTo(snapshot);
+	uint64_t nForwarded = snapshot.counter(HC_ForwardedTrace) + snapshot.counter(HC_ForwardedRocker) +
+		snapshot.counter(HC_ForwardedWheel);
+	if (nPlainSwallowed != nTimedSwallowed || nCountedSwallowed != nTimedSwallowed ||
+		snapshot.counter(HC_Swallowed) != nTimedSwallowed || nForwarded != timedForwarder.nSent + timedForwarder.nPosted) {
+		printf("statistics disagree with the replay\n");
+		return 1;
+	}
+
+	printf("stream: mixed (%zu messages)\n", vMessages.size());
+	printf("%-24s %12s\n", "hook", "ns/msg");
+	printf("%-24s %12.2f\n", "without statistics", nsPlain / nMessages);
+	printf("%-24s %12.2f\n", "counters", nsCounted / nMessages);
+	printf("%-24s %12.2f\n", "counters and latency", nsTimed / nMessages);
+
+	static const char* const aszCounters[HC_Count] = {
+		"messages seen", "fast exits", "root lookups", "swallowed",
+		"forwarded trace", "forwarded rocker", "forwarded wheel", "forwarded key", "forwarded zoom", "forwarded script",
+	};
+	printf("\n%-24s %12s\n", "counter", "per pass");
+	for (int i = 0; i < HC_Count; i++)
+		printf("%-24s %12llu\n", aszCounters[i], static_cast<unsigned long long>(snapshot.counter(static_cast<HookCounterId>(i)) / (nRuns * nPasses)));
+	printf("\n%-24s %12s\n", "slow path latency", "share");
+	uint64_t nTimed = 0;
+	for (int i = 0; i < HOOK_LATENCY_BUCKETS; i++)
+		nTimed += snapshot.aLatencyNs[i];
+	for (int i = 0; i < HOOK_LATENCY_BUCKETS; i++) {
+		if (!snapshot.aLatencyNs[i])
+			continue;
+		char szRange[32];
+		snprintf(szRange, sizeof(szRange), "[%llu, %llu) ns", 1ull << i, 1ull << (i + 1));
+		printf("%-24s %11.2f%%\n", szRange, 100.0 * snapshot.aLatencyNs[i] / nTimed);
+	}
+
+	// hooked threads count concurrently, each into its own padded block
+	const int nThreads = 4;
+	const uint32_t nIncrements = 10000000;
+	std::vector<HookThreadStats> vThreadStats(nThreads);
+	double nsPerThread = BenchBestOf(3, [&]() {
+		std::vector<std::thread> vThreads;
+		for (int t = 0; t < nThreads; t++) {
+			HookThreadStats& threadStats = vThreadStats[t];
+			vThreads.push_back(std::thread([&threadStats, nIncrements]() {
+				for (uint32_t i = 0; i < nIncrements; i++)
+					threadStats.count(HC_MessagesSeen);
+			}));
+		}
+		for (std::thread& thread : vThreads)
+			thread.join();
+	});
+	std::atomic<uint64_t> sharedCounter(0);
+	double nsShared = BenchBestOf(3, [&]() {
+		std::vector<std::thread> vThreads;
+		for (int t = 0; t < nThreads; t++) {
+			vThreads.push_back(std::thread([&sharedCounter, nIncrements]() {
+				for (uint32_t i = 0; i < nIncrements; i++)
+					sharedCounter.fetch_add(1, std::memory_order_relaxed);
+			}));
+		}
+		for (std::thread& thread : vThreads)
+			thread.join();
+	});
+	printf("\n%d threads counting      %12s\n", nThreads, "ns/count");
+	printf("%-24s %12.2f\n", "per-thread, padded", nsPerThread / (nThreads * double(nIncrements)));
+	printf("%-24s %12.2f\n", "shared atomic", nsShared / (nThreads * double(nIncrements)));
+	return 0;
+}
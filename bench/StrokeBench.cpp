@@ -0,0 +1,298 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Trace gestures recognized in the hook versus forwarded to firefox move by move.
+// Accuracy is measured on strokes recorded from a synthetic hand: segments of random length
+// drawn at an angle off the axis, with jitter, rounded corners, uneven sampling and a small hook
+// at the release, plus a few hand-written edge cases. The replay then compares the messages
+// posted across threads per stroke: "before" forwards every move, "after" one hotkey.
+
+#include "BenchUtil.h"
+#include "GestureHandler.h"
+#include "StrokeRecognizer.h"
+
+#include <cmath>
+#include <string>
+
+static const char* const s_aszStrokes[] = {
+	"L", "R", "U", "D", "UD", "DU", "LR", "RL", "DR", "DL", "UR", "UL", "RD", "LU", "LDR", "URD", "DRU", "RDLU",
+};
+
+struct RecordedStroke {
+	std::string expected;
+	std::vector<GesturePoint> vPoints;
+};
+
+/* Draws strokes the way a hand would */
+class StrokeHand {
+private:
+	BenchRandom m_random;
+	double m_x, m_y;
+	std::vector<GesturePoint> m_vPoints;
+
+	double uniform(double lo, double hi) { return lo + (hi - lo) * (m_random.next() % 10001) / 10000.0; }
+	void sample(double x, double y) {
+		GesturePoint pt = { static_cast<int>(std::lround(x + uniform(-2, 2))), static_cast<int>(std::lround(y + uniform(-2, 2))) };
+		m_vPoints.push_back(pt);
+	}
+	/* One segment, the first few samples bend in from the previous direction */
+	void segment(double angle, double length, double prevAngle, bool bFirst) {
+		double traveled = 0;
+		while (traveled < length) {
+			double step = uniform(2, 12);
+			double blend = bFirst ? 1.0 : std::min(1.0, traveled / 25.0);
+			double a = prevAngle + (angle - prevAngle) * blend;
+			m_x += step * std::cos(a);
+			m_y += step * std::sin(a);
+			traveled += step;
+			sample(m_x, m_y);
+		}
+	}
+public:
+	explicit StrokeHand(uint32_t seed) : m_random(seed), m_x(500), m_y(500) {}
+
+	RecordedStroke draw(const char* szDirections) {
+		const double pi = 3.14159265358979;
+		m_vPoints.clear();
+		m_x = 500;
+		m_y = 500;
+		GesturePoint ptStart = { 500, 500 };
+		m_vPoints.push_back(ptStart);
+		double prevAngle = 0;
+		for (int i = 0; szDirections[i]; i++) {
+			double angle = 0;
+			switch (szDirections[i]) {
+			case 'R': angle = 0; break;
+			case 'D': angle = pi / 2; break;
+			case 'L': angle = pi; break;
+			case 'U': angle = -pi / 2; break;
+			}
+			// hands draw up to 20 degrees off the axis
+			angle += uniform(-20, 20) * pi / 180;
+			if (i && std::fabs(angle - prevAngle) > pi)
+				prevAngle += angle > prevAngle ? 2 * pi : -2 * pi;
+			segment(angle, uniform(50, 250), prevAngle, i == 0);
+			prevAngle = angle;
+		}
+		// the pointer often flicks a little when the button is released
+		double flick = uniform(0, 10), flickAngle = uniform(0, 2 * pi);
+		m_x += flick * std::cos(flickAngle);
+		m_y += flick * std::sin(flickAngle);
+		sample(m_x, m_y);
+		RecordedStroke stroke = { szDirections, m_vPoints };
+		return stroke;
+	}
+};
+
+static RecordedStroke HandWritten(const char* szExpected, const int aCoordinates[][2], int nPoints) {
+	RecordedStroke stroke;
+	stroke.expected = szExpected;
+	for (int i = 0; i < nPoints; i++) {
+		GesturePoint pt = { aCoordinates[i][0], aCoordinates[i][1] };
+		stroke.vPoints.push_back(pt);
+	}
+	return stroke;
+}
+
+static std::vector<RecordedStroke> RecordStrokes(int nPerStroke) {
+	std::vector<RecordedStroke> vStrokes;
+	StrokeHand hand(7);
+	for (int i = 0; i < nPerStroke; i++) {
+		for (const char* szDirections : s_aszStrokes)
+			vStrokes.push_back(hand.draw(szDirections));
+	}
+
+	// right, drifting downwards at about 25 degrees the whole way
+	static const int aDrift[][2] = { { 0, 0 }, { 20, 9 }, { 40, 18 }, { 60, 27 }, { 80, 37 }, { 100, 46 }, { 120, 56 } };
+	vStrokes.push_back(HandWritten("R", aDrift, 7));
+	// down in tiny uneven steps that are each below the segment length
+	static const int aCreep[][2] = { { 0, 0 }, { 1, 6 }, { -1, 13 }, { 2, 19 }, { 0, 27 }, { 1, 34 }, { -2, 41 }, { 0, 49 } };
+	vStrokes.push_back(HandWritten("D", aCreep, 8));
+	// up and down with a wide rounded turn at the top
+	static const int aTurn[][2] = { { 0, 0 }, { 0, -30 }, { 2, -60 }, { 8, -75 }, { 16, -78 }, { 22, -72 }, { 25, -55 },
+									{ 25, -25 }, { 26, 5 } };
+	vStrokes.push_back(HandWritten("UD", aTurn, 9));
+	// a diagonal line is neither direction, it must not produce a zigzag of turns
+	static const int aDiagonal[][2] = { { 0, 0 }, { 18, 17 }, { 36, 37 }, { 54, 53 }, { 72, 73 }, { 90, 89 }, { 108, 109 } };
+	vStrokes.push_back(HandWritten("R", aDiagonal, 7));
+	return vStrokes;
+}
+
+static std::string Recognize(const RecordedStroke& stroke) {
+	StrokeRecognizer recognizer;
+	recognizer.begin(stroke.vPoints[0]);
+	for (size_t i = 1; i < stroke.vPoints.size(); i++)
+		recognizer.addPoint(stroke.vPoints[i]);
+	return recognizer.getDirections();
+}
+
+/* One command per stroke of s_aszStrokes, keys F1 onwards */
+static std::vector<uint8_t> BuildCommandBlob() {
+	std::vector<uint8_t> vBlob(1, STROKE_COMMANDS_VERSION);
+	uint8_t vk = 0x70;
+	for (const char* szDirections : s_aszStrokes) {
+		size_t n = strlen(szDirections);
+		vBlob.push_back(static_cast<uint8_t>(n));
+		vBlob.insert(vBlob.end(), szDirections, szDirections + n);
+		vBlob.push_back(vk++);
+		vBlob.push_back(GHM_Ctrl);
+	}
+	return vBlob;
+}
+
+static bool CheckBlobs() {
+	StrokeCommands commands;
+	std::vector<uint8_t> vBlob = BuildCommandBlob();
+	if (commands.isEnabled() || !commands.load(vBlob.data(), vBlob.size()) || !commands.isEnabled()) {
+		printf("command blob rejected\n");
+		return false;
+	}
+	const uint8_t aMalformed[][6] = {
+		{ 2, 1, 'L', 0x25, GHM_Alt },            // wrong version
+		{ 1, 1, 'X', 0x25, GHM_Alt },            // not a direction
+		{ 1, 0, 0x25, GHM_Alt },                 // no directions
+		{ 1, 2, 'L', 0x25, GHM_Alt },            // truncated
+		{ 1, 1, 'L', 0x25, 0x08 },               // unknown modifier
+	};
+	const size_t acbMalformed[] = { 5, 5, 4, 5, 5 };
+	for (size_t i = 0; i < sizeof(acbMalformed) / sizeof(acbMalformed[0]); i++) {
+		if (commands.load(aMalformed[i], acbMalformed[i])) {
+			printf("malformed command blob %zu accepted\n", i);
+			return false;
+		}
+	}
+	const uint8_t aDuplicate[] = { 1, 1, 'L', 0x25, GHM_Alt, 1, 'L', 0x27, GHM_Alt };
+	if (commands.load(aDuplicate, sizeof(aDuplicate))) {
+		printf("duplicate stroke accepted\n");
+		return false;
+	}
+	// the rejected blobs must have left the first table in place
+	StrokeRecognizer recognizer;
+	GesturePoint pt = { 0, 0 };
+	recognizer.begin(pt);
+	pt.y = 40;
+	recognizer.addPoint(pt);
+	pt.x = 40;
+	recognizer.addPoint(pt);
+	StrokeCommand command;
+	if (!commands.find(recognizer, command) || command.virtualKey != 0x70 + 8 || command.modifiers != GHM_Ctrl) {
+		printf("stroke DR not found after rejected blobs\n");
+		return false;
+	}
+	commands.clear();
+	if (commands.isEnabled() || commands.find(recognizer, command)) {
+		printf("cleared commands still match\n");
+		return false;
+	}
+	return true;
+}
+
+static void PushMessage(std::vector<GestureMessage>& vMessages, unsigned int message, uintptr_t wParam, GesturePoint pt) {
+	GestureMessage msg = { BENCH_HWND_PLUGIN, message, wParam, pt.toLParam() };
+	vMessages.push_back(msg);
+}
+
+struct ReplayResult {
+	double ns;
+	size_t nSwallowed;
+	size_t nMessagesToFirefox;
+	size_t nHotkeys;
+};
+
+static ReplayResult Replay(const std::vector<GestureMessage>& vMessages, const StrokeCommands* pCommands, int nRuns) {
+	GestureHandlers handlers;
+	handlers.setStrokeCommands(pCommands);
+	CountingForwarder forwarder;
+	size_t nSwallowed = 0;
+	ReplayResult result;
+	result.ns = BenchBestOf(nRuns, [&]() {
+		for (const GestureMessage& msg : vMessages) {
+			if (msg.message == GMSG_MOUSEMOVE && handlers.allInactive())
+				continue;
+			if (handlers.handleMouseMessage(forwarder, BENCH_HWND_FIREFOX, msg))
+				nSwallowed++;
+		}
+	});
+	result.nSwallowed = nSwallowed / nRuns;
+	result.nMessagesToFirefox = (forwarder.nSent + forwarder.nPosted) / nRuns;
+	result.nHotkeys = forwarder.nHotkeys / nRuns;
+	return result;
+}
+
+int main() {
+	if (!CheckBlobs())
+		return 1;
+
+	std::vector<RecordedStroke> vStrokes = RecordStrokes(200);
+	size_t nCorrect = 0, nWithCommand = 0;
+	int nMistakesShown = 0;
+	for (const RecordedStroke& stroke : vStrokes) {
+		std::string recognized = Recognize(stroke);
+		for (const char* szDirections : s_aszStrokes)
+			nWithCommand += recognized == szDirections ? 1 : 0;
+		if (recognized == stroke.expected) {
+			nCorrect++;
+		} else if (nMistakesShown++ < 5) {
+			printf("expected %s, recognized %s (%zu points)\n", stroke.expected.c_str(), recognized.c_str(),
+				   stroke.vPoints.size());
+		}
+	}
+	double accuracy = 100.0 * nCorrect / vStrokes.size();
+	printf("recognized %zu of %zu recorded strokes correctly (%.2f%%)\n", nCorrect, vStrokes.size(), accuracy);
+	// the hand-written edge cases are the last four and must all pass
+	for (size_t i = vStrokes.size() - 4; i < vStrokes.size(); i++) {
+		if (Recognize(vStrokes[i]) != vStrokes[i].expected) {
+			printf("hand-written stroke %s failed\n", vStrokes[i].expected.c_str());
+			return 1;
+		}
+	}
+	if (accuracy < 99.0)
+		return 1;
+
+	// every recorded stroke as a right button drag over a plugin, with some hovering in between
+	std::vector<GestureMessage> vMessages;
+	MessageStreamBuilder idle;
+	idle.idleMoves(20);
+	for (const RecordedStroke& stroke : vStrokes) {
+		vMessages.insert(vMessages.end(), idle.messages().begin(), idle.messages().end());
+		PushMessage(vMessages, GMSG_RBUTTONDOWN, GMK_RBUTTON, stroke.vPoints[0]);
+		for (size_t i = 1; i < stroke.vPoints.size(); i++)
+			PushMessage(vMessages, GMSG_MOUSEMOVE, GMK_RBUTTON, stroke.vPoints[i]);
+		PushMessage(vMessages, GMSG_RBUTTONUP, 0, stroke.vPoints.back());
+	}
+
+	StrokeCommands commands;
+	std::vector<uint8_t> vBlob = BuildCommandBlob();
+	commands.load(vBlob.data(), vBlob.size());
+	const int nRuns = 9;
+	ReplayResult before = Replay(vMessages, NULL, nRuns);
+	ReplayResult after = Replay(vMessages, &commands, nRuns);
+	if (before.nSwallowed != after.nSwallowed || before.nHotkeys != 0 || after.nMessagesToFirefox != 0 ||
+		after.nHotkeys != nWithCommand) {
+		printf("recognizing swallowed %zu (forwarding %zu), sent %zu messages and %zu hotkeys (expected %zu)\n",
+			   after.nSwallowed, before.nSwallowed, after.nMessagesToFirefox, after.nHotkeys, nWithCommand);
+		return 1;
+	}
+
+	double nStrokes = static_cast<double>(vStrokes.size());
+	printf("\n%-10s %18s %14s %12s\n", "", "to firefox/stroke", "ns/stroke", "ns/msg");
+	printf("%-10s %18.1f %14.0f %12.2f\n", "before", before.nMessagesToFirefox / nStrokes, before.ns / nStrokes,
+		   before.ns / vMessages.size());
+	printf("%-10s %18.1f %14.0f %12.2f\n", "after", (after.nMessagesToFirefox + after.nHotkeys) / nStrokes,
+		   after.ns / nStrokes, after.ns / vMessages.size());
+	return 0;
+}
@@ -0,0 +1,141 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Footprint and first-message cost of the per-thread hook state.
+// "before" is how GetMsgHook used to create it: on the first hook call of every hooked thread,
+// from the heap, with the flight recorder ring zeroed. "after" creates it only once a thread sees
+// a message for a firefox plugin window, from the static pool, without zeroing the ring.
+// Also checks that pool slots are aligned and never handed out twice under concurrent use.
+
+#include "BenchUtil.h"
+#include "HookThreadState.h"
+
+#include <new>
+#include <thread>
+
+/* The old creation path, the memset stands in for the ring zeroing FlightRecorder used to do */
+static HookThreadState* CreateEager(uint32_t idThread) {
+	void* p = ::operator new(sizeof(HookThreadState));
+	memset(p, 0, sizeof(HookThreadState));
+	return ::new (p) HookThreadState(idThread);
+}
+
+static void DestroyEager(HookThreadState* pState) {
+	pState->~HookThreadState();
+	::operator delete(pState);
+}
+
+static bool IsAligned(const void* p) {
+	return reinterpret_cast<uintptr_t>(p) % HOOK_CACHE_LINE == 0;
+}
+
+static bool CheckPool() {
+	std::vector<HookThreadState*> vStates;
+	for (int i = 0; i < HookThreadState::POOL_SLOTS + 2; i++) {
+		vStates.push_back(new HookThreadState(i));
+		if (!IsAligned(vStates.back())) {
+			printf("state %d is not cache line aligned\n", i);
+			return false;
+		}
+	}
+	if (HookThreadState::PoolSlotsInUse() != HookThreadState::POOL_SLOTS) {
+		printf("%d pool slots in use, expected %d\n", HookThreadState::PoolSlotsInUse(), HookThreadState::POOL_SLOTS);
+		return false;
+	}
+	for (HookThreadState* pState : vStates)
+		delete pState;
+
+	// threads keep creating and freeing their state, a slot handed out twice shows up as a foreign thread id
+	const int nThreads = HookThreadState::POOL_SLOTS + 2;
+	std::atomic<int> nCollisions(0);
+	std::vector<std::thread> vThreads;
+	for (int t = 0; t < nThreads; t++) {
+		vThreads.push_back(std::thread([t, &nCollisions]() {
+			for (int i = 0; i < 20000; i++) {
+				HookThreadState* pState = new HookThreadState(t);
+				if (!IsAligned(pState) || pState->flightRecorder.getThreadId() != static_cast<uint32_t>(t))
+					nCollisions++;
+				std::this_thread::yield();
+				if (pState->flightRecorder.getThreadId() != static_cast<uint32_t>(t))
+					nCollisions++;
+				delete pState;
+			}
+		}));
+	}
+	for (std::thread& thread : vThreads)
+		thread.join();
+	if (nCollisions != 0 || HookThreadState::PoolSlotsInUse() != 0) {
+		printf("pool handed out a slot twice (%d) or leaked slots (%d)\n", nCollisions.load(),
+			   HookThreadState::PoolSlotsInUse());
+		return false;
+	}
+	return true;
+}
+
+/* Creates a thread's state and runs its first message through it, like the first right click on a plugin */
+template <class Create, class Destroy>
+static double MeasureFirstMessage(int nIterations, Create create, Destroy destroy, size_t& nForwarded) {
+	CountingForwarder forwarder;
+	GestureMessage msg = { BENCH_HWND_PLUGIN, GMSG_RBUTTONDOWN, GMK_RBUTTON, GesturePoint::fromLParam(0x00640064).toLParam() };
+	double ns = BenchBestOf(7, [&]() {
+		for (int i = 0; i < nIterations; i++) {
+			HookThreadState* pState = create(static_cast<uint32_t>(i));
+			pState->gestureHandlers.handleMouseMessage(forwarder, BENCH_HWND_FIREFOX, msg);
+			destroy(pState);
+		}
+	});
+	nForwarded = forwarder.nSent + forwarder.nPosted;
+	return ns / nIterations;
+}
+
+int main() {
+	if (!CheckPool())
+		return 1;
+
+	printf("per-thread state layout (bytes)\n");
+	printf("  %-24s %8zu\n", "gestureHandlers", sizeof(GestureHandlers));
+	printf("  %-24s %8zu\n", "firefoxRootCache", sizeof(FirefoxRootCache));
+	printf("  %-24s %8zu\n", "modifiers", sizeof(ModifierTracker));
+	printf("  %-24s %8zu\n", "hookStats", sizeof(HookThreadStats));
+	printf("  %-24s %8zu\n", "flightRecorder", sizeof(FlightRecorder));
+	printf("  %-24s %8zu (aligned to %zu)\n", "HookThreadState", sizeof(HookThreadState), alignof(HookThreadState));
+
+	// a typical plugin-container: the main thread and a few worker threads with windows are
+	// hooked, only the plugin thread ever sees a message for a firefox window
+	const size_t nHookedThreads = 8, nPluginThreads = 1;
+	printf("\nfootprint with %zu hooked threads, %zu of them hosting a plugin window\n", nHookedThreads, nPluginThreads);
+	printf("  %-24s %8zu bytes, all from the heap\n", "before", nHookedThreads * sizeof(HookThreadState));
+	printf("  %-24s %8zu bytes, %zu from the heap\n", "after", nPluginThreads * sizeof(HookThreadState),
+		   nPluginThreads > HookThreadState::POOL_SLOTS ? (nPluginThreads - HookThreadState::POOL_SLOTS) * sizeof(HookThreadState) : 0);
+	printf("  %-24s %8zu bytes per thread without plugin windows\n", "after", static_cast<size_t>(0));
+
+	const int nIterations = 200000;
+	size_t nForwardedBefore, nForwardedAfter;
+	double nsBefore = MeasureFirstMessage(nIterations, CreateEager, DestroyEager, nForwardedBefore);
+	double nsAfter = MeasureFirstMessage(nIterations,
+		[](uint32_t idThread) { return new HookThreadState(idThread); },
+		[](HookThreadState* pState) { delete pState; }, nForwardedAfter);
+	if (nForwardedBefore != nForwardedAfter) {
+		printf("first message was handled differently\n");
+		return 1;
+	}
+	printf("\nfirst message of a thread (create state, handle one button down, free)\n");
+	printf("  %-24s %8.1f ns\n", "before", nsBefore);
+	printf("  %-24s %8.1f ns (%.1fx)\n", "after, plugin thread", nsAfter, nsBefore / nsAfter);
+	printf("  %-24s %8.1f ns, no state is created\n", "after, other threads", 0.0);
+	return 0;
+}
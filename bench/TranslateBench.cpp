@@ -0,0 +1,94 @@
+/*
+This file is part of Flash Gestures.
+
+Flash Gestures is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Flash Gestures is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Flash Gestures.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Coordinate translation of forwarded messages: the batched TranslatePackedPoints kernel against
+// translating one point at a time, and the number of coordinate lookups (user32 round-trips in
+// the hook dll) per gesture before and after the offset is computed once per gesture.
+
+#include "BenchUtil.h"
+#include "GestureHandler.h"
+#include "LegacyGestureHandler.h"
+
+static void TranslateOneByOne(uint32_t* aPoints, int nPoints, GesturePoint offset) {
+	for (int i = 0; i < nPoints; i++) {
+		GesturePoint pt = GesturePoint::fromLParam(static_cast<intptr_t>(aPoints[i]));
+		pt.x += offset.x;
+		pt.y += offset.y;
+		aPoints[i] = static_cast<uint32_t>(pt.toLParam());
+	}
+}
+
+template <class Handlers>
+static size_t CountOffsetLookups(const std::vector<GestureMessage>& vMessages) {
+	static const char* const aszAll[] = { "trace", "rocker", "wheel" };
+	Handlers handlers;
+	handlers.setEnabledGestures(aszAll, 3);
+	CountingForwarder forwarder;
+	for (const GestureMessage& msg : vMessages)
+		handlers.handleMouseMessage(forwarder, BENCH_HWND_FIREFOX, msg);
+	return forwarder.nOffsetLookups;
+}
+
+int main() {
+	const int nRuns = 9;
+	const int aBatchSizes[] = { 1, 4, GestureMessageBuffer::CAPACITY, 256, 4096 };
+	const GesturePoint offset = { -1234, 567 };
+
+	// the kernel must wrap exactly like MAKELPARAM, including negative coordinates
+	BenchRandom random;
+	for (int i = 0; i < 100000; i++) {
+		uint32_t pt = random.next();
+		uint32_t ptKernel = pt, ptReference = pt;
+		TranslatePackedPoints(&ptKernel, 1, offset);
+		TranslateOneByOne(&ptReference, 1, offset);
+		if (ptKernel != ptReference) {
+			printf("TranslatePackedPoints(%08x) = %08x, expected %08x\n", pt, ptKernel, ptReference);
+			return 1;
+		}
+	}
+
+	printf("%-10s %14s %14s\n", "batch", "ns/pt single", "ns/pt batched");
+	for (int nBatch : aBatchSizes) {
+		std::vector<uint32_t> vPoints(nBatch);
+		for (int i = 0; i < nBatch; i++)
+			vPoints[i] = random.next();
+		const size_t nPoints = 4000000;
+		size_t nPasses = nPoints / nBatch;
+		double nsSingle = BenchBestOf(nRuns, [&]() {
+			for (size_t i = 0; i < nPasses; i++)
+				TranslateOneByOne(&vPoints[0], nBatch, offset);
+		});
+		double nsBatched = BenchBestOf(nRuns, [&]() {
+			for (size_t i = 0; i < nPasses; i++)
+				TranslatePackedPoints(&vPoints[0], nBatch, offset);
+		});
+		printf("%-10d %14.3f %14.3f\n", nBatch, nsSingle / (nPasses * nBatch), nsBatched / (nPasses * nBatch));
+	}
+
+	printf("\n%-24s %16s %16s\n", "gesture", "lookups before", "lookups after");
+	const int aStrokeLengths[] = { 10, 100, 1000 };
+	for (int nMoves : aStrokeLengths) {
+		MessageStreamBuilder builder;
+		builder.traceStroke(nMoves);
+		char szName[32];
+		snprintf(szName, sizeof(szName), "trace, %d moves", nMoves);
+		// each lookup used to be a ClientToScreen/ScreenToClient pair, now a single MapWindowPoints
+		printf("%-24s %16zu %16zu\n", szName, 2 * CountOffsetLookups<legacy::GestureHandlers>(builder.messages()),
+			   CountOffsetLookups<GestureHandlers>(builder.messages()));
+	}
+	return 0;
+}